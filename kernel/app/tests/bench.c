@@ -0,0 +1,119 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "bench.h"
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <stdlib.h>
+#include <kernel/mp.h>
+
+struct bench_thread {
+    struct bench_run *run;
+    uint index;
+    thread_t *thread;
+};
+
+static int bench_thread_entry(void *arg)
+{
+    struct bench_thread *bt = arg;
+    struct bench_run *run = bt->run;
+
+    atomic_add(&run->ready, 1);
+    event_wait(&run->start);
+    if (run->abort)
+        return 0;
+    return run->entry(run->arg, bt->index);
+}
+
+/* the index'th cpu in a mask, wrapping around */
+static int nth_cpu(mp_cpu_mask_t cpus, uint index)
+{
+    index %= __builtin_popcount(cpus);
+    while (index-- > 0)
+        cpus &= cpus - 1;
+    return __builtin_ctz(cpus);
+}
+
+status_t bench_start(struct bench_run *run, const char *name, uint count,
+                     bench_entry_t entry, void *arg)
+{
+    return bench_start_on(run, name, count, 0, entry, arg);
+}
+
+status_t bench_start_on(struct bench_run *run, const char *name, uint count,
+                        mp_cpu_mask_t cpus, bench_entry_t entry, void *arg)
+{
+    run->entry = entry;
+    run->arg = arg;
+    run->count = 0;
+    run->ready = 0;
+    run->abort = false;
+    event_init(&run->start, false, 0);
+
+    run->threads = calloc(count, sizeof(*run->threads));
+    if (!run->threads) {
+        event_destroy(&run->start);
+        return ERR_NO_MEMORY;
+    }
+
+    for (; run->count < count; run->count++) {
+        struct bench_thread *bt = &run->threads[run->count];
+        bt->run = run;
+        bt->index = run->count;
+        bt->thread = thread_create(name, bench_thread_entry, bt,
+                                   DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        if (!bt->thread)
+            break;
+        if (cpus != 0)
+            thread_set_pinned_cpu(bt->thread, nth_cpu(cpus, bt->index));
+        thread_resume(bt->thread);
+    }
+
+    /* everyone is at the start line before the clock starts */
+    while (atomic_load(&run->ready) < (int)run->count)
+        thread_yield();
+
+    if (run->count != count) {
+        run->abort = true;
+        event_signal(&run->start, true);
+        bench_finish(run);
+        return ERR_NO_MEMORY;
+    }
+
+    run->start_time = current_time_hires();
+    event_signal(&run->start, true);
+    return NO_ERROR;
+}
+
+lk_bigtime_t bench_finish(struct bench_run *run)
+{
+    for (uint i = 0; i < run->count; i++)
+        thread_join(run->threads[i].thread, NULL, INFINITE_TIME);
+    lk_bigtime_t elapsed = current_time_hires() - run->start_time;
+
+    free(run->threads);
+    run->threads = NULL;
+    event_destroy(&run->start);
+    return elapsed;
+}
+
+uint bench_online_cpus(void)
+{
+    return __builtin_popcount(mp_get_online_mask());
+}
+
+mp_cpu_mask_t bench_first_cpus(uint count)
+{
+    mp_cpu_mask_t online = mp_get_online_mask();
+    mp_cpu_mask_t cpus = 0;
+    for (; count > 0 && online != 0; count--) {
+        mp_cpu_mask_t lowest = online & -online;
+        cpus |= lowest;
+        online &= ~lowest;
+    }
+    return cpus;
+}
@@ -0,0 +1,56 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <err.h>
+#include <sys/types.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <platform.h>
+
+__BEGIN_CDECLS
+
+/* Shared scaffolding for the multithreaded benchmarks.
+ *
+ * bench_start() creates |count| threads which each run |entry|(|arg|, index),
+ * waits until all of them are parked at the start line, then starts the
+ * clock and releases them together. bench_finish() joins them and returns
+ * the time from release to the last one finishing.
+ *
+ * bench_start_on() does the same with the threads pinned round robin to the
+ * cpus in |cpus|, thread i to the (i % number of cpus in |cpus|)th of them.
+ */
+
+typedef int (*bench_entry_t)(void *arg, uint index);
+
+struct bench_thread;
+
+struct bench_run {
+    bench_entry_t entry;
+    void *arg;
+    uint count;
+    struct bench_thread *threads;
+    event_t start;
+    volatile int ready;
+    volatile bool abort;
+    lk_bigtime_t start_time;
+};
+
+status_t bench_start(struct bench_run *run, const char *name, uint count,
+                     bench_entry_t entry, void *arg);
+status_t bench_start_on(struct bench_run *run, const char *name, uint count,
+                        mp_cpu_mask_t cpus, bench_entry_t entry, void *arg);
+lk_bigtime_t bench_finish(struct bench_run *run);
+
+uint bench_online_cpus(void);
+
+/* the first |count| online cpus */
+mp_cpu_mask_t bench_first_cpus(uint count);
+
+__END_CDECLS
@@ -0,0 +1,104 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <app/tests.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <platform.h>
+
+#include "bench.h"
+
+/* Kernel mutex latency benchmark.
+ *
+ * Measures the cost of an acquire/release pair on an uncontended mutex, then
+ * has a growing number of threads hammer one shared mutex to show how the
+ * contended path scales with the number of cores.
+ */
+
+#define UNCONTENDED_ITERATIONS 1000000
+#define CONTENDED_ITERATIONS 100000
+
+static void uncontended_bench(void)
+{
+    mutex_t m = MUTEX_INITIAL_VALUE(m);
+
+    lk_bigtime_t start = current_time_hires();
+    for (uint i = 0; i < UNCONTENDED_ITERATIONS; i++) {
+        mutex_acquire(&m);
+        mutex_release(&m);
+    }
+    lk_bigtime_t elapsed = current_time_hires() - start;
+
+    printf("uncontended: %u acquire/release pairs, %" PRIu64 " ns per pair\n",
+           UNCONTENDED_ITERATIONS, elapsed / UNCONTENDED_ITERATIONS);
+
+    mutex_destroy(&m);
+}
+
+struct contended_args {
+    mutex_t lock;
+    volatile uint64_t shared;
+};
+
+static int contended_thread(void *arg, uint index)
+{
+    struct contended_args *args = arg;
+
+    for (uint i = 0; i < CONTENDED_ITERATIONS; i++) {
+        mutex_acquire(&args->lock);
+        args->shared++;
+        mutex_release(&args->lock);
+    }
+    return 0;
+}
+
+static status_t contended_bench(uint num_threads)
+{
+    struct contended_args args;
+    mutex_init(&args.lock);
+    args.shared = 0;
+
+    struct bench_run run;
+    status_t status = bench_start(&run, "mutex bench", num_threads, contended_thread, &args);
+    if (status == NO_ERROR) {
+        lk_bigtime_t elapsed = bench_finish(&run);
+
+        uint64_t ops = (uint64_t)num_threads * CONTENDED_ITERATIONS;
+        if (args.shared != ops) {
+            printf("mutex failed to protect shared counter: %" PRIu64 "\n", args.shared);
+            status = ERR_INTERNAL;
+        } else {
+            printf("contended: %2u threads, %" PRIu64 " ns per pair, %" PRIu64 " pairs/sec\n",
+                   num_threads, elapsed / ops, ops * 1000000000 / elapsed);
+        }
+    }
+
+    mutex_destroy(&args.lock);
+    return status;
+}
+
+int mutex_bench(int argc, const cmd_args *argv)
+{
+    uint num_cpus = bench_online_cpus();
+
+    printf("mutex benchmark, %u online cpus\n", num_cpus);
+
+    uncontended_bench();
+
+    for (uint threads = 1; threads <= num_cpus; threads *= 2) {
+        status_t status = contended_bench(threads);
+        if (status != NO_ERROR) {
+            printf("failed to run with %u threads: %d\n", threads, status);
+            return status;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <app/tests.h>
+#include <kernel/thread.h>
+#include <kernel/vm.h>
+#include <platform.h>
+
+#include "bench.h"
+
+/* Physical page allocator scalability benchmark.
+ *
+ * Runs 1, 4, 8 and 16 threads that each allocate and free single pages and
+ * small batches of pages as fast as they can, then times a handful of
+ * contiguous allocations out of a fragmented pmm.
+ */
+
+#define ITERATIONS 100000
+#define BATCH 16
+#define CONTIGUOUS_RUNS 64
+
+static int pmm_bench_thread(void *arg, uint index)
+{
+    volatile bool *failed = arg;
+
+    for (uint i = 0; i < ITERATIONS; i++) {
+        paddr_t pa;
+        vm_page_t *page = pmm_alloc_page(0, &pa);
+        if (!page) {
+            *failed = true;
+            return ERR_NO_MEMORY;
+        }
+        pmm_free_page(page);
+
+        if (i % BATCH == 0) {
+            struct list_node list = LIST_INITIAL_VALUE(list);
+            size_t count = pmm_alloc_pages(BATCH, 0, &list);
+            pmm_free(&list);
+            if (count != BATCH) {
+                *failed = true;
+                return ERR_NO_MEMORY;
+            }
+        }
+    }
+    return 0;
+}
+
+static status_t alloc_free_bench(uint num_threads)
+{
+    volatile bool failed = false;
+
+    struct bench_run run;
+    status_t status = bench_start(&run, "pmm bench", num_threads, pmm_bench_thread,
+                                  (void *)&failed);
+    if (status != NO_ERROR)
+        return status;
+    lk_bigtime_t elapsed = bench_finish(&run);
+    if (failed)
+        return ERR_NO_MEMORY;
+
+    /* every iteration is a single page pair, every BATCH-th one adds a batch */
+    uint64_t pages = (uint64_t)num_threads *
+                     (ITERATIONS + (ITERATIONS + BATCH - 1) / BATCH * BATCH);
+    printf("%2u threads: %" PRIu64 " ns per page alloc/free, %" PRIu64 " pages/sec\n",
+           num_threads, elapsed * num_threads / pages, pages * 1000000000 / elapsed);
+    return NO_ERROR;
+}
+
+static void contiguous_bench(void)
+{
+    /* punch holes into a chunk of memory so the runs have to be searched for */
+    struct list_node held = LIST_INITIAL_VALUE(held);
+    struct list_node holes = LIST_INITIAL_VALUE(holes);
+    for (uint i = 0; i < 4096; i++) {
+        paddr_t pa;
+        vm_page_t *page = pmm_alloc_page(0, &pa);
+        if (!page)
+            break;
+        list_add_tail((i % 2) ? &holes : &held, &page->free.node);
+    }
+    pmm_free(&holes);
+
+    uint found = 0;
+    lk_bigtime_t start = current_time_hires();
+    for (uint i = 0; i < CONTIGUOUS_RUNS; i++) {
+        struct list_node list = LIST_INITIAL_VALUE(list);
+        paddr_t pa;
+        if (pmm_alloc_contiguous(BATCH, 0, PAGE_SIZE_SHIFT + 4, &pa, &list) == BATCH)
+            found++;
+        pmm_free(&list);
+    }
+    lk_bigtime_t elapsed = current_time_hires() - start;
+
+    printf("contiguous: %u of %u %u page runs, %" PRIu64 " ns per alloc/free\n",
+           found, CONTIGUOUS_RUNS, BATCH, elapsed / CONTIGUOUS_RUNS);
+
+    pmm_free(&held);
+}
+
+int pmm_bench(int argc, const cmd_args *argv)
+{
+    uint num_cpus = bench_online_cpus();
+
+    printf("pmm benchmark, %u online cpus, %zu free pages\n", num_cpus, pmm_count_free_pages());
+
+    static const uint thread_counts[] = { 1, 4, 8, 16 };
+    for (uint i = 0; i < countof(thread_counts); i++) {
+        status_t status = alloc_free_bench(thread_counts[i]);
+        if (status != NO_ERROR) {
+            printf("failed to run with %u threads: %d\n", thread_counts[i], status);
+            return status;
+        }
+    }
+
+    contiguous_bench();
+
+    return 0;
+}
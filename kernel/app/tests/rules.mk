@@ -10,14 +10,19 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 MODULE := $(LOCAL_DIR)
 
 MODULE_SRCS += \
+    $(LOCAL_DIR)/bench.c \
     $(LOCAL_DIR)/benchmarks.c \
     $(LOCAL_DIR)/cache_tests.c \
     $(LOCAL_DIR)/clock_tests.c \
     $(LOCAL_DIR)/fibo.c \
     $(LOCAL_DIR)/mem_tests.c \
+    $(LOCAL_DIR)/mutex_bench.c \
+    $(LOCAL_DIR)/pmm_bench.c \
     $(LOCAL_DIR)/printf_tests.c \
+    $(LOCAL_DIR)/sched_bench.c \
     $(LOCAL_DIR)/sync_ipi_tests.c \
     $(LOCAL_DIR)/sleep_tests.c \
+    $(LOCAL_DIR)/state_tracker_tests.cpp \
     $(LOCAL_DIR)/tests.c \
     $(LOCAL_DIR)/thread_tests.c \
     $(LOCAL_DIR)/alloc_checker_tests.cpp \
@@ -26,6 +31,7 @@ MODULE_SRCS += \
 MODULE_DEPS += \
     lib/crypto \
     lib/header_tests \
+    lib/magenta \
     lib/mxtl \
     lib/safeint \
     lib/unittest \
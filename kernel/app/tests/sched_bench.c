@@ -0,0 +1,159 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <app/tests.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <platform.h>
+
+#include "bench.h"
+
+/* Scheduler stress benchmark.
+ *
+ * Runs pairs of threads that ping-pong through a pair of events, so every
+ * round trip is two wakeups and two context switches. The number of cpus in
+ * use is stepped up, with a pair per cpu pinned so that each wakeup crosses
+ * to another cpu, to show how reschedule throughput scales as more cores hit
+ * the scheduler at once. A final unpinned run with more pairs than cpus
+ * leaves placement and stealing to the scheduler.
+ */
+
+#define BENCH_DURATION_MS 1000
+
+struct sched_bench_pair {
+    event_t ping;
+    event_t pong;
+    volatile bool *done;
+    uint64_t round_trips;
+};
+
+static int ping_thread(struct sched_bench_pair *pair)
+{
+    while (!*pair->done) {
+        event_signal(&pair->ping, true);
+        event_wait(&pair->pong);
+        pair->round_trips++;
+    }
+    return 0;
+}
+
+static int pong_thread(struct sched_bench_pair *pair)
+{
+    for (;;) {
+        event_wait(&pair->ping);
+        if (*pair->done)
+            break;
+        event_signal(&pair->pong, true);
+    }
+    return 0;
+}
+
+/* even threads ping, odd threads pong */
+static int pair_thread(void *arg, uint index)
+{
+    struct sched_bench_pair *pair = (struct sched_bench_pair *)arg + index / 2;
+    return (index % 2) ? pong_thread(pair) : ping_thread(pair);
+}
+
+static ulong total_context_switches(void)
+{
+    ulong total = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++)
+        total += thread_stats[i].context_switches;
+    return total;
+}
+
+static ulong total_steals(void)
+{
+    ulong total = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++)
+        total += thread_stats[i].steals;
+    return total;
+}
+
+/* run |num_pairs| pairs, pinned round robin to |cpus| unless it is 0 */
+static status_t run_pairs(uint num_pairs, mp_cpu_mask_t cpus)
+{
+    struct sched_bench_pair *pairs = calloc(num_pairs, sizeof(*pairs));
+    if (!pairs)
+        return ERR_NO_MEMORY;
+
+    volatile bool done = false;
+    for (uint i = 0; i < num_pairs; i++) {
+        event_init(&pairs[i].ping, false, EVENT_FLAG_AUTOUNSIGNAL);
+        event_init(&pairs[i].pong, false, EVENT_FLAG_AUTOUNSIGNAL);
+        pairs[i].done = &done;
+    }
+
+    ulong start_switches = total_context_switches();
+    ulong start_steals = total_steals();
+
+    struct bench_run run;
+    status_t status = bench_start_on(&run, "sched bench", num_pairs * 2, cpus,
+                                     pair_thread, pairs);
+    if (status == NO_ERROR) {
+        thread_sleep(BENCH_DURATION_MS);
+        done = true;
+
+        /* kick everyone loose so they notice we're done */
+        for (uint i = 0; i < num_pairs; i++) {
+            event_signal(&pairs[i].ping, true);
+            event_signal(&pairs[i].pong, true);
+        }
+        lk_bigtime_t elapsed_ns = bench_finish(&run);
+
+        uint64_t round_trips = 0;
+        for (uint i = 0; i < num_pairs; i++)
+            round_trips += pairs[i].round_trips;
+        ulong switches = total_context_switches() - start_switches;
+        ulong steals = total_steals() - start_steals;
+
+        if (cpus != 0)
+            printf("%3u cpus:  ", __builtin_popcount(cpus));
+        else
+            printf("unpinned:  ");
+        printf("%3u pairs: %9" PRIu64 " round trips, %9" PRIu64 " context switches/sec, %lu steals\n",
+               num_pairs, round_trips, (uint64_t)switches * 1000000000 / elapsed_ns, steals);
+    }
+
+    for (uint i = 0; i < num_pairs; i++) {
+        event_destroy(&pairs[i].ping);
+        event_destroy(&pairs[i].pong);
+    }
+    free(pairs);
+
+    return status;
+}
+
+int sched_bench(int argc, const cmd_args *argv)
+{
+    uint num_cpus = bench_online_cpus();
+
+    printf("scheduler ping-pong benchmark, %u online cpus, %u ms per run\n",
+           num_cpus, BENCH_DURATION_MS);
+
+    for (uint cpus = 1; cpus <= num_cpus; cpus *= 2) {
+        status_t status = run_pairs(cpus, bench_first_cpus(cpus));
+        if (status != NO_ERROR) {
+            printf("failed to run on %u cpus: %d\n", cpus, status);
+            return status;
+        }
+    }
+
+    status_t status = run_pairs(num_cpus * 2, 0);
+    if (status != NO_ERROR) {
+        printf("failed to run with %u pairs: %d\n", num_cpus * 2, status);
+        return status;
+    }
+
+    return 0;
+}
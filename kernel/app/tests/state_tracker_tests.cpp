@@ -0,0 +1,209 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <inttypes.h>
+#include <new.h>
+#include <unittest.h>
+
+#include <magenta/state_observer.h>
+#include <magenta/state_tracker.h>
+#include <mxtl/unique_ptr.h>
+#include <platform.h>
+
+namespace {
+
+class CountingObserver final : public StateObserver {
+public:
+    CountingObserver() : StateObserver() { }
+    ~CountingObserver() { }
+
+    uint32_t changes = 0u;
+    mx_signals_t last_state = 0u;
+    // When set, the next OnStateChange() asks to be removed.
+    bool remove_on_change = false;
+
+private:
+    bool OnInitialize(mx_signals_t initial_state) final {
+        last_state = initial_state;
+        return false;
+    }
+
+    bool OnStateChange(mx_signals_t new_state) final {
+        changes++;
+        last_state = new_state;
+        if (remove_on_change)
+            remove_ = true;
+        return false;
+    }
+
+    bool OnCancel(Handle* handle) final { return false; }
+};
+
+const mx_signals_t kSignals[] = {
+    MX_OBJECT_SIGNAL_0, MX_OBJECT_SIGNAL_1, MX_OBJECT_SIGNAL_2, MX_OBJECT_SIGNAL_3,
+    MX_OBJECT_SIGNAL_4, MX_OBJECT_SIGNAL_5, MX_OBJECT_SIGNAL_6, MX_OBJECT_SIGNAL_7,
+};
+const size_t kNumSignals = countof(kSignals);
+
+static bool interest_filtering(void* context) {
+    BEGIN_TEST;
+
+    StateTracker tracker(MX_OBJECT_SIGNAL_1);
+    CountingObserver readable[2];
+    CountingObserver writable;
+    CountingObserver either;
+
+    tracker.AddObserver(&readable[0], MX_OBJECT_SIGNAL_0);
+    tracker.AddObserver(&readable[1], MX_OBJECT_SIGNAL_0);
+    tracker.AddObserver(&writable, MX_OBJECT_SIGNAL_1);
+    tracker.AddObserver(&either, MX_OBJECT_SIGNAL_0 | MX_OBJECT_SIGNAL_1);
+    EXPECT_EQ(MX_OBJECT_SIGNAL_1, writable.last_state, "initial state");
+
+    tracker.UpdateState(0u, MX_OBJECT_SIGNAL_0);
+    EXPECT_EQ(1u, readable[0].changes, "readable not told");
+    EXPECT_EQ(1u, readable[1].changes, "readable not told");
+    EXPECT_EQ(0u, writable.changes, "writable told");
+    EXPECT_EQ(1u, either.changes, "either not told");
+    EXPECT_EQ(MX_OBJECT_SIGNAL_0 | MX_OBJECT_SIGNAL_1, readable[0].last_state, "bad state");
+
+    // Signals nobody watches, and updates that change nothing, reach nobody.
+    tracker.UpdateState(0u, MX_OBJECT_SIGNAL_2);
+    tracker.UpdateState(0u, MX_OBJECT_SIGNAL_0);
+    EXPECT_EQ(1u, readable[0].changes, "readable told");
+    EXPECT_EQ(0u, writable.changes, "writable told");
+    EXPECT_EQ(1u, either.changes, "either told");
+
+    tracker.UpdateState(MX_OBJECT_SIGNAL_1, 0u);
+    EXPECT_EQ(1u, readable[0].changes, "readable told");
+    EXPECT_EQ(1u, writable.changes, "writable not told");
+    EXPECT_EQ(2u, either.changes, "either not told");
+    EXPECT_EQ(MX_OBJECT_SIGNAL_0 | MX_OBJECT_SIGNAL_2, writable.last_state, "bad state");
+
+    tracker.RemoveObserver(&readable[0]);
+    tracker.UpdateState(MX_OBJECT_SIGNAL_0, 0u);
+    EXPECT_EQ(1u, readable[0].changes, "removed observer told");
+    EXPECT_EQ(2u, readable[1].changes, "readable not told");
+
+    tracker.RemoveObserver(&readable[1]);
+    tracker.RemoveObserver(&writable);
+    tracker.RemoveObserver(&either);
+
+    END_TEST;
+}
+
+static bool mixed_interests(void* context) {
+    BEGIN_TEST;
+
+    // More distinct masks than the tracker has groups for, so some end up
+    // on the mixed list.
+    StateTracker tracker;
+    CountingObserver observers[kNumSignals];
+    for (size_t ix = 0; ix < kNumSignals; ++ix)
+        tracker.AddObserver(&observers[ix], kSignals[ix]);
+
+    for (size_t ix = 0; ix < kNumSignals; ++ix) {
+        tracker.UpdateState(0u, kSignals[ix]);
+        for (size_t jx = 0; jx < kNumSignals; ++jx) {
+            EXPECT_EQ(jx <= ix ? 1u : 0u, observers[jx].changes, "wrong observers told");
+        }
+    }
+
+    // Emptied groups get reused for new masks.
+    for (size_t ix = 0; ix < kNumSignals / 2; ++ix)
+        tracker.RemoveObserver(&observers[ix]);
+    CountingObserver late;
+    tracker.AddObserver(&late, MX_USER_SIGNAL_0);
+    tracker.UpdateState(0u, MX_USER_SIGNAL_0);
+    EXPECT_EQ(1u, late.changes, "late observer not told");
+    EXPECT_EQ(1u, observers[kNumSignals - 1].changes, "unrelated observer told");
+
+    tracker.RemoveObserver(&late);
+    for (size_t ix = kNumSignals / 2; ix < kNumSignals; ++ix)
+        tracker.RemoveObserver(&observers[ix]);
+
+    END_TEST;
+}
+
+static bool remove_on_change(void* context) {
+    BEGIN_TEST;
+
+    StateTracker tracker;
+    CountingObserver once;
+    CountingObserver always;
+    once.remove_on_change = true;
+    tracker.AddObserver(&once, MX_OBJECT_SIGNAL_0);
+    tracker.AddObserver(&always, MX_OBJECT_SIGNAL_0);
+
+    tracker.UpdateState(0u, MX_OBJECT_SIGNAL_0);
+    tracker.UpdateState(MX_OBJECT_SIGNAL_0, 0u);
+    EXPECT_EQ(1u, once.changes, "removed observer told again");
+    EXPECT_EQ(2u, always.changes, "observer not told");
+
+    // |once| already took itself off the tracker.
+    tracker.RemoveObserver(&always);
+
+    END_TEST;
+}
+
+// Times UpdateState() with |count| observers that all watch MX_OBJECT_SIGNAL_0,
+// for flips of that signal and of one none of them watch.
+static bool update_state_bench_one(size_t count) {
+    BEGIN_TEST;
+
+    const uint32_t kIterations = 10000u;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<CountingObserver[]> observers(new (&ac) CountingObserver[count]);
+    REQUIRE_TRUE(ac.check(), "no memory for observers");
+
+    StateTracker tracker;
+    for (size_t ix = 0; ix < count; ++ix)
+        tracker.AddObserver(&observers[ix], MX_OBJECT_SIGNAL_0);
+
+    lk_bigtime_t start = current_time_hires();
+    for (uint32_t ix = 0; ix < kIterations; ++ix) {
+        tracker.UpdateState(0u, MX_OBJECT_SIGNAL_1);
+        tracker.UpdateState(MX_OBJECT_SIGNAL_1, 0u);
+    }
+    lk_bigtime_t unwatched = current_time_hires() - start;
+
+    start = current_time_hires();
+    for (uint32_t ix = 0; ix < kIterations; ++ix) {
+        tracker.UpdateState(0u, MX_OBJECT_SIGNAL_0);
+        tracker.UpdateState(MX_OBJECT_SIGNAL_0, 0u);
+    }
+    lk_bigtime_t watched = current_time_hires() - start;
+
+    EXPECT_EQ(2 * kIterations, observers[0].changes, "watched flips not delivered");
+
+    unittest_printf("%4zu observers: %" PRIu64 " ns per unwatched update, %" PRIu64
+                    " ns per watched update\n",
+                    count, unwatched / (2 * kIterations), watched / (2 * kIterations));
+
+    for (size_t ix = 0; ix < count; ++ix)
+        tracker.RemoveObserver(&observers[ix]);
+
+    END_TEST;
+}
+
+static bool update_state_bench(void* context) {
+    BEGIN_TEST;
+
+    static const size_t kCounts[] = { 1u, 64u, 1024u };
+    for (size_t count : kCounts)
+        EXPECT_TRUE(update_state_bench_one(count), "");
+
+    END_TEST;
+}
+
+} // namespace
+
+UNITTEST_START_TESTCASE(state_tracker_tests)
+UNITTEST("interest filtering", interest_filtering)
+UNITTEST("mixed interests", mixed_interests)
+UNITTEST("remove on change", remove_on_change)
+UNITTEST("UpdateState benchmark", update_state_bench)
+UNITTEST_END_TESTCASE(state_tracker_tests, "statetracker", "StateTracker tests", NULL, NULL);
@@ -27,6 +27,9 @@ STATIC_COMMAND("bench", "miscellaneous benchmarks", (console_cmd)&benchmarks)
 STATIC_COMMAND("fibo", "threaded fibonacci", (console_cmd)&fibo)
 STATIC_COMMAND("spinner", "create a spinning thread", (console_cmd)&spinner)
 STATIC_COMMAND("sync_ipi_tests", "test synchronous IPIs", (console_cmd)&sync_ipi_tests)
+STATIC_COMMAND("mutex_bench", "kernel mutex latency benchmark", (console_cmd)&mutex_bench)
+STATIC_COMMAND("sched_bench", "scheduler context switch benchmark", (console_cmd)&sched_bench)
+STATIC_COMMAND("pmm_bench", "physical page allocator benchmark", (console_cmd)&pmm_bench)
 STATIC_COMMAND_END(tests);
 
 #endif
@@ -6,6 +6,7 @@
 
 #include <assert.h>
 #include <err.h>
+#include <list.h>
 #include <string.h>
 #include <trace.h>
 
@@ -20,6 +21,7 @@
 #include <kernel/vm.h>
 
 #include <bitmap/rle-bitmap.h>
+#include <mxtl/macros.h>
 
 #define LOCAL_TRACE 0
 
@@ -344,73 +346,162 @@ static void tlb_global_invalidate() {
     }
 }
 
-/* Task used for invalidating a TLB entry on each CPU */
-struct tlb_invalidate_page_context {
+/**
+ * @brief A batch of TLB entries to invalidate
+ *
+ * Gathers up the entries that a single unmap, protect or map of a range
+ * touches, so that every cpu running the aspace can be told to flush all of
+ * them with one mp_sync_exec, rather than one per page.  Past
+ * kMaxPendingItems entries it stops tracking them and has the cpus flush
+ * their whole TLB instead.
+ *
+ * Page tables unlinked during the operation are held onto until after the
+ * flush, since other cpus may still be walking them until then.
+ */
+class PendingTlbInvalidation {
+public:
+    explicit PendingTlbInvalidation(arch_aspace_t* aspace) : aspace_(aspace) {}
+    ~PendingTlbInvalidation() { Flush(); }
+
+    /* Queue the entry for vaddr at the given page table level */
+    void Enqueue(vaddr_t vaddr, enum page_table_levels level, bool global_page);
+
+    /* Free the page table once the TLBs no longer refer to it */
+    void FreePageTable(pt_entry_t* table);
+
+    /* Invalidate everything queued so far on every cpu that needs it */
+    void Flush();
+
+private:
+    static const uint kMaxPendingItems = 32;
+
+    struct Item {
+        vaddr_t vaddr;
+        enum page_table_levels level;
+        bool global_page;
+    };
+
+    static void FlushTask(void* raw_context);
+
+    arch_aspace_t* const aspace_;
+    uint count_ = 0;
+    bool full_shootdown_ = false;
+    bool contains_global_ = false;
+    Item items_[kMaxPendingItems];
+    struct list_node freed_tables_ = LIST_INITIAL_VALUE(freed_tables_);
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(PendingTlbInvalidation);
+};
+
+void PendingTlbInvalidation::Enqueue(vaddr_t vaddr, enum page_table_levels level,
+                                     bool global_page) {
+    contains_global_ |= global_page;
+
+#if X86_PAGING_LEVELS > 3
+    /* there's no invalidating a single PML4 entry, it takes a full flush anyway */
+    if (level == PML4_L) {
+        full_shootdown_ = true;
+    }
+#endif
+
+    if (full_shootdown_) {
+        return;
+    }
+    if (count_ == kMaxPendingItems) {
+        full_shootdown_ = true;
+        return;
+    }
+
+    items_[count_].vaddr = vaddr;
+    items_[count_].level = level;
+    items_[count_].global_page = global_page;
+    count_++;
+}
+
+void PendingTlbInvalidation::FreePageTable(pt_entry_t* table) {
+    vm_page_t* page = paddr_to_vm_page(X86_VIRT_TO_PHYS(table));
+    DEBUG_ASSERT(page);
+    list_add_tail(&freed_tables_, &page->free.node);
+}
+
+/* Task used for invalidating the pending TLB entries on each CPU */
+struct tlb_invalidate_context {
     ulong target_cr3;
-    vaddr_t vaddr;
-    enum page_table_levels level;
-    bool global_page;
+    const PendingTlbInvalidation* pending;
 };
-static void tlb_invalidate_page_task(void* raw_context) {
+
+void PendingTlbInvalidation::FlushTask(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
-    tlb_invalidate_page_context* context = (tlb_invalidate_page_context*)raw_context;
+    tlb_invalidate_context* context = (tlb_invalidate_context*)raw_context;
+    const PendingTlbInvalidation* pending = context->pending;
 
     ulong cr3 = x86_get_cr3();
-    if (context->target_cr3 != cr3 && !context->global_page) {
-        /* This invalidation doesn't apply to this CPU, ignore it */
+    bool aspace_active = context->target_cr3 == cr3;
+
+    if (pending->full_shootdown_) {
+        if (pending->contains_global_) {
+            tlb_global_invalidate();
+        } else if (aspace_active) {
+            /* reloading cr3 flushes everything but the global pages */
+            x86_set_cr3(cr3);
+        }
         return;
     }
 
-    switch (context->level) {
+    for (uint i = 0; i < pending->count_; i++) {
+        const Item& item = pending->items_[i];
+        if (!aspace_active && !item.global_page) {
+            /* This invalidation doesn't apply to this CPU, ignore it */
+            continue;
+        }
+
+        switch (item.level) {
 #if X86_PAGING_LEVELS > 3
-        case PML4_L:
-            tlb_global_invalidate();
-            break;
+            case PML4_L:
+                tlb_global_invalidate();
+                break;
 #endif
 #if X86_PAGING_LEVELS > 2
-        case PDP_L:
+            case PDP_L:
 #endif
-        case PD_L:
-        case PT_L:
-            __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)context->vaddr));
-            break;
+            case PD_L:
+            case PT_L:
+                __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)item.vaddr));
+                break;
+        }
     }
 }
 
-/**
- * @brief Invalidate a single page at a given page table level
- *
- * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
- * @param vaddr The virtual address we are invalidating the TLB entry for
- * @param level The page table level that maps this vaddr
- * @param global_page True if we are invalidating a global mapping
- *
- * TODO(teisenbe): Optimize this.  This is horribly inefficient.
- * We should also change this to pool invalidations from a single
- * "transaction" and then only execute a single mp_sync_exec for that
- * transaction, rather than one per page.
- */
-void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_table_levels level,
-                             bool global_page) {
-    ulong cr3 = aspace ? aspace->pt_phys : x86_get_cr3();
-    struct tlb_invalidate_page_context task_context = {
-        .target_cr3 = cr3, .vaddr = vaddr, .level = level, .global_page = global_page,
-    };
+void PendingTlbInvalidation::Flush() {
+    if (count_ > 0 || full_shootdown_) {
+        ulong cr3 = aspace_ ? aspace_->pt_phys : x86_get_cr3();
+        struct tlb_invalidate_context task_context = {
+            .target_cr3 = cr3, .pending = this,
+        };
+
+        /* Target only CPUs this aspace is active on.  It may be the case that some
+         * other CPU will become active in it after this load, or will have left it
+         * just before this load.  In the former case, it is becoming active after
+         * the write to the page table, so it will see the change.  In the latter
+         * case, it will get a spurious request to flush. */
+        mp_cpu_mask_t targets;
+        if (contains_global_ || aspace_ == NULL) {
+            targets = MP_CPU_ALL;
+        } else {
+            targets = atomic_load(&aspace_->active_cpus);
+            static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace_->active_cpus), "err");
+        }
 
-    /* Target only CPUs this aspace is active on.  It may be the case that some
-     * other CPU will become active in it after this load, or will have left it
-     * just before this load.  In the former case, it is becoming active after
-     * the write to the page table, so it will see the change.  In the latter
-     * case, it will get a spurious request to flush. */
-    mp_cpu_mask_t targets;
-    if (global_page || aspace == NULL) {
-        targets = MP_CPU_ALL;
-    } else {
-        targets = atomic_load(&aspace->active_cpus);
-        static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace->active_cpus), "err");
+        mp_sync_exec(targets, FlushTask, &task_context);
+
+        count_ = 0;
+        full_shootdown_ = false;
+        contains_global_ = false;
     }
 
-    mp_sync_exec(targets, tlb_invalidate_page_task, &task_context);
+    if (!list_is_empty(&freed_tables_)) {
+        pmm_free(&freed_tables_);
+    }
 }
 
 struct MappingCursor {
@@ -420,8 +511,8 @@ struct MappingCursor {
 };
 
 template <int Level>
-static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, paddr_t paddr,
-                         arch_flags_t flags) {
+static void update_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte,
+                         paddr_t paddr, arch_flags_t flags) {
 
     DEBUG_ASSERT(pte);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(paddr));
@@ -434,12 +525,13 @@ static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte,
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        x86_tlb_invalidate_page(aspace, vaddr, (page_table_levels)Level, is_kernel_address(vaddr));
+        pending->Enqueue(vaddr, (page_table_levels)Level, is_kernel_address(vaddr));
     }
 }
 
 template <int Level>
-static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, bool flush) {
+static void unmap_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte,
+                        bool flush) {
     DEBUG_ASSERT(pte);
 
     pt_entry_t olde = *pte;
@@ -448,7 +540,7 @@ static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, b
 
     /* attempt to invalidate the page */
     if (flush && IS_PAGE_PRESENT(olde)) {
-        x86_tlb_invalidate_page(aspace, vaddr, (page_table_levels)Level, is_kernel_address(vaddr));
+        pending->Enqueue(vaddr, (page_table_levels)Level, is_kernel_address(vaddr));
     }
 }
 
@@ -473,7 +565,7 @@ static pt_entry_t* _map_alloc_page(void) {
  * @brief Split the given large page into smaller pages
  */
 template <int Level>
-static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static status_t x86_mmu_split(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte) {
     static_assert(Level != PT_L, "tried splitting PT_L");
 #if X86_PAGING_LEVELS > 3
     // This can't easily be a static assert without duplicating
@@ -512,14 +604,14 @@ static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t*
         pt_entry_t* e = m + i;
         // If this is a PDP_L (i.e. huge page), flags will include the
         // PS bit still, so the new PD entries will be large pages.
-        update_entry<Level - 1>(aspace, new_vaddr, e, new_paddr, flags);
+        update_entry<Level - 1>(pending, new_vaddr, e, new_paddr, flags);
         new_vaddr += ps;
         new_paddr += ps;
     }
     DEBUG_ASSERT(new_vaddr == vaddr + page_size<Level>());
 
     flags = get_x86_intermediate_arch_flags();
-    update_entry<Level>(aspace, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
+    update_entry<Level>(pending, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
     return NO_ERROR;
 }
 
@@ -605,7 +697,7 @@ status_t x86_mmu_get_mapping<PT_L>(pt_entry_t* table, vaddr_t vaddr,
  *
  * Level must be MAX_PAGING_LEVEL when invoked.
  *
- * @param aspace The aspace we're updating
+ * @param pending The batch of TLB invalidations for this operation
  * @param table The top-level paging structure's virtual address
  * @param start_cursor A cursor describing the range of address space to
  * unmap within table
@@ -615,8 +707,8 @@ status_t x86_mmu_get_mapping<PT_L>(pt_entry_t* table, vaddr_t vaddr,
  * @return true if at least one page was unmapped at this level
  */
 template <int Level>
-static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, const MappingCursor& start_cursor,
-                                   MappingCursor* new_cursor) {
+static bool x86_mmu_remove_mapping(PendingTlbInvalidation* pending, pt_entry_t* table,
+                                   const MappingCursor& start_cursor, MappingCursor* new_cursor) {
     static_assert(Level >= 0, "level too low");
     static_assert(Level < X86_PAGING_LEVELS, "level too high");
 
@@ -652,7 +744,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
             bool vaddr_level_aligned = page_aligned<Level>(new_cursor->vaddr);
             // If the request covers the entire large page, just unmap it
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                unmap_entry<Level>(aspace, new_cursor->vaddr, e, true);
+                unmap_entry<Level>(pending, new_cursor->vaddr, e, true);
                 unmapped = true;
 
                 new_cursor->vaddr += ps;
@@ -662,7 +754,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            status_t status = x86_mmu_split<Level>(aspace, page_vaddr, e);
+            status_t status = x86_mmu_split<Level>(pending, page_vaddr, e);
             if (status != NO_ERROR) {
                 panic("Need to implement recovery from split failure");
             }
@@ -671,7 +763,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
         bool lower_unmapped = x86_mmu_remove_mapping<Level - 1>(
-                aspace, next_table, *new_cursor, &cursor);
+                pending, next_table, *new_cursor, &cursor);
 
         // If we were requesting to unmap everything in the lower page table,
         // we know we can unmap the lower level page table.  Otherwise, if
@@ -691,8 +783,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
             }
         }
         if (unmap_page_table) {
-            unmap_entry<Level>(aspace, new_cursor->vaddr, e, false);
-            pmm_free_page(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
+            unmap_entry<Level>(pending, new_cursor->vaddr, e, false);
+            pending->FreePageTable(next_table);
             unmapped = true;
         }
         *new_cursor = cursor;
@@ -706,8 +798,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
 
 // Base case of x86_remove_mapping for smallest page size
 template <>
-bool x86_mmu_remove_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, const MappingCursor& start_cursor,
-                                  MappingCursor* new_cursor) {
+bool x86_mmu_remove_mapping<PT_L>(PendingTlbInvalidation* pending, pt_entry_t* table,
+                                  const MappingCursor& start_cursor, MappingCursor* new_cursor) {
 
     LTRACEF("%016" PRIxPTR " %016zx\n", start_cursor.vaddr, start_cursor.size);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
@@ -719,7 +811,7 @@ bool x86_mmu_remove_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, cons
     for (; index != NO_OF_PT_ENTRIES && new_cursor->size != 0; ++index) {
         pt_entry_t* e = table + index;
         if (IS_PAGE_PRESENT(*e)) {
-            unmap_entry<PT_L>(aspace, new_cursor->vaddr, e, true);
+            unmap_entry<PT_L>(pending, new_cursor->vaddr, e, true);
             unmapped = true;
         }
 
@@ -736,6 +828,7 @@ bool x86_mmu_remove_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, cons
  * Level must be MAX_PAGING_LEVEL when invoked.
  *
  * @param aspace The aspace we're updating
+ * @param pending The batch of TLB invalidations for this operation
  * @param table The top-level paging structure's virtual address
  * @param start_cursor A cursor describing the range of address space to
  * act on within table
@@ -747,7 +840,8 @@ bool x86_mmu_remove_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, cons
  * @return ERR_NO_MEMORY if intermediate page tables could not be allocated
  */
 template <int Level>
-static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                    pt_entry_t* table, uint mmu_flags,
                                     const MappingCursor& start_cursor, MappingCursor* new_cursor) {
     static_assert(Level >= 0, "level too low");
     static_assert(Level < X86_PAGING_LEVELS, "level too high");
@@ -779,7 +873,7 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
         if (level_supports_large_pages && !IS_PAGE_PRESENT(*e) && level_valigned &&
             level_paligned && new_cursor->size >= ps) {
 
-            update_entry<Level>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
+            update_entry<Level>(pending, new_cursor->vaddr, table + index, new_cursor->paddr,
                                 arch_flags | X86_MMU_PG_PS);
 
             new_cursor->paddr += ps;
@@ -797,13 +891,13 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
 
                 LTRACEF_LEVEL(2, "new table %p at level %d\n", m, Level);
 
-                update_entry<Level>(aspace, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
+                update_entry<Level>(pending, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
                                     interm_arch_flags);
             }
 
             MappingCursor cursor;
-            ret = x86_mmu_add_mapping<Level - 1>(aspace, get_next_table_from_entry(*e), mmu_flags,
-                                                 *new_cursor, &cursor);
+            ret = x86_mmu_add_mapping<Level - 1>(aspace, pending, get_next_table_from_entry(*e),
+                                                 mmu_flags, *new_cursor, &cursor);
             *new_cursor = cursor;
             DEBUG_ASSERT(new_cursor->size <= start_cursor.size);
             if (ret != NO_ERROR) {
@@ -819,7 +913,7 @@ err:
         // new_cursor->size should be how much is left to be mapped still
         cursor.size -= new_cursor->size;
         if (cursor.size > 0) {
-            x86_mmu_remove_mapping<MAX_PAGING_LEVEL>(aspace, table, cursor, &result);
+            x86_mmu_remove_mapping<MAX_PAGING_LEVEL>(pending, table, cursor, &result);
             DEBUG_ASSERT(result.size == 0);
         }
     }
@@ -828,7 +922,8 @@ err:
 
 // Base case of x86_mmu_add_mapping for smallest page size
 template <>
-status_t x86_mmu_add_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+status_t x86_mmu_add_mapping<PT_L>(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                   pt_entry_t* table, uint mmu_flags,
                                    const MappingCursor& start_cursor, MappingCursor* new_cursor) {
 
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
@@ -844,7 +939,7 @@ status_t x86_mmu_add_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, uin
             return ERR_ALREADY_EXISTS;
         }
 
-        update_entry<PT_L>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr, arch_flags);
+        update_entry<PT_L>(pending, new_cursor->vaddr, table + index, new_cursor->paddr, arch_flags);
 
         new_cursor->paddr += PAGE_SIZE;
         new_cursor->vaddr += PAGE_SIZE;
@@ -861,6 +956,7 @@ status_t x86_mmu_add_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, uin
  * Level must be MAX_PAGING_LEVEL when invoked.
  *
  * @param aspace The aspace we're updating
+ * @param pending The batch of TLB invalidations for this operation
  * @param table The top-level paging structure's virtual address
  * @param start_cursor A cursor describing the range of address space to
  * act on within table
@@ -868,7 +964,8 @@ status_t x86_mmu_add_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, uin
  * completed.  Must be non-null.
  */
 template <int Level>
-static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                       pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
                                        MappingCursor* new_cursor) {
     static_assert(Level >= 0, "level too low");
@@ -906,7 +1003,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             // If the request covers the entire large page, just change the
             // permissions
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                update_entry<Level>(aspace, new_cursor->vaddr, e, paddr_from_pte<Level>(*e),
+                update_entry<Level>(pending, new_cursor->vaddr, e, paddr_from_pte<Level>(*e),
                                     arch_flags | X86_MMU_PG_PS);
 
                 new_cursor->vaddr += ps;
@@ -916,7 +1013,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            ret = x86_mmu_split<Level>(aspace, page_vaddr, e);
+            ret = x86_mmu_split<Level>(pending, page_vaddr, e);
             if (ret != NO_ERROR) {
                 goto err;
             }
@@ -924,7 +1021,8 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
 
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
-        ret = x86_mmu_update_mapping<Level - 1>(aspace, next_table, mmu_flags, *new_cursor, &cursor);
+        ret = x86_mmu_update_mapping<Level - 1>(aspace, pending, next_table, mmu_flags,
+                                                *new_cursor, &cursor);
         *new_cursor = cursor;
         if (ret != NO_ERROR) {
             goto err;
@@ -941,7 +1039,8 @@ err:
 
 // Base case of x86_update_mapping for smallest page size
 template <>
-status_t x86_mmu_update_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+status_t x86_mmu_update_mapping<PT_L>(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                      pt_entry_t* table, uint mmu_flags,
                                       const MappingCursor& start_cursor,
                                       MappingCursor* new_cursor) {
 
@@ -957,7 +1056,7 @@ status_t x86_mmu_update_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table,
         pt_entry_t* e = table + index;
         // Skip unmapped pages (we may encounter these due to demand paging)
         if (IS_PAGE_PRESENT(*e)) {
-            update_entry<PT_L>(aspace, new_cursor->vaddr, e, paddr_from_pte<PT_L>(*e), arch_flags);
+            update_entry<PT_L>(pending, new_cursor->vaddr, e, paddr_from_pte<PT_L>(*e), arch_flags);
         }
 
         new_cursor->vaddr += PAGE_SIZE;
@@ -983,8 +1082,9 @@ int arch_mmu_unmap(arch_aspace_t* aspace, vaddr_t vaddr, size_t count) {
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
 
+    PendingTlbInvalidation pending(aspace);
     MappingCursor result;
-    x86_mmu_remove_mapping<MAX_PAGING_LEVEL>(aspace, aspace->pt_virt, start, &result);
+    x86_mmu_remove_mapping<MAX_PAGING_LEVEL>(&pending, aspace->pt_virt, start, &result);
     DEBUG_ASSERT(result.size == 0);
     return NO_ERROR;
 }
@@ -1009,9 +1109,10 @@ int arch_mmu_map(arch_aspace_t* aspace, vaddr_t vaddr, paddr_t paddr, size_t cou
     MappingCursor start = {
         .paddr = paddr, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
+    PendingTlbInvalidation pending(aspace);
     MappingCursor result;
-    status_t status = x86_mmu_add_mapping<MAX_PAGING_LEVEL>(aspace, aspace->pt_virt, flags,
-                                                            start, &result);
+    status_t status = x86_mmu_add_mapping<MAX_PAGING_LEVEL>(aspace, &pending, aspace->pt_virt,
+                                                            flags, start, &result);
     if (status != NO_ERROR) {
         dprintf(SPEW, "Add mapping failed with err=%d\n", status);
         return status;
@@ -1036,8 +1137,9 @@ int arch_mmu_protect(arch_aspace_t* aspace, vaddr_t vaddr, size_t count, uint fl
     MappingCursor start = {
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
+    PendingTlbInvalidation pending(aspace);
     MappingCursor result;
-    status_t status = x86_mmu_update_mapping<MAX_PAGING_LEVEL>(aspace, aspace->pt_virt,
+    status_t status = x86_mmu_update_mapping<MAX_PAGING_LEVEL>(aspace, &pending, aspace->pt_virt,
                                                                flags, start, &result);
     if (status != NO_ERROR) {
         return status;
@@ -1052,7 +1154,10 @@ void x86_mmu_early_init() {
 
 #if ARCH_X86_64
     /* unmap the lower identity mapping */
-    unmap_entry<PML4_L>(nullptr, 0, &pml4[0], true);
+    {
+        PendingTlbInvalidation pending(nullptr);
+        unmap_entry<PML4_L>(&pending, 0, &pml4[0], true);
+    }
 #else
     /* unmap the lower identity mapping */
     for (uint i = 0; i < (1 * GB) / (4 * MB); i++) {
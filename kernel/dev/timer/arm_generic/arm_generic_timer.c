@@ -225,6 +225,12 @@ uint64_t ticks_per_second(void)
     return u64_mul_u32_fp32_64(1000, cntpct_per_ms);
 }
 
+bool platform_ticks_to_ns(struct fp_32_64 *ns_per_tick)
+{
+    // mx_ticks_get() reads the cycle counter, not this timer.
+    return false;
+}
+
 static uint32_t abs_int32(int32_t a)
 {
     return (a > 0) ? a : -a;
@@ -0,0 +1,77 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef __KERNEL_MAGAZINE_H
+#define __KERNEL_MAGAZINE_H
+
+#include <magenta/compiler.h>
+#include <sys/types.h>
+#include <arch/ops.h>
+#include <kernel/spinlock.h>
+
+__BEGIN_CDECLS;
+
+/* Per-cpu magazines of free objects in front of a shared allocator.
+ *
+ * Each cpu keeps a small stack of free objects. Allocations pop from the
+ * current cpu's stack and frees push onto it, taking only that stack's
+ * spinlock. Objects only move to or from the shared allocator (the depot),
+ * half a magazine at a time, when a stack runs dry or overflows, so the
+ * depot's own lock is taken once per batch rather than once per object.
+ */
+
+#define MAGAZINE_SIZE 64
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
+
+struct magazine_depot {
+    /* Fill |objs| with up to |count| objects, returning how many it got. */
+    size_t (*alloc)(void *ctx, void **objs, size_t count);
+    /* Take back |count| objects. */
+    void (*free)(void *ctx, void **objs, size_t count);
+    void *ctx;
+};
+
+struct magazine {
+    spin_lock_t lock;
+    size_t count;
+    void *objs[MAGAZINE_SIZE];
+    uint64_t hits;    /* objects handed out straight from the magazine */
+    uint64_t refills; /* non-empty batches pulled in from the depot */
+    uint64_t drains;  /* batches pushed back to the depot */
+    /* Objects allocated minus objects freed on this cpu. Only the sum across
+     * all cpus is meaningful. */
+    int64_t outstanding;
+} __CPU_ALIGN;
+
+struct magazine_set {
+    const struct magazine_depot *depot;
+    struct magazine mags[SMP_MAX_CPUS];
+};
+
+void magazine_set_init(struct magazine_set *set, const struct magazine_depot *depot);
+
+/* Allocate up to |count| objects into |objs|, refilling the current cpu's
+ * magazine from the depot if it runs dry. Requests for more than
+ * MAGAZINE_BATCH objects are only served from what is already cached; the
+ * caller gets the rest from the depot itself. */
+size_t magazine_alloc(struct magazine_set *set, void **objs, size_t count);
+
+/* Free |count| objects into the current cpu's magazine, handing its coldest
+ * half back to the depot whenever it fills up. */
+void magazine_free(struct magazine_set *set, void *const *objs, size_t count);
+
+/* Give every cached object back to the depot. */
+void magazine_drain_all(struct magazine_set *set);
+
+/* Number of objects cached across all cpus. */
+size_t magazine_cached(const struct magazine_set *set);
+
+/* Objects allocated and not yet freed, summed across all cpus. */
+size_t magazine_outstanding(const struct magazine_set *set);
+
+__END_CDECLS;
+
+#endif
@@ -22,6 +22,8 @@ __BEGIN_CDECLS;
 typedef struct TA_CAP("mutex") mutex {
     uint32_t magic;
     thread_t *holder;
+    /* holder plus waiters. the uncontended paths only ever move this
+     * between 0 and 1 with an atomic compare and swap. */
     int count;
     wait_queue_t wait;
 } mutex_t;
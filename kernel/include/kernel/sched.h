@@ -21,3 +21,5 @@ void sched_unblock_list(struct list_node *list, bool resched);
 
 void sched_yield(void);
 void sched_preempt(void);
+
+void sched_change_priority(thread_t *t, int priority);
@@ -73,7 +73,10 @@ typedef struct thread {
 
     /* active bits */
     struct list_node queue_node;
-    int priority;
+    int priority; /* effective priority, the higher of the two below */
+    int base_priority;
+    int inherited_priority; /* from threads blocked on this one, or 0 */
+    uint queued_cpu; /* whose run queue queue_node is on while THREAD_READY */
     enum thread_state state;
     lk_bigtime_t last_started_running;
     lk_bigtime_t remaining_time_slice;
@@ -176,6 +179,7 @@ void thread_construct_first(thread_t *t, const char *name);
 thread_t *thread_create_idle_thread(uint cpu_num);
 void thread_set_name(const char *name);
 void thread_set_priority(int priority);
+void thread_set_inherited_priority_locked(thread_t *t, int priority);
 void thread_set_exit_callback(thread_t *t, thread_exit_callback_t cb, void *cb_arg);
 thread_t *thread_create(const char *name, thread_start_routine entry, void *arg, int priority, size_t stack_size);
 thread_t *thread_create_etc(thread_t *t, const char *name, thread_start_routine entry, void *arg, int priority, void *stack, size_t stack_size, thread_trampoline_routine alt_trampoline);
@@ -268,12 +272,14 @@ struct thread_stats {
     ulong irq_preempts;
     ulong preempts;
     ulong yields;
+    ulong steals; /* threads taken from another cpu's run queue */
 
     /* cpu level interrupts and exceptions */
     ulong interrupts; /* hardware interrupts, minus timer interrupts or inter-processor interrupts */
     ulong timer_ints; /* timer interrupts */
     ulong timers; /* timer callbacks */
     ulong exceptions; /* exceptions such as page fault or undefined opcode */
+    ulong page_faults;
     ulong syscalls;
 
 #if WITH_SMP
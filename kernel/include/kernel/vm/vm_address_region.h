@@ -90,8 +90,12 @@ public:
     mxtl::RefPtr<VmMapping> as_vm_mapping();
 
     // Page fault in an address within the region.  Recursively traverses
-    // the regions to find the target mapping, if it exists.
-    virtual status_t PageFault(vaddr_t va, uint pf_flags) = 0;
+    // the regions to find the target mapping, if it exists.  Mappings the
+    // fault leaves to be unmapped are added to |unmap_list|, which the caller
+    // unmaps after dropping the aspace lock.  |spare| is passed on to
+    // VmObject::FaultPageLocked().
+    virtual status_t PageFault(vaddr_t va, uint pf_flags, VmUnmapList* unmap_list,
+                               vm_page_t** spare) = 0;
 
     // WAVL tree key function
     vaddr_t GetKey() const { return base(); }
@@ -207,7 +211,8 @@ public:
     bool is_mapping() const override { return false; }
 
     void Dump(uint depth, bool verbose) const override;
-    status_t PageFault(vaddr_t va, uint pf_flags) override;
+    status_t PageFault(vaddr_t va, uint pf_flags, VmUnmapList* unmap_list,
+                       vm_page_t** spare) override;
 
 protected:
     static const uint32_t kMagic = 0x564d4152; // VMAR
@@ -243,6 +248,10 @@ private:
     // Version of FindRegion() that does not acquire the aspace lock
     mxtl::RefPtr<VmAddressRegionOrMapping> FindRegionLocked(vaddr_t addr);
 
+    // Find the mapping that contains |va| anywhere below this region, or
+    // nullptr.  Does not acquire the aspace lock.
+    mxtl::RefPtr<VmMapping> FindMappingLocked(vaddr_t va);
+
     // Version of Destroy() that does not acquire the aspace lock
     status_t DestroyLocked() override;
 
@@ -323,7 +332,8 @@ public:
         return;
     }
 
-    status_t PageFault(vaddr_t va, uint pf_flags) override {
+    status_t PageFault(vaddr_t va, uint pf_flags, VmUnmapList* unmap_list,
+                       vm_page_t** spare) override {
         // We should never be trying to page fault on this...
         ASSERT(false);
         return ERR_BAD_STATE;
@@ -379,7 +389,15 @@ public:
     bool is_mapping() const override { return true; }
 
     void Dump(uint depth, bool verbose) const override;
-    status_t PageFault(vaddr_t va, uint pf_flags) override;
+    status_t PageFault(vaddr_t va, uint pf_flags, VmUnmapList* unmap_list,
+                       vm_page_t** spare) override;
+
+    // Check that a fault with |pf_flags| at |va| is allowed and return the
+    // object and offset backing it, so the page the fault needs can be
+    // allocated without holding the aspace lock.  The caller must redo the fault with
+    // PageFault() afterwards.
+    status_t PrepareFaultLocked(vaddr_t va, uint pf_flags, mxtl::RefPtr<VmObject>* vmo,
+                                uint64_t* vmo_offset);
 
 protected:
     static const uint32_t kMagic = 0x564d4150; // VMAP
@@ -389,8 +407,13 @@ protected:
 
     // private apis from VmObject land
     friend class VmObjectPaged;
+    friend class VmUnmapList;
 
     // unmap any pages that map the passed in vmo range. May not intersect with this range
+    status_t UnmapVmoRange(uint64_t start, uint64_t size);
+
+    // Version of UnmapVmoRange() that does not acquire the aspace lock or the
+    // object lock
     status_t UnmapVmoRangeLocked(uint64_t start, uint64_t size);
 
 private:
@@ -415,6 +438,18 @@ private:
     // Implementation for Protect().  This does not acquire the aspace lock.
     status_t ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+    // Apply new permissions to the pages already mapped in a range.  This does
+    // not acquire the aspace lock.
+    status_t ProtectRangeLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags);
+
+    // Returns ERR_ACCESS_DENIED if the mapping doesn't allow a fault with |pf_flags|
+    status_t CheckFaultFlags(uint pf_flags) const;
+
+    // Map the page that faulted in at |va| and as many of the pages after it
+    // as are cheap to get at.  Returns the number of pages mapped in |mapped|.
+    status_t FaultAroundLocked(vaddr_t va, uint64_t vmo_offset, uint pf_flags, paddr_t pa,
+                               uint mmu_flags, size_t* mapped);
+
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
@@ -431,4 +466,10 @@ private:
 
     // cached mapping flags (read/write/user/etc)
     uint arch_mmu_flags_;
+
+    // sequential access tracking for fault-around, protected by the aspace lock:
+    // the object offset just past the last page the previous fault mapped, and
+    // how many missing pages the next sequential fault may fault in ahead
+    uint64_t next_fault_offset_ = UINT64_MAX;
+    uint fault_ahead_pages_ = 0;
 };
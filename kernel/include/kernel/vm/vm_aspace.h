@@ -66,6 +66,11 @@ public:
     // VMAR in the tree that includes *va*.
     mxtl::RefPtr<VmAddressRegionOrMapping> FindRegion(vaddr_t va);
 
+    // Find the object and offset backing the range [va, va + len), if all of
+    // it lies within a single mapping that user code may write to.
+    status_t FindWritableObject(vaddr_t va, size_t len, mxtl::RefPtr<VmObject>* vmo,
+                                uint64_t* vmo_offset);
+
     // legacy functions to assist in the transition to VMARs
     // These all assume a flat VMAR structure in which all VMOs are mapped
     // as children of the root.  They will all assert if used on user aspaces
@@ -22,6 +22,51 @@
 
 class VmMapping;
 
+// Ranges of mappings that have to be unmapped once an object's lock is dropped.
+//
+// An aspace lock is taken before the lock of any object mapped into the aspace,
+// never after it.  So anything that changes the pages of an object under the
+// object's lock gathers the mappings that may still have the old pages mapped
+// here, and unmaps them once it has dropped the lock.  Old pages can't be freed
+// until then, and no page of the object, or of any object it shares its lock
+// with, may be mapped writable.
+//
+// The destructor unmaps whatever is left, so declare the list ahead of the
+// locks it has to outlive.
+class VmUnmapList {
+public:
+    VmUnmapList() = default;
+    ~VmUnmapList();
+
+    bool is_empty() const { return count_ == 0; }
+
+    // leave |mapping| out of the list, for a caller that is updating it itself
+    void set_exempt(const VmMapping* mapping) { exempt_ = mapping; }
+
+    // add the range [offset, offset + len) of the object |mapping| maps.  The
+    // caller holds the object's lock.
+    status_t Add(VmMapping* mapping, uint64_t offset, uint64_t len);
+
+    // unmap everything that was added, holding neither an object lock nor an
+    // aspace lock
+    void Unmap();
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(VmUnmapList);
+
+    struct Entry {
+        mxtl::RefPtr<VmMapping> mapping;
+        uint64_t offset;
+        uint64_t len;
+    };
+    mxtl::Array<Entry> entries_;
+    size_t count_ = 0;
+    const VmMapping* exempt_ = nullptr;
+
+    // an object whose pending_unmaps_ counts this list, while it isn't empty
+    mxtl::RefPtr<VmObject> object_;
+};
+
 // The base vm object that holds a range of bytes of data
 //
 // Can be created without mapping and used as a container of data, or mappable
@@ -45,11 +90,34 @@ public:
         return ERR_NOT_SUPPORTED;
     };
 
+    // allocate the page a fault with PF_FLAGS at |offset| is going to need,
+    // holding no locks, for the fault to take through FaultPageLocked().
+    // Returns null if the fault won't need a page.
+    virtual vm_page_t* AllocFaultPage(uint64_t offset, uint pf_flags) { return nullptr; }
+
     // free a range of the vmo back to the default state
     virtual status_t DecommitRange(uint64_t offset, uint64_t len, uint64_t* decommitted) {
         return ERR_NOT_SUPPORTED;
     }
 
+    // take the committed pages backing a whole-page range of the object out of
+    // it, appending them to |pages| in order.  Only objects created to loan
+    // pages support this.
+    virtual status_t TakePages(uint64_t offset, uint64_t len, list_node* pages) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // back a whole-page range of the object with the pages on |pages|, in
+    // order, freeing whatever pages were there
+    virtual status_t SupplyPages(uint64_t offset, uint64_t len, list_node* pages) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // create a copy-on-write clone of a range of the object
+    virtual status_t CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) {
+        return ERR_NOT_SUPPORTED;
+    }
+
     // read/write operators against kernel pointers only
     virtual status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) {
         return ERR_NOT_SUPPORTED;
@@ -91,6 +159,9 @@ protected:
     // private constructor (use Create())
     VmObject();
 
+    // constructor for objects that share the lock of the object they were cloned from
+    explicit VmObject(VmObject& root);
+
     // private destructor, only called from refptr
     virtual ~VmObject();
     friend mxtl::RefPtr<VmObject>;
@@ -100,6 +171,7 @@ protected:
     // private apis used by the VmMapping class
     // get a pointer to a page at a given offset
     friend class VmMapping;
+    friend class VmUnmapList;
 
     virtual vm_page_t* GetPageLocked(uint64_t offset) TA_REQ(lock_) { return nullptr; }
 
@@ -112,20 +184,40 @@ protected:
         return NO_ERROR;
     }
 
-    // fault in a page at a given offset with PF_FLAGS
-    virtual vm_page_t* FaultPageLocked(uint64_t offset, uint pf_flags) TA_REQ(lock_) {
+    // fault in a page at a given offset with PF_FLAGS.  A write fault may
+    // replace pages other mappings have mapped, and adds those mappings to
+    // |unmap_list|, which may be null for a fault that isn't a write.  If
+    // |spare| points at a zeroed page from AllocFaultPage(), a fault that
+    // needs a new page takes that one and clears *|spare|.
+    virtual vm_page_t* FaultPageLocked(uint64_t offset, uint pf_flags, VmUnmapList* unmap_list,
+                                       vm_page_t** spare) TA_REQ(lock_) {
         return nullptr;
     }
 
     // fault in a page at a given offset with PF_FLAGS returning the physical address
-    virtual status_t FaultPageLocked(uint64_t offset, uint pf_flags, paddr_t* pa) TA_REQ(lock_) {
-        auto page = FaultPageLocked(offset, pf_flags);
+    virtual status_t FaultPageLocked(uint64_t offset, uint pf_flags, VmUnmapList* unmap_list,
+                                     vm_page_t** spare, paddr_t* pa) TA_REQ(lock_) {
+        auto page = FaultPageLocked(offset, pf_flags, unmap_list, spare);
         if (!page)
             return ERR_NOT_FOUND;
         *pa = vm_page_to_paddr(page);
         return NO_ERROR;
     }
 
+    // whether the page at |pa| that a fault got for |offset| may be mapped
+    // writable, which it may not if the object doesn't own it, or while other
+    // mappings may still show a page it replaced
+    virtual bool CanMapWritableLocked(uint64_t offset, paddr_t pa) TA_REQ(lock_) {
+        if (pending_unmaps_ > 0)
+            return false;
+        paddr_t owned_pa;
+        return GetPageLocked(offset, &owned_pa) == NO_ERROR && owned_pa == pa;
+    }
+
+    // whether any page of the object may be shared with a copy-on-write
+    // clone, so that write access can't be granted to a range all at once
+    virtual bool SharesPagesLocked() TA_REQ(lock_) { return false; }
+
     Mutex& lock() TA_RET_CAP(lock_) { return lock_; }
 
     // TODO(teisenbe): Rename these to s/Region/Mapping/
@@ -137,14 +229,42 @@ protected:
     uint32_t magic_ = MAGIC;
 
     // members
-    mutable Mutex lock_;
+    mutable Mutex local_lock_;
+    // either local_lock_ or the lock of the object at the root of the clone tree
+    Mutex& lock_;
+    // the number of VmUnmapLists that hold mappings of objects sharing lock_,
+    // either local_pending_unmaps_ or that of the root of the clone tree
+    uint32_t local_pending_unmaps_ = 0;
+    uint32_t& pending_unmaps_ TA_GUARDED(lock_);
     mxtl::DoublyLinkedList<VmMapping*> region_list_ TA_GUARDED(lock_);
 };
 
 // the main VM object type, holding a list of pages
-class VmObjectPaged final : public VmObject {
+//
+// A VmObjectPaged may be a copy-on-write clone of another one.  Until it is
+// written, a page of a clone is read straight from its parent (or the parent's
+// parent, and so on), and it only gets a private copy of the page on the first
+// write to it.  A clone is a snapshot: before the parent changes a page that a
+// clone still reads, the clone is given a copy of the page as it was.  All of
+// the objects in a clone tree share one lock.
+class VmObjectPaged final : public VmObject,
+                            public mxtl::DoublyLinkedListable<VmObjectPaged*> {
 public:
-    static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size);
+    // options for Create()
+    //
+    // kLoanable: the object holds plain anonymous memory whose pages may be
+    // moved to or from another such object with TakePages() and SupplyPages().
+    // That is refused while the object has clones, and for good once its
+    // physical addresses have been looked up or it has been committed
+    // contiguously.
+    static constexpr uint32_t kLoanable = (1u << 0);
+    // kPinned: the object is committed in full when it is created, and keeps
+    // its size and its pages for life; Resize() and DecommitRange() fail.  For
+    // objects the kernel keeps mapped while userspace holds handles to them.
+    static constexpr uint32_t kPinned = (1u << 1);
+
+    static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size,
+                                         uint32_t options = 0);
 
     static mxtl::RefPtr<VmObject> CreateFromROData(const void* data, size_t size);
 
@@ -158,6 +278,11 @@ public:
                                            uint8_t alignment_log2) override;
     status_t DecommitRange(uint64_t offset, uint64_t len, uint64_t* decommitted) override;
 
+    status_t TakePages(uint64_t offset, uint64_t len, list_node* pages) override;
+    status_t SupplyPages(uint64_t offset, uint64_t len, list_node* pages) override;
+
+    status_t CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) override;
+
     status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) override;
     status_t Write(const void* ptr, uint64_t offset, size_t len, size_t* bytes_written) override;
 
@@ -175,15 +300,24 @@ public:
     status_t CleanInvalidateCache(const uint64_t offset, const uint64_t len) override;
     status_t SyncCache(const uint64_t offset, const uint64_t len) override;
 
+    vm_page_t* AllocFaultPage(uint64_t offset, uint pf_flags) override;
+
     vm_page_t* GetPageLocked(uint64_t offset) override TA_REQ(lock_);
-    vm_page_t* FaultPageLocked(uint64_t offset, uint pf_flags) override TA_REQ(lock_);
+    vm_page_t* FaultPageLocked(uint64_t offset, uint pf_flags, VmUnmapList* unmap_list,
+                               vm_page_t** spare) override TA_REQ(lock_);
+    bool CanMapWritableLocked(uint64_t offset, paddr_t pa) override TA_REQ(lock_);
+    bool SharesPagesLocked() override TA_REQ(lock_);
 
 private:
     // private constructor (use Create())
-    explicit VmObjectPaged(uint32_t pmm_alloc_flags);
+    VmObjectPaged(uint32_t pmm_alloc_flags, uint32_t options);
+
+    // private constructor for clones (use CloneCOW())
+    VmObjectPaged(mxtl::RefPtr<VmObjectPaged> parent, uint64_t parent_offset, uint64_t size);
 
     // private destructor, only called from refptr
     ~VmObjectPaged() override;
+    friend mxtl::RefPtr<VmObjectPaged>;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmObjectPaged);
 
@@ -197,12 +331,43 @@ private:
     // internal page list routine
     void AddPageToArray(size_t index, vm_page_t* p);
 
+    // find the page backing |offset| in the closest ancestor that has one
+    vm_page_t* GetPageFromParentLocked(uint64_t offset) TA_REQ(lock_);
+
+    // give the object a page of its own at |offset|, a copy of whatever it
+    // reads there now, without changing what any clone sees.  |spare| is as
+    // for FaultPageLocked().
+    vm_page_t* CommitPageLocked(uint64_t offset, VmUnmapList* unmap_list,
+                                vm_page_t** spare) TA_REQ(lock_);
+
+    // whether a clone still reads the page the object has at |offset|
+    bool IsReadByClonesLocked(uint64_t offset) TA_REQ(lock_);
+
+    // before what the object shows at |offset| changes, give every clone that
+    // reads it a copy of its own
+    status_t PreserveForClonesLocked(uint64_t offset, VmUnmapList* unmap_list) TA_REQ(lock_);
+
+    // find the part of the range [offset, offset + len) of |ancestor| that
+    // this clone of it, or of one of its clones, sees, as offsets into this
+    // object.  Returns false if it sees none of it.
+    bool CloneWindowLocked(const VmObjectPaged* ancestor, uint64_t offset, uint64_t len,
+                           uint64_t* window_offset, uint64_t* window_len) const TA_REQ(lock_);
+
+    // add all of the mappings of a range of the object, and the mappings of
+    // its clones that read the range, to |unmap_list|
+    status_t GatherMappingsLocked(uint64_t offset, uint64_t len,
+                                  VmUnmapList* unmap_list) TA_REQ(lock_);
+
     // internal read/write routine that takes a templated copy function to help share some code
     template <typename T>
     status_t ReadWriteInternal(uint64_t offset, size_t len, size_t* bytes_copied, bool write,
                                T copyfunc);
 
 // constants
+    // the most clones deep an object may be, counting the object it was
+    // first cloned from as depth 0
+    static const uint32_t kMaxCloneDepth = 32;
+
 #if _LP64
     static const uint64_t MAX_SIZE = ROUNDDOWN(SIZE_MAX, PAGE_SIZE);
 #else
@@ -213,8 +378,26 @@ private:
     uint64_t size_ = 0;
     uint32_t pmm_alloc_flags_ = PMM_ALLOC_FLAG_ANY;
 
+    // whether pages may be loaned in or out, see kLoanable
+    bool loanable_ TA_GUARDED(lock_) = false;
+
+    // whether the size and pages are fixed, see kPinned; set before Create()
+    // returns and never changed after
+    bool pinned_ = false;
+
     // a tree of pages
     VmPageList page_list_ TA_GUARDED(lock_);
+
+    // how many clones deep we are
+    const uint32_t depth_ = 0;
+
+    // the object we are a copy-on-write clone of, if any, and where we start
+    // in it.  Only cleared by the destructor.
+    mxtl::RefPtr<VmObjectPaged> parent_;
+    const uint64_t parent_offset_ = 0;
+
+    // our own copy-on-write clones
+    mxtl::DoublyLinkedList<VmObjectPaged*> children_list_ TA_GUARDED(lock_);
 };
 
 // VMO representing a physical range of memory
@@ -227,7 +410,8 @@ public:
     void Dump(uint depth, bool verbose) override;
 
     status_t GetPageLocked(uint64_t offset, paddr_t* pa) override TA_REQ(lock_);
-    status_t FaultPageLocked(uint64_t offset, uint pf_flags, paddr_t* pa) override TA_REQ(lock_);
+    status_t FaultPageLocked(uint64_t offset, uint pf_flags, VmUnmapList* unmap_list,
+                             vm_page_t** spare, paddr_t* pa) override TA_REQ(lock_);
 
 private:
     // private constructor (use Create())
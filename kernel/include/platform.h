@@ -42,6 +42,13 @@ lk_bigtime_t current_time_hires(void);
 /* high-precision timer ticks per second */
 uint64_t ticks_per_second(void);
 
+struct fp_32_64;
+
+/* if current_time_hires() is the counter user mode reads in mx_ticks_get()
+ * times a fixed scale, fill in the scale and return true so that the vDSO
+ * can tell the time without entering the kernel */
+bool platform_ticks_to_ns(struct fp_32_64 *ns_per_tick);
+
 /* super early platform initialization, before almost everything */
 void platform_early_init(void);
 
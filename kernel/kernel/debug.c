@@ -82,6 +82,7 @@ static int cmd_threadstats(int argc, const cmd_args *argv)
         printf("\treschedules: %lu\n", thread_stats[i].reschedules);
 #if WITH_SMP
         printf("\treschedule_ipis: %lu\n", thread_stats[i].reschedule_ipis);
+        printf("\tsteals: %lu\n", thread_stats[i].steals);
 #endif
         printf("\tcontext_switches: %lu\n", thread_stats[i].context_switches);
         printf("\tpreempts: %lu\n", thread_stats[i].preempts);
@@ -89,6 +90,7 @@ static int cmd_threadstats(int argc, const cmd_args *argv)
         printf("\tinterrupts: %lu\n", thread_stats[i].interrupts);
         printf("\ttimer interrupts: %lu\n", thread_stats[i].timer_ints);
         printf("\ttimers: %lu\n", thread_stats[i].timers);
+        printf("\tpage faults: %lu\n", thread_stats[i].page_faults);
     }
 
     return 0;
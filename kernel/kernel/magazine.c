@@ -0,0 +1,135 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/magazine.h>
+
+#include <assert.h>
+#include <debug.h>
+#include <string.h>
+
+/* The lock in each magazine is only ever contended if a thread migrates
+ * between picking a magazine and locking it. Every path below copes with that
+ * by taking whatever magazine is current at the time it locks. */
+
+static struct magazine *current_magazine(struct magazine_set *set)
+{
+    return &set->mags[arch_curr_cpu_num()];
+}
+
+void magazine_set_init(struct magazine_set *set, const struct magazine_depot *depot)
+{
+    set->depot = depot;
+    for (uint i = 0; i < countof(set->mags); i++) {
+        struct magazine *mag = &set->mags[i];
+        spin_lock_init(&mag->lock);
+        mag->count = 0;
+        mag->hits = 0;
+        mag->refills = 0;
+        mag->drains = 0;
+        mag->outstanding = 0;
+    }
+}
+
+size_t magazine_alloc(struct magazine_set *set, void **objs, size_t count)
+{
+    size_t allocated = 0;
+
+    struct magazine *mag = current_magazine(set);
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&mag->lock, state);
+    while (allocated < count && mag->count > 0)
+        objs[allocated++] = mag->objs[--mag->count];
+    mag->hits += allocated;
+    mag->outstanding += allocated;
+    spin_unlock_irqrestore(&mag->lock, state);
+
+    if (allocated == count || count - allocated > MAGAZINE_BATCH)
+        return allocated;
+
+    /* pull in a batch, keep what the caller still needs and stash the rest */
+    void *batch[MAGAZINE_BATCH];
+    size_t fetched = set->depot->alloc(set->depot->ctx, batch, MAGAZINE_BATCH);
+    size_t used = 0;
+    while (allocated < count && used < fetched)
+        objs[allocated++] = batch[used++];
+
+    mag = current_magazine(set);
+    spin_lock_irqsave(&mag->lock, state);
+    if (fetched > 0)
+        mag->refills++;
+    mag->outstanding += used;
+    while (used < fetched && mag->count < MAGAZINE_SIZE)
+        mag->objs[mag->count++] = batch[used++];
+    spin_unlock_irqrestore(&mag->lock, state);
+
+    /* we may have migrated to a cpu whose magazine was already stocked */
+    if (used < fetched)
+        set->depot->free(set->depot->ctx, &batch[used], fetched - used);
+
+    return allocated;
+}
+
+void magazine_free(struct magazine_set *set, void *const *objs, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        void *spill[MAGAZINE_BATCH];
+        bool spilled = false;
+
+        /* take the lock an object at a time so big frees don't hold off
+         * interrupts */
+        struct magazine *mag = current_magazine(set);
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&mag->lock, state);
+        if (mag->count == MAGAZINE_SIZE) {
+            /* full, hand the coldest half back to the depot */
+            memcpy(spill, mag->objs, sizeof(spill));
+            mag->count -= MAGAZINE_BATCH;
+            memmove(&mag->objs[0], &mag->objs[MAGAZINE_BATCH], mag->count * sizeof(mag->objs[0]));
+            mag->drains++;
+            spilled = true;
+        }
+        mag->objs[mag->count++] = objs[i];
+        mag->outstanding--;
+        spin_unlock_irqrestore(&mag->lock, state);
+
+        if (spilled)
+            set->depot->free(set->depot->ctx, spill, MAGAZINE_BATCH);
+    }
+}
+
+void magazine_drain_all(struct magazine_set *set)
+{
+    for (uint i = 0; i < countof(set->mags); i++) {
+        struct magazine *mag = &set->mags[i];
+        void *objs[MAGAZINE_SIZE];
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&mag->lock, state);
+        size_t count = mag->count;
+        memcpy(objs, mag->objs, count * sizeof(objs[0]));
+        mag->count = 0;
+        spin_unlock_irqrestore(&mag->lock, state);
+
+        if (count)
+            set->depot->free(set->depot->ctx, objs, count);
+    }
+}
+
+size_t magazine_cached(const struct magazine_set *set)
+{
+    size_t count = 0;
+    for (uint i = 0; i < countof(set->mags); i++)
+        count += set->mags[i].count;
+    return count;
+}
+
+size_t magazine_outstanding(const struct magazine_set *set)
+{
+    int64_t total = 0;
+    for (uint i = 0; i < countof(set->mags); i++)
+        total += set->mags[i].outstanding;
+    return total > 0 ? (size_t)total : 0u;
+}
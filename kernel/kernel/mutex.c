@@ -21,6 +21,9 @@
 #include <err.h>
 #include <kernel/thread.h>
 
+/* number of times to poll a mutex whose holder is running on another cpu before blocking */
+#define MUTEX_SPIN_MAX_ITERATIONS 1000
+
 /**
  * @brief  Initialize a mutex_t
  */
@@ -41,7 +44,7 @@ void mutex_destroy(mutex_t *m)
 
     THREAD_LOCK(state);
 #if LK_DEBUGLEVEL > 0
-    if (unlikely(m->count > 0)) {
+    if (unlikely(atomic_load(&m->count) > 0)) {
         panic("mutex_destroy: thread %p (%s) tried to destroy locked mutex %p,"
               " locked by %p (%s)\n",
               get_current_thread(), get_current_thread()->name, m,
@@ -59,7 +62,10 @@ status_t mutex_acquire_internal(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    if (unlikely(++m->count > 1)) {
+    /* count is the holder plus the number of waiters. anyone bumping it past 1 does so
+     * with the thread lock held, so a releaser that sees it above 1 will find us on
+     * the wait queue once it grabs the thread lock. */
+    if (unlikely(atomic_add(&m->count, 1) > 0)) {
         status_t ret = wait_queue_block(&m->wait, INFINITE_TIME);
         if (unlikely(ret < NO_ERROR)) {
             /* mutexes are not interruptable and cannot time out, so it
@@ -75,6 +81,51 @@ status_t mutex_acquire_internal(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
     return NO_ERROR;
 }
 
+/* try to grab an unheld mutex without touching the thread lock */
+static inline bool mutex_try_acquire_fast(mutex_t *m)
+{
+    int expected = 0;
+    if (atomic_cmpxchg(&m->count, &expected, 1)) {
+        m->holder = get_current_thread();
+        return true;
+    }
+    return false;
+}
+
+#if WITH_SMP
+/* If the holder is running on another cpu it is likely to drop the mutex soon,
+ * so spin for a bit waiting for it rather than going through the thread lock and
+ * blocking. Give up as soon as anyone queues up behind it, or the holder stops
+ * running.
+ */
+static bool mutex_spin_acquire(mutex_t *m)
+{
+    uint curr_cpu = arch_curr_cpu_num();
+
+    for (uint i = 0; i < MUTEX_SPIN_MAX_ITERATIONS; i++) {
+        if (mutex_try_acquire_fast(m))
+            return true;
+
+        if (atomic_load_relaxed(&m->count) > 1)
+            return false;
+
+        /* the holder is read racily and may have dropped the mutex and exited by the
+         * time we look at it, so this is only a hint. the kernel heap lives in the
+         * physmap, so a stale thread structure is still safe to read. */
+        thread_t *holder = ((volatile mutex_t *)m)->holder;
+        if (holder) {
+            if (((volatile thread_t *)holder)->state != THREAD_RUNNING ||
+                thread_last_cpu((volatile thread_t *)holder) == curr_cpu)
+                return false;
+        }
+
+        arch_spinloop_pause();
+    }
+
+    return false;
+}
+#endif
+
 /**
  * @brief  Acquire the mutex
  *
@@ -91,6 +142,14 @@ status_t mutex_acquire(mutex_t *m)
               get_current_thread(), get_current_thread()->name, m);
 #endif
 
+    if (likely(mutex_try_acquire_fast(m)))
+        return NO_ERROR;
+
+#if WITH_SMP
+    if (mutex_spin_acquire(m))
+        return NO_ERROR;
+#endif
+
     THREAD_LOCK(state);
     status_t ret = mutex_acquire_internal(m);
     THREAD_UNLOCK(state);
@@ -104,7 +163,7 @@ void mutex_release_internal(mutex_t *m, bool reschedule) TA_NO_THREAD_SAFETY_ANA
 
     m->holder = 0;
 
-    if (unlikely(--m->count >= 1)) {
+    if (unlikely(atomic_add(&m->count, -1) > 1)) {
         /* release a thread */
         wait_queue_wake_one(&m->wait, reschedule, NO_ERROR);
     }
@@ -125,6 +184,12 @@ void mutex_release(mutex_t *m)
     }
 #endif
 
+    /* nobody is waiting, drop it without touching the thread lock */
+    m->holder = 0;
+    int expected = 1;
+    if (likely(atomic_cmpxchg(&m->count, &expected, 0)))
+        return;
+
     THREAD_LOCK(state);
     mutex_release_internal(m, true);
     THREAD_UNLOCK(state);
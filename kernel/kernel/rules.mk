@@ -21,6 +21,7 @@ MODULE_SRCS := \
 	$(LOCAL_DIR)/debug.c \
 	$(LOCAL_DIR)/event.c \
 	$(LOCAL_DIR)/init.c \
+	$(LOCAL_DIR)/magazine.c \
 	$(LOCAL_DIR)/mutex.c \
 	$(LOCAL_DIR)/sched.c \
 	$(LOCAL_DIR)/thread.c \
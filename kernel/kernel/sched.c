@@ -19,26 +19,44 @@
 /* legacy implementation that just broadcast ipis for every reschedule */
 #define BROADCAST_RESCHEDULE 0
 
-/* the run queue */
-static struct list_node run_queue[NUM_PRIORITIES];
-static uint32_t run_queue_bitmap;
+/* per cpu run queue, each with its own priority bitmap.
+ * only safely accessible with the thread lock held. every queue is still
+ * guarded by the one global thread lock, so splitting them spreads threads
+ * across cpus and keeps wakeups local, but does not by itself cut lock
+ * contention between cpus.
+ */
+struct run_queue {
+    struct list_node queue[NUM_PRIORITIES];
+    uint32_t bitmap;
+
+    /* number of threads currently sitting in this run queue */
+    uint count;
+
+    /* priority of the thread currently running on this cpu */
+    int curr_priority;
+} __CPU_ALIGN;
+
+static struct run_queue run_queues[SMP_MAX_CPUS];
 
 /* make sure the bitmap is large enough to cover our number of priorities */
-static_assert(NUM_PRIORITIES <= sizeof(run_queue_bitmap) * CHAR_BIT, "");
+static_assert(NUM_PRIORITIES <= sizeof(((struct run_queue *)0)->bitmap) * CHAR_BIT, "");
 
-/* pick a 'random' cpu */
-static mp_cpu_mask_t rand_cpu(const mp_cpu_mask_t mask)
+/* return the highest priority with a thread in it from a run queue bitmap */
+static inline uint highest_run_queue(uint32_t bitmap)
 {
-    if (unlikely(mask == 0))
-        return 0;
+    DEBUG_ASSERT(bitmap != 0);
+    return HIGHEST_PRIORITY - __builtin_clz(bitmap)
+           - (sizeof(bitmap) * CHAR_BIT - NUM_PRIORITIES);
+}
 
-    /* check that the mask passed in has at least one bit set in the online mask */
-    mp_cpu_mask_t online = mp_get_online_mask();
-    if (unlikely((mask & online) == 0))
-        return 0;
+#if WITH_SMP
+/* pick a 'random' cpu */
+static uint rand_cpu(const mp_cpu_mask_t mask)
+{
+    DEBUG_ASSERT(mask != 0);
 
-    /* compute the highest online cpu */
-    uint highest_cpu = (sizeof(mp_cpu_mask_t) * CHAR_BIT - 1) - __builtin_clz(online);
+    /* compute the highest cpu in the mask */
+    uint highest_cpu = (sizeof(mp_cpu_mask_t) * CHAR_BIT - 1) - __builtin_clz(mask);
 
     /* not very random, round robins a bit through the mask until it gets a hit */
     for (;;) {
@@ -49,56 +67,105 @@ static mp_cpu_mask_t rand_cpu(const mp_cpu_mask_t mask)
             rot = 0;
 
         if ((1u << rot) & mask)
-            return (1u << rot);
+            return rot;
     }
 }
 
-/* find a cpu to wake up */
-static mp_cpu_mask_t find_cpu(thread_t *t)
+/* return the cpu in the mask with the fewest queued threads, preferring the hint on ties */
+static uint least_loaded_cpu(mp_cpu_mask_t mask, uint hint)
 {
-#if BROADCAST_RESCHEDULE
-    return MP_CPU_ALL_BUT_LOCAL;
-#elif WITH_SMP
+    DEBUG_ASSERT(mask != 0);
+
+    uint best = (mask & (1u << hint)) ? hint : (uint)__builtin_ctz(mask);
+    for (uint cpu = 0; mask != 0; cpu++, mask >>= 1) {
+        if ((mask & 1) && run_queues[cpu].count < run_queues[best].count)
+            best = cpu;
+    }
+    return best;
+}
+
+/* return the cpu in the mask running the lowest priority thread */
+static uint lowest_priority_cpu(mp_cpu_mask_t mask)
+{
+    DEBUG_ASSERT(mask != 0);
+
+    uint best = __builtin_ctz(mask);
+    for (uint cpu = 0; mask != 0; cpu++, mask >>= 1) {
+        if ((mask & 1) && run_queues[cpu].curr_priority < run_queues[best].curr_priority)
+            best = cpu;
+    }
+    return best;
+}
+#endif
+
+/* find a cpu whose run queue the thread should be placed in */
+static uint find_cpu(thread_t *t)
+{
+#if WITH_SMP
+    uint curr_cpu = arch_curr_cpu_num();
+
+    /* pinned threads only ever run on their cpu */
+    if (unlikely(thread_pinned_cpu(t) >= 0))
+        return thread_pinned_cpu(t);
+
+    /* nothing has come up yet, keep everything local */
+    mp_cpu_mask_t active_mask = mp_get_active_mask();
+    if (unlikely(active_mask == 0))
+        return curr_cpu;
+
     /* get the last cpu the thread ran on */
-    mp_cpu_mask_t last_ran_cpu_mask = (1u << thread_last_cpu(t));
+    uint last_cpu = thread_last_cpu(t);
+    mp_cpu_mask_t last_ran_cpu_mask = (1u << last_cpu);
 
     /* the current cpu */
-    mp_cpu_mask_t curr_cpu_mask = (1u << arch_curr_cpu_num());
+    mp_cpu_mask_t curr_cpu_mask = (1u << curr_cpu);
 
     /* get a list of idle cpus */
-    mp_cpu_mask_t idle_cpu_mask = mp_get_idle_mask();
+    mp_cpu_mask_t idle_cpu_mask = mp_get_idle_mask() & active_mask;
     if (idle_cpu_mask != 0) {
+        uint cpu;
         if (idle_cpu_mask & curr_cpu_mask) {
             /* the current cpu is idle, so run it here */
-            return 0;
-        }
-
-        if (last_ran_cpu_mask & idle_cpu_mask) {
+            cpu = curr_cpu;
+        } else if (last_ran_cpu_mask & idle_cpu_mask) {
             /* the last core it ran on is idle and isn't the current cpu */
-            return last_ran_cpu_mask;
+            cpu = last_cpu;
+        } else {
+            /* pick an idle_cpu */
+            cpu = rand_cpu(idle_cpu_mask);
         }
 
-        /* pick an idle_cpu */
-        return rand_cpu(idle_cpu_mask);
+        /* claim the cpu so that other wakeups before it reschedules spread out.
+         * if the thread is stolen before then, the cpu marks itself idle again
+         * when it reschedules back into its idle thread.
+         */
+        mp_set_cpu_busy(cpu);
+        return cpu;
     }
 
-    /* no idle cpus */
-    if (last_ran_cpu_mask == curr_cpu_mask) {
-        /* the last cpu it ran on is us */
-        /* pick a random cpu that isn't the current one */
-        return rand_cpu(mp_get_online_mask() & ~(curr_cpu_mask));
-    } else {
-        /* pick the last cpu it ran on */
-        return last_ran_cpu_mask;
-    }
+    /* no idle cpus. avoid cpus running realtime threads, they won't take a reschedule ipi */
+    uint cpu = (active_mask & last_ran_cpu_mask) ? last_cpu : curr_cpu;
+    mp_cpu_mask_t candidates = active_mask & ~mp_get_realtime_mask();
+    if (candidates == 0)
+        return cpu;
+
+    /* stay where the cache is warm if we'd preempt what's running there */
+    if ((candidates & (1u << cpu)) && t->priority > run_queues[cpu].curr_priority)
+        return cpu;
+
+    /* otherwise find something we'd preempt, or failing that the shortest queue */
+    uint lowest = lowest_priority_cpu(candidates);
+    if (t->priority > run_queues[lowest].curr_priority)
+        return lowest;
+
+    return least_loaded_cpu(candidates, cpu);
 #else /* !WITH_SMP */
-    /* no smp, dont send an IPI */
     return 0;
 #endif
 }
 
 /* run queue manipulation */
-static void insert_in_run_queue_head(thread_t *t)
+static void insert_in_run_queue_head(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -106,11 +173,14 @@ static void insert_in_run_queue_head(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_head(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    struct run_queue *rq = &run_queues[cpu];
+    list_add_head(&rq->queue[t->priority], &t->queue_node);
+    t->queued_cpu = cpu;
+    rq->bitmap |= (1<<t->priority);
+    rq->count++;
 }
 
-static void insert_in_run_queue_tail(thread_t *t)
+static void insert_in_run_queue_tail(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -118,38 +188,96 @@ static void insert_in_run_queue_tail(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_tail(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    struct run_queue *rq = &run_queues[cpu];
+    list_add_tail(&rq->queue[t->priority], &t->queue_node);
+    t->queued_cpu = cpu;
+    rq->bitmap |= (1<<t->priority);
+    rq->count++;
 }
 
-thread_t *sched_get_top_thread(uint cpu)
+static void remove_from_run_queue(struct run_queue *rq, thread_t *t)
+{
+    DEBUG_ASSERT(rq->count > 0);
+
+    list_delete(&t->queue_node);
+    if (list_is_empty(&rq->queue[t->priority]))
+        rq->bitmap &= ~(1<<t->priority);
+    rq->count--;
+}
+
+/* take the highest priority thread out of a run queue that is allowed to run on cpu */
+static thread_t *dequeue_top_thread(struct run_queue *rq, uint cpu)
 {
-    thread_t *newthread;
-    uint32_t local_run_queue_bitmap = run_queue_bitmap;
+    thread_t *t;
+    uint32_t local_run_queue_bitmap = rq->bitmap;
 
     while (local_run_queue_bitmap) {
         /* find the first (remaining) queue with a thread in it */
-        uint next_queue = HIGHEST_PRIORITY - __builtin_clz(local_run_queue_bitmap)
-                          - (sizeof(run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
+        uint next_queue = highest_run_queue(local_run_queue_bitmap);
 
-        list_for_every_entry(&run_queue[next_queue], newthread, thread_t, queue_node) {
+        list_for_every_entry(&rq->queue[next_queue], t, thread_t, queue_node) {
 #if WITH_SMP
-            if (likely(newthread->pinned_cpu < 0) || (uint)newthread->pinned_cpu == cpu)
+            if (likely(t->pinned_cpu < 0) || (uint)t->pinned_cpu == cpu)
 #endif
             {
-                list_delete(&newthread->queue_node);
-
-                if (list_is_empty(&run_queue[next_queue]))
-                    run_queue_bitmap &= ~(1<<next_queue);
-
-                return newthread;
+                remove_from_run_queue(rq, t);
+                return t;
             }
         }
 
         local_run_queue_bitmap &= ~(1<<next_queue);
     }
-    /* no threads to run, select the idle thread for this cpu */
-    return &idle_threads[cpu];
+
+    return NULL;
+}
+
+#if WITH_SMP
+/* we're about to go idle, try to take a thread from the busiest other cpu */
+static thread_t *steal_thread(uint cpu)
+{
+    /* find the cpu with the most queued threads */
+    uint busiest = cpu;
+    uint busiest_count = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (i != cpu && run_queues[i].count > busiest_count) {
+            busiest = i;
+            busiest_count = run_queues[i].count;
+        }
+    }
+    if (busiest_count == 0)
+        return NULL;
+
+    thread_t *t = dequeue_top_thread(&run_queues[busiest], cpu);
+
+    /* everything queued there may be pinned, fall back to anything else we can run */
+    for (uint i = 0; !t && i < SMP_MAX_CPUS; i++) {
+        if (i != cpu && i != busiest && run_queues[i].count != 0)
+            t = dequeue_top_thread(&run_queues[i], cpu);
+    }
+
+    if (t)
+        THREAD_STATS_INC(steals);
+    return t;
+}
+#endif
+
+thread_t *sched_get_top_thread(uint cpu)
+{
+    struct run_queue *rq = &run_queues[cpu];
+
+    thread_t *newthread = dequeue_top_thread(rq, cpu);
+#if WITH_SMP
+    if (!newthread) {
+        newthread = steal_thread(cpu);
+    }
+#endif
+    if (!newthread) {
+        /* no threads to run, select the idle thread for this cpu */
+        newthread = &idle_threads[cpu];
+    }
+
+    rq->curr_priority = newthread->priority;
+    return newthread;
 }
 
 void sched_block(void)
@@ -166,6 +294,21 @@ void sched_block(void)
     thread_resched();
 }
 
+/* stuff a newly runnable thread in a run queue and kick the cpu that owns it */
+static void enqueue_ready_thread(thread_t *t)
+{
+    t->state = THREAD_READY;
+
+    uint cpu = find_cpu(t);
+    insert_in_run_queue_head(cpu, t);
+
+#if BROADCAST_RESCHEDULE
+    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+#else
+    mp_reschedule(1u << cpu, 0);
+#endif
+}
+
 void sched_unblock(thread_t *t, bool resched)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
@@ -179,14 +322,18 @@ void sched_unblock(thread_t *t, bool resched)
         thread_t *current_thread = get_current_thread();
 
         current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
+        insert_in_run_queue_head(arch_curr_cpu_num(), current_thread);
     }
 
-    /* stuff the new thread in the run queue */
-    t->state = THREAD_READY;
-    insert_in_run_queue_head(t);
-
-    mp_reschedule(find_cpu(t), 0);
+    /* stuff the new thread in the run queue. if we're about to reschedule, keep it
+     * local so it runs ahead of the current thread like the caller asked for.
+     */
+    if (resched && thread_pinned_cpu(t) < 0) {
+        t->state = THREAD_READY;
+        insert_in_run_queue_head(arch_curr_cpu_num(), t);
+    } else {
+        enqueue_ready_thread(t);
+    }
 
     if (resched)
         thread_resched();
@@ -205,7 +352,7 @@ void sched_unblock_list(struct list_node *list, bool resched)
         thread_t *current_thread = get_current_thread();
 
         current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
+        insert_in_run_queue_head(arch_curr_cpu_num(), current_thread);
     }
 
     /* pop the list of threads and shove into the scheduler */
@@ -215,10 +362,7 @@ void sched_unblock_list(struct list_node *list, bool resched)
         DEBUG_ASSERT(!thread_is_idle(t));
 
         /* stuff the new thread in the run queue */
-        t->state = THREAD_READY;
-        insert_in_run_queue_head(t);
-
-        mp_reschedule(find_cpu(t), 0);
+        enqueue_ready_thread(t);
     }
 
     if (resched)
@@ -234,7 +378,7 @@ void sched_yield(void)
     current_thread->state = THREAD_READY;
     current_thread->remaining_time_slice = 0;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
-        insert_in_run_queue_tail(current_thread);
+        insert_in_run_queue_tail(arch_curr_cpu_num(), current_thread);
     }
     thread_resched();
 }
@@ -242,22 +386,55 @@ void sched_yield(void)
 void sched_preempt(void)
 {
     thread_t *current_thread = get_current_thread();
+    uint cpu = arch_curr_cpu_num();
 
     /* we are being preempted, so we get to go back into the front of the run queue if we have quantum left */
     current_thread->state = THREAD_READY;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
         if (current_thread->remaining_time_slice > 0)
-            insert_in_run_queue_head(current_thread);
+            insert_in_run_queue_head(cpu, current_thread);
         else
-            insert_in_run_queue_tail(current_thread); /* if we're out of quantum, go to the tail of the queue */
+            insert_in_run_queue_tail(cpu, current_thread); /* if we're out of quantum, go to the tail of the queue */
     }
     sched_block();
 }
 
+/* change a thread's effective priority, wherever it is */
+void sched_change_priority(thread_t *t, int priority)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    if (t->priority == priority || thread_is_idle(t))
+        return;
+
+    int old_priority = t->priority;
+    if (t->state == THREAD_READY && list_in_list(&t->queue_node)) {
+        /* move it to the list for its new priority in the same run queue */
+        uint cpu = t->queued_cpu;
+        remove_from_run_queue(&run_queues[cpu], t);
+        t->priority = priority;
+        insert_in_run_queue_tail(cpu, t);
+        if (priority > run_queues[cpu].curr_priority && cpu != arch_curr_cpu_num())
+            mp_reschedule(1u << cpu, 0);
+    } else if (t->state == THREAD_RUNNING) {
+        t->priority = priority;
+        uint cpu = thread_last_cpu(t);
+        run_queues[cpu].curr_priority = priority;
+        /* something queued there may now outrank it */
+        if (priority < old_priority && cpu != arch_curr_cpu_num())
+            mp_reschedule(1u << cpu, 0);
+    } else {
+        /* blocked or sleeping, it'll be queued at the new priority when it wakes */
+        t->priority = priority;
+    }
+}
+
 void sched_init_early(void)
 {
     /* initialize the run queues */
-    for (int i=0; i < NUM_PRIORITIES; i++)
-        list_initialize(&run_queue[i]);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        for (int i=0; i < NUM_PRIORITIES; i++)
+            list_initialize(&run_queues[cpu].queue[i]);
+    }
 }
-
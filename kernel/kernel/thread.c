@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <list.h>
 #include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
 #include <printf.h>
 #include <err.h>
@@ -147,6 +148,7 @@ thread_t *thread_create_etc(
     t->entry = entry;
     t->arg = arg;
     t->priority = priority;
+    t->base_priority = priority;
     t->state = THREAD_SUSPENDED;
     t->signals = 0;
     t->blocking_wait_queue = NULL;
@@ -549,8 +551,14 @@ void thread_resched(void)
     thread_t *oldthread = current_thread;
 
     /* if it's the same thread as we're already running, exit */
-    if (newthread == oldthread)
+    if (newthread == oldthread) {
+        /* a wakeup may have claimed this cpu and then had its thread stolen
+         * by another cpu before we got here, so an idle cpu staying idle
+         * has to put itself back in the idle mask */
+        if (thread_is_idle(newthread))
+            mp_set_cpu_idle(cpu);
         return;
+    }
 
     lk_bigtime_t now = current_time_hires();
     oldthread->runtime_ns += now - oldthread->last_started_running;
@@ -846,6 +854,7 @@ void thread_construct_first(thread_t *t, const char *name)
 
     init_thread_struct(t, name);
     t->priority = HIGHEST_PRIORITY;
+    t->base_priority = HIGHEST_PRIORITY;
     t->state = THREAD_RUNNING;
     t->flags = THREAD_FLAG_DETACHED;
     t->signals = 0;
@@ -921,13 +930,32 @@ void thread_set_priority(int priority)
         priority = IDLE_PRIORITY + 1;
     if (priority > HIGHEST_PRIORITY)
         priority = HIGHEST_PRIORITY;
-    current_thread->priority = priority;
+    current_thread->base_priority = priority;
+    current_thread->priority = MAX(priority, current_thread->inherited_priority);
 
     sched_preempt();
 
     THREAD_UNLOCK(state);
 }
 
+/**
+ * @brief Set the priority a thread inherits from threads blocked on it
+ *
+ * Used for priority inheritance: while a thread holds something that
+ * higher priority threads are waiting for, it runs at the highest of their
+ * priorities.  Pass 0 once nothing is waiting on it any more.  The thread
+ * lock must be held.
+ */
+void thread_set_inherited_priority_locked(thread_t *t, int priority)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(priority >= 0 && priority <= HIGHEST_PRIORITY);
+
+    t->inherited_priority = priority;
+    sched_change_priority(t, MAX(t->base_priority, priority));
+}
+
 /**
  * @brief  Become an idle thread
  *
@@ -947,6 +975,7 @@ void thread_become_idle(void)
 
     /* mark ourself as idle */
     t->priority = IDLE_PRIORITY;
+    t->base_priority = IDLE_PRIORITY;
     t->flags |= THREAD_FLAG_IDLE;
     thread_set_pinned_cpu(t, arch_curr_cpu_num());
 
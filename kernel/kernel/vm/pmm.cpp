@@ -6,15 +6,21 @@
 // https://opensource.org/licenses/MIT
 
 #include "vm_priv.h"
+#include <arch/ops.h>
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
+#include <kernel/event.h>
+#include <kernel/magazine.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/vm.h>
 #include <lib/console.h>
 #include <list.h>
+#include <lk/init.h>
 #include <new.h>
 #include <pow2.h>
 #include <stdlib.h>
@@ -31,6 +37,44 @@
 static mxtl::DoublyLinkedList<PmmArena*> arena_list;
 static Mutex arena_lock;
 
+// Pages that have already been zeroed, so that PMM_ALLOC_FLAG_ZEROED
+// allocations don't have to clear them on the spot.  Whenever the pool drops
+// below the low watermark a lowest priority thread tops it back up to the high
+// one, so the zeroing mostly happens on otherwise idle cpus.  Pages in the
+// pool come out of KMAP arenas so they can be cleared through the kernel
+// mapping, and still count as free memory.
+#define ZEROED_POOL_LOW_WATERMARK 64
+#define ZEROED_POOL_HIGH_WATERMARK 256
+
+// guarded by zeroed_pool_lock
+static spin_lock_t zeroed_pool_lock = SPIN_LOCK_INITIAL_VALUE;
+static struct list_node zeroed_pool = LIST_INITIAL_VALUE(zeroed_pool);
+static size_t zeroed_pool_count;
+static struct {
+    uint64_t hits;        // zeroed pages handed out of the pool
+    uint64_t misses;      // zeroed allocations the pool couldn't fully cover
+    uint64_t sync_zeroed; // pages zeroed by the allocating thread
+    uint64_t bg_zeroed;   // pages zeroed by the pool thread
+} zeroed_pool_stats;
+
+static event_t zeroed_pool_event =
+    EVENT_INITIAL_VALUE(zeroed_pool_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+// Per-cpu caches of free pages.  Most allocations and frees are a page or two
+// and only touch the current cpu's magazine (see kernel/magazine.h); pages move
+// between it and the arenas in batches under a single hold of arena_lock.
+// Pages in a magazine are in the FREE state but are not on their arena's free
+// list.  KMAP allocations skip the magazines, since frees put pages from any
+// arena into them.
+static size_t page_depot_alloc(void* ctx, void** pages, size_t count);
+static void page_depot_free(void* ctx, void** pages, size_t count);
+
+static const struct magazine_depot page_depot = {
+    page_depot_alloc, page_depot_free, nullptr,
+};
+
+static struct magazine_set page_magazines = { &page_depot, {} };
+
 paddr_t vm_page_to_paddr(const vm_page_t* page) {
     for (const auto& a : arena_list) {
         // LTRACEF("testing page %p against arena %p\n", page, &a);
@@ -79,25 +123,204 @@ done_add:
     return NO_ERROR;
 }
 
-vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
-    AutoLock al(arena_lock);
+// allocate up to |count| pages out of the arenas, must hold arena_lock
+static size_t alloc_pages_locked(size_t count, uint alloc_flags, struct list_node* list) {
+    if (count == 0)
+        return 0;
 
-    /* walk the arenas in order until we find one with a free page */
+    /* walk the arenas in order, allocating as many pages as we can from each */
+    size_t allocated = 0;
     for (auto& a : arena_list) {
+        DEBUG_ASSERT(count > allocated);
+
         /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
         if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
             if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
                 continue;
         }
 
-        // try to allocate the page out of the arena
-        vm_page_t* page = a.AllocPage(pa);
-        if (page)
-            return page;
+        // ask the arena to allocate some pages
+        allocated += a.AllocPages(count - allocated, list);
+        DEBUG_ASSERT(allocated <= count);
+        if (allocated == count)
+            break;
+    }
+
+    return allocated;
+}
+
+// give a list of pages back to their arenas, must hold arena_lock
+static size_t free_pages_locked(struct list_node* list) {
+    size_t count = 0;
+    vm_page_t* page;
+    while ((page = list_remove_head_type(list, vm_page_t, free.node))) {
+        /* see which arena this page belongs to and add it */
+        for (auto& a : arena_list) {
+            if (a.FreePage(page) >= 0) {
+                count++;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+static bool page_belongs_to_any_arena(const vm_page_t* page) {
+    for (const auto& a : arena_list) {
+        if (a.page_belongs_to_arena(page))
+            return true;
+    }
+    return false;
+}
+
+// move up to |count| pages from the zeroed pool to |list|, only counting
+// towards the pool's hits and misses if the caller asked for zeroed pages
+static size_t zeroed_pool_take(size_t count, struct list_node* list, bool zeroed) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&zeroed_pool_lock, state);
+
+    size_t taken = 0;
+    while (taken < count) {
+        vm_page_t* page = list_remove_head_type(&zeroed_pool, vm_page_t, free.node);
+        if (!page)
+            break;
+        zeroed_pool_count--;
+        list_add_tail(list, &page->free.node);
+        taken++;
+    }
+
+    if (zeroed) {
+        zeroed_pool_stats.hits += taken;
+        if (taken < count)
+            zeroed_pool_stats.misses++;
     }
 
-    LTRACEF("failed to allocate page\n");
-    return nullptr;
+    bool refill = zeroed_pool_count < ZEROED_POOL_LOW_WATERMARK;
+
+    spin_unlock_irqrestore(&zeroed_pool_lock, state);
+
+    if (refill)
+        event_signal(&zeroed_pool_event, false);
+
+    return taken;
+}
+
+static void zero_page(vm_page_t* page) {
+    void* ptr = paddr_to_kvaddr(vm_page_to_paddr(page));
+    DEBUG_ASSERT(ptr);
+
+    arch_zero_page(ptr);
+}
+
+// zero every page on |list| on the spot
+static void zero_pages_sync(struct list_node* list) {
+    size_t count = 0;
+    vm_page_t* page;
+    list_for_every_entry (list, page, vm_page_t, free.node) {
+        zero_page(page);
+        count++;
+    }
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&zeroed_pool_lock, state);
+    zeroed_pool_stats.sync_zeroed += count;
+    spin_unlock_irqrestore(&zeroed_pool_lock, state);
+}
+
+static size_t page_depot_alloc(void* ctx, void** pages, size_t count) {
+    struct list_node list;
+    list_initialize(&list);
+    {
+        AutoLock al(arena_lock);
+        alloc_pages_locked(count, PMM_ALLOC_FLAG_ANY, &list);
+    }
+
+    size_t allocated = 0;
+    vm_page_t* page;
+    while ((page = list_remove_head_type(&list, vm_page_t, free.node))) {
+        page->state = VM_PAGE_STATE_FREE;
+        pages[allocated++] = page;
+    }
+    return allocated;
+}
+
+static void page_depot_free(void* ctx, void** pages, size_t count) {
+    struct list_node list;
+    list_initialize(&list);
+    for (size_t i = 0; i < count; i++)
+        list_add_tail(&list, &static_cast<vm_page_t*>(pages[i])->free.node);
+
+    AutoLock al(arena_lock);
+    free_pages_locked(&list);
+}
+
+// allocate up to |count| pages out of the current cpu's magazine, refilling
+// it from the arenas if it runs dry
+static size_t page_cache_alloc(size_t count, struct list_node* list) {
+    void* pages[MAGAZINE_BATCH];
+    size_t allocated = magazine_alloc(&page_magazines, pages, MIN(count, countof(pages)));
+
+    for (size_t i = 0; i < allocated; i++) {
+        vm_page_t* page = static_cast<vm_page_t*>(pages[i]);
+        DEBUG_ASSERT(page_is_free(page));
+        page->state = VM_PAGE_STATE_ALLOC;
+        list_add_tail(list, &page->free.node);
+    }
+    return allocated;
+}
+
+// put a list of pages into the current cpu's magazine
+static size_t page_cache_free(struct list_node* list) {
+    size_t count = 0;
+    for (;;) {
+        void* pages[MAGAZINE_BATCH];
+        size_t batch = 0;
+        vm_page_t* page;
+        while (batch < countof(pages) &&
+               (page = list_remove_head_type(list, vm_page_t, free.node))) {
+            DEBUG_ASSERT(!page_is_free(page));
+
+            if (!page_belongs_to_any_arena(page))
+                continue;
+
+            page->state = VM_PAGE_STATE_FREE;
+            pages[batch++] = page;
+        }
+        if (batch == 0)
+            return count;
+
+        magazine_free(&page_magazines, pages, batch);
+        count += batch;
+    }
+}
+
+// give every free page parked outside the arenas, in the magazines or the
+// zeroed pool, back to them so that searches for specific pages see it
+static void return_parked_pages() {
+    magazine_drain_all(&page_magazines);
+
+    struct list_node list;
+    list_initialize(&list);
+    zeroed_pool_take(SIZE_MAX, &list, false);
+
+    AutoLock al(arena_lock);
+    free_pages_locked(&list);
+}
+
+vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
+    struct list_node list;
+    list_initialize(&list);
+
+    if (pmm_alloc_pages(1, alloc_flags, &list) == 0) {
+        LTRACEF("failed to allocate page\n");
+        return nullptr;
+    }
+
+    vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+    if (pa)
+        *pa = vm_page_to_paddr(page);
+
+    return page;
 }
 
 size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
@@ -109,24 +332,35 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     if (count == 0)
         return 0;
 
-    AutoLock al(arena_lock);
+    const bool zeroed = (alloc_flags & PMM_ALLOC_FLAG_ZEROED);
 
-    /* walk the arenas in order, allocating as many pages as we can from each */
     size_t allocated = 0;
-    for (auto& a : arena_list) {
-        DEBUG_ASSERT(count > allocated);
+    if (zeroed)
+        allocated = zeroed_pool_take(count, list, true);
 
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
-        }
+    // anything else comes out of the caches or the arenas and may need zeroing
+    struct list_node fresh;
+    list_initialize(&fresh);
+    struct list_node* target = zeroed ? &fresh : list;
 
-        // ask the arena to allocate some pages
-        allocated += a.AllocPages(count - allocated, list);
-        DEBUG_ASSERT(allocated <= count);
-        if (allocated == count)
-            break;
+    if (!(alloc_flags & PMM_ALLOC_FLAG_KMAP))
+        allocated += page_cache_alloc(count - allocated, target);
+
+    if (allocated < count) {
+        AutoLock al(arena_lock);
+        allocated += alloc_pages_locked(count - allocated, alloc_flags, target);
+    }
+
+    // the pool is still free memory, dip into it if everything else ran dry
+    if (allocated < count)
+        allocated += zeroed_pool_take(count - allocated, list, false);
+
+    if (zeroed && !list_is_empty(&fresh)) {
+        zero_pages_sync(&fresh);
+
+        vm_page_t* page;
+        while ((page = list_remove_head_type(&fresh, vm_page_t, free.node)))
+            list_add_tail(list, &page->free.node);
     }
 
     return allocated;
@@ -141,40 +375,42 @@ size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
 
     address = ROUNDDOWN(address, PAGE_SIZE);
 
-    AutoLock al(arena_lock);
+    // the pages we want may be parked outside the arenas, in which case give
+    // them back and carry on from where we stopped
+    for (bool retried = false;; retried = true) {
+        {
+            AutoLock al(arena_lock);
 
-    /* walk through the arenas, looking to see if the physical page belongs to it */
-    for (auto& a : arena_list) {
-        while (allocated < count && a.address_in_arena(address)) {
-            vm_page_t* page = a.AllocSpecific(address);
-            if (!page)
-                break;
+            /* walk through the arenas, looking to see if the physical page belongs to it */
+            for (auto& a : arena_list) {
+                while (allocated < count && a.address_in_arena(address)) {
+                    vm_page_t* page = a.AllocSpecific(address);
+                    if (!page)
+                        break;
+
+                    if (list)
+                        list_add_tail(list, &page->free.node);
 
-            if (list)
-                list_add_tail(list, &page->free.node);
+                    allocated++;
+                    address += PAGE_SIZE;
+                }
 
-            allocated++;
-            address += PAGE_SIZE;
+                if (allocated == count)
+                    break;
+            }
         }
 
-        if (allocated == count)
+        if (allocated == count || retried)
             break;
+        return_parked_pages();
     }
 
     return allocated;
 }
 
-size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_log2, paddr_t* pa,
-                            struct list_node* list) {
-    LTRACEF("count %zu, align %u\n", count, alignment_log2);
-
-    if (count == 0)
-        return 0;
-    if (alignment_log2 < PAGE_SIZE_SHIFT)
-        alignment_log2 = PAGE_SIZE_SHIFT;
-
-    AutoLock al(arena_lock);
-
+// find a run of pages in the arenas, must hold arena_lock
+static size_t alloc_contiguous_locked(size_t count, uint alloc_flags, uint8_t alignment_log2,
+                                      paddr_t* pa, struct list_node* list) {
     for (auto& a : arena_list) {
         /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
         if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
@@ -189,10 +425,58 @@ size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_lo
         }
     }
 
-    LTRACEF("couldn't find run\n");
     return 0;
 }
 
+size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_log2, paddr_t* pa,
+                            struct list_node* list) {
+    LTRACEF("count %zu, align %u\n", count, alignment_log2);
+
+    if (count == 0)
+        return 0;
+    if (alignment_log2 < PAGE_SIZE_SHIFT)
+        alignment_log2 = PAGE_SIZE_SHIFT;
+
+    paddr_t base;
+    size_t allocated;
+    {
+        AutoLock al(arena_lock);
+        allocated = alloc_contiguous_locked(count, alloc_flags, alignment_log2, &base, list);
+    }
+
+    // the pages we need may be parked outside the arenas, so give them back
+    // and try once more
+    if (allocated == 0) {
+        return_parked_pages();
+
+        AutoLock al(arena_lock);
+        allocated = alloc_contiguous_locked(count, alloc_flags, alignment_log2, &base, list);
+    }
+
+    if (allocated == 0) {
+        LTRACEF("couldn't find run\n");
+        return 0;
+    }
+
+    // a run can't come out of the pool, so always zero it here
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        void* ptr = paddr_to_kvaddr(base);
+        DEBUG_ASSERT(ptr);
+        for (size_t i = 0; i < allocated; i++)
+            arch_zero_page(static_cast<uint8_t*>(ptr) + i * PAGE_SIZE);
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&zeroed_pool_lock, state);
+        zeroed_pool_stats.misses++;
+        zeroed_pool_stats.sync_zeroed += allocated;
+        spin_unlock_irqrestore(&zeroed_pool_lock, state);
+    }
+
+    if (pa)
+        *pa = base;
+    return allocated;
+}
+
 /* physically allocate a run from arenas marked as KMAP */
 void* pmm_alloc_kpages(size_t count, struct list_node* list, paddr_t* _pa) {
     LTRACEF("count %zu\n", count);
@@ -267,24 +551,9 @@ size_t pmm_free(struct list_node* list) {
 
     DEBUG_ASSERT(list);
 
-    AutoLock al(arena_lock);
-
-    uint count = 0;
-    while (!list_is_empty(list)) {
-        vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
+    size_t count = page_cache_free(list);
 
-        DEBUG_ASSERT(!page_is_free(page));
-
-        /* see which arena this page belongs to and add it */
-        for (auto& a : arena_list) {
-            if (a.FreePage(page) >= 0) {
-                count++;
-                break;
-            }
-        }
-    }
-
-    LTRACEF("returning count %u\n", count);
+    LTRACEF("returning count %zu\n", count);
 
     return count;
 }
@@ -298,8 +567,13 @@ size_t pmm_free_page(vm_page_t* page) {
     return pmm_free(&list);
 }
 
+// pages that are free but parked in the zeroed pool or a per-cpu cache
+static size_t count_parked_pages() {
+    return zeroed_pool_count + magazine_cached(&page_magazines);
+}
+
 void pmm_dump_free() {
-    size_t free = 0u;
+    size_t free = count_parked_pages();
     for (const auto& a : arena_list) {
         free += a.free_count();
     }
@@ -308,14 +582,87 @@ void pmm_dump_free() {
 }
 
 size_t pmm_count_free_pages() {
-    size_t free = 0u;
     AutoLock al(arena_lock);
+    size_t free = count_parked_pages();
     for (const auto& a : arena_list) {
         free += a.free_count();
     }
     return free;
 }
 
+static int zeroed_pool_thread(void*) {
+    for (;;) {
+        event_wait(&zeroed_pool_event);
+
+        for (;;) {
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&zeroed_pool_lock, state);
+            bool full = zeroed_pool_count >= ZEROED_POOL_HIGH_WATERMARK;
+            spin_unlock_irqrestore(&zeroed_pool_lock, state);
+            if (full)
+                break;
+
+            struct list_node list;
+            list_initialize(&list);
+            size_t allocated;
+            {
+                AutoLock al(arena_lock);
+                allocated = alloc_pages_locked(1, PMM_ALLOC_FLAG_KMAP, &list);
+            }
+            if (allocated == 0)
+                break;
+
+            // zero it without any locks held so allocations can go on around us
+            vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+            zero_page(page);
+
+            spin_lock_irqsave(&zeroed_pool_lock, state);
+            list_add_tail(&zeroed_pool, &page->free.node);
+            zeroed_pool_count++;
+            zeroed_pool_stats.bg_zeroed++;
+            spin_unlock_irqrestore(&zeroed_pool_lock, state);
+        }
+    }
+
+    return 0;
+}
+
+static void pmm_init_zeroed_pool(uint level) {
+    thread_t* t = thread_create("pmm zeroer", &zeroed_pool_thread, nullptr,
+                                LOWEST_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_detach_and_resume(t);
+
+    // fill the pool up for the first time
+    event_signal(&zeroed_pool_event, false);
+}
+
+LK_INIT_HOOK(pmm_zeroed_pool, &pmm_init_zeroed_pool, LK_INIT_LEVEL_THREADING);
+
+static void pmm_dump_zeroed_pool() {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&zeroed_pool_lock, state);
+    size_t count = zeroed_pool_count;
+    auto stats = zeroed_pool_stats;
+    spin_unlock_irqrestore(&zeroed_pool_lock, state);
+
+    printf("zeroed pool: %zu pages (low %u, high %u)\n", count,
+           ZEROED_POOL_LOW_WATERMARK, ZEROED_POOL_HIGH_WATERMARK);
+    printf("\thits %" PRIu64 " misses %" PRIu64 " sync zeroed %" PRIu64
+           " background zeroed %" PRIu64 "\n",
+           stats.hits, stats.misses, stats.sync_zeroed, stats.bg_zeroed);
+}
+
+static void pmm_dump_page_caches() {
+    printf("%4s %8s %12s %10s %10s\n", "cpu", "cached", "hits", "refills", "drains");
+    for (uint i = 0; i < countof(page_magazines.mags); i++) {
+        const struct magazine& mag = page_magazines.mags[i];
+        if (mag.hits == 0 && mag.refills == 0 && mag.drains == 0)
+            continue;
+        printf("%4u %8zu %12" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+               i, mag.count, mag.hits, mag.refills, mag.drains);
+    }
+}
+
 extern "C"
 enum handler_return pmm_dump_timer(struct timer *t, lk_time_t, void *) {
     pmm_dump_free();
@@ -336,6 +683,8 @@ static int cmd_pmm(int argc, const cmd_args* argv) {
         printf("%s dump_alloced\n", argv[0].str);
         printf("%s free_alloced\n", argv[0].str);
         printf("%s free\n", argv[0].str);
+        printf("%s zeroed\n", argv[0].str);
+        printf("%s caches\n", argv[0].str);
         return ERR_INTERNAL;
     }
 
@@ -345,6 +694,10 @@ static int cmd_pmm(int argc, const cmd_args* argv) {
         for (auto& a : arena_list) {
             a.Dump(false);
         }
+    } else if (!strcmp(argv[1].str, "zeroed")) {
+        pmm_dump_zeroed_pool();
+    } else if (!strcmp(argv[1].str, "caches")) {
+        pmm_dump_page_caches();
     } else if (!strcmp(argv[1].str, "free")) {
         static bool show_mem = false;
         static timer_t timer;
@@ -32,16 +32,52 @@ void PmmArena::BootAllocArray() {
 
     page_array_ = (vm_page_t*)raw_page_array;
 
+    /* and a bitmap of which of them are free, with every page starting out free */
+    size_t map_words = ROUNDUP(page_count, kBitsPerWord) / kBitsPerWord;
+    free_map_ = static_cast<size_t*>(boot_alloc_mem(map_words * sizeof(size_t)));
+    memset(free_map_, 0, map_words * sizeof(size_t));
+
     /* add them to the free list */
     for (size_t i = 0; i < page_count; i++) {
         auto& p = page_array_[i];
 
         list_add_tail(&free_list_, &p.free.node);
+        MarkFree(i);
     }
 
     free_count_ += page_count;
 }
 
+size_t PmmArena::FindFree(size_t start, size_t end) const {
+    size_t i = start;
+    while (i < end) {
+        size_t word = free_map_[i / kBitsPerWord] >> (i % kBitsPerWord);
+        if (word == 0) {
+            /* nothing free in the rest of this word, skip to the next one */
+            i = ROUNDUP(i + 1, kBitsPerWord);
+            continue;
+        }
+        i += __builtin_ctzl(word);
+        break;
+    }
+    return MIN(i, end);
+}
+
+size_t PmmArena::FindAllocated(size_t start, size_t end) const {
+    size_t i = start;
+    while (i < end) {
+        size_t word = ~free_map_[i / kBitsPerWord] >> (i % kBitsPerWord);
+        if (word == 0) {
+            /* everything free in the rest of this word, skip to the next one */
+            i = ROUNDUP(i + 1, kBitsPerWord);
+            continue;
+        }
+        i += __builtin_ctzl(word);
+        break;
+    }
+    return MIN(i, end);
+}
+
 vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
     vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
     if (!page)
@@ -54,6 +90,7 @@ vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
     DEBUG_ASSERT(page_is_free(page));
 
     page->state = VM_PAGE_STATE_ALLOC;
+    MarkAllocated(page_index(page));
 
     if (pa) {
         /* compute the physical address of the page based on its offset into the arena */
@@ -74,15 +111,19 @@ vm_page_t* PmmArena::AllocSpecific(paddr_t pa) {
 
     DEBUG_ASSERT(index < size() / PAGE_SIZE);
 
-    vm_page_t* page = get_page(index);
-    if (!page_is_free(page)) {
+    /* pages sitting in a per-cpu cache are marked free but aren't ours to hand out */
+    if (!IsFree(index)) {
         /* we hit an allocated page */
         return nullptr;
     }
 
+    vm_page_t* page = get_page(index);
+    DEBUG_ASSERT(page_is_free(page));
+
     list_delete(&page->free.node);
 
     page->state = VM_PAGE_STATE_ALLOC;
+    MarkAllocated(index);
 
     DEBUG_ASSERT(free_count_ > 0);
 
@@ -108,6 +149,7 @@ size_t PmmArena::AllocPages(size_t count, list_node* list) {
         DEBUG_ASSERT(page_is_free(page));
 
         page->state = VM_PAGE_STATE_ALLOC;
+        MarkAllocated(page_index(page));
         list_add_tail(list, &page->free.node);
 
         allocated++;
@@ -117,7 +159,7 @@ size_t PmmArena::AllocPages(size_t count, list_node* list) {
 }
 
 size_t PmmArena::AllocContiguous(size_t count, uint8_t alignment_log2, paddr_t* pa, struct list_node* list) {
-    /* walk the list starting at alignment boundaries.
+    /* walk the free bitmap starting at alignment boundaries.
      * calculate the starting offset into this arena, based on the
      * base address of the arena to handle the case where the arena
      * is not aligned on the same boundary requested.
@@ -126,39 +168,41 @@ size_t PmmArena::AllocContiguous(size_t count, uint8_t alignment_log2, paddr_t*
     if (rounded_base < base() || rounded_base > base() + size() - 1)
         return 0;
 
-    paddr_t aligned_offset = (rounded_base - base()) / PAGE_SIZE;
-    paddr_t start = aligned_offset;
-    LTRACEF("starting search at aligned offset %#" PRIxPTR "\n", start);
+    const size_t page_count = size() / PAGE_SIZE;
+    const size_t align_pages = 1UL << (alignment_log2 - PAGE_SIZE_SHIFT);
+    const size_t aligned_offset = (rounded_base - base()) / PAGE_SIZE;
+    size_t start = aligned_offset;
+    LTRACEF("starting search at aligned offset %#zx\n", start);
     LTRACEF("arena base %#" PRIxPTR " size %zu\n", base(), size());
 
-retry:
     /* search while we're still within the arena and have a chance of finding a slot
        (start + count < end of arena) */
-    while ((start < size() / PAGE_SIZE) && ((start + count) <= size() / PAGE_SIZE)) {
-        vm_page_t* p = &page_array_[start];
-        for (uint i = 0; i < count; i++) {
-            if (!page_is_free(p)) {
-                /* this run is broken, break out of the inner loop.
-                 * start over at the next alignment boundary
-                 */
-                start = ROUNDUP(start - aligned_offset + i + 1, 1UL << (alignment_log2 - PAGE_SIZE_SHIFT)) +
-                        aligned_offset;
-                goto retry;
-            }
-            p++;
+    while (start + count <= page_count) {
+        /* skip ahead to the first free page, then to the next alignment boundary at or after it */
+        size_t first = FindFree(start, page_count);
+        start = ROUNDUP(first - aligned_offset, align_pages) + aligned_offset;
+        if (start + count > page_count)
+            break;
+
+        /* if the run is broken, start over at the next boundary after the allocated page */
+        size_t end = FindAllocated(start, start + count);
+        if (end != start + count) {
+            start = end + 1;
+            continue;
         }
 
         /* we found a run */
-        LTRACEF("found run from pn %" PRIuPTR " to %" PRIuPTR "\n", start, start + count);
+        LTRACEF("found run from pn %zu to %zu\n", start, start + count);
 
         /* remove the pages from the run out of the free list */
-        for (paddr_t i = start; i < start + count; i++) {
-            p = &page_array_[i];
+        for (size_t i = start; i < start + count; i++) {
+            vm_page_t* p = &page_array_[i];
             DEBUG_ASSERT(page_is_free(p));
             DEBUG_ASSERT(list_in_list(&p->free.node));
 
             list_delete(&p->free.node);
             p->state = VM_PAGE_STATE_ALLOC;
+            MarkAllocated(i);
 
             DEBUG_ASSERT(free_count_ > 0);
 
@@ -182,7 +226,10 @@ status_t PmmArena::FreePage(vm_page_t* page) {
     if (!page_belongs_to_arena(page))
         return ERR_NOT_FOUND;
 
+    DEBUG_ASSERT(!IsFree(page_index(page)));
+
     page->state = VM_PAGE_STATE_FREE;
+    MarkFree(page_index(page));
 
     list_add_head(&free_list_, &page->free.node);
     free_count_++;
@@ -50,6 +50,10 @@ public:
                 (page_addr < (page_array_base + (info_->size / PAGE_SIZE) * VM_PAGE_STRUCT_SIZE)));
     }
 
+    size_t page_index(const vm_page* page) const {
+        return page - page_array_;
+    }
+
     paddr_t page_address_from_arena(const vm_page* page) const {
         uintptr_t page_addr = reinterpret_cast<uintptr_t>(page);
         uintptr_t page_array_base = reinterpret_cast<uintptr_t>(page_array_);
@@ -62,9 +66,27 @@ public:
     }
 
 private:
+    static constexpr size_t kBitsPerWord = sizeof(size_t) * 8;
+
+    // the free bitmap has a bit set for every page sitting on free_list_
+    bool IsFree(size_t index) const {
+        return free_map_[index / kBitsPerWord] & (1UL << (index % kBitsPerWord));
+    }
+    void MarkFree(size_t index) {
+        free_map_[index / kBitsPerWord] |= (1UL << (index % kBitsPerWord));
+    }
+    void MarkAllocated(size_t index) {
+        free_map_[index / kBitsPerWord] &= ~(1UL << (index % kBitsPerWord));
+    }
+
+    // index of the first free (or allocated) page in [start, end), or end if there is none
+    size_t FindFree(size_t start, size_t end) const;
+    size_t FindAllocated(size_t start, size_t end) const;
+
     const pmm_arena_info_t* info_ = nullptr;
 
     vm_page_t* page_array_ = nullptr;
+    size_t* free_map_ = nullptr;
 
     size_t free_count_ = 0;
     list_node free_list_ = LIST_INITIAL_VALUE(free_list_);
@@ -11,6 +11,7 @@
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/thread.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
@@ -107,6 +108,9 @@ void vm_init_preheap(uint level) {
 void vm_init_postheap(uint level) {
     LTRACE_ENTRY;
 
+    vm_fault_around_pages = MIN(cmdline_get_uint32("vm.fault_around", VM_FAULT_AROUND_DEFAULT_PAGES),
+                                VM_FAULT_AROUND_MAX_PAGES);
+
     vmm_aspace_t* aspace = vmm_get_kernel_aspace();
 
     // we expect the kernel to be in a temporary mapping, define permanent
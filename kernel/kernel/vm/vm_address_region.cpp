@@ -332,7 +332,7 @@ size_t VmAddressRegion::AllocatedPagesLocked() const {
     return sum;
 }
 
-status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
+mxtl::RefPtr<VmMapping> VmAddressRegion::FindMappingLocked(vaddr_t va) {
     DEBUG_ASSERT(magic_ == kMagic);
     DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
 
@@ -340,17 +340,30 @@ status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
     while (1) {
         mxtl::RefPtr<VmAddressRegionOrMapping> next(vmar->FindRegionLocked(va));
         if (!next) {
-            return ERR_NOT_FOUND;
+            return nullptr;
         }
 
         if (next->is_mapping()) {
-            return next->PageFault(va, pf_flags);
+            return next->as_vm_mapping();
         }
 
         vmar = next->as_vm_address_region();
     }
 }
 
+status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags, VmUnmapList* unmap_list,
+                                   vm_page_t** spare) {
+    DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+
+    mxtl::RefPtr<VmMapping> mapping = FindMappingLocked(va);
+    if (!mapping) {
+        return ERR_NOT_FOUND;
+    }
+
+    return mapping->PageFault(va, pf_flags, unmap_list, spare);
+}
+
 bool VmAddressRegion::IsRangeAvailableLocked(vaddr_t base, size_t size) {
     DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
     DEBUG_ASSERT(size > 0);
@@ -467,6 +467,30 @@ status_t VmAspace::FreeRegion(vaddr_t va) {
     return r->Destroy();
 }
 
+status_t VmAspace::FindWritableObject(vaddr_t va, size_t len, mxtl::RefPtr<VmObject>* vmo,
+                                      uint64_t* vmo_offset) {
+    DEBUG_ASSERT(len > 0);
+
+    AutoLock a(lock_);
+
+    mxtl::RefPtr<VmMapping> mapping = root_vmar_->FindMappingLocked(va);
+    if (!mapping)
+        return ERR_NOT_FOUND;
+
+    if (len > mapping->base() + mapping->size() - va)
+        return ERR_OUT_OF_RANGE;
+
+    // a write fault is held to the same permissions
+    uint64_t offset;
+    status_t status = mapping->PrepareFaultLocked(va, VMM_PF_FLAG_WRITE | VMM_PF_FLAG_USER,
+                                                  vmo, &offset);
+    if (status < 0)
+        return status;
+
+    *vmo_offset = offset + (va & (PAGE_SIZE - 1));
+    return NO_ERROR;
+}
+
 mxtl::RefPtr<VmAddressRegionOrMapping> VmAspace::FindRegion(vaddr_t va) {
     mxtl::RefPtr<VmAddressRegion> vmar(RootVmar());
     while (1) {
@@ -503,12 +527,54 @@ status_t VmAspace::PageFault(vaddr_t va, uint flags) {
     DEBUG_ASSERT(!aspace_destroyed_);
     LTRACEF("va %#" PRIxPTR ", flags %#x\n", va, flags);
 
-    // for now, hold the aspace lock across the page fault operation,
-    // which stops any other operations on the address space from moving
-    // the region out from underneath it
-    AutoLock a(lock_);
+    // Getting a missing page into the object can mean allocating and zeroing
+    // it, which would hold up every other fault and map or unmap on this
+    // aspace if done under the aspace lock.  So look the mapping up under the
+    // lock, drop it to allocate a zeroed page holding no locks at all, and
+    // then go through the whole fault again.  The second pass finds the
+    // mapping afresh, so a racing unmap or protect is caught there, and it
+    // puts the page into the object, copying into it if need be.  Changing
+    // the object is left to that pass, which holds the aspace lock ahead of
+    // the object's.
+    vm_page_t* spare = nullptr;
+    if (flags & VMM_PF_FLAG_NOT_PRESENT) {
+        mxtl::RefPtr<VmObject> vmo;
+        uint64_t vmo_offset;
+        {
+            AutoLock a(lock_);
+
+            mxtl::RefPtr<VmMapping> mapping = root_vmar_->FindMappingLocked(va);
+            if (!mapping)
+                return ERR_NOT_FOUND;
+
+            status_t status = mapping->PrepareFaultLocked(va, flags, &vmo, &vmo_offset);
+            if (status < 0)
+                return status;
+        }
+
+        // failures here are left for the second pass to report
+        spare = vmo->AllocFaultPage(vmo_offset, flags);
+    }
+
+    status_t status;
+    {
+        // mappings elsewhere that show a page this fault replaced are
+        // unmapped once both locks have been dropped
+        VmUnmapList unmap_list;
+
+        // hold the aspace lock across the rest of the page fault operation,
+        // which stops any other operations on the address space from moving
+        // the region out from underneath it
+        AutoLock a(lock_);
+
+        status = root_vmar_->PageFault(va, flags, &unmap_list, &spare);
+    }
+
+    // the page wasn't needed after all
+    if (spare)
+        pmm_free_page(spare);
 
-    return root_vmar_->PageFault(va, flags);
+    return status;
 }
 
 void VmAspace::Dump(bool verbose) const {
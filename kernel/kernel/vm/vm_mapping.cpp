@@ -21,6 +21,57 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+// how many pages past a faulting one the fault handler may map, see
+// VmMapping::FaultAroundLocked()
+uint vm_fault_around_pages = VM_FAULT_AROUND_DEFAULT_PAGES;
+
+namespace {
+
+// Collects pages to be mapped at consecutive virtual addresses and hands each
+// physically contiguous run with the same flags to the arch layer in one call.
+class MapBatcher {
+public:
+    explicit MapBatcher(arch_aspace_t* aspace) : aspace_(aspace) {}
+
+    status_t Add(vaddr_t va, paddr_t pa, uint mmu_flags) {
+        if (count_ > 0 && va == va_ + count_ * PAGE_SIZE && pa == pa_ + count_ * PAGE_SIZE &&
+            mmu_flags == mmu_flags_) {
+            count_++;
+            return NO_ERROR;
+        }
+
+        status_t status = Flush();
+        va_ = va;
+        pa_ = pa;
+        mmu_flags_ = mmu_flags;
+        count_ = 1;
+        return status;
+    }
+
+    // start of the run that hasn't been mapped yet
+    vaddr_t run_va() const { return va_; }
+
+    status_t Flush() {
+        if (count_ == 0)
+            return NO_ERROR;
+
+        LTRACEF_LEVEL(2, "mapping %zu pages at pa %#" PRIxPTR " to va %#" PRIxPTR "\n",
+                      count_, pa_, va_);
+        int ret = arch_mmu_map(aspace_, va_, pa_, count_, mmu_flags_);
+        count_ = 0;
+        return (ret < 0) ? ret : NO_ERROR;
+    }
+
+private:
+    arch_aspace_t* aspace_;
+    vaddr_t va_ = 0;
+    paddr_t pa_ = 0;
+    uint mmu_flags_ = 0;
+    size_t count_ = 0;
+};
+
+} // namespace
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      mxtl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags,
                      const char* name)
@@ -80,6 +131,18 @@ status_t VmMapping::Protect(vaddr_t base, size_t size, uint new_arch_mmu_flags)
 }
 
 
+// The caller holds object_->lock(), see FaultAroundLocked() for why the
+// analysis is disabled.
+status_t VmMapping::ProtectRangeLocked(vaddr_t base, size_t size,
+                                       uint new_arch_mmu_flags) TA_NO_THREAD_SAFETY_ANALYSIS {
+    // Pages shared with a clone must stay read-only, so rather than granting
+    // write access in place, let them all fault back in.
+    if ((new_arch_mmu_flags & ARCH_MMU_FLAG_PERM_WRITE) && object_->SharesPagesLocked())
+        return arch_mmu_unmap(&aspace_->arch_aspace(), base, size / PAGE_SIZE);
+
+    return arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE, new_arch_mmu_flags);
+}
+
 status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags) {
     DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
     DEBUG_ASSERT(size != 0 && IS_PAGE_ALIGNED(base) && IS_PAGE_ALIGNED(size));
@@ -109,9 +172,8 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
 
     // If we're changing the whole mapping, just make the change.
     if (base_ == base && size_ == size) {
-        status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
-                                           new_arch_mmu_flags);
-        LTRACEF("arch_mmu_protect returns %d\n", status);
+        status_t status = ProtectRangeLocked(base, size, new_arch_mmu_flags);
+        LTRACEF("ProtectRangeLocked returns %d\n", status);
         arch_mmu_flags_ = new_arch_mmu_flags;
         return NO_ERROR;
     }
@@ -127,9 +189,8 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
             return ERR_NO_MEMORY;
         }
 
-        status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
-                                           new_arch_mmu_flags);
-        LTRACEF("arch_mmu_protect returns %d\n", status);
+        status_t status = ProtectRangeLocked(base, size, new_arch_mmu_flags);
+        LTRACEF("ProtectRangeLocked returns %d\n", status);
         arch_mmu_flags_ = new_arch_mmu_flags;
 
         size_ = size;
@@ -150,9 +211,8 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
             return ERR_NO_MEMORY;
         }
 
-        status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
-                                           new_arch_mmu_flags);
-        LTRACEF("arch_mmu_protect returns %d\n", status);
+        status_t status = ProtectRangeLocked(base, size, new_arch_mmu_flags);
+        LTRACEF("ProtectRangeLocked returns %d\n", status);
 
         size_ -= size;
         mapping->ActivateLocked();
@@ -179,9 +239,8 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
         return ERR_NO_MEMORY;
     }
 
-    status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
-                                       new_arch_mmu_flags);
-    LTRACEF("arch_mmu_protect returns %d\n", status);
+    status_t status = ProtectRangeLocked(base, size, new_arch_mmu_flags);
+    LTRACEF("ProtectRangeLocked returns %d\n", status);
 
     // Turn us into the left half
     size_ = left_size;
@@ -290,7 +349,7 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
     return NO_ERROR;
 }
 
-status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) {
+status_t VmMapping::UnmapVmoRange(uint64_t offset, uint64_t len) {
     DEBUG_ASSERT(magic_ == kMagic);
 
     AutoLock guard(aspace_->lock());
@@ -298,6 +357,19 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) {
         return ERR_BAD_STATE;
     }
 
+    // grab the lock for the vmo
+    AutoLock al(object_->lock());
+    return UnmapVmoRangeLocked(offset, len);
+}
+
+status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) {
+    DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+
+    if (state_ != LifeCycleState::ALIVE) {
+        return ERR_BAD_STATE;
+    }
+
     LTRACEF("region %p '%s', offset %#" PRIx64 ", len %#" PRIx64 "\n", this, name_, offset, len);
 
     DEBUG_ASSERT(object_);
@@ -329,7 +401,7 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) {
     LTRACEF("going to unmap %#" PRIxPTR ", len %#" PRIx64 "\n", unmap_base.ValueOrDie(), len_new);
 
     status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), unmap_base.ValueOrDie(),
-                                     static_cast<size_t>(len_new));
+                                     static_cast<size_t>(len_new) / PAGE_SIZE);
     if (status < 0)
         return status;
 
@@ -339,6 +411,9 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) {
 status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     DEBUG_ASSERT(magic_ == kMagic);
 
+    // committing may replace pages mapped elsewhere, which can only be
+    // unmapped once the locks below are dropped
+    VmUnmapList unmap_list;
     AutoLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
@@ -355,6 +430,7 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
 
     // iterate through the range, grabbing a page from the underlying object and
     // mapping it in
+    MapBatcher batch(&aspace_->arch_aspace());
     size_t o;
     for (o = offset; o < offset + len; o += PAGE_SIZE) {
         uint64_t vmo_offset = object_offset_ + o;
@@ -362,7 +438,8 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
         status_t status;
         paddr_t pa;
         if (commit) {
-            status = object_->FaultPageLocked(vmo_offset, VMM_PF_FLAG_WRITE, &pa);
+            status = object_->FaultPageLocked(vmo_offset, VMM_PF_FLAG_WRITE, &unmap_list,
+                                              nullptr, &pa);
         } else {
             status = object_->GetPageLocked(vmo_offset, &pa);
         }
@@ -371,15 +448,24 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
             continue;
         }
 
-        vaddr_t va = base_ + o;
-        LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", pa, va);
+        // the same rule as for a fault, see PageFault()
+        uint mmu_flags = arch_mmu_flags_;
+        if ((mmu_flags & ARCH_MMU_FLAG_PERM_WRITE) &&
+            !object_->CanMapWritableLocked(vmo_offset, pa)) {
+            mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+        }
 
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_);
+        auto ret = batch.Add(base_ + o, pa, mmu_flags);
         if (ret < 0) {
-            TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n", ret, va, pa);
+            TRACEF("error %d mapping pages below va %#" PRIxPTR "\n", ret, base_ + o);
         }
     }
 
+    auto ret = batch.Flush();
+    if (ret < 0) {
+        TRACEF("error %d mapping pages below va %#" PRIxPTR "\n", ret, base_ + o);
+    }
+
     return NO_ERROR;
 }
 
@@ -417,18 +503,7 @@ status_t VmMapping::DestroyLocked() {
     return NO_ERROR;
 }
 
-status_t VmMapping::PageFault(vaddr_t va, uint pf_flags) {
-    DEBUG_ASSERT(magic_ == kMagic);
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
-
-    DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
-
-    va = ROUNDDOWN(va, PAGE_SIZE);
-    uint64_t vmo_offset = va - base_ + object_offset_;
-
-    LTRACEF("%p '%s', vmo_offset %#" PRIx64 ", pf_flags %#x\n", this, name_, vmo_offset, pf_flags);
-
-    // make sure we have permission to continue
+status_t VmMapping::CheckFaultFlags(uint pf_flags) const {
     if ((pf_flags & VMM_PF_FLAG_USER) && (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_USER) == 0) {
         // user page fault on non user mapped region
         LTRACEF("permission failure: user fault on non user region\n");
@@ -444,63 +519,117 @@ status_t VmMapping::PageFault(vaddr_t va, uint pf_flags) {
         LTRACEF("permission failure: execute fault on no execute region\n");
         return ERR_ACCESS_DENIED;
     }
+    return NO_ERROR;
+}
+
+status_t VmMapping::PrepareFaultLocked(vaddr_t va, uint pf_flags, mxtl::RefPtr<VmObject>* vmo,
+                                       uint64_t* vmo_offset) {
+    DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+
+    DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
+
+    status_t status = CheckFaultFlags(pf_flags);
+    if (status < 0)
+        return status;
+
+    *vmo = object_;
+    *vmo_offset = ROUNDDOWN(va, PAGE_SIZE) - base_ + object_offset_;
+    return NO_ERROR;
+}
+
+status_t VmMapping::PageFault(vaddr_t va, uint pf_flags, VmUnmapList* unmap_list,
+                             vm_page_t** spare) {
+    DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+
+    DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
+
+    va = ROUNDDOWN(va, PAGE_SIZE);
+    uint64_t vmo_offset = va - base_ + object_offset_;
+
+    LTRACEF("%p '%s', vmo_offset %#" PRIx64 ", pf_flags %#x\n", this, name_, vmo_offset, pf_flags);
+
+    // make sure we have permission to continue
+    status_t perm_status = CheckFaultFlags(pf_flags);
+    if (perm_status < 0)
+        return perm_status;
 
     if (!(pf_flags & VMM_PF_FLAG_NOT_PRESENT)) {
         // kernel attempting to access userspace, and permissions were fine, so
-        // architecture prevented the cross-privilege access
+        // architecture prevented the cross-privilege access, unless this is a
+        // write to a page that is only mapped read-only until it is copied
         if (!(pf_flags & VMM_PF_FLAG_USER) && aspace_->is_user()) {
-            TRACEF("ERROR: kernel faulted on user address\n");
-            return ERR_ACCESS_DENIED;
+            uint page_flags;
+            paddr_t pa;
+            if (!(pf_flags & VMM_PF_FLAG_WRITE) ||
+                arch_mmu_query(&aspace_->arch_aspace(), va, &pa, &page_flags) < 0 ||
+                (page_flags & ARCH_MMU_FLAG_PERM_WRITE)) {
+                TRACEF("ERROR: kernel faulted on user address\n");
+                return ERR_ACCESS_DENIED;
+            }
         }
     }
 
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
-    // fault in or grab an existing page
+    // fault in or grab an existing page.  If that replaces the page mapped
+    // here, this mapping is updated below rather than through |unmap_list|.
+    unmap_list->set_exempt(this);
     paddr_t new_pa;
-    auto status = object_->FaultPageLocked(vmo_offset, pf_flags, &new_pa);
+    auto status = object_->FaultPageLocked(vmo_offset, pf_flags, unmap_list, spare, &new_pa);
     if (status < 0) {
         TRACEF("ERROR: failed to fault in or grab existing page\n");
         TRACEF("%p '%s', vmo_offset %#" PRIx64 ", pf_flags %#x\n", this, name_, vmo_offset, pf_flags);
         return status;
     }
 
+    // A page the object doesn't own, or one a clone still reads, is mapped
+    // read-only to catch the first write to it.  So is any page while other
+    // mappings may still show what it replaced: write access waits for the
+    // next fault, after they have been unmapped.
+    uint mmu_flags = arch_mmu_flags_;
+    if ((mmu_flags & ARCH_MMU_FLAG_PERM_WRITE) &&
+        !object_->CanMapWritableLocked(vmo_offset, new_pa)) {
+        mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+    }
+
     // see if something is mapped here now
     // this may happen if we are one of multiple threads racing on a single
     // address
+    size_t mapped = 1;
     uint page_flags;
     paddr_t pa;
     status_t err = arch_mmu_query(&aspace_->arch_aspace(), va, &pa, &page_flags);
+    if (err >= 0 && pa != new_pa) {
+        // the object has replaced the page mapped here with a copy of its own
+        LTRACEF("replacing pa %#" PRIxPTR " with %#" PRIxPTR "\n", pa, new_pa);
+        auto ret = arch_mmu_unmap(&aspace_->arch_aspace(), va, 1);
+        if (ret < 0) {
+            TRACEF("failed to unmap replaced page\n");
+            return ERR_NO_MEMORY;
+        }
+        err = ERR_NOT_FOUND;
+    }
     if (err >= 0) {
         LTRACEF("queried va, page at pa %#" PRIxPTR ", flags %#x is already there\n", pa,
                 page_flags);
-        if (pa == new_pa) {
-            // page was already mapped, are the permissions compatible?
-            if (page_flags == arch_mmu_flags_)
-                return NO_ERROR;
-
-            // same page, different permission
-            auto ret = arch_mmu_protect(&aspace_->arch_aspace(), va, 1, arch_mmu_flags_);
-            if (ret < 0) {
-                TRACEF("failed to modify permissions on existing mapping\n");
-                return ERR_NO_MEMORY;
-            }
-        } else {
-            // some other page is mapped there already
-            // currently this is an error situation, since there's no way for this to
-            // have
-            // happened, but in the future this will be a path for copy-on-write.
-            // TODO: implement
-            printf("KERN: thread %s faulted on va %#" PRIxPTR
-                   ", different page was present, unhandled\n",
-                   get_current_thread()->name, va);
-            return ERR_NOT_SUPPORTED;
+        // page was already mapped, are the permissions compatible?
+        if (page_flags == mmu_flags)
+            return NO_ERROR;
+
+        // same page, different permission
+        auto ret = arch_mmu_protect(&aspace_->arch_aspace(), va, 1, mmu_flags);
+        if (ret < 0) {
+            TRACEF("failed to modify permissions on existing mapping\n");
+            return ERR_NO_MEMORY;
         }
     } else {
-        // nothing was mapped there before, map it now
+        // nothing was mapped there before, map it now along with whatever
+        // neighbours we can cheaply get at
         LTRACEF("mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", new_pa, va);
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, new_pa, 1, arch_mmu_flags_);
+        auto ret = FaultAroundLocked(va, vmo_offset, pf_flags, new_pa, mmu_flags, &mapped);
         if (ret < 0) {
             TRACEF("failed to map page\n");
             return ERR_NO_MEMORY;
@@ -510,11 +639,91 @@ status_t VmMapping::PageFault(vaddr_t va, uint pf_flags) {
 // TODO: figure out what to do with this
 #if ARCH_ARM64
     if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
-        arch_sync_cache_range(va, PAGE_SIZE);
+        arch_sync_cache_range(va, mapped * PAGE_SIZE);
 #endif
     return NO_ERROR;
 }
 
+// Map the page that faulted at |va| along with up to vm_fault_around_pages of
+// the pages after it, stopping at the first one that is already mapped.
+// Pages the object already has are always mapped.  While the mapping is being
+// touched sequentially, missing pages are faulted in as well, over a window
+// that doubles with every sequential fault, so that walking a big buffer takes
+// a handful of traps instead of one per page.
+//
+// The caller holds object_->lock(), but the analysis can't follow it through
+// the object_ pointer, so it is disabled here.
+status_t VmMapping::FaultAroundLocked(vaddr_t va, uint64_t vmo_offset, uint pf_flags, paddr_t pa,
+                                      uint mmu_flags, size_t* mapped) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(object_->lock().IsHeld());
+
+    if (vmo_offset == next_fault_offset_) {
+        fault_ahead_pages_ = mxtl::min(mxtl::max(fault_ahead_pages_ * 2, 1u), vm_fault_around_pages);
+    } else {
+        fault_ahead_pages_ = 0;
+    }
+
+    MapBatcher batch(&aspace_->arch_aspace());
+    __UNUSED status_t status = batch.Add(va, pa, mmu_flags);
+    DEBUG_ASSERT(status == NO_ERROR);
+
+    const size_t max_pages = mxtl::min<size_t>((base_ + size_ - va) / PAGE_SIZE - 1,
+                                               vm_fault_around_pages);
+    size_t count = 1;
+    for (; count <= max_pages; count++) {
+        vaddr_t page_va = va + count * PAGE_SIZE;
+        uint64_t page_offset = vmo_offset + count * PAGE_SIZE;
+
+        paddr_t page_pa;
+        uint page_flags;
+        if (arch_mmu_query(&aspace_->arch_aspace(), page_va, &page_pa, &page_flags) >= 0)
+            break;
+
+        if (object_->GetPageLocked(page_offset, &page_pa) < 0) {
+            if (count > fault_ahead_pages_)
+                break;
+            // never write fault on a neighbour's behalf, so a clone maps its
+            // parent's page rather than copying it
+            if (object_->FaultPageLocked(page_offset, pf_flags & ~VMM_PF_FLAG_WRITE, nullptr,
+                                         nullptr, &page_pa) < 0)
+                break;
+        }
+
+        // same rule as for the faulting page: a page the object doesn't own,
+        // or one a clone still reads, is mapped read-only
+        page_flags = arch_mmu_flags_;
+        if ((page_flags & ARCH_MMU_FLAG_PERM_WRITE) &&
+            !object_->CanMapWritableLocked(page_offset, page_pa)) {
+            page_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+        }
+
+        // adding a page that doesn't extend the current run maps the run
+        vaddr_t run_va = batch.run_va();
+        if (batch.Add(page_va, page_pa, page_flags) < 0) {
+            // only the run with the faulting page in it has to make it
+            if (run_va == va)
+                return ERR_NO_MEMORY;
+            // leave the page we just added for a later fault
+            count = (run_va - va) / PAGE_SIZE;
+            *mapped = count;
+            next_fault_offset_ = vmo_offset + count * PAGE_SIZE;
+            return NO_ERROR;
+        }
+    }
+
+    vaddr_t run_va = batch.run_va();
+    if (batch.Flush() < 0) {
+        if (run_va == va)
+            return ERR_NO_MEMORY;
+        count = (run_va - va) / PAGE_SIZE;
+    }
+
+    *mapped = count;
+    next_fault_offset_ = vmo_offset + count * PAGE_SIZE;
+    return NO_ERROR;
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
@@ -23,7 +23,11 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
-VmObject::VmObject() {
+VmObject::VmObject() : lock_(local_lock_), pending_unmaps_(local_pending_unmaps_) {
+    LTRACEF("%p\n", this);
+}
+
+VmObject::VmObject(VmObject& root) : lock_(root.lock_), pending_unmaps_(root.pending_unmaps_) {
     LTRACEF("%p\n", this);
 }
 
@@ -47,6 +51,60 @@ void VmObject::RemoveRegionLocked(VmMapping* r) {
     region_list_.erase(*r);
 }
 
+VmUnmapList::~VmUnmapList() {
+    Unmap();
+}
+
+// The caller holds the object's lock, which the analysis can't see through
+// the mapping.
+status_t VmUnmapList::Add(VmMapping* mapping, uint64_t offset,
+                          uint64_t len) TA_NO_THREAD_SAFETY_ANALYSIS {
+    if (mapping == exempt_)
+        return NO_ERROR;
+
+    // keep the pages from being mapped writable until Unmap()
+    if (!object_) {
+        object_ = mapping->object_;
+        object_->pending_unmaps_++;
+    }
+    DEBUG_ASSERT(&object_->lock() == &mapping->object_->lock());
+
+    if (count_ == entries_.size()) {
+        size_t size = entries_.size() ? entries_.size() * 2 : 4;
+
+        AllocChecker ac;
+        mxtl::Array<Entry> entries(new (&ac) Entry[size], size);
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+
+        for (size_t i = 0; i < count_; i++)
+            entries[i] = mxtl::move(entries_[i]);
+        entries_ = mxtl::move(entries);
+    }
+
+    // a mapping only leaves its object's list of mappings, under the object's
+    // lock, before its last reference goes, so it's safe to take one here
+    entries_[count_++] = Entry{mxtl::RefPtr<VmMapping>(mapping), offset, len};
+    return NO_ERROR;
+}
+
+void VmUnmapList::Unmap() {
+    for (size_t i = 0; i < count_; i++) {
+        // the mapping may have been destroyed in the meantime, which is fine
+        entries_[i].mapping->UnmapVmoRange(entries_[i].offset, entries_[i].len);
+        entries_[i].mapping.reset();
+    }
+    count_ = 0;
+
+    if (object_) {
+        {
+            AutoLock a(object_->lock());
+            object_->pending_unmaps_--;
+        }
+        object_.reset();
+    }
+}
+
 static int cmd_vm_object(int argc, const cmd_args* argv) {
     if (argc < 2) {
     notenoughargs:
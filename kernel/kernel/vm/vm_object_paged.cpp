@@ -26,40 +26,70 @@
 
 namespace {
 
-void ZeroPage(paddr_t pa) {
-    void* ptr = paddr_to_kvaddr(pa);
-    DEBUG_ASSERT(ptr);
+void CopyPage(paddr_t dest_pa, vm_page_t* src) {
+    void* dest = paddr_to_kvaddr(dest_pa);
+    const void* source = paddr_to_kvaddr(vm_page_to_paddr(src));
+    DEBUG_ASSERT(dest && source);
 
-    arch_zero_page(ptr);
-}
-
-void ZeroPage(vm_page_t* p) {
-    paddr_t pa = vm_page_to_paddr(p);
-    ZeroPage(pa);
+    memcpy(dest, source, PAGE_SIZE);
 }
 
 } // namespace
 
-VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags)
-    : pmm_alloc_flags_(pmm_alloc_flags) {
+VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, uint32_t options)
+    : pmm_alloc_flags_(pmm_alloc_flags), loanable_(options & kLoanable) {
     LTRACEF("%p\n", this);
 }
 
+VmObjectPaged::VmObjectPaged(mxtl::RefPtr<VmObjectPaged> parent, uint64_t parent_offset,
+                             uint64_t size)
+    : VmObject(*parent), size_(size), pmm_alloc_flags_(parent->pmm_alloc_flags_),
+      depth_(parent->depth_ + 1), parent_(mxtl::move(parent)), parent_offset_(parent_offset) {
+    LTRACEF("%p parent %p offset %#" PRIx64 "\n", this, parent_.get(), parent_offset_);
+}
+
 VmObjectPaged::~VmObjectPaged() {
     DEBUG_ASSERT(magic_ == MAGIC);
     LTRACEF("%p\n", this);
 
+    if (parent_) {
+        AutoLock a(parent_->lock());
+        parent_->children_list_.erase(*this);
+    }
+
     // free all of the pages attached to us
     page_list_.FreeAllPages();
+
+    // Dropping our reference to the parent may destroy it, which drops its
+    // reference to its own parent, and so on up the chain.  Let go of the
+    // ancestors one at a time here instead of a destructor frame apiece.
+    mxtl::RefPtr<VmObjectPaged> parent = mxtl::move(parent_);
+    while (parent) {
+        VmObjectPaged* p = parent.leak_ref();
+        if (!p->Release())
+            break;
+        // we held the last reference; keep its parent alive across its
+        // destruction so that it is released by this loop instead
+        parent = p->parent_;
+        delete p;
+    }
 }
 
-mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size) {
+mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size,
+                                             uint32_t options) {
     // there's a max size to keep indexes within range
     if (size > MAX_SIZE)
         return nullptr;
 
+    // loaned pages come from wherever the pmm had them
+    if ((options & kLoanable) && pmm_alloc_flags != PMM_ALLOC_FLAG_ANY)
+        return nullptr;
+    // pinned pages can never be handed to another object
+    if ((options & kLoanable) && (options & kPinned))
+        return nullptr;
+
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(pmm_alloc_flags));
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags, options));
     if (!ac.check())
         return nullptr;
 
@@ -71,6 +101,12 @@ mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t
     if (err != NO_ERROR)
         return nullptr;
 
+    if (options & kPinned) {
+        if (vmo->CommitRange(0, size, nullptr) != NO_ERROR)
+            return nullptr;
+        vmo->pinned_ = true;
+    }
+
     return vmo;
 }
 
@@ -88,7 +124,10 @@ void VmObjectPaged::Dump(uint depth, bool verbose) {
     for (uint i = 0; i < depth; ++i) {
         printf("  ");
     }
-    printf("object %p size %#" PRIx64 " pages %zu ref %d\n", this, size_, count, ref_count_debug());
+    printf("object %p size %#" PRIx64 " pages %zu ref %d", this, size_, count, ref_count_debug());
+    if (parent_)
+        printf(" parent %p offset %#" PRIx64, parent_.get(), parent_offset_);
+    printf("\n");
 
     if (verbose) {
         auto f = [depth](const auto p, uint64_t offset) {
@@ -182,38 +221,283 @@ vm_page_t* VmObjectPaged::GetPageLocked(uint64_t offset) {
     return page_list_.GetPage(offset);
 }
 
-vm_page_t* VmObjectPaged::FaultPageLocked(uint64_t offset, uint pf_flags) {
-    DEBUG_ASSERT(magic_ == MAGIC);
+// The whole clone tree shares one lock, but the analysis can't tell that the
+// parent's lock is the same capability as ours, so it is disabled here.
+vm_page_t* VmObjectPaged::GetPageFromParentLocked(uint64_t offset) TA_NO_THREAD_SAFETY_ANALYSIS {
     DEBUG_ASSERT(lock_.IsHeld());
 
-    LTRACEF("vmo %p, offset %#" PRIx64 ", pf_flags %#x\n", this, offset, pf_flags);
+    for (VmObjectPaged* o = this; o->parent_; ) {
+        offset += o->parent_offset_;
+        o = o->parent_.get();
 
-    if (offset >= size_)
-        return nullptr;
+        if (offset >= o->size_)
+            return nullptr;
+
+        vm_page_t* p = o->page_list_.GetPage(offset);
+        if (p)
+            return p;
+    }
+    return nullptr;
+}
+
+// See GetPageFromParentLocked() for why the analysis is disabled.
+bool VmObjectPaged::CloneWindowLocked(const VmObjectPaged* ancestor, uint64_t offset, uint64_t len,
+                                      uint64_t* window_offset,
+                                      uint64_t* window_len) const TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    // Walk up to |ancestor|, working in each object's offsets in turn.  A
+    // clone sees nothing past the end of any object between it and
+    // |ancestor|, so the window is clipped to each of them on the way.
+    uint64_t start = 0;
+    uint64_t end = ROUNDUP_PAGE_SIZE(size_);
+    uint64_t shift = 0;
+    for (const VmObjectPaged* o = this; o != ancestor; o = o->parent_.get()) {
+        start += o->parent_offset_;
+        end += o->parent_offset_;
+        shift += o->parent_offset_;
+        if (o->parent_.get() != ancestor)
+            end = MIN(end, ROUNDUP_PAGE_SIZE(o->parent_->size_));
+        if (start >= end)
+            return false;
+    }
+
+    start = MAX(start, offset);
+    end = MIN(end, offset + len);
+    if (start >= end)
+        return false;
+
+    *window_offset = start - shift;
+    *window_len = end - start;
+    return true;
+}
+
+// See GetPageFromParentLocked() for why the analysis is disabled.
+status_t VmObjectPaged::GatherMappingsLocked(uint64_t offset, uint64_t len,
+                                             VmUnmapList* unmap_list) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(len));
+
+    // Visit us and then every clone below us that sees the range, depth
+    // first.  Clone trees can be deep, so this follows the parent and sibling
+    // links instead of recursing.
+    VmObjectPaged* o = this;
+    uint64_t o_offset = offset;
+    uint64_t o_len = len;
+    for (;;) {
+        for (auto& r : o->region_list_) {
+            auto status = unmap_list->Add(&r, o_offset, o_len);
+            if (status != NO_ERROR)
+                return status;
+        }
+
+        // go down to the first clone, or else across to the next sibling of
+        // the nearest object that has one, skipping clones (and so their
+        // clones too) that don't see the range
+        VmObjectPaged* next = o->children_list_.is_empty() ? nullptr : &o->children_list_.front();
+        for (;;) {
+            while (!next) {
+                if (o == this)
+                    return NO_ERROR;
+                auto& siblings = o->parent_->children_list_;
+                auto it = siblings.make_iterator(*o);
+                if (++it != siblings.end())
+                    next = &*it;
+                else
+                    o = o->parent_.get();
+            }
+            if (next->CloneWindowLocked(this, offset, len, &o_offset, &o_len))
+                break;
+            o = next;
+            next = nullptr;
+        }
+        o = next;
+    }
+}
+
+// See GetPageFromParentLocked() for why the analysis is disabled.
+bool VmObjectPaged::IsReadByClonesLocked(uint64_t offset) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    // a clone with a page of its own at the offset hides ours from its clones too
+    for (auto& c : children_list_) {
+        if (offset < c.parent_offset_ || offset - c.parent_offset_ >= c.size_)
+            continue;
+        if (!c.page_list_.GetPage(offset - c.parent_offset_))
+            return true;
+    }
+    return false;
+}
+
+// See GetPageFromParentLocked() for why the analysis is disabled.
+status_t VmObjectPaged::PreserveForClonesLocked(uint64_t offset,
+                                                VmUnmapList* unmap_list) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+
+    bool looked = false;
+    vm_page_t* src = nullptr;
+    for (auto& c : children_list_) {
+        if (offset < c.parent_offset_ || offset - c.parent_offset_ >= c.size_)
+            continue;
+        uint64_t child_offset = offset - c.parent_offset_;
+        if (c.page_list_.GetPage(child_offset))
+            continue;
+
+        // what the clone reads now, which is nothing past our end
+        if (!looked) {
+            if (offset < size_) {
+                src = page_list_.GetPage(offset);
+                if (!src && parent_)
+                    src = GetPageFromParentLocked(offset);
+            }
+            looked = true;
+        }
+
+        // anything the clone, or a clone of it, has mapped here is our page or
+        // an ancestor's, and has to fault again to pick up the copy.  With no
+        // page to copy there is nothing mapped.
+        if (src) {
+            auto status = c.GatherMappingsLocked(child_offset, PAGE_SIZE, unmap_list);
+            if (status != NO_ERROR)
+                return status;
+        }
+
+        paddr_t pa;
+        vm_page_t* p = pmm_alloc_page(c.pmm_alloc_flags_ | (src ? 0 : PMM_ALLOC_FLAG_ZEROED), &pa);
+        if (!p)
+            return ERR_NO_MEMORY;
+
+        p->state = VM_PAGE_STATE_OBJECT;
+
+        if (src)
+            CopyPage(pa, src);
+
+        __UNUSED auto status = c.page_list_.AddPage(p, child_offset);
+        DEBUG_ASSERT(status == NO_ERROR);
+
+        LTRACEF("preserved page %p for clone %p at %#" PRIx64 "\n", p, &c, child_offset);
+    }
+
+    return NO_ERROR;
+}
+
+vm_page_t* VmObjectPaged::CommitPageLocked(uint64_t offset, VmUnmapList* unmap_list,
+                                           vm_page_t** spare) {
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(offset < size_);
 
     vm_page_t* p = page_list_.GetPage(offset);
     if (p)
         return p;
 
-    // allocate a page
+    // anything that had a parent's page mapped here, through us or through a
+    // clone of ours, has to fault again to pick up the copy
+    vm_page_t* parent_page = parent_ ? GetPageFromParentLocked(offset) : nullptr;
+    if (parent_page) {
+        DEBUG_ASSERT(unmap_list);
+        if (GatherMappingsLocked(ROUNDDOWN(offset, PAGE_SIZE), PAGE_SIZE, unmap_list) != NO_ERROR)
+            return nullptr;
+    }
+
+    // take the page the fault allocated ahead of time, if there is one, else
+    // allocate a page, only bothering to have it zeroed if we aren't about
+    // to copy over it
     paddr_t pa;
-    p = pmm_alloc_page(pmm_alloc_flags_, &pa);
-    if (!p)
-        return nullptr;
+    if (spare && *spare) {
+        p = *spare;
+        *spare = nullptr;
+        pa = vm_page_to_paddr(p);
+    } else {
+        uint alloc_flags = pmm_alloc_flags_ | (parent_page ? 0 : PMM_ALLOC_FLAG_ZEROED);
+        p = pmm_alloc_page(alloc_flags, &pa);
+        if (!p)
+            return nullptr;
+    }
 
     p->state = VM_PAGE_STATE_OBJECT;
 
-    // TODO: remove once pmm returns zeroed pages
-    ZeroPage(pa);
+    if (parent_page)
+        CopyPage(pa, parent_page);
 
     __UNUSED auto status = page_list_.AddPage(p, offset);
     DEBUG_ASSERT(status == NO_ERROR);
 
-    LTRACEF("faulted in page %p, pa %#" PRIxPTR "\n", p, pa);
+    LTRACEF("committed page %p, pa %#" PRIxPTR "\n", p, pa);
 
     return p;
 }
 
+vm_page_t* VmObjectPaged::AllocFaultPage(uint64_t offset, uint pf_flags) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+
+    {
+        AutoLock a(lock_);
+
+        if (offset >= size_ || page_list_.GetPage(offset))
+            return nullptr;
+
+        // a read of a clone maps its parent's page
+        if (!(pf_flags & VMM_PF_FLAG_WRITE) && parent_ && GetPageFromParentLocked(offset))
+            return nullptr;
+    }
+
+    // Zero it even if it is going to be copied over, so that it suits either
+    // kind of fault whatever happens to the object before the page is used.
+    paddr_t pa;
+    return pmm_alloc_page(pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &pa);
+}
+
+vm_page_t* VmObjectPaged::FaultPageLocked(uint64_t offset, uint pf_flags, VmUnmapList* unmap_list,
+                                          vm_page_t** spare) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    LTRACEF("vmo %p, offset %#" PRIx64 ", pf_flags %#x\n", this, offset, pf_flags);
+
+    if (offset >= size_)
+        return nullptr;
+
+    vm_page_t* p = page_list_.GetPage(offset);
+
+    if (!(pf_flags & VMM_PF_FLAG_WRITE)) {
+        if (p)
+            return p;
+
+        // a clone reads through to its parent's page until it writes to it
+        vm_page_t* parent_page = parent_ ? GetPageFromParentLocked(offset) : nullptr;
+        if (parent_page) {
+            LTRACEF("sharing parent page %p\n", parent_page);
+            return parent_page;
+        }
+
+        // nothing to read through to, so fill in a zero page
+        return CommitPageLocked(offset, unmap_list, spare);
+    }
+
+    // clones that read what we have here keep seeing it as it was
+    DEBUG_ASSERT(unmap_list);
+    if (PreserveForClonesLocked(ROUNDDOWN(offset, PAGE_SIZE), unmap_list) != NO_ERROR)
+        return nullptr;
+
+    return p ? p : CommitPageLocked(offset, unmap_list, spare);
+}
+
+bool VmObjectPaged::CanMapWritableLocked(uint64_t offset, paddr_t pa) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    // a clone still reading the page has to be given its own copy first
+    return VmObject::CanMapWritableLocked(offset, pa) &&
+           !IsReadByClonesLocked(ROUNDDOWN(offset, PAGE_SIZE));
+}
+
+bool VmObjectPaged::SharesPagesLocked() {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    return parent_ || !children_list_.is_empty();
+}
+
 status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) {
     DEBUG_ASSERT(magic_ == MAGIC);
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -221,6 +505,7 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     if (committed)
         *committed = 0;
 
+    VmUnmapList unmap_list;
     AutoLock a(lock_);
 
     // trim the size
@@ -244,11 +529,26 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     if (count == 0)
         return NO_ERROR;
 
+    // a clone has to take a copy of whatever its parent has at each offset,
+    // so commit the pages one at a time.  Nothing it reads changes, so its
+    // own clones are left alone.
+    if (parent_) {
+        for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+            if (page_list_.GetPage(o))
+                continue;
+            if (!CommitPageLocked(o, &unmap_list, nullptr))
+                return ERR_NO_MEMORY;
+            if (committed)
+                *committed += PAGE_SIZE;
+        }
+        return NO_ERROR;
+    }
+
     // allocate count number of pages
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &page_list);
     if (allocated < count) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
         pmm_free(&page_list);
@@ -266,9 +566,6 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
 
         p->state = VM_PAGE_STATE_OBJECT;
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
-
         __UNUSED auto status = page_list_.AddPage(p, o);
         DEBUG_ASSERT(status == NO_ERROR);
 
@@ -289,11 +586,18 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     DEBUG_ASSERT(magic_ == MAGIC);
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 ", alignment %hhu\n", offset, len, alignment_log2);
 
+    // a clone's pages are copies of its parent's, which can't be made contiguous
+    if (parent_)
+        return ERR_NOT_SUPPORTED;
+
     if (committed)
         *committed = 0;
 
     AutoLock a(lock_);
 
+    // the run is presumably wanted for a device, so it has to stay put
+    loanable_ = false;
+
     // trim the size
     if (!TrimRange(offset, len, size_))
         return ERR_OUT_OF_RANGE;
@@ -319,7 +623,8 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_contiguous(count, pmm_alloc_flags_, alignment_log2, nullptr, &page_list);
+    size_t allocated = pmm_alloc_contiguous(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED,
+                                            alignment_log2, nullptr, &page_list);
     if (allocated < count) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
         pmm_free(&page_list);
@@ -335,9 +640,6 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
 
         p->state = VM_PAGE_STATE_OBJECT;
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
-
         __UNUSED auto status = page_list_.AddPage(p, o);
         DEBUG_ASSERT(status == NO_ERROR);
 
@@ -358,6 +660,10 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
     if (decommitted)
         *decommitted = 0;
 
+    if (pinned_)
+        return ERR_NOT_SUPPORTED;
+
+    VmUnmapList unmap_list;
     AutoLock a(lock_);
 
     // trim the size
@@ -378,21 +684,133 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
     LTRACEF("start offset %#" PRIx64 ", end %#" PRIx64 ", page_aliged_len %#" PRIx64 "\n", start, end,
             page_aligned_len);
 
-    // unmap all of the pages in this range on all the mapping regions
-    for (auto& r : region_list_) {
-        // unmap any pages the region may have mapped that intersect this range
-        r.UnmapVmoRangeLocked(start, page_aligned_len);
+    // clones that read the pages keep seeing them as they were
+    for (uint64_t o = start; o < end; o += PAGE_SIZE) {
+        if (!page_list_.GetPage(o))
+            continue;
+        auto status = PreserveForClonesLocked(o, &unmap_list);
+        if (status != NO_ERROR)
+            return status;
     }
 
-    // iterate through the pages, freeing them
+    // unmap all of the pages in this range on all the mapping regions, and
+    // those of any clones that may be sharing them
+    auto status = GatherMappingsLocked(start, page_aligned_len, &unmap_list);
+    if (status != NO_ERROR)
+        return status;
+
+    // iterate through the pages, pulling them out
+    list_node freed;
+    list_initialize(&freed);
     while (start < end) {
-        auto status = page_list_.FreePage(start);
-        if (status == NO_ERROR && decommitted) {
-            *decommitted += PAGE_SIZE;
+        vm_page_t* p = page_list_.RemovePage(start);
+        if (p) {
+            list_add_tail(&freed, &p->free.node);
+            if (decommitted)
+                *decommitted += PAGE_SIZE;
         }
         start += PAGE_SIZE;
     }
 
+    // the pages can only be freed once nothing has them mapped
+    a.release();
+    unmap_list.Unmap();
+    pmm_free(&freed);
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::TakePages(uint64_t offset, uint64_t len, list_node* pages) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("vmo %p offset %#" PRIx64 " len %#" PRIx64 "\n", this, offset, len);
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ERR_INVALID_ARGS;
+
+    VmUnmapList unmap_list;
+    AutoLock a(lock_);
+
+    if (offset > size_ || len > size_ - offset)
+        return ERR_OUT_OF_RANGE;
+
+    if (!loanable_)
+        return ERR_NOT_SUPPORTED;
+
+    // pages shared with a parent or with clones can't be given away
+    if (parent_ || !children_list_.is_empty())
+        return ERR_BAD_STATE;
+
+    // it's all or nothing, so make sure every page is there before taking any
+    for (uint64_t o = offset; o < offset + len; o += PAGE_SIZE) {
+        if (!page_list_.GetPage(o))
+            return ERR_BAD_STATE;
+    }
+
+    auto status = GatherMappingsLocked(offset, len, &unmap_list);
+    if (status != NO_ERROR)
+        return status;
+
+    for (uint64_t o = offset; o < offset + len; o += PAGE_SIZE) {
+        vm_page_t* p = page_list_.RemovePage(o);
+        DEBUG_ASSERT(p);
+        list_add_tail(pages, &p->free.node);
+    }
+
+    // the caller can only have the pages once nothing has them mapped
+    a.release();
+    unmap_list.Unmap();
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, list_node* pages) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("vmo %p offset %#" PRIx64 " len %#" PRIx64 "\n", this, offset, len);
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ERR_INVALID_ARGS;
+    if (list_length(pages) != len / PAGE_SIZE)
+        return ERR_INVALID_ARGS;
+
+    VmUnmapList unmap_list;
+    AutoLock a(lock_);
+
+    if (offset > size_ || len > size_ - offset)
+        return ERR_OUT_OF_RANGE;
+
+    // the pages came from wherever the pmm had them, which only suits an
+    // object of plain anonymous memory that nothing is using the physical
+    // addresses of
+    if (!loanable_)
+        return ERR_NOT_SUPPORTED;
+
+    // clones would see the new pages in place of what they had
+    if (parent_ || !children_list_.is_empty())
+        return ERR_BAD_STATE;
+
+    // anything mapping the old pages has to fault again to pick up the new ones
+    auto status = GatherMappingsLocked(offset, len, &unmap_list);
+    if (status != NO_ERROR)
+        return status;
+
+    list_node freed;
+    list_initialize(&freed);
+    for (uint64_t o = offset; o < offset + len; o += PAGE_SIZE) {
+        vm_page_t* old = page_list_.RemovePage(o);
+        if (old)
+            list_add_tail(&freed, &old->free.node);
+
+        vm_page_t* p = list_remove_head_type(pages, vm_page_t, free.node);
+        p->state = VM_PAGE_STATE_OBJECT;
+        status = page_list_.AddPage(p, o);
+        DEBUG_ASSERT(status == NO_ERROR);
+    }
+
+    // the old pages can only be freed once nothing has them mapped
+    a.release();
+    unmap_list.Unmap();
+    pmm_free(&freed);
+
     return NO_ERROR;
 }
 
@@ -404,6 +822,13 @@ status_t VmObjectPaged::Resize(uint64_t s) {
     if (s > MAX_SIZE)
         return ERR_OUT_OF_RANGE;
 
+    if (pinned_)
+        return ERR_NOT_SUPPORTED;
+
+    VmUnmapList unmap_list;
+    list_node freed;
+    list_initialize(&freed);
+
     AutoLock a(lock_);
 
     // see if we're shrinking the vmo
@@ -415,15 +840,28 @@ status_t VmObjectPaged::Resize(uint64_t s) {
 
         // we're only worried about whole pages to be removed
         if (page_aligned_len > 0) {
-            // unmap all of the pages in this range on all the mapping regions
-            for (auto& r : region_list_) {
-                // unmap any pages the region may have mapped that intersect this range
-                r.UnmapVmoRangeLocked(start, page_aligned_len);
+            // clones that read pages in this range keep seeing them as they were
+            if (!children_list_.is_empty()) {
+                for (uint64_t o = start; o < end; o += PAGE_SIZE) {
+                    if (!page_list_.GetPage(o) && !(parent_ && GetPageFromParentLocked(o)))
+                        continue;
+                    auto status = PreserveForClonesLocked(o, &unmap_list);
+                    if (status != NO_ERROR)
+                        return status;
+                }
             }
 
-            // iterate through the pages, freeing them
+            // unmap all of the pages in this range on all the mapping regions,
+            // and those of any clones that may be sharing them
+            auto status = GatherMappingsLocked(start, page_aligned_len, &unmap_list);
+            if (status != NO_ERROR)
+                return status;
+
+            // iterate through the pages, pulling them out
             while (start < end) {
-                page_list_.FreePage(start);
+                vm_page_t* p = page_list_.RemovePage(start);
+                if (p)
+                    list_add_tail(&freed, &p->free.node);
                 start += PAGE_SIZE;
             }
         }
@@ -432,6 +870,51 @@ status_t VmObjectPaged::Resize(uint64_t s) {
     // save bytewise size
     size_ = s;
 
+    // the pages can only be freed once nothing has them mapped
+    a.release();
+    unmap_list.Unmap();
+    pmm_free(&freed);
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("vmo %p offset %#" PRIx64 " size %#" PRIx64 "\n", this, offset, size);
+
+    // pages are shared whole, so the clone has to start on a page boundary
+    if (!IS_PAGE_ALIGNED(offset))
+        return ERR_INVALID_ARGS;
+
+    // there's a max size to keep indexes within range
+    if (size > MAX_SIZE || offset > MAX_SIZE - size)
+        return ERR_OUT_OF_RANGE;
+
+    // walks up and down the tree are bounded by its depth
+    if (depth_ >= kMaxCloneDepth)
+        return ERR_OUT_OF_RANGE;
+
+    AllocChecker ac;
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(
+        new (&ac) VmObjectPaged(mxtl::RefPtr<VmObjectPaged>(this), offset, size));
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    {
+        VmUnmapList unmap_list;
+        AutoLock a(lock_);
+        children_list_.push_front(vmo.get());
+
+        // the pages the clone shares can't stay mapped writable.  On failure
+        // the clone takes itself off the list as it goes away.
+        for (auto& r : region_list_) {
+            auto status = unmap_list.Add(&r, offset, ROUNDUP_PAGE_SIZE(size));
+            if (status != NO_ERROR)
+                return status;
+        }
+    }
+
+    *clone_vmo = mxtl::move(vmo);
     return NO_ERROR;
 }
 
@@ -444,6 +927,7 @@ status_t VmObjectPaged::ReadWriteInternal(uint64_t offset, size_t len, size_t* b
     if (bytes_copied)
         *bytes_copied = 0;
 
+    VmUnmapList unmap_list;
     AutoLock a(lock_);
 
     // trim the size
@@ -461,10 +945,24 @@ status_t VmObjectPaged::ReadWriteInternal(uint64_t offset, size_t len, size_t* b
         size_t tocopy = MIN(PAGE_SIZE - page_offset, len);
 
         // fault in the page
-        vm_page_t* p = FaultPageLocked(offset, write ? VMM_PF_FLAG_WRITE : 0);
+        vm_page_t* p = FaultPageLocked(offset, write ? VMM_PF_FLAG_WRITE : 0, &unmap_list, nullptr);
         if (!p)
             return ERR_NO_MEMORY;
 
+        // the page can't be written while other mappings may still show what
+        // it replaced, or what a clone was given a copy of
+        if (!unmap_list.is_empty()) {
+            lock_.Release();
+            unmap_list.Unmap();
+            lock_.Acquire();
+
+            // the object may have shrunk in the meantime
+            if (offset >= size_)
+                return ERR_OUT_OF_RANGE;
+            len = MIN(len, size_ - offset);
+            continue;
+        }
+
         // compute the kernel mapping of this page
         paddr_t pa = vm_page_to_paddr(p);
         uint8_t* page_ptr = reinterpret_cast<uint8_t*>(paddr_to_kvaddr(pa));
@@ -565,6 +1063,9 @@ status_t VmObjectPaged::Lookup(uint64_t offset, uint64_t len, user_ptr<paddr_t>
     if (unlikely(!InRange(offset, len, size_)))
         return ERR_OUT_OF_RANGE;
 
+    // someone may hand the addresses to a device, so the pages have to stay put
+    loanable_ = false;
+
     uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
     uint64_t end = offset + len;
     uint64_t end_page_offset = ROUNDUP(end, PAGE_SIZE);
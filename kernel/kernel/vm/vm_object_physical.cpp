@@ -79,7 +79,8 @@ status_t VmObjectPhysical::GetPageLocked(uint64_t offset, paddr_t* _pa) {
 }
 
 // get the physical address of a page at offset
-status_t VmObjectPhysical::FaultPageLocked(uint64_t offset, uint pf_flags, paddr_t* _pa) {
+status_t VmObjectPhysical::FaultPageLocked(uint64_t offset, uint pf_flags, VmUnmapList* unmap_list,
+                                           vm_page_t** spare, paddr_t* _pa) {
     DEBUG_ASSERT(lock_.IsHeld());
 
     if (offset >= size_)
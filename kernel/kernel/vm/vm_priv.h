@@ -28,6 +28,11 @@ void vmm_init(void);
 // global vmm lock (for now)
 extern mutex_t vmm_lock;
 
+// fault-around window, in pages past the faulting one; vm.fault_around=<pages>
+#define VM_FAULT_AROUND_DEFAULT_PAGES 16
+#define VM_FAULT_AROUND_MAX_PAGES 256
+extern uint vm_fault_around_pages;
+
 // utility function to test that offset + len is entirely within a range
 // returns false if out of range
 // NOTE: only use unsigned lengths
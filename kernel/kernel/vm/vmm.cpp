@@ -11,6 +11,7 @@
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
 #include <kernel/mutex.h>
+#include <kernel/thread.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_address_region.h>
@@ -152,6 +153,8 @@ status_t vmm_page_fault_handler(vaddr_t addr, uint flags) {
     ktrace(TAG_PAGE_FAULT, 0, (uint32_t)addr, flags, arch_curr_cpu_num());
 #endif
 
+    THREAD_STATS_INC(page_faults);
+
     // get the address space object this pointer is in
     VmAspace* aspace = vmm_aspace_to_obj(vaddr_to_aspace((void*)addr));
     if (!aspace)
@@ -16,6 +16,14 @@ void *cmpct_realloc(void *, size_t);
 void cmpct_free(void *);
 void *cmpct_memalign(size_t size, size_t alignment);
 
+/* Allocate or free many objects of the same size with a single lock hold.
+ * cmpct_alloc_batch returns the number of objects actually allocated. */
+size_t cmpct_alloc_batch(size_t size, void **out, size_t count);
+void cmpct_free_batch(void **payloads, size_t count);
+
+/* Number of bytes usable in an allocation, at least what was asked for. */
+size_t cmpct_usable_size(void *payload);
+
 void cmpct_init(void);
 void cmpct_dump(void);
 void cmpct_test(void);
@@ -68,6 +68,29 @@ static inline void HEAP_INIT(void)
 #define HEAP_TRIM miniheap_trim
 
 /* end miniheap implementation */
+#elif WITH_LIB_HEAP_PCPUCACHE
+/* cmpctmalloc behind per-cpu size class caches implementation */
+#include <lib/cmpctmalloc.h>
+#include <lib/pcpucache.h>
+
+#define HEAP_MEMALIGN(boundary, s) pcpucache_memalign(s, boundary)
+#define HEAP_MALLOC pcpucache_alloc
+#define HEAP_REALLOC pcpucache_realloc
+#define HEAP_FREE pcpucache_free
+#define HEAP_INIT pcpucache_init
+#define HEAP_DUMP pcpucache_dump
+#define HEAP_TRIM pcpucache_trim
+static inline void *HEAP_CALLOC(size_t n, size_t s)
+{
+    size_t realsize = n * s;
+
+    void *ptr = pcpucache_alloc(realsize);
+    if (likely(ptr))
+        memset(ptr, 0, realsize);
+    return ptr;
+}
+
+/* end cmpctmalloc behind per-cpu size class caches implementation */
 #elif WITH_LIB_HEAP_CMPCTMALLOC
 /* cmpctmalloc implementation */
 #include <lib/cmpctmalloc.h>
@@ -291,7 +314,7 @@ static void heap_dump(void)
 
 static void heap_test(void)
 {
-#if WITH_LIB_HEAP_CMPCTMALLOC
+#if WITH_LIB_HEAP_CMPCTMALLOC || WITH_LIB_HEAP_PCPUCACHE
     cmpct_test();
 #else
     void *ptr[16];
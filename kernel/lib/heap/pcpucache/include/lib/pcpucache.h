@@ -0,0 +1,26 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stddef.h>
+#include <magenta/compiler.h>
+
+__BEGIN_CDECLS;
+
+/* Per-cpu size class caches in front of cmpctmalloc. Small allocations and
+ * frees are served from the current cpu's cache and only go to the global
+ * heap, in batches, when the cache runs dry or overflows. */
+void *pcpucache_alloc(size_t);
+void *pcpucache_realloc(void *, size_t);
+void pcpucache_free(void *);
+void *pcpucache_memalign(size_t size, size_t alignment);
+
+void pcpucache_init(void);
+void pcpucache_dump(void);
+void pcpucache_trim(void);
+
+__END_CDECLS;
@@ -0,0 +1,160 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/pcpucache.h>
+
+#include <assert.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <trace.h>
+#include <kernel/magazine.h>
+#include <lib/cmpctmalloc.h>
+
+// Per-cpu size class caches in front of cmpctmalloc.
+//
+// Each size class has a set of per-cpu magazines of free blocks (see
+// kernel/magazine.h).  Allocations that fit a class are rounded up to it and
+// served from the current cpu's magazine; frees of blocks that are big enough
+// for a class (but not much bigger) go back into it.  Blocks only move to or
+// from cmpctmalloc in batches, under a single hold of the global heap lock.
+//
+// Everything bigger than the largest class goes straight to cmpctmalloc.
+
+#define LOCAL_TRACE 0
+
+// Payload sizes of the cached classes.
+static const size_t size_classes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+#define NUM_SIZE_CLASSES countof(size_classes)
+
+static struct magazine_depot size_class_depots[NUM_SIZE_CLASSES];
+static struct magazine_set size_class_magazines[NUM_SIZE_CLASSES];
+
+// Smallest class that fits an allocation of |size|, or -1 if none does.
+static int alloc_size_to_class(size_t size)
+{
+    for (uint i = 0; i < NUM_SIZE_CLASSES; i++) {
+        if (size <= size_classes[i])
+            return i;
+    }
+    return -1;
+}
+
+// Largest class a block with |usable| bytes can serve, or -1 if it is too
+// small for any class or would waste more than half of itself in one.
+static int block_size_to_class(size_t usable)
+{
+    if (usable < size_classes[0] || usable >= 2 * size_classes[NUM_SIZE_CLASSES - 1])
+        return -1;
+
+    int cls = NUM_SIZE_CLASSES - 1;
+    while (size_classes[cls] > usable)
+        cls--;
+    return cls;
+}
+
+static size_t depot_alloc(void *ctx, void **blocks, size_t count)
+{
+    return cmpct_alloc_batch(*(const size_t *)ctx, blocks, count);
+}
+
+static void depot_free(void *ctx, void **blocks, size_t count)
+{
+    cmpct_free_batch(blocks, count);
+}
+
+void *pcpucache_alloc(size_t size)
+{
+    if (size == 0u) return NULL;
+
+    int cls = alloc_size_to_class(size);
+    if (cls < 0)
+        return cmpct_alloc(size);
+
+    void *ptr;
+    return magazine_alloc(&size_class_magazines[cls], &ptr, 1) ? ptr : NULL;
+}
+
+void pcpucache_free(void *ptr)
+{
+    if (ptr == NULL) return;
+
+    int cls = block_size_to_class(cmpct_usable_size(ptr));
+    if (cls < 0) {
+        cmpct_free(ptr);
+        return;
+    }
+
+    magazine_free(&size_class_magazines[cls], &ptr, 1);
+}
+
+void *pcpucache_memalign(size_t size, size_t alignment)
+{
+    if (alignment < 8) return pcpucache_alloc(size);
+    return cmpct_memalign(size, alignment);
+}
+
+void *pcpucache_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL) return pcpucache_alloc(size);
+
+    // Shrinking, or growing into slack the block already has, stays put.
+    size_t old_size = cmpct_usable_size(ptr);
+    if (size <= old_size)
+        return ptr;
+
+    void *new_ptr = pcpucache_alloc(size);
+    if (new_ptr == NULL)
+        return NULL;
+    memcpy(new_ptr, ptr, old_size);
+    pcpucache_free(ptr);
+    return new_ptr;
+}
+
+void pcpucache_init(void)
+{
+    LTRACE_ENTRY;
+
+    for (uint cls = 0; cls < NUM_SIZE_CLASSES; cls++) {
+        size_class_depots[cls].alloc = depot_alloc;
+        size_class_depots[cls].free = depot_free;
+        size_class_depots[cls].ctx = (void *)&size_classes[cls];
+        magazine_set_init(&size_class_magazines[cls], &size_class_depots[cls]);
+    }
+
+    cmpct_init();
+}
+
+void pcpucache_dump(void)
+{
+    printf("\tper-cpu cache:\n");
+    printf("\t\t%6s %8s %12s %10s %10s\n", "class", "cached", "hits", "refills", "drains");
+    for (uint cls = 0; cls < NUM_SIZE_CLASSES; cls++) {
+        const struct magazine_set *set = &size_class_magazines[cls];
+        uint64_t hits = 0;
+        uint64_t refills = 0;
+        uint64_t drains = 0;
+        for (uint i = 0; i < countof(set->mags); i++) {
+            hits += set->mags[i].hits;
+            refills += set->mags[i].refills;
+            drains += set->mags[i].drains;
+        }
+        printf("\t\t%6zu %8zu %12" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+               size_classes[cls], magazine_cached(set), hits, refills, drains);
+    }
+
+    cmpct_dump();
+}
+
+void pcpucache_trim(void)
+{
+    // Give everything cached back to the heap so it can coalesce and return pages.
+    for (uint cls = 0; cls < NUM_SIZE_CLASSES; cls++)
+        magazine_drain_all(&size_class_magazines[cls]);
+
+    cmpct_trim();
+}
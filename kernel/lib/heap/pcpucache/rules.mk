@@ -0,0 +1,19 @@
+# Copyright 2017 The Fuchsia Authors
+#
+# Use of this source code is governed by a MIT-style
+# license that can be found in the LICENSE file or at
+# https://opensource.org/licenses/MIT
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+KERNEL_INCLUDES += $(LOCAL_DIR)/include
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_SRCS += \
+	$(LOCAL_DIR)/pcpucache.c
+
+MODULE_DEPS += \
+	lib/heap/cmpctmalloc
+
+include make/module.mk
@@ -26,6 +26,10 @@ endif
 ifeq ($(LK_HEAP_IMPLEMENTATION),cmpctmalloc)
 MODULE_DEPS := lib/heap/cmpctmalloc
 endif
+# cmpctmalloc behind per-cpu caches of small blocks, opt in only
+ifeq ($(LK_HEAP_IMPLEMENTATION),cmpctmalloc_pcpu)
+MODULE_DEPS := lib/heap/pcpucache
+endif
 
 KERNEL_DEFINES += LK_HEAP_IMPLEMENTATION=$(LK_HEAP_IMPLEMENTATION)
 
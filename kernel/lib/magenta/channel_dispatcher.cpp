@@ -188,6 +188,36 @@ status_t ChannelDispatcher::Read(uint32_t* msg_size,
     return rv;
 }
 
+status_t ChannelDispatcher::ReadMany(const mx_channel_msg_t* bufs, uint32_t num_bufs,
+                                     MessageList* msgs,
+                                     uint32_t* msg_size, uint32_t* msg_handle_count) {
+    AutoLock lock(&lock_);
+
+    if (messages_.is_empty())
+        return other_ ? ERR_SHOULD_WAIT : ERR_REMOTE_CLOSED;
+
+    uint32_t count = 0;
+    while (count < num_bufs && !messages_.is_empty()) {
+        const MessagePacket& next = messages_.front();
+        if (next.data_size() > bufs[count].num_bytes ||
+            next.num_handles() > bufs[count].num_handles)
+            break;
+        msgs->push_back(messages_.pop_front());
+        count++;
+    }
+
+    if (count == 0) {
+        *msg_size = messages_.front().data_size();
+        *msg_handle_count = messages_.front().num_handles();
+        return ERR_BUFFER_TOO_SMALL;
+    }
+
+    if (messages_.is_empty())
+        state_tracker_.UpdateState(MX_CHANNEL_READABLE, 0u);
+
+    return NO_ERROR;
+}
+
 status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
     mxtl::RefPtr<ChannelDispatcher> other;
     {
@@ -207,6 +237,21 @@ status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
     return NO_ERROR;
 }
 
+status_t ChannelDispatcher::WriteMany(MessageList* msgs) {
+    mxtl::RefPtr<ChannelDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ERR_REMOTE_CLOSED;
+        other = other_;
+    }
+
+    if (other->WriteSelfMany(msgs) > 0)
+        thread_preempt(false);
+
+    return NO_ERROR;
+}
+
 status_t ChannelDispatcher::Call(mxtl::unique_ptr<MessagePacket> msg,
                                  mx_time_t timeout, bool* return_handles,
                                  mxtl::unique_ptr<MessagePacket>* reply) {
@@ -260,6 +305,31 @@ status_t ChannelDispatcher::Call(mxtl::unique_ptr<MessagePacket> msg,
 
 int ChannelDispatcher::WriteSelf(mxtl::unique_ptr<MessagePacket> msg) {
     AutoLock lock(&lock_);
+
+    bool queued = false;
+    int woken = WriteSelfLocked(mxtl::move(msg), &queued);
+    if (queued)
+        state_tracker_.UpdateState(0u, MX_CHANNEL_READABLE);
+    return woken;
+}
+
+// Hands every message to a waiting caller or queues it, then raises
+// MX_CHANNEL_READABLE once for the lot.
+int ChannelDispatcher::WriteSelfMany(MessageList* msgs) {
+    AutoLock lock(&lock_);
+
+    int woken = 0;
+    bool queued = false;
+    while (!msgs->is_empty())
+        woken += WriteSelfLocked(msgs->pop_front(), &queued);
+    if (queued)
+        state_tracker_.UpdateState(0u, MX_CHANNEL_READABLE);
+    return woken;
+}
+
+// Sets |queued| if |msg| went on the message queue rather than to a waiter, in which case
+// the caller still has to update the state tracker.
+int ChannelDispatcher::WriteSelfLocked(mxtl::unique_ptr<MessagePacket> msg, bool* queued) {
     auto size = msg->data_size();
 
     if (!waiters_.is_empty()) {
@@ -278,8 +348,8 @@ int ChannelDispatcher::WriteSelf(mxtl::unique_ptr<MessagePacket> msg) {
         }
     }
     messages_.push_back(mxtl::move(msg));
+    *queued = true;
 
-    state_tracker_.UpdateState(0u, MX_CHANNEL_READABLE);
     if (iopc_)
         iopc_->Signal(MX_CHANNEL_READABLE, size, &lock_);
     return 0;
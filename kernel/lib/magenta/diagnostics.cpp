@@ -13,6 +13,7 @@
 
 #include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/message_packet.h>
 #include <magenta/process_dispatcher.h>
 
 static void DumpProcessListKeyMap() {
@@ -284,6 +285,7 @@ static int cmd_diagnostics(int argc, const cmd_args* argv) {
         printf("%s jb   <pid> : list job tree\n", argv[0].str);
         printf("%s kill <pid> : kill process\n", argv[0].str);
         printf("%s asd  <pid> : dump process address space\n", argv[0].str);
+        printf("%s mp         : dump message packet pools\n", argv[0].str);
         return -1;
     }
 
@@ -320,6 +322,8 @@ static int cmd_diagnostics(int argc, const cmd_args* argv) {
         if (argc < 3)
             goto usage;
         DumpProcessAddressSpace(argv[2].u);
+    } else if (strcmp(argv[1].str, "mp") == 0) {
+        MessagePacket::DumpPools();
     } else {
         printf("unrecognized subcommand\n");
         goto usage;
@@ -7,10 +7,71 @@
 #include <new.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object.h>
 #include <lib/user_copy/user_ptr.h>
 #include <magenta/fifo_dispatcher.h>
 #include <magenta/handle.h>
 
+static_assert(MX_FIFO_RING_ENTRIES(0) == PAGE_SIZE, "fifo ring layout assumes 4k pages");
+static_assert(2 * sizeof(mx_fifo_ring_t) <= PAGE_SIZE, "fifo ring headers must fit a page");
+
+// The VMO behind a MX_FIFO_SHARED_RING fifo, shared by both endpoints.  The
+// kernel keeps the header page mapped so that doorbells can read the indices
+// directly.  The VMO is pinned, so nothing userspace does with its handle can
+// take that page away from under the mapping.
+class FifoDispatcher::SharedRing : public mxtl::RefCounted<SharedRing> {
+public:
+    static status_t Create(mxtl::RefPtr<SharedRing>* out) {
+        AllocChecker ac;
+        auto ring = mxtl::AdoptRef(new (&ac) SharedRing());
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+
+        ring->vmo_ = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, MX_FIFO_RING_VMO_SIZE,
+                                           VmObjectPaged::kPinned);
+        if (!ring->vmo_)
+            return ERR_NO_MEMORY;
+
+        void* ptr;
+        status_t status = VmAspace::kernel_aspace()->MapObject(
+            ring->vmo_, "fifo ring", 0, PAGE_SIZE, &ptr, 0, 0, VMM_FLAG_COMMIT,
+            ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE);
+        if (status != NO_ERROR)
+            return status;
+        ring->mapping_ = reinterpret_cast<vaddr_t>(ptr);
+
+        *out = mxtl::move(ring);
+        return NO_ERROR;
+    }
+
+    ~SharedRing() {
+        if (mapping_)
+            VmAspace::kernel_aspace()->FreeRegion(mapping_);
+    }
+
+    mxtl::RefPtr<VmObject> vmo() const { return vmo_; }
+
+    // Number of entries in ring |index|, as far as userspace says.  The
+    // indices are untrusted, but the worst a bad pair can do is make the
+    // ring look full.
+    uint32_t Count(uint32_t index) const {
+        auto ring = reinterpret_cast<volatile mx_fifo_ring_t*>(
+            mapping_ + MX_FIFO_RING_HEADER(index));
+        return ring->head - ring->tail;
+    }
+
+    // Serializes doorbells, so signals are never set from stale indices.
+    Mutex lock;
+
+private:
+    SharedRing() : mapping_(0) {}
+
+    mxtl::RefPtr<VmObject> vmo_;
+    vaddr_t mapping_;
+};
+
 
 constexpr mx_rights_t kDefaultFifoRights =
     MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_WRITE;
@@ -28,6 +89,14 @@ status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t opti
         ((count * elemsize) > kMaxSizeBytes)) {
         return ERR_OUT_OF_RANGE;
     }
+    if (options & ~MX_FIFO_SHARED_RING)
+        return ERR_INVALID_ARGS;
+
+    mx_status_t status;
+    mxtl::RefPtr<SharedRing> ring;
+    if ((options & MX_FIFO_SHARED_RING) && (status = SharedRing::Create(&ring)) != NO_ERROR)
+        return status;
+
     AllocChecker ac;
     auto fifo0 = mxtl::AdoptRef(new (&ac) FifoDispatcher(count, elemsize, options));
     if (!ac.check())
@@ -37,10 +106,9 @@ status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t opti
     if (!ac.check())
         return ERR_NO_MEMORY;
 
-    mx_status_t status;
-    if ((status = fifo0->Init(fifo1)) != NO_ERROR)
+    if ((status = fifo0->Init(fifo1, ring, 0u)) != NO_ERROR)
         return status;
-    if ((status = fifo1->Init(fifo0)) != NO_ERROR)
+    if ((status = fifo1->Init(fifo0, ring, 1u)) != NO_ERROR)
         return status;
 
     *rights = kDefaultFifoRights;
@@ -52,7 +120,7 @@ status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t opti
 FifoDispatcher::FifoDispatcher(uint32_t count, uint32_t elem_size, uint32_t /*options*/)
     : elem_count_(count), elem_size_(elem_size), mask_(count - 1),
       peer_koid_(0u), state_tracker_(MX_FIFO_WRITABLE),
-      head_(0u), tail_(0u) {
+      head_(0u), tail_(0u), data_(nullptr), ring_index_(0u) {
 }
 
 FifoDispatcher::~FifoDispatcher() {
@@ -61,9 +129,17 @@ FifoDispatcher::~FifoDispatcher() {
 
 // Thread safety analysis disabled as this happens during creation only,
 // when no other thread could be accessing the object.
-mx_status_t FifoDispatcher::Init(mxtl::RefPtr<FifoDispatcher> other) TA_NO_THREAD_SAFETY_ANALYSIS {
+mx_status_t FifoDispatcher::Init(mxtl::RefPtr<FifoDispatcher> other,
+                                 mxtl::RefPtr<SharedRing> ring,
+                                 uint32_t ring_index) TA_NO_THREAD_SAFETY_ANALYSIS {
     other_ = mxtl::move(other);
     peer_koid_ = other_->get_koid();
+    if (ring) {
+        // Entries live in the shared VMO instead.
+        ring_ = mxtl::move(ring);
+        ring_index_ = ring_index;
+        return NO_ERROR;
+    }
     if ((data_ = (uint8_t*) calloc(elem_count_, elem_size_)) == nullptr)
         return ERR_NO_MEMORY;
     return NO_ERROR;
@@ -86,6 +162,9 @@ void FifoDispatcher::OnPeerZeroHandles() {
 }
 
 mx_status_t FifoDispatcher::Write(const uint8_t* ptr, size_t len, uint32_t* actual) {
+    if (ring_)
+        return ERR_BAD_STATE;
+
     mxtl::RefPtr<FifoDispatcher> other;
     {
         AutoLock lock(&lock_);
@@ -152,6 +231,9 @@ mx_status_t FifoDispatcher::WriteSelf(const uint8_t* ptr, size_t bytelen, uint32
 }
 
 mx_status_t FifoDispatcher::Read(uint8_t* ptr, size_t bytelen, uint32_t* actual) {
+    if (ring_)
+        return ERR_BAD_STATE;
+
     size_t count = bytelen / elem_size_;
     if (count == 0)
         return ERR_OUT_OF_RANGE;
@@ -204,4 +286,52 @@ mx_status_t FifoDispatcher::Read(uint8_t* ptr, size_t bytelen, uint32_t* actual)
 
     *actual = (tail_ - old_tail);
     return NO_ERROR;
-}
\ No newline at end of file
+}
+
+mx_status_t FifoDispatcher::GetRing(mxtl::RefPtr<VmObject>* vmo, uint32_t* index) {
+    if (!ring_)
+        return ERR_BAD_STATE;
+    *vmo = ring_->vmo();
+    *index = ring_index_;
+    return NO_ERROR;
+}
+
+mx_status_t FifoDispatcher::RingDoorbell() {
+    if (!ring_)
+        return ERR_BAD_STATE;
+
+    mxtl::RefPtr<FifoDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ERR_REMOTE_CLOSED;
+        other = other_;
+    }
+
+    AutoLock lock(&ring_->lock);
+    UpdateRingState();
+    other->UpdateRingState();
+    return NO_ERROR;
+}
+
+void FifoDispatcher::UpdateRingState() {
+    DEBUG_ASSERT(ring_->lock.IsHeld());
+
+    AutoLock lock(&lock_);
+    // Once the peer is gone our signals are final.
+    if (!other_)
+        return;
+
+    mx_signals_t set = 0u;
+    mx_signals_t clear = 0u;
+    // We consume from the peer's ring and produce into our own.
+    if (ring_->Count(ring_index_ ^ 1u) != 0u)
+        set |= MX_FIFO_READABLE;
+    else
+        clear |= MX_FIFO_READABLE;
+    if (ring_->Count(ring_index_) < elem_count_)
+        set |= MX_FIFO_WRITABLE;
+    else
+        clear |= MX_FIFO_WRITABLE;
+    state_tracker_.UpdateState(clear, set);
+}
@@ -11,6 +11,7 @@
 #include <magenta/futex_context.h>
 #include <magenta/user_copy.h>
 #include <magenta/user_thread.h>
+#include <mxtl/auto_call.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
@@ -24,16 +25,34 @@ FutexContext::~FutexContext() {
 
     // All of the threads should have removed themselves from wait queues
     // by the time the process has exited.
-    DEBUG_ASSERT(futex_table_.is_empty());
+#if LK_DEBUGLEVEL > 0
+    for (auto& bucket : buckets_) {
+        AutoLock lock(bucket.lock);
+        DEBUG_ASSERT(bucket.futex_table.is_empty());
+    }
+#endif
+}
+
+FutexContext::Bucket& FutexContext::GetBucket(uintptr_t futex_key) {
+    // Futexes are often packed together in one structure, so mix in some
+    // higher bits rather than just striding through the buckets.
+    uintptr_t hash = (futex_key >> 2) ^ (futex_key >> 9);
+    return buckets_[hash % kNumBuckets];
 }
 
 status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t timeout) {
     LTRACE_ENTRY;
 
+    return BlockOnFutex(value_ptr, current_value, nullptr, 0, timeout);
+}
+
+status_t FutexContext::BlockOnFutex(user_ptr<int> value_ptr, int current_value,
+                                    UserThread* pi_owner, int pi_handle, mx_time_t timeout) {
     uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
     if (futex_key % sizeof(int))
         return ERR_INVALID_ARGS;
 
+    Bucket* bucket = &GetBucket(futex_key);
     FutexNode* node;
 
     // FutexWait() checks that the address value_ptr still contains
@@ -42,37 +61,51 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
     // could miss wakeups.
-    lock_.Acquire();
+    bucket->lock.Acquire();
 
     int value;
     status_t result = value_ptr.copy_from_user(&value);
     if (result != NO_ERROR) {
-        lock_.Release();
+        bucket->lock.Release();
         return result;
     }
     if (value != current_value) {
-        lock_.Release();
+        bucket->lock.Release();
         return ERR_BAD_STATE;
     }
 
     UserThread* thread = UserThread::GetCurrent();
     node = thread->futex_node();
     node->set_hash_key(futex_key);
+    node->set_pi_handle(pi_handle);
     node->SetAsSingletonList();
 
-    QueueNodesLocked(node);
+    QueueNodesLocked(bucket, node);
+
+    if (pi_owner) {
+        THREAD_LOCK(state);
+        node->StartBoosting(pi_owner);
+        THREAD_UNLOCK(state);
+    }
+
+    // Block current thread.  This releases the bucket lock and does not
+    // reacquire it.
+    result = node->BlockThread(&bucket->lock, timeout);
+
+    if (pi_owner) {
+        THREAD_LOCK(state);
+        node->StopBoosting();
+        THREAD_UNLOCK(state);
+    }
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
-    result = node->BlockThread(&lock_, timeout);
     if (result == NO_ERROR) {
         // All the work necessary for removing us from the hash table was done by FutexWake()
         return NO_ERROR;
     }
 
-    AutoLock lock(lock_);
     // If we got a timeout, we need to remove the thread's node from the
     // wait queue, since FutexWake() didn't do that.
-    if (UnqueueNodeLocked(node)) {
+    if (UnqueueNode(node)) {
         return ERR_TIMED_OUT;
     }
     // The current thread was not found on the wait queue.  This means
@@ -106,10 +139,11 @@ status_t FutexContext::FutexWake(user_ptr<int> value_ptr, uint32_t count) {
     if (futex_key % sizeof(int))
         return ERR_INVALID_ARGS;
 
+    Bucket* bucket = &GetBucket(futex_key);
     {
-        AutoLock lock(lock_);
+        AutoLock lock(bucket->lock);
 
-        FutexNode* node = futex_table_.erase(futex_key);
+        FutexNode* node = bucket->futex_table.erase(futex_key);
         if (!node) {
             // nothing blocked on this futex if we can't find it
             return NO_ERROR;
@@ -122,7 +156,7 @@ status_t FutexContext::FutexWake(user_ptr<int> value_ptr, uint32_t count) {
 
         if (node != nullptr) {
             DEBUG_ASSERT(node->GetKey() == futex_key);
-            futex_table_.insert(node);
+            bucket->futex_table.insert(node);
         }
 
         // Traversing this list of threads must be done while holding the
@@ -136,29 +170,43 @@ status_t FutexContext::FutexWake(user_ptr<int> value_ptr, uint32_t count) {
 }
 
 status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count, int current_value,
-                                    user_ptr<int> requeue_ptr, uint32_t requeue_count) {
+                                    user_ptr<int> requeue_ptr, uint32_t requeue_count)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
     LTRACE_ENTRY;
 
     if ((requeue_ptr.get() == nullptr) && requeue_count)
         return ERR_INVALID_ARGS;
 
-    AutoLock lock(lock_);
-
-    int value;
-    status_t result = wake_ptr.copy_from_user(&value);
-    if (result != NO_ERROR) return result;
-    if (value != current_value) return ERR_BAD_STATE;
-
     uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
     uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
     if (wake_key == requeue_key) return ERR_INVALID_ARGS;
     if (wake_key % sizeof(int) || requeue_key % sizeof(int))
         return ERR_INVALID_ARGS;
 
+    // Both futexes' buckets are held throughout, locked in address order
+    // so that two requeues in opposite directions cannot deadlock.
+    Bucket* wake_bucket = &GetBucket(wake_key);
+    Bucket* requeue_bucket = &GetBucket(requeue_key);
+    Bucket* first = wake_bucket < requeue_bucket ? wake_bucket : requeue_bucket;
+    Bucket* second = wake_bucket < requeue_bucket ? requeue_bucket : wake_bucket;
+    first->lock.Acquire();
+    if (second != first)
+        second->lock.Acquire();
+    auto unlock = mxtl::MakeAutoCall([first, second]() TA_NO_THREAD_SAFETY_ANALYSIS {
+        if (second != first)
+            second->lock.Release();
+        first->lock.Release();
+    });
+
+    int value;
+    status_t result = wake_ptr.copy_from_user(&value);
+    if (result != NO_ERROR) return result;
+    if (value != current_value) return ERR_BAD_STATE;
+
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
+    // nodes below, because operations on futex_table look at the GetKey
     // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    FutexNode* node = wake_bucket->futex_table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return NO_ERROR;
@@ -182,22 +230,89 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
 
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            QueueNodesLocked(requeue_bucket, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_bucket->futex_table.insert(node);
     }
 
     FutexNode::WakeThreads(wake_head);
     return NO_ERROR;
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.IsHeld());
+status_t FutexContext::FutexLockPi(user_ptr<int> value_ptr, int current_value,
+                                   mxtl::RefPtr<UserThread> owner, int new_owner,
+                                   mx_time_t timeout) {
+    LTRACE_ENTRY;
+
+    if (owner.get() == UserThread::GetCurrent())
+        return ERR_INVALID_ARGS;
+
+    // |owner| stays referenced until we are done boosting it, or it has
+    // handed the futex on.
+    return BlockOnFutex(value_ptr, current_value, owner.get(), new_owner, timeout);
+}
+
+status_t FutexContext::FutexUnlockPi(user_ptr<int> value_ptr, int current_value) {
+    LTRACE_ENTRY;
+
+    uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
+    if (futex_key % sizeof(int))
+        return ERR_INVALID_ARGS;
+
+    Bucket* bucket = &GetBucket(futex_key);
+    AutoLock lock(bucket->lock);
+
+    int value;
+    status_t result = value_ptr.copy_from_user(&value);
+    if (result != NO_ERROR)
+        return result;
+    if (value != current_value)
+        return ERR_BAD_STATE;
+
+    FutexNode* head = bucket->futex_table.erase(futex_key);
+    if (!head)
+        return value_ptr.copy_to_user(0);
+
+    FutexNode* next_owner;
+    {
+        THREAD_LOCK(state);
+        next_owner = FutexNode::NextPiOwner(head);
+        THREAD_UNLOCK(state);
+    }
+
+    // Store the next owner in the futex before anyone is woken.  A waiter
+    // that came in through FutexWait() has no handle to store, so it is
+    // woken to an unlocked futex and has to race for it.
+    int new_value = next_owner->pi_handle();
+    if (new_value && !head->IsOnlyNodeInList())
+        new_value |= MX_FUTEX_PI_WAITERS;
+    result = value_ptr.copy_to_user(new_value);
+    if (result != NO_ERROR) {
+        bucket->futex_table.insert(head);
+        return result;
+    }
+
+    FutexNode* rest = FutexNode::RemoveNodeFromList(head, next_owner);
+    {
+        THREAD_LOCK(state);
+        FutexNode::HandOffPi(next_owner, rest, UserThread::GetCurrent());
+        THREAD_UNLOCK(state);
+    }
+
+    if (rest)
+        bucket->futex_table.insert(rest);
+    next_owner->SetAsSingletonList();
+    FutexNode::WakeThreads(next_owner);
+    return NO_ERROR;
+}
+
+void FutexContext::QueueNodesLocked(Bucket* bucket, FutexNode* head) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     FutexNode::HashTable::iterator iter;
 
@@ -205,29 +320,41 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!bucket->futex_table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
+bool FutexContext::UnqueueNode(FutexNode* node) {
+    for (;;) {
+        // Note: When UnqueueNode() is called from FutexWait(), it might be
+        // tempting to reuse the futex key that was passed to FutexWait().
+        // However, that could be out of date if the thread was requeued by
+        // FutexRequeue(), so we need to re-get the hash table key here.
+        // Requeuing changes the key with both buckets locked, so it cannot
+        // change once we hold the bucket it names.
+        uintptr_t futex_key = node->GetKey();
+        Bucket* bucket = &GetBucket(futex_key);
+        AutoLock lock(bucket->lock);
+        if (node->GetKey() == futex_key)
+            return UnqueueNodeLocked(bucket, node);
+    }
+}
+
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
 // found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.IsHeld());
+bool FutexContext::UnqueueNodeLocked(Bucket* bucket, FutexNode* node) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     if (!node->IsInQueue())
         return false;
 
-    // Note: When UnqueueNode() is called from FutexWait(), it might be
-    // tempting to reuse the futex key that was passed to FutexWait().
-    // However, that could be out of date if the thread was requeued by
-    // FutexRequeue(), so we need to re-get the hash table key here.
     uintptr_t futex_key = node->GetKey();
 
-    FutexNode* old_head = futex_table_.erase(futex_key);
+    FutexNode* old_head = bucket->futex_table.erase(futex_key);
     DEBUG_ASSERT(old_head);
     FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
     if (new_head)
-        futex_table_.insert(new_head);
+        bucket->futex_table.insert(new_head);
     return true;
 }
@@ -6,8 +6,10 @@
 
 #include <assert.h>
 #include <err.h>
+#include <kernel/sched.h>
 #include <magenta/futex_node.h>
 #include <magenta/magenta.h>
+#include <magenta/user_thread.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
@@ -31,6 +33,11 @@ bool FutexNode::IsInQueue() const {
     return queue_next_ != nullptr;
 }
 
+bool FutexNode::IsOnlyNodeInList() const {
+    DEBUG_ASSERT(IsInQueue());
+    return queue_next_ == this;
+}
+
 void FutexNode::SetAsSingletonList() {
     DEBUG_ASSERT(!IsInQueue());
     queue_prev_ = this;
@@ -144,6 +151,101 @@ void FutexNode::WakeThreads(FutexNode* head) {
     } while (node != head);
 }
 
+void FutexNode::StartBoosting(UserThread* owner) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(pi_owner_ == nullptr);
+
+    pi_owner_ = owner;
+    pi_thread_ = get_current_thread();
+    owner->pi_waiters().push_back(this);
+
+    thread_t* owner_thread = owner->lk_thread();
+    if (pi_thread_->priority > owner_thread->inherited_priority)
+        thread_set_inherited_priority_locked(owner_thread, pi_thread_->priority);
+}
+
+void FutexNode::StopBoosting() {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    // pi_thread_ is left set for HandOffPi() to find our thread, should it
+    // hand us the futex after we timed out but before we left its queue.
+    UserThread* owner = pi_owner_;
+    if (owner == nullptr)
+        return;
+    owner->pi_waiters().erase(*this);
+    pi_owner_ = nullptr;
+    UpdateInheritedPriority(owner);
+}
+
+FutexNode* FutexNode::NextPiOwner(FutexNode* head) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    FutexNode* best = nullptr;
+    int best_priority = 0;
+    FutexNode* node = head;
+    do {
+        // Threads that came in through FutexWait(), or have already timed
+        // out, rank below everyone.
+        int priority = node->pi_owner_ ? node->pi_thread_->priority : -1;
+        if (!best || priority > best_priority) {
+            best = node;
+            best_priority = priority;
+        }
+        node = node->queue_next_;
+    } while (node != head);
+    return best;
+}
+
+void FutexNode::HandOffPi(FutexNode* next_owner, FutexNode* rest, UserThread* from) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    if (next_owner->pi_owner_ == from) {
+        from->pi_waiters().erase(*next_owner);
+        next_owner->pi_owner_ = nullptr;
+    }
+
+    // A thread that came in through FutexWait() is not handed the futex, so
+    // there is nobody left to boost.
+    UserThread* to = nullptr;
+    if (next_owner->pi_handle_)
+        to = reinterpret_cast<UserThread*>(next_owner->pi_thread_->user_thread);
+
+    if (rest) {
+        FutexNode* node = rest;
+        do {
+            if (node->pi_owner_ == from) {
+                from->pi_waiters().erase(*node);
+                node->pi_owner_ = to;
+                if (to)
+                    to->pi_waiters().push_back(node);
+            }
+            node = node->queue_next_;
+        } while (node != rest);
+    }
+
+    UpdateInheritedPriority(from);
+    if (to)
+        UpdateInheritedPriority(to);
+}
+
+void FutexNode::DetachPiWaiters(UserThread* owner) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    while (!owner->pi_waiters().is_empty())
+        owner->pi_waiters().pop_front()->pi_owner_ = nullptr;
+}
+
+void FutexNode::UpdateInheritedPriority(UserThread* owner) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    int priority = 0;
+    for (const auto& waiter : owner->pi_waiters()) {
+        if (waiter.pi_thread_->priority > priority)
+            priority = waiter.pi_thread_->priority;
+    }
+    thread_set_inherited_priority_locked(owner->lk_thread(), priority);
+}
+
 // Set |node1| and |node2|'s list pointers so that |node1| is immediately
 // before |node2| in the linked list.
 void FutexNode::RelinkAsAdjacent(FutexNode* node1, FutexNode* node2) {
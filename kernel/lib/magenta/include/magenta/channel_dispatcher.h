@@ -22,6 +22,8 @@ class MessagePacket;
 
 class ChannelDispatcher final : public Dispatcher {
 public:
+    using MessageList = mxtl::DoublyLinkedList<mxtl::unique_ptr<MessagePacket>>;
+
     static status_t Create(uint32_t flags, mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1, mx_rights_t* rights);
 
@@ -44,19 +46,31 @@ public:
                   mxtl::unique_ptr<MessagePacket>* msg,
                   bool may_disard);
 
+    // Read as many messages as there are |bufs| from this endpoint's message queue, under a
+    // single hold of the lock, stopping early at the first one that doesn't fit the
+    // |num_bytes| and |num_handles| of its buffer.  On ERR_BUFFER_TOO_SMALL, not even the
+    // first message fit and |msg_size| and |msg_handle_count| give its size.
+    status_t ReadMany(const mx_channel_msg_t* bufs, uint32_t num_bufs, MessageList* msgs,
+                      uint32_t* msg_size, uint32_t* msg_handle_count);
+
     // Write to the opposing endpoint's message queue.
     status_t Write(mxtl::unique_ptr<MessagePacket> msg);
+
+    // Write all of |msgs| to the opposing endpoint's message queue at once.  On failure,
+    // |msgs| is left as it was so the caller can take back their handles.
+    status_t WriteMany(MessageList* msgs);
     status_t Call(mxtl::unique_ptr<MessagePacket> msg,
                   mx_time_t timeout, bool* return_handles,
                   mxtl::unique_ptr<MessagePacket>* reply);
 
 private:
-    using MessageList = mxtl::DoublyLinkedList<mxtl::unique_ptr<MessagePacket>>;
     using WaiterList = mxtl::DoublyLinkedList<MessageWaiter*>;
 
     ChannelDispatcher(uint32_t flags);
     void Init(mxtl::RefPtr<ChannelDispatcher> other);
     int WriteSelf(mxtl::unique_ptr<MessagePacket> msg);
+    int WriteSelfMany(MessageList* msgs);
+    int WriteSelfLocked(mxtl::unique_ptr<MessagePacket> msg, bool* queued) TA_REQ(lock_);
     status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     void OnPeerZeroHandles();
 
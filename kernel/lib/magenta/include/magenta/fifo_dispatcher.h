@@ -15,6 +15,9 @@
 #include <magenta/types.h>
 
 #include <mxtl/ref_counted.h>
+#include <mxtl/ref_ptr.h>
+
+class VmObject;
 
 class FifoDispatcher final : public Dispatcher {
 public:
@@ -33,10 +36,21 @@ public:
     mx_status_t Write(const uint8_t* ptr, size_t len, uint32_t* actual);
     mx_status_t Read(uint8_t* dst, size_t len, uint32_t* actual);
 
+    // For MX_FIFO_SHARED_RING fifos: the VMO holding both rings, and the
+    // index of the ring this endpoint produces into.
+    mx_status_t GetRing(mxtl::RefPtr<VmObject>* vmo, uint32_t* index);
+    // For MX_FIFO_SHARED_RING fifos: bring both endpoints' READABLE and
+    // WRITABLE signals up to date with the shared indices.
+    mx_status_t RingDoorbell();
+
 private:
+    class SharedRing;
+
     FifoDispatcher(uint32_t elem_count, uint32_t elem_size, uint32_t options);
-    mx_status_t Init(mxtl::RefPtr<FifoDispatcher> other);
+    mx_status_t Init(mxtl::RefPtr<FifoDispatcher> other, mxtl::RefPtr<SharedRing> ring,
+                     uint32_t ring_index);
     mx_status_t WriteSelf(const uint8_t* ptr, size_t len, uint32_t* actual);
+    void UpdateRingState();
 
     void OnPeerZeroHandles();
 
@@ -52,5 +66,9 @@ private:
     uint32_t tail_ TA_GUARDED(lock_);
     uint8_t* data_ TA_GUARDED(lock_);
 
+    // Only set for MX_FIFO_SHARED_RING fifos, which have no data_.
+    mxtl::RefPtr<SharedRing> ring_;
+    uint32_t ring_index_;
+
     static constexpr uint32_t kMaxSizeBytes = 4096;
 };
@@ -10,10 +10,15 @@
 #include <lib/user_copy/user_ptr.h>
 #include <magenta/futex_node.h>
 #include <magenta/types.h>
+#include <mxtl/ref_ptr.h>
+
+class UserThread;
 
 // FutexContext is a class that encapsulates support for futex operations.
 // FutexContext uses a hash table keyed on the futex address (a pointer to integer in userspace)
 // to contain all active futexes.
+// The table is split into buckets by address, each with its own lock, so that
+// operations on unrelated futexes in a process do not contend with each other.
 // A futex is considered active if there is one or more threads blocked on the futex.
 // After no threads are left blocked on a futex it is removed from the hash table.
 // The value in the futex hash table is the FutexNode object associated with the head
@@ -47,18 +52,48 @@ public:
     status_t FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count, int current_value,
                           user_ptr<int> requeue_ptr, uint32_t requeue_count);
 
+    // FutexLockPi is FutexWait for a priority inheriting futex, held by
+    // |owner|.  Until it returns, whoever holds the futex runs at no lower a
+    // priority than the current thread.  It returns NO_ERROR once
+    // FutexUnlockPi has handed the futex to the current thread, by storing
+    // |new_owner| in it.
+    status_t FutexLockPi(user_ptr<int> value_ptr, int current_value,
+                         mxtl::RefPtr<UserThread> owner, int new_owner, mx_time_t timeout);
+
+    // FutexUnlockPi hands the |value_ptr| futex, which the current thread
+    // holds as |current_value|, straight to the highest priority thread
+    // blocked on it, or sets it to 0 if there are none.  The futex is never
+    // free in between, so nobody can take it out from under the waiters,
+    // who go on to boost the new owner instead of the current thread.
+    status_t FutexUnlockPi(user_ptr<int> value_ptr, int current_value);
+
 private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    static constexpr size_t kNumBuckets = 32;
+
+    struct Bucket {
+        Mutex lock;
+
+        // Key is futex address, value is the FutexNode for the head of
+        // futex's blocked thread list.
+        FutexNode::HashTable futex_table TA_GUARDED(lock);
+    };
+
+    Bucket& GetBucket(uintptr_t futex_key);
+
+    // Blocks the current thread on a futex, as the common part of FutexWait
+    // and FutexLockPi.
+    status_t BlockOnFutex(user_ptr<int> value_ptr, int current_value,
+                          UserThread* pi_owner, int pi_handle, mx_time_t timeout);
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+    void QueueNodesLocked(Bucket* bucket, FutexNode* head) TA_REQ(bucket->lock);
 
-    // protects futex_table_
-    Mutex lock_;
+    // Unqueues the node of a thread whose wait has ended, which may have
+    // been requeued to another futex (and so bucket) in the meantime.
+    bool UnqueueNode(FutexNode* node);
+    bool UnqueueNodeLocked(Bucket* bucket, FutexNode* node) TA_REQ(bucket->lock);
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+    Bucket buckets_[kNumBuckets];
 };
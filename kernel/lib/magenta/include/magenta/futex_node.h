@@ -11,13 +11,28 @@
 #include <kernel/wait.h>
 #include <list.h>
 #include <magenta/types.h>
+#include <mxtl/intrusive_double_list.h>
 #include <mxtl/intrusive_hash_table.h>
 
+class UserThread;
+
 // Node for linked list of threads blocked on a futex
 // Intended to be embedded within a UserThread Instance
 class FutexNode : public mxtl::SinglyLinkedListable<FutexNode*> {
 public:
-    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*>;
+    // Each lock bucket of a FutexContext keeps its own table of futexes.
+    // Collisions within a bucket are rare enough that one chain will do.
+    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*,
+                                      mxtl::SinglyLinkedList<FutexNode*>, size_t, 1>;
+
+    // Traits to belong to the list of threads blocked on the PI futexes
+    // that a thread holds.
+    struct PiListTraits {
+        static mxtl::DoublyLinkedListNodeState<FutexNode*>& node_state(FutexNode& obj) {
+            return obj.dll_pi_;
+        }
+    };
+    using PiWaiterList = mxtl::DoublyLinkedList<FutexNode*, PiListTraits>;
 
     FutexNode();
     ~FutexNode();
@@ -26,6 +41,7 @@ public:
     FutexNode& operator=(const FutexNode &) = delete;
 
     bool IsInQueue() const;
+    bool IsOnlyNodeInList() const;
     void SetAsSingletonList();
 
     // adds a list of nodes to our tail
@@ -44,10 +60,37 @@ public:
     // wakes the list of threads starting with node |head|
     static void WakeThreads(FutexNode* head);
 
+    // The rest is for priority inheriting futexes, and must be called with
+    // thread_lock held.
+
+    // Makes this node's thread, which is about to block, boost |owner|.
+    void StartBoosting(UserThread* owner);
+    // Stops this node's thread from boosting whichever thread it was, once
+    // it is done waiting.
+    void StopBoosting();
+    // Returns the highest priority thread in the list starting at |head| to
+    // hand the futex to.  Threads waiting through FutexWait() come last.
+    static FutexNode* NextPiOwner(FutexNode* head);
+    // Moves the futex |from| its owner to |next_owner|, which has been taken
+    // off the list of waiters |rest|.  Everyone left in |rest| that boosted
+    // |from| boosts |next_owner| from now on.
+    static void HandOffPi(FutexNode* next_owner, FutexNode* rest, UserThread* from);
+    // Stops every thread from boosting |owner|, which is going away.
+    static void DetachPiWaiters(UserThread* owner);
+    // Recomputes the priority |owner| inherits from its PI waiters.
+    static void UpdateInheritedPriority(UserThread* owner);
+
     void set_hash_key(uintptr_t key) {
         hash_key_ = key;
     }
 
+    // The value to store in a PI futex when it is handed to this node's
+    // thread, or 0 if it blocked through FutexWait().
+    int pi_handle() const { return pi_handle_; }
+    void set_pi_handle(int handle) {
+        pi_handle_ = handle;
+    }
+
     // Trait implementation for mxtl::HashTable
     uintptr_t GetKey() const { return hash_key_; }
     static size_t GetHash(uintptr_t key) { return (key >> 3); }
@@ -76,4 +119,16 @@ private:
     //  * When the thread is not waiting on a futex, queue_next_ is null.
     FutexNode* queue_prev_ = nullptr;
     FutexNode* queue_next_ = nullptr;
+
+    // Set along with the hash key when the thread blocks.
+    int pi_handle_ = 0;
+
+    // While blocked in FutexLockPi(), the thread this one boosts, its own
+    // lk thread, and its entry in the owner's pi_waiters() list.  These are
+    // guarded by thread_lock.  The blocked thread holds a reference to the
+    // owner it blocked on; an owner it was handed on to clears pi_owner_
+    // before it goes away.
+    UserThread* pi_owner_ = nullptr;
+    thread_t* pi_thread_ = nullptr;
+    mxtl::DoublyLinkedListNodeState<FutexNode*> dll_pi_;
 };
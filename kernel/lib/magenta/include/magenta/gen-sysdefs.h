@@ -4,6 +4,9 @@
 mx_time_t sys_time_get(
     uint32_t clock_id);
 
+mx_time_t sys_time_get_kernel(
+    uint32_t clock_id);
+
 mx_status_t sys_nanosleep(
     mx_time_t nanoseconds);
 
@@ -127,6 +130,20 @@ mx_status_t sys_channel_call(
     uint32_t actual_handles[1],
     mx_status_t read_status[1]);
 
+mx_status_t sys_channel_read_many(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_channel_msg_t msgs[],
+    uint32_t num_msgs,
+    uint32_t actual_msgs[1]);
+
+mx_status_t sys_channel_write_many(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_channel_msg_t msgs[],
+    uint32_t num_msgs,
+    uint32_t actual_msgs[1]);
+
 mx_status_t sys_socket_create(
     uint32_t options,
     mx_handle_t out0[1],
@@ -146,6 +163,34 @@ mx_status_t sys_socket_read(
     size_t size,
     size_t actual[1]);
 
+mx_status_t sys_socket_create_etc(
+    uint32_t options,
+    size_t buffer_size,
+    mx_handle_t out0[1],
+    mx_handle_t out1[1]);
+
+mx_status_t sys_socket_writev(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_iovec_t iov[],
+    uint32_t num_iov,
+    size_t actual[1]);
+
+mx_status_t sys_socket_readv(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_iovec_t iov[],
+    uint32_t num_iov,
+    size_t actual[1]);
+
+mx_status_t sys_socket_splice(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_handle_t vmo,
+    uint64_t offset,
+    size_t size,
+    size_t actual[1]);
+
 void sys_thread_exit();
 
 mx_status_t sys_thread_create(
@@ -245,6 +290,15 @@ mx_status_t sys_futex_requeue(
     mx_futex_t requeue_ptr[1],
     uint32_t requeue_count);
 
+mx_status_t sys_futex_lock_pi(
+    mx_futex_t value_ptr[1],
+    int current_value,
+    mx_handle_t new_owner,
+    mx_time_t timeout);
+
+mx_status_t sys_futex_unlock_pi(
+    mx_futex_t value_ptr[1]);
+
 mx_status_t sys_waitset_create(
     uint32_t options,
     mx_handle_t out[1]);
@@ -280,6 +334,13 @@ mx_status_t sys_port_wait(
     void* packet,
     size_t size);
 
+mx_status_t sys_port_wait_many(
+    mx_handle_t handle,
+    mx_time_t timeout,
+    void* packets,
+    uint32_t count,
+    uint32_t actual[1]);
+
 mx_status_t sys_port_bind(
     mx_handle_t handle,
     uint64_t key,
@@ -321,6 +382,13 @@ mx_status_t sys_vmo_op_range(
     void* buffer,
     size_t buffer_size);
 
+mx_status_t sys_vmo_clone(
+    mx_handle_t handle,
+    uint32_t options,
+    uint64_t offset,
+    uint64_t size,
+    mx_handle_t out[1]);
+
 mx_status_t sys_cprng_draw(
     void* buffer,
     size_t len,
@@ -349,6 +417,14 @@ mx_status_t sys_fifo_write(
     size_t len,
     uint32_t num_written[1]);
 
+mx_status_t sys_fifo_get_ring(
+    mx_handle_t handle,
+    mx_handle_t vmo[1],
+    uint32_t ring[1]);
+
+mx_status_t sys_fifo_doorbell(
+    mx_handle_t handle);
+
 mx_status_t sys_log_create(
     uint32_t options,
     mx_handle_t out[1]);
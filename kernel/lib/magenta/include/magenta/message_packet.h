@@ -6,27 +6,52 @@
 
 #pragma once
 
+#include <debug.h>
 #include <stdint.h>
 
+#include <lib/user_copy/user_ptr.h>
 #include <magenta/types.h>
 #include <mxtl/intrusive_double_list.h>
+#include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
 class Handle;
+class VmAspace;
+class VmObject;
 
 class MessagePacket : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<MessagePacket>> {
 public:
-    // Creates a message packet.
+    // Payloads at least this big are kept in the pages of a VMO rather than on the heap.
+    static constexpr uint32_t kPagedDataThreshold = 16384u;
+
+    // Creates a message packet whose payload the caller fills in through mutable_data().
     static mx_status_t Create(uint32_t data_size, uint32_t num_handles,
                               mxtl::unique_ptr<MessagePacket>* msg);
 
+    // Creates a message packet holding a copy of the |data_size| bytes at |data|.
+    static mx_status_t Create(user_ptr<const void> data, uint32_t data_size, uint32_t num_handles,
+                              mxtl::unique_ptr<MessagePacket>* msg);
+
+    // Copies the payload out to |dst| in |aspace|.  The whole pages of a paged payload are
+    // moved into the VMO mapped there instead, if |dst| is page aligned and writable.
+    mx_status_t CopyDataTo(user_ptr<void> dst, VmAspace* aspace);
+
     uint32_t data_size() const { return data_size_; }
     uint32_t num_handles() const { return num_handles_; }
 
     void set_owns_handles(bool own_handles) { owns_handles_ = own_handles; }
 
-    const void* data() const { return static_cast<void*>(handles_ + num_handles_); }
-    void* mutable_data() { return static_cast<void*>(handles_ + num_handles_); }
+    bool is_paged() const { return vmo_ != nullptr; }
+
+    // Only for payloads that aren't paged.
+    const void* data() const {
+        DEBUG_ASSERT(!is_paged());
+        return static_cast<void*>(handles_ + num_handles_);
+    }
+    void* mutable_data() {
+        DEBUG_ASSERT(!is_paged());
+        return static_cast<void*>(handles_ + num_handles_);
+    }
     Handle* const* handles() const { return handles_; }
     Handle** mutable_handles() { return handles_; }
 
@@ -35,22 +60,29 @@ public:
     uint32_t get_txid() const {
         if (data_size_ < sizeof(uint32_t)) {
             return 0;
+        } else if (is_paged()) {
+            return txid_;
         } else {
             return *(reinterpret_cast<const uint32_t*>(data()));
         }
     }
 
+    // Prints how many packets are live in each size class.
+    static void DumpPools();
+
 private:
     MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles);
     ~MessagePacket();
 
-    static void operator delete(void* ptr) {
-        free(ptr);
-    }
+    static void operator delete(void* ptr);
     friend class mxtl::unique_ptr<MessagePacket>;
 
     bool owns_handles_;
     uint32_t data_size_;
     uint32_t num_handles_;
     Handle** handles_;
+
+    // The payload, if it is paged, and a copy of its leading uint32_t.
+    mxtl::RefPtr<VmObject> vmo_;
+    uint32_t txid_ = 0;
 };
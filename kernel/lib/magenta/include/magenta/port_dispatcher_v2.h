@@ -90,6 +90,12 @@
 //   state tracker (w1), then the Port packet can delete the Port
 //   observer and thusly delete itself.
 //
+// 4) Repeating observers (MX_WAIT_ASYNC_REPEATING) stay owned by the
+//    Port, as in 1), for as long as the handle they watch is open.
+//    Their packet goes in and out of the port's queue (w3) without
+//    anything being allocated or freed. Only the packet reporting that
+//    the handle went away follows 2) and 3).
+//
 
 class PortDispatcherV2;
 class PortObserver;
@@ -101,6 +107,10 @@ struct PortPacket final : public mxtl::DoublyLinkedListable<PortPacket*> {
     PortPacket() = delete;
     explicit PortPacket(PortObserver* obs);
     void Destroy();
+    // True for the packets of repeating observers, which go back to waiting
+    // for the next edge instead of being destroyed once dequeued.  Must be
+    // called with the port lock held.
+    bool IsRearmable() const;
 };
 
 class PortObserver final : public StateObserver {
@@ -113,7 +123,7 @@ public:
         }
     };
 
-    PortObserver(PortDispatcherV2* port, uint64_t key, mx_signals_t signals);
+    PortObserver(PortDispatcherV2* port, uint64_t key, mx_signals_t signals, bool repeating);
     ~PortObserver();
 
     mx_status_t Begin(Handle* handle);
@@ -130,8 +140,18 @@ private:
 
     bool MaybeQueue(mx_signals_t new_state);
 
+    friend class PortDispatcherV2;
+    friend struct PortPacket;
+
     const uint64_t key_;
     const mx_signals_t trigger_;
+    const bool repeating_;
+
+    // Signals seen by the last callback, for spotting the edges that
+    // queue a repeating observer's packet.
+    mx_signals_t last_state_;
+    // Set by the port once a repeating observer has queued its last packet.
+    bool final_;
 
     PortPacket packet_;
     PortDispatcherV2* port_;
@@ -154,9 +174,16 @@ public:
     void on_zero_handles() final;
 
     mx_status_t Queue(PortPacket* packet);
-    mx_status_t DeQueue(mx_time_t timeout, PortPacket** packet);
+    // Queues the packet of a repeating observer, unless it is still queued
+    // from an earlier edge, in which case that packet reports this one too.
+    void QueueRepeating(PortObserver* observer, mx_signals_t effective, bool final);
+
+    mx_status_t DeQueue(mx_time_t timeout, mx_port_packet_t* packet);
+    // Waits for at least one packet, then takes up to |max_packets| of them.
+    mx_status_t DeQueueMany(mx_time_t timeout, mx_port_packet_t* packets, uint32_t max_packets,
+                            uint32_t* count);
 
-    PortObserver* MakeObserver(uint64_t key, mx_signals_t signals);
+    PortObserver* MakeObserver(uint64_t key, mx_signals_t signals, bool repeating);
     void CancelObserver(PortObserver* observer);
 
 private:
@@ -21,7 +21,10 @@ class PortClient;
 
 class SocketDispatcher final : public Dispatcher {
 public:
-    static status_t Create(uint32_t flags, mxtl::RefPtr<Dispatcher>* dispatcher0,
+    // A |buffer_size| of 0 picks the default.  Otherwise it is rounded up to
+    // a power of two.
+    static status_t Create(uint32_t flags, size_t buffer_size,
+                           mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1, mx_rights_t* rights);
 
     ~SocketDispatcher() final;
@@ -43,6 +46,17 @@ public:
     mx_status_t Read(void* dest, size_t len, bool from_user,
                      size_t* nread);
 
+    // Scatter-gather versions of Write and Read.  The buffers are user
+    // pointers, filled or drained in order under a single lock hold.
+    mx_status_t WriteV(const mx_iovec_t* iov, uint32_t count, size_t* written);
+    mx_status_t ReadV(const mx_iovec_t* iov, uint32_t count, size_t* nread);
+
+    // Move data between |vmo| and the socket without going through user
+    // memory.  Page aligned runs move whole pages, leaving the source range
+    // decommitted; the rest is copied.
+    mx_status_t WriteFromVmo(VmObject* vmo, uint64_t offset, size_t len, size_t* written);
+    mx_status_t ReadToVmo(VmObject* vmo, uint64_t offset, size_t len, size_t* nread);
+
     void OnPeerZeroHandles();
 
 private:
@@ -52,11 +66,20 @@ private:
         bool Init(uint32_t len);
         size_t Write(const void* src, size_t len, bool from_user);
         size_t Read(void* dest, size_t len, bool from_user);
+        size_t WriteV(const mx_iovec_t* iov, uint32_t count);
+        size_t ReadV(const mx_iovec_t* iov, uint32_t count);
+        size_t WriteFromVmo(VmObject* vmo, uint64_t offset, size_t len);
+        size_t ReadToVmo(VmObject* vmo, uint64_t offset, size_t len);
         size_t CouldRead() const;
         size_t free() const;
         bool empty() const;
 
     private:
+        // Bytes that can be written at head_, or read at tail_, without
+        // wrapping around.
+        size_t WriteSpan() const;
+        size_t ReadSpan() const;
+
         size_t head_ = 0u;
         size_t tail_ = 0u;
         uint32_t len_pow2_ = 0u;
@@ -65,9 +88,14 @@ private:
     };
 
     SocketDispatcher(uint32_t flags);
-    mx_status_t Init(mxtl::RefPtr<SocketDispatcher> other);
-    mx_status_t WriteSelf(const void* src, size_t len, bool from_user,
-                          size_t* nwritten);
+    mx_status_t Init(mxtl::RefPtr<SocketDispatcher> other, uint32_t buffer_size);
+    // |write| and |read| move data into or out of a CBuf and return how much.
+    template <typename WriteFn>
+    mx_status_t WriteToPeer(WriteFn write, size_t* written);
+    template <typename WriteFn>
+    mx_status_t WriteSelf(WriteFn write, size_t* written);
+    template <typename ReadFn>
+    mx_status_t ReadSelf(ReadFn read, size_t* nread);
     status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     status_t HalfCloseOther();
 
@@ -11,6 +11,7 @@
 #include <mxtl/intrusive_double_list.h>
 
 class Handle;
+class StateTracker;
 
 // Observer base class for state maintained by StateTracker.
 class StateObserver {
@@ -22,8 +23,8 @@ public:
     // WARNING: This is called under StateTracker's mutex.
     virtual bool OnInitialize(mx_signals_t initial_state) = 0;
 
-    // Called whenever the state changes, to give it the new state. Returns true if a thread was
-    // awoken.
+    // Called whenever the state changes in one of the signals the observer was added with, to give
+    // it the new state. Returns true if a thread was awoken.
     // WARNING: This is called under StateTracker's mutex
     virtual bool OnStateChange(mx_signals_t new_state) = 0;
 
@@ -46,8 +47,13 @@ protected:
     bool remove_ = false;
 
 private:
+    friend class StateTracker;
     friend struct StateObserverListTraits;
     mxtl::DoublyLinkedListNodeState<StateObserver*> state_observer_list_node_state_;
+
+    // Set by StateTracker::AddObserver() and guarded by the tracker's lock.
+    mx_signals_t interest_ = 0u;
+    uint32_t group_ = 0u;
 };
 
 // For use by StateTracker to maintain a list of StateObservers. (We don't use the default traits so
@@ -29,8 +29,9 @@ public:
         signals_ = signals;
     }
 
-    // Add an observer.
-    void AddObserver(StateObserver* observer);
+    // Add an observer. Its OnStateChange() is only called when one of the signals in |interest|
+    // changes; OnInitialize() and OnCancel() are always called.
+    void AddObserver(StateObserver* observer, mx_signals_t interest);
 
     // Remove an observer (which must have been added).
     void RemoveObserver(StateObserver* observer);
@@ -47,9 +48,32 @@ public:
     mx_signals_t GetSignalsState() { return signals_; }
 
 private:
+    using ObserverList = mxtl::DoublyLinkedList<StateObserver*, StateObserverListTraits>;
+
+    // Observers that share an interest mask, so a state change can skip all of them with a
+    // single test. A group is free for another mask once its list is empty.
+    struct ObserverGroup {
+        mx_signals_t interest = 0u;
+        ObserverList observers;
+    };
+
+    // The handful of distinct masks on a busy object (e.g. everyone waiting for a channel to
+    // become readable) each get a group; observers with any other mask go on |mixed_observers_|
+    // and are tested one by one.
+    static constexpr uint32_t kNumGroups = 4u;
+    static constexpr uint32_t kMixedGroup = kNumGroups;
+
+    ObserverList& ListForLocked(StateObserver* observer) TA_REQ(lock_);
+
+    // Calls |callback| on each observer of |list|, dropping the ones that ask to be removed.
+    // Returns true if any callback awoke a thread.
+    template <typename Callback>
+    static bool VisitLocked(ObserverList* list, Callback callback);
+
     mx_signals_t signals_;
     Mutex lock_;
 
-    // Active observers are elements in |observers_|.
-    mxtl::DoublyLinkedList<StateObserver*, StateObserverListTraits> observers_ TA_GUARDED(lock_);
+    // Active observers are elements of one of the lists below.
+    ObserverGroup groups_[kNumGroups] TA_GUARDED(lock_);
+    ObserverList mixed_observers_ TA_GUARDED(lock_);
 };
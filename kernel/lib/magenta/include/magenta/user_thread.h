@@ -62,6 +62,9 @@ public:
     ThreadDispatcher* dispatcher() { return dispatcher_; }
 
     FutexNode* futex_node() { return &futex_node_; }
+    // Threads blocked on PI futexes this thread holds.  Guarded by thread_lock.
+    FutexNode::PiWaiterList& pi_waiters() { return pi_waiters_; }
+    thread_t* lk_thread() { return &thread_; }
     StateTracker* state_tracker() { return &state_tracker_; }
     const char* name() const { return thread_.name; }
     status_t set_name(const char* name, size_t len);
@@ -141,6 +144,8 @@ private:
     // Node for linked list of threads blocked on a futex
     FutexNode futex_node_;
 
+    FutexNode::PiWaiterList pi_waiters_;
+
     StateTracker state_tracker_;
 
     // A thread-level exception port for this thread.
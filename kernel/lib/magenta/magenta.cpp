@@ -6,9 +6,11 @@
 
 #include <magenta/magenta.h>
 
+#include <string.h>
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/magazine.h>
 #include <kernel/mutex.h>
 
 #include <lk/init.h>
@@ -39,7 +41,10 @@ constexpr size_t kHighHandleCount = (kMaxHandleCount * 8) / 7;
 // The handle arena and its mutex.
 mutex_t handle_mutex = MUTEX_INITIAL_VALUE(handle_mutex);
 mxtl::TypedArena<Handle> handle_arena;
-size_t outstanding_handles = 0u;
+
+// Per-cpu magazines of free handle slots in front of |handle_arena|, so
+// that creating and destroying handles usually avoids |handle_mutex|.
+static struct magazine_set handle_magazines;
 
 // The system exception port.
 static mxtl::RefPtr<ExceptionPort> system_exception_port;
@@ -48,27 +53,70 @@ static mutex_t system_exception_mutex = MUTEX_INITIAL_VALUE(system_exception_mut
 // All jobs and processes are rooted at the |root_job|.
 static mxtl::RefPtr<JobDispatcher> root_job;
 
+static size_t handle_depot_alloc(void* ctx, void** slots, size_t count);
+static void handle_depot_free(void* ctx, void** slots, size_t count);
+
+static const struct magazine_depot handle_depot = {
+    handle_depot_alloc, handle_depot_free, nullptr,
+};
+
 void magenta_init(uint level) {
     handle_arena.Init("handles", kMaxHandleCount);
+    magazine_set_init(&handle_magazines, &handle_depot);
     root_job = JobDispatcher::CreateRootJob();
 }
 
 static void high_handle_count(size_t count) {
-    printf("warning!! high handle count: %zu handles\n", outstanding_handles);
+    printf("warning!! high handle count: %zu handles\n", count);
 }
 
-Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
+static size_t handle_depot_alloc(void* ctx, void** slots, size_t count) {
     AutoLock lock(&handle_mutex);
-    if (++outstanding_handles > kHighHandleCount)
-        high_handle_count(outstanding_handles);
-    return handle_arena.New(mxtl::move(dispatcher), rights);
+    size_t allocated = 0;
+    while (allocated < count) {
+        void* slot = handle_arena.RawAlloc();
+        if (!slot)
+            break;
+        slots[allocated++] = slot;
+    }
+
+    // Only checked on the slow path, it is good enough for a warning.
+    size_t outstanding = magazine_outstanding(&handle_magazines) + 1;
+    if (outstanding > kHighHandleCount)
+        high_handle_count(outstanding);
+
+    return allocated;
 }
 
-Handle* DupHandle(Handle* source, mx_rights_t rights) {
+static void handle_depot_free(void* ctx, void** slots, size_t count) {
     AutoLock lock(&handle_mutex);
-    if (++outstanding_handles > kHighHandleCount)
-        high_handle_count(outstanding_handles);
-    return handle_arena.New(source, rights);
+    for (size_t i = 0; i < count; i++)
+        handle_arena.RawFree(slots[i]);
+}
+
+static void* alloc_handle_slot() {
+    void* slot;
+    if (magazine_alloc(&handle_magazines, &slot, 1))
+        return slot;
+
+    // The arena is out, but other cpus' magazines may be holding free
+    // slots.  Put them all back and try once more.
+    magazine_drain_all(&handle_magazines);
+    return magazine_alloc(&handle_magazines, &slot, 1) ? slot : nullptr;
+}
+
+static void free_handle_slot(void* slot) {
+    magazine_free(&handle_magazines, &slot, 1);
+}
+
+Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
+    void* addr = alloc_handle_slot();
+    return addr ? new (addr) Handle(mxtl::move(dispatcher), rights) : nullptr;
+}
+
+Handle* DupHandle(Handle* source, mx_rights_t rights) {
+    void* addr = alloc_handle_slot();
+    return addr ? new (addr) Handle(source, rights) : nullptr;
 }
 
 void DeleteHandle(Handle* handle) {
@@ -98,14 +146,14 @@ void DeleteHandle(Handle* handle) {
     // table lookup.
     memset(handle, 0, sizeof(Handle));
 
-    AutoLock lock(&handle_mutex);
-    --outstanding_handles;
-    handle_arena.RawFree(handle);
+    free_handle_slot(handle);
 }
 
 bool HandleInRange(void* addr) {
-    AutoLock lock(&handle_mutex);
-    return handle_arena.in_range(addr);
+    // Slots sitting in the per-cpu magazines are zeroed just like never
+    // used ones, so it's enough to check against the whole arena, whose
+    // bounds don't change after init. That keeps lookups off the mutex.
+    return (addr >= handle_arena.start()) && (addr < handle_arena.end());
 }
 
 uint32_t MapHandleToU32(const Handle* handle) {
@@ -6,14 +6,231 @@
 
 #include <err.h>
 #include <new.h>
+#include <stdio.h>
 
+#include <arch/ops.h>
+
+#include <kernel/auto_lock.h>
+#include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object.h>
 #include <magenta/handle_reaper.h>
 #include <magenta/magenta.h>
 #include <magenta/message_packet.h>
+#include <mxtl/algorithm.h>
+#include <mxtl/intrusive_double_list.h>
 
 constexpr uint32_t kMaxMessageSize = 65536u;
 constexpr uint32_t kMaxMessageHandles = 1024u;
 
+// Slabs each cpu may carve into packets of one size class before further
+// packets of that size fall back to the heap.
+constexpr size_t kMaxSlabsPerSizeClass = 64u;
+
+// Empty slabs each cpu keeps for one size class, to ride out bursts without
+// going back to the heap.  Any beyond that are freed.
+constexpr size_t kMaxEmptySlabsPerSizeClass = 2u;
+
+namespace {
+
+// Size class values; packets outside of the pools use kHeapSizeClass.
+enum : uint8_t {
+    kTinySizeClass,
+    kSmallSizeClass,
+    kMediumSizeClass,
+    kHeapSizeClass,
+};
+
+// Every packet's storage comes right after a tag saying where it came from,
+// which outlives the packet so that it can be read once the packet has been
+// destructed.
+struct PacketTag {
+    void* slab;
+    uint8_t size_class;
+    uint16_t cpu;
+};
+static_assert(sizeof(PacketTag) % sizeof(void*) == 0, "packets must stay aligned");
+
+// Per-cpu slab allocator for packets that fit in |kSize| bytes.  A packet
+// may be freed on any cpu; it goes back to the allocator it came from.
+template <size_t kSize>
+class PacketSizeClass {
+public:
+    static constexpr size_t kBlockSize = kSize;
+
+    // Returns a tag followed by kBlockSize bytes, or null if the slab limit
+    // has been reached.
+    PacketTag* Alloc() {
+        AutoLock guard(lock_);
+
+        if (partial_.is_empty()) {
+            if (slab_count_ == kMaxSlabsPerSizeClass)
+                return nullptr;
+            Slab* slab = NewSlab();
+            if (!slab)
+                return nullptr;
+            partial_.push_front(slab);
+            slab_count_++;
+            empty_count_++;
+        }
+
+        // empty slabs sit at the back, so this is one in use if there is any
+        Slab* slab = &partial_.front();
+        if (slab->used == 0)
+            empty_count_--;
+        Block* block = slab->free_list;
+        slab->free_list = block->next;
+        if (++slab->used == kBlocksPerSlab)
+            partial_.erase(*slab);
+
+        atomic_add_relaxed(&live_, 1);
+        block->tag.slab = slab;
+        return &block->tag;
+    }
+
+    void Free(PacketTag* tag) {
+        Slab* slab = static_cast<Slab*>(tag->slab);
+        Block* block = reinterpret_cast<Block*>(tag);
+        Slab* release = nullptr;
+        {
+            AutoLock guard(lock_);
+
+            if (slab->used == kBlocksPerSlab)
+                partial_.push_front(slab);
+            block->next = slab->free_list;
+            slab->free_list = block;
+
+            if (--slab->used == 0) {
+                partial_.erase(*slab);
+                if (empty_count_ < kMaxEmptySlabsPerSizeClass) {
+                    partial_.push_back(slab);
+                    empty_count_++;
+                } else {
+                    slab_count_--;
+                    release = slab;
+                }
+            }
+        }
+        atomic_add_relaxed(&live_, -1);
+
+        if (release) {
+            release->~Slab();
+            free(release);
+        }
+    }
+
+    int live() const { return atomic_load_relaxed(&live_); }
+
+    size_t slabs() const {
+        AutoLock guard(lock_);
+        return slab_count_;
+    }
+
+private:
+    union Block {
+        Block* next;
+        PacketTag tag;
+    };
+    static constexpr size_t kBlockStride = sizeof(PacketTag) + kSize;
+
+    struct Slab : public mxtl::DoublyLinkedListable<Slab*> {
+        Block* free_list = nullptr;
+        size_t used = 0;
+    };
+    static constexpr size_t kSlabSize = mxtl::max<size_t>(16u << 10, 16 * kBlockStride);
+    static constexpr size_t kBlocksPerSlab = (kSlabSize - sizeof(Slab)) / kBlockStride;
+
+    // Carves a slab from the heap into free blocks.
+    static Slab* NewSlab() {
+        void* mem = malloc(kSlabSize);
+        if (!mem)
+            return nullptr;
+
+        Slab* slab = new (mem) Slab();
+        char* blocks = static_cast<char*>(mem) + sizeof(Slab);
+        for (size_t i = kBlocksPerSlab; i-- > 0;) {
+            Block* block = reinterpret_cast<Block*>(blocks + i * kBlockStride);
+            block->next = slab->free_list;
+            slab->free_list = block;
+        }
+        return slab;
+    }
+
+    mutable Mutex lock_;
+    // slabs with a free block, with the empty ones at the back
+    mxtl::DoublyLinkedList<Slab*> partial_;
+    size_t slab_count_ = 0;
+    size_t empty_count_ = 0;
+    mutable int live_ = 0;
+};
+
+struct PacketPool {
+    // Room for the packet itself and a few handles, which covers handle-only
+    // messages and small control messages.
+    PacketSizeClass<128> tiny;
+    PacketSizeClass<512> small;
+    PacketSizeClass<4096> medium;
+} __CPU_ALIGN;
+
+PacketPool packet_pools[SMP_MAX_CPUS];
+
+// Packets too big for any size class, or that found theirs exhausted.
+int live_heap_packets = 0;
+
+} // namespace
+
+// Allocates room for a packet of |size| bytes, behind a tag recording where
+// it came from.
+static void* alloc_packet_storage(size_t size) {
+    uint16_t cpu = static_cast<uint16_t>(arch_curr_cpu_num());
+    PacketPool& pool = packet_pools[cpu];
+
+    uint8_t size_class = kHeapSizeClass;
+    PacketTag* tag = nullptr;
+    if (size <= pool.tiny.kBlockSize) {
+        size_class = kTinySizeClass;
+        tag = pool.tiny.Alloc();
+    } else if (size <= pool.small.kBlockSize) {
+        size_class = kSmallSizeClass;
+        tag = pool.small.Alloc();
+    } else if (size <= pool.medium.kBlockSize) {
+        size_class = kMediumSizeClass;
+        tag = pool.medium.Alloc();
+    }
+
+    if (!tag) {
+        size_class = kHeapSizeClass;
+        tag = static_cast<PacketTag*>(malloc(sizeof(PacketTag) + size));
+        if (!tag)
+            return nullptr;
+        tag->slab = nullptr;
+        atomic_add_relaxed(&live_heap_packets, 1);
+    }
+
+    tag->size_class = size_class;
+    tag->cpu = cpu;
+    return tag + 1;
+}
+
+static void free_packet_storage(void* ptr) {
+    PacketTag* tag = static_cast<PacketTag*>(ptr) - 1;
+    PacketPool& pool = packet_pools[tag->cpu];
+    switch (tag->size_class) {
+    case kTinySizeClass:
+        pool.tiny.Free(tag);
+        break;
+    case kSmallSizeClass:
+        pool.small.Free(tag);
+        break;
+    case kMediumSizeClass:
+        pool.medium.Free(tag);
+        break;
+    default:
+        free(tag);
+        atomic_add_relaxed(&live_heap_packets, -1);
+        break;
+    }
+}
+
 // static
 mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
                                   mxtl::unique_ptr<MessagePacket>* msg) {
@@ -24,9 +241,9 @@ mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
 
     // Allocate space for the MessagePacket object followed by num_handles
     // Handle*s followed by data_size bytes.
-    char* ptr = static_cast<char*>(malloc(sizeof(MessagePacket) +
-                                          num_handles * sizeof(Handle*) +
-                                          data_size));
+    char* ptr = static_cast<char*>(alloc_packet_storage(sizeof(MessagePacket) +
+                                                        num_handles * sizeof(Handle*) +
+                                                        data_size));
     if (ptr == NULL)
         return ERR_NO_MEMORY;
 
@@ -38,6 +255,96 @@ mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
     return NO_ERROR;
 }
 
+// static
+mx_status_t MessagePacket::Create(user_ptr<const void> data, uint32_t data_size,
+                                  uint32_t num_handles, mxtl::unique_ptr<MessagePacket>* msg) {
+    if (data_size < kPagedDataThreshold) {
+        mx_status_t status = Create(data_size, num_handles, msg);
+        if (status != NO_ERROR)
+            return status;
+        if (data.copy_array_from_user((*msg)->mutable_data(), data_size) != NO_ERROR) {
+            msg->reset();
+            return ERR_INVALID_ARGS;
+        }
+        return NO_ERROR;
+    }
+
+    if (data_size > kMaxMessageSize)
+        return ERR_OUT_OF_RANGE;
+    if (num_handles > kMaxMessageHandles)
+        return ERR_OUT_OF_RANGE;
+
+    // Big payloads go into pages of their own, so that the reader can take them
+    // over rather than copy them a second time.
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, ROUNDUP(data_size, PAGE_SIZE),
+                                     VmObjectPaged::kLoanable);
+    if (!vmo)
+        return ERR_NO_MEMORY;
+
+    size_t copied;
+    if (vmo->WriteUser(data, 0, data_size, &copied) != NO_ERROR || copied != data_size)
+        return ERR_INVALID_ARGS;
+
+    uint32_t txid;
+    if (vmo->Read(&txid, 0, sizeof(txid), &copied) != NO_ERROR)
+        return ERR_NO_MEMORY;
+
+    char* ptr = static_cast<char*>(alloc_packet_storage(sizeof(MessagePacket) +
+                                                        num_handles * sizeof(Handle*)));
+    if (ptr == NULL)
+        return ERR_NO_MEMORY;
+
+    msg->reset(new (ptr) MessagePacket(data_size, num_handles,
+                                       reinterpret_cast<Handle**>(ptr + sizeof(MessagePacket))));
+    (*msg)->vmo_ = mxtl::move(vmo);
+    (*msg)->txid_ = txid;
+    return NO_ERROR;
+}
+
+// Moves the first |len| bytes of |src| into whatever object is mapped writable at
+// |va| in |aspace|.  Nothing is moved if that fails.
+static status_t loan_pages(VmObject* src, vaddr_t va, size_t len, VmAspace* aspace) {
+    mxtl::RefPtr<VmObject> dst;
+    uint64_t dst_offset;
+    status_t status = aspace->FindWritableObject(va, len, &dst, &dst_offset);
+    if (status != NO_ERROR)
+        return status;
+
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    status = src->TakePages(0, len, &pages);
+    if (status != NO_ERROR)
+        return status;
+
+    status = dst->SupplyPages(dst_offset, len, &pages);
+    if (status != NO_ERROR) {
+        // Put them back so the payload can still be copied out.
+        __UNUSED status_t restored = src->SupplyPages(0, len, &pages);
+        DEBUG_ASSERT(restored == NO_ERROR);
+    }
+    return status;
+}
+
+mx_status_t MessagePacket::CopyDataTo(user_ptr<void> dst, VmAspace* aspace) {
+    if (!is_paged())
+        return dst.copy_array_to_user(data(), data_size_) == NO_ERROR ? NO_ERROR : ERR_INVALID_ARGS;
+
+    size_t offset = 0;
+    vaddr_t va = reinterpret_cast<vaddr_t>(dst.get());
+    size_t whole_pages = ROUNDDOWN(data_size_, PAGE_SIZE);
+    if (aspace && IS_PAGE_ALIGNED(va) && whole_pages > 0 &&
+        loan_pages(vmo_.get(), va, whole_pages, aspace) == NO_ERROR) {
+        offset = whole_pages;
+    }
+
+    if (offset < data_size_) {
+        size_t copied;
+        if (vmo_->ReadUser(dst.byte_offset(offset), offset, data_size_ - offset, &copied) != NO_ERROR ||
+            copied != data_size_ - offset)
+            return ERR_INVALID_ARGS;
+    }
+    return NO_ERROR;
+}
+
 MessagePacket::~MessagePacket() {
     if (owns_handles_) {
         // Delete handles out-of-band to avoid the worst case recursive
@@ -49,3 +356,27 @@ MessagePacket::~MessagePacket() {
 MessagePacket::MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles)
     : owns_handles_(false), data_size_(data_size), num_handles_(num_handles), handles_(handles) {
 }
+
+void MessagePacket::operator delete(void* ptr) {
+    free_packet_storage(ptr);
+}
+
+// static
+void MessagePacket::DumpPools() {
+    static const char* const kNames[] = { "128", "512", "4096" };
+    int live[countof(kNames)] = {};
+    size_t slabs[countof(kNames)] = {};
+    for (const auto& pool : packet_pools) {
+        live[kTinySizeClass] += pool.tiny.live();
+        live[kSmallSizeClass] += pool.small.live();
+        live[kMediumSizeClass] += pool.medium.live();
+        slabs[kTinySizeClass] += pool.tiny.slabs();
+        slabs[kSmallSizeClass] += pool.small.slabs();
+        slabs[kMediumSizeClass] += pool.medium.slabs();
+    }
+
+    printf("message packets by size class:\n");
+    for (size_t i = 0; i < countof(kNames); i++)
+        printf("  %5s bytes: %d live, %zu slabs\n", kNames[i], live[i], slabs[i]);
+    printf("  heap       : %d live\n", atomic_load_relaxed(&live_heap_packets));
+}
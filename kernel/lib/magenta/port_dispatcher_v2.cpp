@@ -22,6 +22,10 @@ constexpr mx_rights_t kDefaultIOPortRightsV2 =
 PortPacket::PortPacket(PortObserver* obs) : observer(obs), packet{} {
 }
 
+bool PortPacket::IsRearmable() const {
+    return observer && observer->repeating_ && !observer->final_;
+}
+
 // Cannot be called within any lock held.
 void PortPacket::Destroy() {
     // Here we meed more state to track stack allocated packets.
@@ -33,9 +37,13 @@ void PortPacket::Destroy() {
     }
 }
 
-PortObserver::PortObserver(PortDispatcherV2* port, uint64_t key, mx_signals_t signals)
+PortObserver::PortObserver(PortDispatcherV2* port, uint64_t key, mx_signals_t signals,
+                           bool repeating)
     : key_(key),
       trigger_(signals | MX_SIGNAL_HANDLE_CLOSED),
+      repeating_(repeating),
+      last_state_(0u),
+      final_(false),
       packet_(this),
       port_(port),
       handle_(nullptr) {
@@ -54,7 +62,7 @@ mx_status_t PortObserver::Begin(Handle* handle) {
 
     handle_ = handle;
     dispatcher_ = mxtl::move(dispatcher);
-    state_tracker->AddObserver(this);
+    state_tracker->AddObserver(this, trigger_);
     return NO_ERROR;
 }
 
@@ -65,6 +73,23 @@ void PortObserver::End() {
 
 bool PortObserver::MaybeQueue(mx_signals_t new_state) {
     // Always called with the object state lock being held.
+    if (repeating_) {
+        if (!port_)
+            return false;
+
+        // Edge triggered: only signals that weren't already up count.
+        mx_signals_t edges = trigger_ & new_state & ~last_state_;
+        last_state_ = new_state;
+        if (!edges)
+            return false;
+
+        bool final = (new_state & MX_SIGNAL_HANDLE_CLOSED) != 0;
+        port_->QueueRepeating(this, new_state, final);
+        if (final)
+            port_ = nullptr;
+        return false;
+    }
+
     if (trigger_ & new_state) {
         //  TODO(cpu): |port_| is used as one-shot flag. Fix this at the
         //  state tracker layer.
@@ -118,51 +143,110 @@ PortDispatcherV2::PortDispatcherV2(uint32_t /*options*/)
 }
 
 PortDispatcherV2::~PortDispatcherV2() {
-    while (!observers_.is_empty()) {
-        auto observer = observers_.pop_front();
-        observer->End();
-        delete observer;
-    }
+    // Stop the observers the port owns from queuing anything else, then drop
+    // the packets before the observers, since the packets of repeating
+    // observers live in observers that are still on |observers_|.
+    for (auto& observer : observers_)
+        observer.End();
 
     while (!packets_.is_empty()) {
         auto packet = packets_.pop_front();
-        packet->Destroy();
+        if (!packet->IsRearmable())
+            packet->Destroy();
     }
+
+    while (!observers_.is_empty())
+        delete observers_.pop_front();
 }
 
 void PortDispatcherV2::on_zero_handles() {
 }
 
 mx_status_t PortDispatcherV2::Queue(PortPacket* packet) {
-    int wake_count = 0;
-    {
-        AutoLock al(&lock_);
+    AutoLock al(&lock_);
 
-        if (packet->observer) {
-            // TODO(cpu): Do this only for one-shot observers.
-            observers_.erase(*packet->observer);
-        }
+    // Only one-shot observers come through here; their packet owns them now.
+    if (packet->observer)
+        observers_.erase(*packet->observer);
 
-        packets_.push_back(packet);
-        wake_count = event_.Signal();
-    }
+    packets_.push_back(packet);
 
-    if (wake_count)
-        thread_preempt(false);
+    // The woken thread runs as soon as a cpu is free for it.  Preempting the
+    // queuing thread here would make it pay a context switch for every packet
+    // when it has more to queue, and hand the waiter one packet at a time.
+    event_.Signal();
 
     return NO_ERROR;
 }
 
-mx_status_t PortDispatcherV2::DeQueue(mx_time_t timeout, PortPacket** packet) {
+void PortDispatcherV2::QueueRepeating(PortObserver* observer, mx_signals_t effective,
+                                      bool final) {
+    AutoLock al(&lock_);
+
+    // From the last packet on, the packet owns the observer like a one-shot
+    // observer's does.
+    if (final) {
+        observers_.erase(*observer);
+        observer->final_ = true;
+    }
+
+    PortPacket* packet = &observer->packet_;
+    if (packet->InContainer()) {
+        packet->packet.signal.effective = effective;
+        packet->packet.signal.count++;
+        return;
+    }
+
+    packet->packet.status = NO_ERROR;
+    packet->packet.key = observer->key_;
+    packet->packet.type = MX_PKT_TYPE_SIGNAL;
+    packet->packet.signal.trigger = observer->trigger_;
+    packet->packet.signal.effective = effective;
+    packet->packet.signal.count = 1u;
+
+    packets_.push_back(packet);
+    event_.Signal();
+}
+
+mx_status_t PortDispatcherV2::DeQueue(mx_time_t timeout, mx_port_packet_t* packet) {
+    uint32_t count;
+    return DeQueueMany(timeout, packet, 1u, &count);
+}
+
+mx_status_t PortDispatcherV2::DeQueueMany(mx_time_t timeout, mx_port_packet_t* packets,
+                                          uint32_t max_packets, uint32_t* count) {
+    DEBUG_ASSERT(max_packets > 0u);
+
     while (true) {
+        mxtl::DoublyLinkedList<PortPacket*> done;
+        uint32_t n = 0;
         {
             AutoLock al(&lock_);
             if (!packets_.is_empty()) {
-                *packet = packets_.pop_front();
-                return NO_ERROR;
+                while (n < max_packets && !packets_.is_empty()) {
+                    auto packet = packets_.pop_front();
+                    packets[n++] = packet->packet;
+
+                    // Taking a repeating observer's packet off the queue is
+                    // all it takes to re-arm it.
+                    if (!packet->IsRearmable())
+                        done.push_back(packet);
+                }
+
+                // The event only wakes one waiter per Queue(); pass the baton
+                // on if there is still something for another one to take.
+                if (!packets_.is_empty())
+                    event_.Signal();
             }
         }
 
+        if (n > 0u) {
+            while (!done.is_empty())
+                done.pop_front()->Destroy();
+            *count = n;
+            return NO_ERROR;
+        }
+
         if (timeout == 0ull)
             return ERR_TIMED_OUT;
 
@@ -174,9 +258,10 @@ mx_status_t PortDispatcherV2::DeQueue(mx_time_t timeout, PortPacket** packet) {
     return ERR_BAD_STATE;
 }
 
-PortObserver* PortDispatcherV2::MakeObserver(uint64_t key, mx_signals_t signals) {
+PortObserver* PortDispatcherV2::MakeObserver(uint64_t key, mx_signals_t signals,
+                                             bool repeating) {
     AllocChecker ac;
-    auto observer = new (&ac) PortObserver(this, key, signals);
+    auto observer = new (&ac) PortObserver(this, key, signals, repeating);
     if (!ac.check())
         return nullptr;
 
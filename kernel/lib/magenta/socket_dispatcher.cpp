@@ -30,6 +30,9 @@ constexpr mx_rights_t kDefaultSocketRights =
 
 constexpr size_t kDeFaultSocketBufferSize = 256 * 1024u;
 
+static_assert(MX_SOCKET_MIN_BUFFER_SIZE >= PAGE_SIZE, "socket buffers are whole pages");
+static_assert(MX_SOCKET_MAX_BUFFER_SIZE <= (1u << 31), "socket buffer sizes must fit a uint32_t");
+
 constexpr mx_signals_t kValidSignalMask =
     MX_SOCKET_READABLE | MX_SOCKET_PEER_CLOSED | MX_USER_SIGNAL_ALL;
 
@@ -40,12 +43,33 @@ template <typename T> T vmodpow2(T val, uint modp2) { return val & ((1U << modp2
 
 #define INC_POINTER(len_pow2, ptr, inc) vmodpow2(((ptr) + (inc)), len_pow2)
 
+// Moves the pages of [src_offset, src_offset + len) in |src| over to |dst|.
+// Nothing moves if that fails, which it does unless both objects were created
+// with VmObjectPaged::kLoanable and can still loan pages, so the caller copies
+// the data instead.
+static status_t move_pages(VmObject* src, uint64_t src_offset,
+                           VmObject* dst, uint64_t dst_offset, size_t len) {
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    status_t status = src->TakePages(src_offset, len, &pages);
+    if (status != NO_ERROR)
+        return status;
+
+    status = dst->SupplyPages(dst_offset, len, &pages);
+    if (status != NO_ERROR) {
+        __UNUSED status_t restored = src->SupplyPages(src_offset, len, &pages);
+        DEBUG_ASSERT(restored == NO_ERROR);
+    }
+    return status;
+}
+
 SocketDispatcher::CBuf::~CBuf() {
     VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(buf_));
 }
 
 bool SocketDispatcher::CBuf::Init(uint32_t len) {
-    vmo_ = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, len);
+    // the ring only ever holds plain memory, so it can swap pages with the
+    // VMOs data is spliced from or to
+    vmo_ = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, len, VmObjectPaged::kLoanable);
     if (!vmo_)
         return false;
 
@@ -151,17 +175,103 @@ size_t SocketDispatcher::CBuf::Read(void* dest, size_t len, bool from_user) {
     return ret;
 }
 
+size_t SocketDispatcher::CBuf::WriteSpan() const {
+    if (head_ >= tail_) {
+        // Same special case as in Write: head may not wrap onto a tail at 0.
+        return valpow2(len_pow2_) - head_ - (tail_ == 0 ? 1 : 0);
+    }
+    return tail_ - head_ - 1;
+}
+
+size_t SocketDispatcher::CBuf::ReadSpan() const {
+    return (head_ >= tail_) ? head_ - tail_ : valpow2(len_pow2_) - tail_;
+}
+
+size_t SocketDispatcher::CBuf::WriteV(const mx_iovec_t* iov, uint32_t count) {
+    size_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t written = Write(iov[i].buffer, iov[i].size, true);
+        total += written;
+        if (written < iov[i].size)
+            break;
+    }
+    return total;
+}
+
+size_t SocketDispatcher::CBuf::ReadV(const mx_iovec_t* iov, uint32_t count) {
+    size_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t nread = Read(iov[i].buffer, iov[i].size, true);
+        total += nread;
+        if (nread < iov[i].size)
+            break;
+    }
+    return total;
+}
+
+size_t SocketDispatcher::CBuf::WriteFromVmo(VmObject* vmo, uint64_t offset, size_t len) {
+    size_t pos = 0;
+    while (pos < len) {
+        size_t span = MIN(WriteSpan(), len - pos);
+        if (span == 0)
+            break;
+
+        size_t pages = ROUNDDOWN(span, PAGE_SIZE);
+        if (pages > 0 && IS_PAGE_ALIGNED(head_) && IS_PAGE_ALIGNED(offset + pos) &&
+            move_pages(vmo, offset + pos, vmo_.get(), head_, pages) == NO_ERROR) {
+            span = pages;
+        } else {
+            size_t copied = 0;
+            if (vmo->Read(buf_ + head_, offset + pos, span, &copied) != NO_ERROR || copied == 0)
+                break;
+            span = copied;
+        }
+
+        head_ = INC_POINTER(len_pow2_, head_, span);
+        pos += span;
+    }
+    return pos;
+}
+
+size_t SocketDispatcher::CBuf::ReadToVmo(VmObject* vmo, uint64_t offset, size_t len) {
+    size_t pos = 0;
+    while (pos < len && tail_ != head_) {
+        size_t span = MIN(ReadSpan(), len - pos);
+
+        size_t pages = ROUNDDOWN(span, PAGE_SIZE);
+        if (pages > 0 && IS_PAGE_ALIGNED(tail_) && IS_PAGE_ALIGNED(offset + pos) &&
+            move_pages(vmo_.get(), tail_, vmo, offset + pos, pages) == NO_ERROR) {
+            span = pages;
+        } else {
+            size_t copied = 0;
+            if (vmo->Write(buf_ + tail_, offset + pos, span, &copied) != NO_ERROR || copied == 0)
+                break;
+            span = copied;
+        }
+
+        tail_ = INC_POINTER(len_pow2_, tail_, span);
+        pos += span;
+    }
+    return pos;
+}
+
 size_t SocketDispatcher::CBuf::CouldRead() const {
     return modpow2((uint)(head_ - tail_), len_pow2_);
 }
 
 // static
-status_t SocketDispatcher::Create(uint32_t flags,
+status_t SocketDispatcher::Create(uint32_t flags, size_t buffer_size,
                                   mxtl::RefPtr<Dispatcher>* dispatcher0,
                                   mxtl::RefPtr<Dispatcher>* dispatcher1,
                                   mx_rights_t* rights) {
     LTRACE_ENTRY;
 
+    if (buffer_size == 0u)
+        buffer_size = kDeFaultSocketBufferSize;
+    if (buffer_size < MX_SOCKET_MIN_BUFFER_SIZE || buffer_size > MX_SOCKET_MAX_BUFFER_SIZE)
+        return ERR_OUT_OF_RANGE;
+    uint32_t len = round_up_pow2_u32(static_cast<uint32_t>(buffer_size));
+
     AllocChecker ac;
     auto socket0 = mxtl::AdoptRef(new (&ac) SocketDispatcher(flags));
     if (!ac.check())
@@ -172,9 +282,9 @@ status_t SocketDispatcher::Create(uint32_t flags,
         return ERR_NO_MEMORY;
 
     mx_status_t status;
-    if ((status = socket0->Init(socket1)) != NO_ERROR)
+    if ((status = socket0->Init(socket1, len)) != NO_ERROR)
         return status;
-    if ((status = socket1->Init(socket0)) != NO_ERROR)
+    if ((status = socket1->Init(socket0, len)) != NO_ERROR)
         return status;
 
     *rights = kDefaultSocketRights;
@@ -194,10 +304,11 @@ SocketDispatcher::~SocketDispatcher() {
 
 // This is called before either SocketDispatcher is accessible from threads other than the one
 // initializing the socket, so it does not need locking.
-mx_status_t SocketDispatcher::Init(mxtl::RefPtr<SocketDispatcher> other) TA_NO_THREAD_SAFETY_ANALYSIS {
+mx_status_t SocketDispatcher::Init(mxtl::RefPtr<SocketDispatcher> other,
+                                   uint32_t buffer_size) TA_NO_THREAD_SAFETY_ANALYSIS {
     other_ = mxtl::move(other);
     peer_koid_ = other_->get_koid();
-    return cbuf_.Init(kDeFaultSocketBufferSize) ? NO_ERROR : ERR_NO_MEMORY;
+    return cbuf_.Init(buffer_size) ? NO_ERROR : ERR_NO_MEMORY;
 }
 
 void SocketDispatcher::on_zero_handles() {
@@ -294,6 +405,26 @@ status_t SocketDispatcher::HalfCloseOther() {
 
 mx_status_t SocketDispatcher::Write(const void* src, size_t len,
                                     bool from_user, size_t* nwritten) {
+    return WriteToPeer([src, len, from_user](CBuf* cbuf) {
+        return cbuf->Write(src, len, from_user);
+    }, nwritten);
+}
+
+mx_status_t SocketDispatcher::WriteV(const mx_iovec_t* iov, uint32_t count, size_t* written) {
+    return WriteToPeer([iov, count](CBuf* cbuf) {
+        return cbuf->WriteV(iov, count);
+    }, written);
+}
+
+mx_status_t SocketDispatcher::WriteFromVmo(VmObject* vmo, uint64_t offset, size_t len,
+                                           size_t* written) {
+    return WriteToPeer([vmo, offset, len](CBuf* cbuf) {
+        return cbuf->WriteFromVmo(vmo, offset, len);
+    }, written);
+}
+
+template <typename WriteFn>
+mx_status_t SocketDispatcher::WriteToPeer(WriteFn write, size_t* written) {
     mxtl::RefPtr<SocketDispatcher> other;
     {
         AutoLock lock(&lock_);
@@ -304,11 +435,11 @@ mx_status_t SocketDispatcher::Write(const void* src, size_t len,
         other = other_;
     }
 
-    return other->WriteSelf(src, len, from_user, nwritten);
+    return other->WriteSelf(write, written);
 }
 
-mx_status_t SocketDispatcher::WriteSelf(const void* src, size_t len,
-                                        bool from_user, size_t* written) {
+template <typename WriteFn>
+mx_status_t SocketDispatcher::WriteSelf(WriteFn write, size_t* written) {
     AutoLock lock(&lock_);
 
     if (!cbuf_.free())
@@ -316,7 +447,7 @@ mx_status_t SocketDispatcher::WriteSelf(const void* src, size_t len,
 
     bool was_empty = cbuf_.empty();
 
-    auto st = cbuf_.Write(src, len, from_user);
+    auto st = write(&cbuf_);
 
     if (st > 0) {
         if (was_empty)
@@ -334,14 +465,35 @@ mx_status_t SocketDispatcher::WriteSelf(const void* src, size_t len,
 
 mx_status_t SocketDispatcher::Read(void* dest, size_t len,
                                    bool from_user, size_t* nread) {
-    AutoLock lock(&lock_);
-
     // Just query for bytes outstanding.
     if (!dest && len == 0) {
+        AutoLock lock(&lock_);
         *nread = cbuf_.CouldRead();
         return NO_ERROR;
     }
 
+    return ReadSelf([dest, len, from_user](CBuf* cbuf) {
+        return cbuf->Read(dest, len, from_user);
+    }, nread);
+}
+
+mx_status_t SocketDispatcher::ReadV(const mx_iovec_t* iov, uint32_t count, size_t* nread) {
+    return ReadSelf([iov, count](CBuf* cbuf) {
+        return cbuf->ReadV(iov, count);
+    }, nread);
+}
+
+mx_status_t SocketDispatcher::ReadToVmo(VmObject* vmo, uint64_t offset, size_t len,
+                                        size_t* nread) {
+    return ReadSelf([vmo, offset, len](CBuf* cbuf) {
+        return cbuf->ReadToVmo(vmo, offset, len);
+    }, nread);
+}
+
+template <typename ReadFn>
+mx_status_t SocketDispatcher::ReadSelf(ReadFn read, size_t* nread) {
+    AutoLock lock(&lock_);
+
     bool closed = half_closed_[1] || !other_;
 
     if (cbuf_.empty())
@@ -349,7 +501,7 @@ mx_status_t SocketDispatcher::Read(void* dest, size_t len,
 
     bool was_full = cbuf_.free() == 0u;
 
-    auto st = cbuf_.Read(dest, len, from_user);
+    auto st = read(&cbuf_);
 
     if (cbuf_.empty()) {
         state_tracker_.UpdateState(MX_SOCKET_READABLE, 0u);
@@ -9,7 +9,29 @@
 #include <kernel/auto_lock.h>
 #include <magenta/wait_event.h>
 
-void StateTracker::AddObserver(StateObserver* observer) {
+template <typename Callback>
+bool StateTracker::VisitLocked(ObserverList* list, Callback callback) {
+    bool awoke_threads = false;
+    for (auto it = list->begin(); it != list->end();) {
+        awoke_threads = callback(&(*it)) || awoke_threads;
+        if (it->remove()) {
+            auto to_remove = it;
+            ++it;
+            list->erase(to_remove);
+        } else {
+            ++it;
+        }
+    }
+    return awoke_threads;
+}
+
+StateTracker::ObserverList& StateTracker::ListForLocked(StateObserver* observer) {
+    if (observer->group_ == kMixedGroup)
+        return mixed_observers_;
+    return groups_[observer->group_].observers;
+}
+
+void StateTracker::AddObserver(StateObserver* observer, mx_signals_t interest) {
     DEBUG_ASSERT(observer != nullptr);
 
     bool awoke_threads = false;
@@ -17,8 +39,26 @@ void StateTracker::AddObserver(StateObserver* observer) {
         AutoLock lock(&lock_);
 
         awoke_threads = observer->OnInitialize(signals_);
-        if (!observer->remove())
-            observers_.push_front(observer);
+        if (!observer->remove()) {
+            // Join the group for |interest|, or claim an empty one. Observers that only want
+            // OnCancel() never hear of a state change, so they need not take up a group.
+            uint32_t group = kMixedGroup;
+            for (uint32_t ix = 0; interest && ix < kNumGroups; ++ix) {
+                if (groups_[ix].observers.is_empty()) {
+                    if (group == kMixedGroup)
+                        group = ix;
+                } else if (groups_[ix].interest == interest) {
+                    group = ix;
+                    break;
+                }
+            }
+            if (group != kMixedGroup)
+                groups_[group].interest = interest;
+
+            observer->interest_ = interest;
+            observer->group_ = group;
+            ListForLocked(observer).push_front(observer);
+        }
     }
     if (awoke_threads)
         thread_preempt(false);
@@ -27,7 +67,7 @@ void StateTracker::AddObserver(StateObserver* observer) {
 void StateTracker::RemoveObserver(StateObserver* observer) {
     AutoLock lock(&lock_);
     DEBUG_ASSERT(observer != nullptr);
-    observers_.erase(*observer);
+    ListForLocked(observer).erase(*observer);
 }
 
 void StateTracker::Cancel(Handle* handle) {
@@ -35,16 +75,12 @@ void StateTracker::Cancel(Handle* handle) {
 
     {
         AutoLock lock(&lock_);
-        for (auto it = observers_.begin(); it != observers_.end();) {
-            awoke_threads = it->OnCancel(handle) || awoke_threads;
-            if (it->remove()) {
-                auto to_remove = it;
-                ++it;
-                observers_.erase(to_remove);
-            } else {
-                ++it;
-            }
-        }
+        auto cancel = [handle](StateObserver* observer) {
+            return observer->OnCancel(handle);
+        };
+        for (auto& group : groups_)
+            awoke_threads = VisitLocked(&group.observers, cancel) || awoke_threads;
+        awoke_threads = VisitLocked(&mixed_observers_, cancel) || awoke_threads;
     }
 
     if (awoke_threads)
@@ -65,16 +101,22 @@ void StateTracker::UpdateState(mx_signals_t clear_mask,
         if (previous_signals == signals_)
             return;
 
-        for (auto it = observers_.begin(); it != observers_.end();) {
-            awoke_threads = it->OnStateChange(signals_) || awoke_threads;
-            if (it->remove()) {
-                auto to_remove = it;
-                ++it;
-                observers_.erase(to_remove);
-            } else {
-                ++it;
-            }
+        // Only observers interested in one of the flipped signals hear about it.
+        mx_signals_t changed = previous_signals ^ signals_;
+        mx_signals_t new_state = signals_;
+
+        for (auto& group : groups_) {
+            if (!(group.interest & changed))
+                continue;
+            awoke_threads = VisitLocked(&group.observers, [new_state](StateObserver* observer) {
+                return observer->OnStateChange(new_state);
+            }) || awoke_threads;
         }
+        awoke_threads = VisitLocked(&mixed_observers_, [new_state, changed](StateObserver* observer) {
+            if (!(observer->interest_ & changed))
+                return false;
+            return observer->OnStateChange(new_state);
+        }) || awoke_threads;
     }
 
     if (awoke_threads) {
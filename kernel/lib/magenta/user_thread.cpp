@@ -75,6 +75,12 @@ UserThread::~UserThread() {
         DEBUG_ASSERT_MSG(false, "bad state %s, this %p\n", StateToString(state_), this);
     }
 
+    // Threads still blocked on a PI futex that was handed on to us boost us
+    // without holding a reference, so they have to let go now.
+    THREAD_LOCK(state);
+    FutexNode::DetachPiWaiters(this);
+    THREAD_UNLOCK(state);
+
     cond_destroy(&exception_wait_cond_);
 }
 
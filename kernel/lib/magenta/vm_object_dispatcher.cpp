@@ -63,6 +63,18 @@ mx_status_t VmObjectDispatcher::GetSize(uint64_t* size) {
     return NO_ERROR;
 }
 
+mx_status_t VmObjectDispatcher::Clone(uint32_t options, uint64_t offset, uint64_t size,
+                                      mxtl::RefPtr<VmObject>* clone_vmo) {
+    LTRACEF("options %#x offset %#" PRIx64 " size %#" PRIx64 "\n", options, offset, size);
+
+    switch (options) {
+        case MX_VMO_CLONE_COPY_ON_WRITE:
+            return vmo_->CloneCOW(offset, size, clone_vmo);
+        default:
+            return ERR_INVALID_ARGS;
+    }
+}
+
 mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t size,
                                         user_ptr<void> buffer, size_t buffer_size) {
     LTRACEF("op %u offset %#" PRIx64 " size %#" PRIx64
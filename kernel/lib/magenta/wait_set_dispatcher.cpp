@@ -84,7 +84,10 @@ bool WaitSetDispatcher::Entry::IsTriggeredLocked() const {
 
 mx_signals_t WaitSetDispatcher::Entry::GetSignalsStateLocked() const {
     DEBUG_ASSERT(wait_set_->mutex_.IsHeld());
-    return signals_;
+    // We only hear about changes to the watched signals, so take the rest from the object as it
+    // is now.
+    mx_signals_t current = dispatcher_->get_state_tracker()->GetSignalsState();
+    return (signals_ & watched_signals_) | (current & ~watched_signals_);
 }
 
 WaitSetDispatcher::Entry::Entry(mx_signals_t watched_signals, uint64_t cookie)
@@ -243,7 +246,7 @@ status_t WaitSetDispatcher::AddEntry(mxtl::unique_ptr<Entry> entry, Handle* hand
     // set its state to REMOVE_REQUESTED).
 
     // We need to call this outside the lock.
-    state_tracker->AddObserver(e);
+    state_tracker->AddObserver(e, e->watched_signals());
 
     // AddObserver() calls e->OnInitialize(), which sets |e|'s state to ADDED. WARNING:
     // That state change means that RemoveEntry() may actually call RemoveObserver(), so we must not
@@ -343,7 +346,7 @@ WaitSetDispatcher::WaitSetDispatcher()
     event_init(&event_, false, 0);
 
     // This is just so we can observe our own handle's cancellation.
-    state_tracker_.AddObserver(this);
+    state_tracker_.AddObserver(this, 0u);
 }
 
 bool WaitSetDispatcher::OnInitialize(mx_signals_t initial_state) { return false; }
@@ -34,7 +34,7 @@ mx_status_t WaitStateObserver::Begin(WaitEvent* event,
         return ERR_NOT_SUPPORTED;
     }
 
-    state_tracker->AddObserver(this);
+    state_tracker->AddObserver(this, watched_signals_);
     return NO_ERROR;
 }
 
@@ -43,8 +43,12 @@ mx_signals_t WaitStateObserver::End() {
 
     auto tracker = dispatcher_->get_state_tracker();
     DEBUG_ASSERT(tracker);
-    if (tracker)
+    if (tracker) {
         tracker->RemoveObserver(this);
+        // We were only told about changes to the watched signals; pick up
+        // whatever else is set now.
+        wakeup_reasons_ |= tracker->GetSignalsState();
+    }
     dispatcher_.reset();
 
     // Return the set of reasons that we may have been woken.  Basically, this
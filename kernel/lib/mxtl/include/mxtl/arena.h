@@ -86,6 +86,10 @@ public:
         arena_.Free(obj);
     }
 
+    void* RawAlloc() {
+        return arena_.Alloc();
+    }
+
     void RawFree(void* mem) {
         arena_.Free(mem);
     }
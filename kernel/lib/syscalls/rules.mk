@@ -14,6 +14,7 @@ MODULE_DEPS := \
     lib/crypto \
     lib/magenta \
     lib/user_copy \
+    lib/vdso \
 
 MODULE_SRCS := \
     $(LOCAL_DIR)/syscalls.cpp \
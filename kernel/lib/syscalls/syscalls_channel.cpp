@@ -32,6 +32,7 @@
 
 constexpr size_t kChannelReadHandlesChunkCount = 16u;
 constexpr size_t kChannelWriteHandlesInlineCount = 8u;
+constexpr size_t kChannelReadManyInlineCount = 8u;
 
 mx_status_t sys_channel_create(uint32_t flags, mx_handle_t* _out0, mx_handle_t* _out1) {
     LTRACEF("out_handles %p,%p\n", _out0, _out1);
@@ -134,7 +135,7 @@ mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t flags,
         return result;
 
     if (num_bytes > 0u) {
-        if (make_user_ptr(_bytes).copy_array_to_user(msg->data(), num_bytes) != NO_ERROR)
+        if (msg->CopyDataTo(make_user_ptr(_bytes), up->aspace().get()) != NO_ERROR)
             return ERR_INVALID_ARGS;
     }
 
@@ -210,15 +211,10 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
 
 
     mxtl::unique_ptr<MessagePacket> msg;
-    result = MessagePacket::Create(num_bytes, num_handles, &msg);
+    result = MessagePacket::Create(make_user_ptr(_bytes), num_bytes, num_handles, &msg);
     if (result != NO_ERROR)
         return result;
 
-    if (num_bytes > 0u) {
-        if (make_user_ptr(_bytes).copy_array_from_user(msg->mutable_data(), num_bytes) != NO_ERROR)
-            return ERR_INVALID_ARGS;
-    }
-
     AllocChecker ac;
     mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, num_handles);
     if (!ac.check())
@@ -243,6 +239,165 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
     return result;
 }
 
+// Takes the handles of a message that failed to be written back into the process.
+static void msg_undo_put_handles(ProcessDispatcher* up, MessagePacket* msg) {
+    Handle* const* handle_list = msg->handles();
+    {
+        AutoLock lock(up->handle_table_lock());
+        for (size_t ix = 0; ix != msg->num_handles(); ++ix) {
+            up->UndoRemoveHandleLocked(up->MapHandleToValue(handle_list[ix]));
+        }
+    }
+    msg->set_owns_handles(false);
+}
+
+static mx_status_t msg_create_from_user(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                        const mx_channel_msg_t& desc,
+                                        mxtl::unique_ptr<MessagePacket>* out) {
+    mxtl::unique_ptr<MessagePacket> msg;
+    mx_status_t result = MessagePacket::Create(make_user_ptr(static_cast<const void*>(desc.bytes)),
+                                               desc.num_bytes, desc.num_handles, &msg);
+    if (result != NO_ERROR)
+        return result;
+
+    if (desc.num_handles > 0u) {
+        AllocChecker ac;
+        mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(
+            &ac, desc.num_handles);
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        result = msg_put_handles(up, msg.get(), handles.get(), desc.handles, desc.num_handles,
+                                 static_cast<Dispatcher*>(channel));
+        if (result)
+            return result;
+    }
+
+    *out = mxtl::move(msg);
+    return NO_ERROR;
+}
+
+mx_status_t sys_channel_write_many(mx_handle_t handle_value, uint32_t options,
+                                   const mx_channel_msg_t* _msgs, uint32_t num_msgs,
+                                   uint32_t* _actual_msgs) {
+    LTRACEF("handle %d msgs %p num_msgs %u\n", handle_value, _msgs, num_msgs);
+
+    if (options != 0u)
+        return ERR_INVALID_ARGS;
+    if (num_msgs == 0u || num_msgs > MX_CHANNEL_MAX_MSGS_PER_CALL)
+        return ERR_OUT_OF_RANGE;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &channel);
+    if (result != NO_ERROR)
+        return result;
+
+    // Build as many of the messages as we can.  If one of them is bad, the ones
+    // before it still go out and the caller finds out from |actual_msgs|.
+    ChannelDispatcher::MessageList msgs;
+    uint32_t count = 0;
+    for (; count < num_msgs; count++) {
+        mx_channel_msg_t desc;
+        if (make_user_ptr(_msgs).element_offset(count).copy_from_user(&desc) != NO_ERROR) {
+            result = ERR_INVALID_ARGS;
+            break;
+        }
+
+        mxtl::unique_ptr<MessagePacket> msg;
+        result = msg_create_from_user(up, channel.get(), desc, &msg);
+        if (result != NO_ERROR)
+            break;
+        msgs.push_back(mxtl::move(msg));
+    }
+    if (count == 0)
+        return result;
+
+    result = channel->WriteMany(&msgs);
+    if (result != NO_ERROR) {
+        // Write failed, put back the handles into this process.
+        while (!msgs.is_empty()) {
+            auto msg = msgs.pop_front();
+            msg_undo_put_handles(up, msg.get());
+        }
+        return result;
+    }
+
+    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), count, 0, 0);
+
+    if (make_user_ptr(_actual_msgs).copy_to_user(count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
+}
+
+mx_status_t sys_channel_read_many(mx_handle_t handle_value, uint32_t options,
+                                  mx_channel_msg_t* _msgs, uint32_t num_msgs,
+                                  uint32_t* _actual_msgs) {
+    LTRACEF("handle %d msgs %p num_msgs %u\n", handle_value, _msgs, num_msgs);
+
+    if (options != 0u)
+        return ERR_INVALID_ARGS;
+    if (num_msgs == 0u || num_msgs > MX_CHANNEL_MAX_MSGS_PER_CALL)
+        return ERR_OUT_OF_RANGE;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_READ, &channel);
+    if (result != NO_ERROR)
+        return result;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_channel_msg_t, kChannelReadManyInlineCount> bufs(&ac, num_msgs);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if (make_user_ptr(_msgs).copy_array_from_user(bufs.get(), num_msgs) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    ChannelDispatcher::MessageList msgs;
+    uint32_t num_bytes = 0;
+    uint32_t num_handles = 0;
+    result = channel->ReadMany(bufs.get(), num_msgs, &msgs, &num_bytes, &num_handles);
+    if (result == ERR_BUFFER_TOO_SMALL) {
+        // Like channel_read, report the size of the message that didn't fit.
+        if (make_user_ptr(&_msgs->actual_bytes).copy_to_user(num_bytes) != NO_ERROR ||
+            make_user_ptr(&_msgs->actual_handles).copy_to_user(num_handles) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        return result;
+    }
+    if (result != NO_ERROR)
+        return result;
+
+    uint32_t count = 0;
+    while (!msgs.is_empty()) {
+        auto msg = msgs.pop_front();
+        const mx_channel_msg_t& buf = bufs[count];
+        num_bytes = msg->data_size();
+        num_handles = msg->num_handles();
+
+        mx_channel_msg_t* out = _msgs + count;
+        if (make_user_ptr(&out->actual_bytes).copy_to_user(num_bytes) != NO_ERROR ||
+            make_user_ptr(&out->actual_handles).copy_to_user(num_handles) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+
+        if (num_bytes > 0u) {
+            if (msg->CopyDataTo(make_user_ptr(buf.bytes), up->aspace().get()) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+        }
+
+        if (num_handles > 0u) {
+            msg_get_handles(up, msg.get(), buf.handles, num_handles);
+        }
+        count++;
+    }
+
+    ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), count, 0, 0);
+
+    if (make_user_ptr(_actual_msgs).copy_to_user(count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
+}
+
 mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t flags,
                              mx_time_t timeout, const mx_channel_call_args_t* _args,
                              uint32_t* actual_bytes, uint32_t* actual_handles,
@@ -267,15 +422,11 @@ mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t flags,
 
     // Prepare a MessagePacket for writing
     mxtl::unique_ptr<MessagePacket> msg;
-    result = MessagePacket::Create(num_bytes, num_handles, &msg);
+    result = MessagePacket::Create(make_user_ptr(static_cast<const void*>(args.wr_bytes)),
+                                   num_bytes, num_handles, &msg);
     if (result != NO_ERROR)
         return result;
 
-    if (num_bytes > 0u) {
-        if (make_user_ptr(args.wr_bytes).copy_array_from_user(msg->mutable_data(), num_bytes) != NO_ERROR)
-            return ERR_INVALID_ARGS;
-    }
-
     AllocChecker ac;
     mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, num_handles);
     if (!ac.check())
@@ -329,7 +480,7 @@ mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t flags,
     }
 
     if (num_bytes > 0u) {
-        if (make_user_ptr(args.rd_bytes).copy_array_to_user(reply->data(), num_bytes) != NO_ERROR) {
+        if (reply->CopyDataTo(make_user_ptr(args.rd_bytes), up->aspace().get()) != NO_ERROR) {
             result = ERR_INVALID_ARGS;
             goto read_failed;
         }
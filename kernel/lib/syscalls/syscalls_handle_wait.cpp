@@ -181,7 +181,7 @@ static mx_status_t add_port_observer(mx_handle_t handle_value, PortObserver* obs
 mx_status_t sys_object_wait_async(mx_handle_t handle_value, mx_handle_t port_handle,
                                   uint64_t key, mx_signals_t signals, uint32_t options) {
     LTRACEF("handle %d\n", handle_value);
-    if (options)
+    if (options & ~MX_WAIT_ASYNC_REPEATING)
         return ERR_INVALID_ARGS;
 
     auto up = ProcessDispatcher::GetCurrent();
@@ -191,7 +191,7 @@ mx_status_t sys_object_wait_async(mx_handle_t handle_value, mx_handle_t port_han
     if (status != NO_ERROR)
         return status;
 
-    auto observer = port->MakeObserver(key, signals);
+    auto observer = port->MakeObserver(key, signals, options & MX_WAIT_ASYNC_REPEATING);
     if (!observer)
         return ERR_NO_MEMORY;
 
@@ -19,9 +19,11 @@
 #include <kernel/auto_lock.h>
 #include <kernel/mp.h>
 #include <kernel/thread.h>
+#include <kernel/vm/vm_object.h>
 
 #include <lib/crypto/global_prng.h>
 #include <lib/ktrace.h>
+#include <lib/vdso.h>
 #include <lib/user_copy.h>
 #include <lib/user_copy/user_ptr.h>
 
@@ -34,11 +36,14 @@
 #include <magenta/process_dispatcher.h>
 #include <magenta/socket_dispatcher.h>
 #include <magenta/state_tracker.h>
+#include <magenta/thread_dispatcher.h>
 #include <magenta/syscalls/log.h>
 #include <magenta/user_copy.h>
 #include <magenta/user_thread.h>
+#include <magenta/vm_object_dispatcher.h>
 #include <magenta/wait_set_dispatcher.h>
 
+#include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
@@ -64,7 +69,12 @@ mx_status_t sys_nanosleep(mx_time_t nanoseconds) {
 // This must be accessed atomically from any given thread.
 static int64_t utc_offset;
 
-uint64_t sys_time_get(uint32_t clock_id) {
+// Serializes updates of utc_offset with publishing it to the vDSO.
+static Mutex utc_offset_lock;
+
+// mx_time_get is served by the vDSO, which only enters the kernel for
+// clocks (or timer sources) it cannot read from its clock data.
+uint64_t sys_time_get_kernel(uint32_t clock_id) {
     switch (clock_id) {
     case MX_CLOCK_MONOTONIC:
         return current_time_hires();
@@ -88,9 +98,12 @@ mx_status_t sys_clock_adjust(mx_handle_t hrsrc, uint32_t clock_id, int64_t offse
     switch (clock_id) {
     case MX_CLOCK_MONOTONIC:
         return ERR_ACCESS_DENIED;
-    case MX_CLOCK_UTC:
+    case MX_CLOCK_UTC: {
+        AutoLock lock(&utc_offset_lock);
         atomic_store_64(&utc_offset, offset);
+        VDso::SetUtcOffset(offset);
         return NO_ERROR;
+    }
     default:
         return ERR_INVALID_ARGS;
     }
@@ -170,6 +183,49 @@ mx_status_t sys_futex_requeue(mx_futex_t* _wake_ptr, uint32_t wake_count, int cu
         make_user_ptr(_requeue_ptr), requeue_count);
 }
 
+mx_status_t sys_futex_lock_pi(mx_futex_t* _value_ptr, int current_value, mx_handle_t new_owner,
+                              mx_time_t timeout) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // The futex holds the owner's thread handle, plus the waiters bit.
+    mxtl::RefPtr<ThreadDispatcher> owner;
+    mx_status_t status = up->GetDispatcher(current_value & ~MX_FUTEX_PI_WAITERS, &owner);
+    if (status != NO_ERROR)
+        return status;
+    if (owner->thread()->process() != up)
+        return ERR_INVALID_ARGS;
+
+    // |new_owner| is what goes in the futex if it is handed to us.
+    mxtl::RefPtr<ThreadDispatcher> self;
+    status = up->GetDispatcher(new_owner, &self);
+    if (status != NO_ERROR)
+        return status;
+    if (self->thread() != UserThread::GetCurrent())
+        return ERR_INVALID_ARGS;
+
+    return up->futex_context()->FutexLockPi(
+        make_user_ptr(_value_ptr), current_value,
+        mxtl::RefPtr<UserThread>(owner->thread()), new_owner, timeout);
+}
+
+mx_status_t sys_futex_unlock_pi(mx_futex_t* _value_ptr) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // Only the thread whose handle the futex holds may hand it on.  Nobody
+    // else may change the value while it is held with the waiters bit set,
+    // and FutexUnlockPi() checks again that it has not.
+    int value;
+    mx_status_t status = make_user_ptr(_value_ptr).copy_from_user(&value);
+    if (status != NO_ERROR)
+        return status;
+    mxtl::RefPtr<ThreadDispatcher> owner;
+    if (up->GetDispatcher(value & ~MX_FUTEX_PI_WAITERS, &owner) != NO_ERROR ||
+        owner->thread() != UserThread::GetCurrent())
+        return ERR_ACCESS_DENIED;
+
+    return up->futex_context()->FutexUnlockPi(make_user_ptr(_value_ptr), value);
+}
+
 mx_status_t sys_log_create(uint32_t flags, mx_handle_t* out) {
     LTRACEF("flags 0x%x\n", flags);
 
@@ -395,14 +451,19 @@ mx_status_t sys_waitset_wait(mx_handle_t ws_handle,
 }
 
 mx_status_t sys_socket_create(uint32_t flags, mx_handle_t* _out0, mx_handle_t* _out1) {
-    LTRACEF("entry out_handles %p, %p\n", _out0, _out1);
+    return sys_socket_create_etc(flags, 0u, _out0, _out1);
+}
+
+mx_status_t sys_socket_create_etc(uint32_t flags, size_t buffer_size,
+                                  mx_handle_t* _out0, mx_handle_t* _out1) {
+    LTRACEF("entry buffer_size %zu out_handles %p, %p\n", buffer_size, _out0, _out1);
 
     if (flags != 0u)
         return ERR_INVALID_ARGS;
 
     mxtl::RefPtr<Dispatcher> socket0, socket1;
     mx_rights_t rights;
-    status_t result = SocketDispatcher::Create(flags, &socket0, &socket1, &rights);
+    status_t result = SocketDispatcher::Create(flags, buffer_size, &socket0, &socket1, &rights);
     if (result != NO_ERROR)
         return result;
 
@@ -491,6 +552,125 @@ mx_status_t sys_socket_read(mx_handle_t handle, uint32_t flags,
     return status;
 }
 
+// Most callers pass a handful of iovecs, which can live on the stack.
+constexpr size_t kSocketIovecsInlineCount = 8u;
+
+// Copies in the iovec array for socket_writev and socket_readv.
+static mx_status_t socket_copy_iovecs(const mx_iovec_t* _iov, uint32_t num_iov,
+                                      mx_iovec_t* iov) {
+    if (make_user_ptr(_iov).copy_array_from_user(iov, num_iov) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    for (uint32_t i = 0; i < num_iov; i++) {
+        if (iov[i].size > 0u && !iov[i].buffer)
+            return ERR_INVALID_ARGS;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t sys_socket_writev(mx_handle_t handle, uint32_t options,
+                              const mx_iovec_t* _iov, uint32_t num_iov,
+                              size_t* _actual) {
+    LTRACEF("handle %d num_iov %u\n", handle, num_iov);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<SocketDispatcher> socket;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &socket);
+    if (status != NO_ERROR)
+        return status;
+
+    if (num_iov == 0u || num_iov > MX_SOCKET_MAX_IOVECS)
+        return ERR_OUT_OF_RANGE;
+    AllocChecker ac;
+    mxtl::InlineArray<mx_iovec_t, kSocketIovecsInlineCount> iov(&ac, num_iov);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if ((status = socket_copy_iovecs(_iov, num_iov, iov.get())) != NO_ERROR)
+        return status;
+
+    size_t nwritten;
+    status = socket->WriteV(iov.get(), num_iov, &nwritten);
+
+    // Caller may ignore results if desired.
+    if (status == NO_ERROR && _actual)
+        status = make_user_ptr(_actual).copy_to_user(nwritten);
+
+    return status;
+}
+
+mx_status_t sys_socket_readv(mx_handle_t handle, uint32_t options,
+                             const mx_iovec_t* _iov, uint32_t num_iov,
+                             size_t* _actual) {
+    LTRACEF("handle %d num_iov %u\n", handle, num_iov);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<SocketDispatcher> socket;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_READ, &socket);
+    if (status != NO_ERROR)
+        return status;
+
+    if (num_iov == 0u || num_iov > MX_SOCKET_MAX_IOVECS)
+        return ERR_OUT_OF_RANGE;
+    AllocChecker ac;
+    mxtl::InlineArray<mx_iovec_t, kSocketIovecsInlineCount> iov(&ac, num_iov);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if ((status = socket_copy_iovecs(_iov, num_iov, iov.get())) != NO_ERROR)
+        return status;
+
+    size_t nread;
+    status = socket->ReadV(iov.get(), num_iov, &nread);
+
+    // Caller may ignore results if desired.
+    if (status == NO_ERROR && _actual)
+        status = make_user_ptr(_actual).copy_to_user(nread);
+
+    return status;
+}
+
+mx_status_t sys_socket_splice(mx_handle_t handle, uint32_t options, mx_handle_t vmo_handle,
+                              uint64_t offset, size_t size, size_t* _actual) {
+    LTRACEF("handle %d vmo %d offset %#" PRIx64 " size %#zx\n", handle, vmo_handle, offset, size);
+
+    if (options != MX_SOCKET_SPLICE_FROM_VMO && options != MX_SOCKET_SPLICE_TO_VMO)
+        return ERR_INVALID_ARGS;
+    bool from_vmo = (options == MX_SOCKET_SPLICE_FROM_VMO);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<SocketDispatcher> socket;
+    mx_status_t status = up->GetDispatcherWithRights(
+        handle, from_vmo ? MX_RIGHT_WRITE : MX_RIGHT_READ, &socket);
+    if (status != NO_ERROR)
+        return status;
+
+    // Moving pages out of the VMO changes it too, so both ways need write.
+    mxtl::RefPtr<VmObjectDispatcher> vmo;
+    status = up->GetDispatcherWithRights(
+        vmo_handle, from_vmo ? (MX_RIGHT_READ | MX_RIGHT_WRITE) : MX_RIGHT_WRITE, &vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    size_t actual;
+    if (from_vmo)
+        status = socket->WriteFromVmo(vmo->vmo().get(), offset, size, &actual);
+    else
+        status = socket->ReadToVmo(vmo->vmo().get(), offset, size, &actual);
+
+    // Caller may ignore results if desired.
+    if (status == NO_ERROR && _actual)
+        status = make_user_ptr(_actual).copy_to_user(actual);
+
+    return status;
+}
+
 mx_status_t sys_fifo_create(uint32_t count, uint32_t elemsize, uint32_t options,
                             mx_handle_t* _out0, mx_handle_t* _out1) {
     mxtl::RefPtr<Dispatcher> dispatcher0;
@@ -554,4 +734,47 @@ mx_status_t sys_fifo_read(mx_handle_t handle, void* entries, size_t len, uint32_
         return ERR_INVALID_ARGS;
 
     return NO_ERROR;
-}
\ No newline at end of file
+}
+
+mx_status_t sys_fifo_get_ring(mx_handle_t handle, mx_handle_t* _vmo, uint32_t* _ring) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<FifoDispatcher> fifo;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_READ | MX_RIGHT_WRITE, &fifo);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<VmObject> vmo;
+    uint32_t ring;
+    if ((status = fifo->GetRing(&vmo, &ring)) != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    if ((status = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights)) != NO_ERROR)
+        return status;
+
+    HandleOwner vmo_handle(MakeHandle(mxtl::move(dispatcher), rights & ~MX_RIGHT_EXECUTE));
+    if (!vmo_handle)
+        return ERR_NO_MEMORY;
+
+    if (make_user_ptr(_vmo).copy_to_user(up->MapHandleToValue(vmo_handle)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (make_user_ptr(_ring).copy_to_user(ring) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(vmo_handle));
+
+    return NO_ERROR;
+}
+
+mx_status_t sys_fifo_doorbell(mx_handle_t handle) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<FifoDispatcher> fifo;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &fifo);
+    if (status != NO_ERROR)
+        return status;
+
+    return fifo->RingDoorbell();
+}
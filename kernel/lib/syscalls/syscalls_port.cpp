@@ -17,12 +17,15 @@
 #include <magenta/process_dispatcher.h>
 #include <magenta/user_copy.h>
 
+#include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
 
 #define LOCAL_TRACE 0
 
+constexpr size_t kPortWaitManyInlineCount = 8u;
+
 mx_status_t sys_port_create(uint32_t options, mx_handle_t* _out) {
     LTRACEF("options %u\n", options);
 
@@ -109,15 +112,14 @@ mx_status_t sys_port_wait2(mx_handle_t handle, mx_time_t timeout, void* _packet)
     if (status != NO_ERROR)
         return status;
 
-    PortPacket* pp = nullptr;
+    mx_port_packet_t pp;
     mx_status_t st = port->DeQueue(timeout, &pp);
     if (st != NO_ERROR)
         return st;
 
-    if (make_user_ptr(_packet).copy_array_to_user(&pp->packet, sizeof(pp->packet)) != NO_ERROR)
+    if (make_user_ptr(_packet).copy_array_to_user(&pp, sizeof(pp)) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    pp->Destroy();
     return NO_ERROR;
 }
 
@@ -152,6 +154,40 @@ mx_status_t sys_port_wait(mx_handle_t handle, mx_time_t timeout,
     return NO_ERROR;
 }
 
+mx_status_t sys_port_wait_many(mx_handle_t handle, mx_time_t timeout, void* _packets,
+                               uint32_t count, uint32_t* _actual) {
+    LTRACEF("handle %d count %u\n", handle, count);
+
+    if (count == 0u || count > MX_PORT_MAX_PKTS_PER_WAIT)
+        return ERR_OUT_OF_RANGE;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PortDispatcherV2> port;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_READ, &port);
+    if (status != NO_ERROR)
+        return status;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_port_packet_t, kPortWaitManyInlineCount> packets(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    uint32_t actual = 0;
+    status = port->DeQueueMany(timeout, packets.get(), count, &actual);
+    if (status != NO_ERROR)
+        return status;
+
+    if (make_user_ptr(static_cast<mx_port_packet_t*>(_packets))
+            .copy_array_to_user(packets.get(), actual) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    if (make_user_ptr(_actual).copy_to_user(actual) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    return NO_ERROR;
+}
+
 mx_status_t sys_port_bind(mx_handle_t handle, uint64_t key,
                           mx_handle_t source, mx_signals_t signals) {
     LTRACEF("handle %d source %d\n", handle, source);
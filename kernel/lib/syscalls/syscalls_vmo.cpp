@@ -33,7 +33,8 @@ mx_status_t sys_vmo_create(uint64_t size, uint32_t options, mx_handle_t* _out) {
         return ERR_INVALID_ARGS;
 
     // create a vm object
-    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::Create(0, size);
+    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, size,
+                                                       VmObjectPaged::kLoanable);
     if (!vmo)
         return ERR_NO_MEMORY;
 
@@ -159,3 +160,46 @@ mx_status_t sys_vmo_op_range(mx_handle_t handle, uint32_t op, uint64_t offset, u
 
     return vmo->RangeOp(op, offset, size, make_user_ptr(_buffer), buffer_size);
 }
+
+mx_status_t sys_vmo_clone(mx_handle_t handle, uint32_t options, uint64_t offset, uint64_t size,
+                          mx_handle_t* _out) {
+    LTRACEF("handle %d options %#x offset %#" PRIx64 " size %#" PRIx64 "\n",
+            handle, options, offset, size);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // lookup the dispatcher from handle, the clone exposes the contents so it
+    // needs read access
+    mxtl::RefPtr<VmObjectDispatcher> vmo;
+    mx_rights_t vmo_rights;
+    mx_status_t status = up->GetDispatcherAndRights(handle, &vmo, &vmo_rights);
+    if (status != NO_ERROR)
+        return status;
+    if (!(vmo_rights & MX_RIGHT_READ))
+        return ERR_ACCESS_DENIED;
+
+    // create the clone
+    mxtl::RefPtr<VmObject> clone_vmo;
+    status = vmo->Clone(options, offset, size, &clone_vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    // create a Vm Object dispatcher
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t default_rights;
+    status = VmObjectDispatcher::Create(mxtl::move(clone_vmo), &dispatcher, &default_rights);
+    if (status != NO_ERROR)
+        return status;
+
+    // the clone gets no more rights than the handle it was made from
+    HandleOwner clone_handle(MakeHandle(mxtl::move(dispatcher), vmo_rights));
+    if (!clone_handle)
+        return ERR_NO_MEMORY;
+
+    if (make_user_ptr(_out).copy_to_user(up->MapHandleToValue(clone_handle)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(clone_handle));
+
+    return NO_ERROR;
+}
@@ -30,3 +30,27 @@ struct vdso_constants {
     // Conversion factor for mx_ticks_get return values to seconds.
     uint64_t ticks_per_second;
 };
+
+// This struct holds the kernel's clock parameters that mx_time_get needs
+// to compute the time in user mode.  Unlike vdso_constants, the kernel
+// updates it while processes are reading it (for instance, when
+// mx_clock_adjust sets a new UTC offset), so it is protected by a
+// sequence lock: the kernel increments seq before and after each update,
+// and a reader retries unless it sees the same even seq value both before
+// and after reading the other members.
+struct vdso_clock {
+    uint32_t seq;
+
+    // Nonzero if MX_CLOCK_MONOTONIC is mx_ticks_get() scaled by
+    // ns_per_tick.  If zero, mx_time_get has to ask the kernel.
+    uint32_t ticks_valid;
+
+    // Nanoseconds per mx_ticks_get() tick, in the 32.64 fixed point form
+    // of struct fp_32_64 from the kernel's lib/fixed_point.h.
+    uint32_t ns_per_tick_l0;
+    uint32_t ns_per_tick_l32;
+    uint32_t ns_per_tick_l64;
+
+    // Added to MX_CLOCK_MONOTONIC to get MX_CLOCK_UTC.
+    int64_t utc_offset;
+};
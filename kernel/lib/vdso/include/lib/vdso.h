@@ -12,4 +12,8 @@
 class VDso : public RoDso {
 public:
     VDso();
+
+    // Publish a new MX_CLOCK_UTC offset to the clock data that the
+    // vDSO's mx_time_get reads.
+    static void SetUtcOffset(int64_t offset);
 };
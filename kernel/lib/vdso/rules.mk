@@ -14,6 +14,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/vdso-image.S \
 
 MODULE_DEPS := \
+    lib/fixed_point \
     lib/mxtl \
 
 vdso-filename := $(BUILDDIR)/ulib/magenta/libmagenta.so
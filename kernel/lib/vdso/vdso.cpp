@@ -7,8 +7,13 @@
 #include <lib/vdso.h>
 #include <lib/vdso-constants.h>
 
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <kernel/spinlock.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
+#include <lib/fixed_point.h>
+#include <new.h>
 #include <platform.h>
 
 #include "vdso-code.h"
@@ -54,6 +59,24 @@ private:
     T* data_;
 };
 
+// The kernel's mapping of the vdso_clock struct stays in place for good,
+// so that clock changes can be published to the vDSO at any time.
+KernelVmoWindow<vdso_clock>* clock_window;
+spin_lock_t clock_lock = SPIN_LOCK_INITIAL_VALUE;
+
+// Runs |update| on the clock struct as a sequence lock writer.  Interrupts
+// stay off throughout so that readers never spin on a preempted writer.
+template<typename Update>
+void update_clock(Update update) {
+    AutoSpinLockIrqSave lock(clock_lock);
+    vdso_clock* clock = clock_window->data();
+    clock->seq++;
+    smp_wmb();
+    update(clock);
+    smp_wmb();
+    clock->seq++;
+}
+
 }; // anonymous namespace
 
 VDso::VDso() : RoDso("vdso", vdso_image, VDSO_CODE_END, VDSO_CODE_START) {
@@ -70,4 +93,32 @@ VDso::VDso() : RoDso("vdso", vdso_image, VDSO_CODE_END, VDSO_CODE_START) {
         arch_dcache_line_size(),
         ticks_per_second(),
     };
+
+    // There is only ever one vDSO image, so the clock window never needs
+    // to be replaced.
+    ASSERT(clock_window == nullptr);
+    AllocChecker ac;
+    clock_window = new (&ac) KernelVmoWindow<vdso_clock>(
+        "vDSO clock", vmo()->vmo(), VDSO_DATA_CLOCK);
+    ASSERT(ac.check());
+
+    // No process has the image mapped yet, so start the sequence afresh
+    // from whatever placeholder the vDSO's own build put there.
+    clock_window->data()->seq = 0;
+
+    struct fp_32_64 ns_per_tick = {};
+    bool ticks_valid = platform_ticks_to_ns(&ns_per_tick);
+    update_clock([&](vdso_clock* clock) {
+        clock->ticks_valid = ticks_valid;
+        clock->ns_per_tick_l0 = ns_per_tick.l0;
+        clock->ns_per_tick_l32 = ns_per_tick.l32;
+        clock->ns_per_tick_l64 = ns_per_tick.l64;
+        clock->utc_offset = 0;
+    });
+}
+
+void VDso::SetUtcOffset(int64_t offset) {
+    update_clock([offset](vdso_clock* clock) {
+        clock->utc_offset = offset;
+    });
 }
@@ -172,6 +172,15 @@ uint64_t ticks_per_second(void)
     return tsc_ticks_per_ms * 1000;
 }
 
+bool platform_ticks_to_ns(struct fp_32_64 *ns_per_tick)
+{
+    // mx_ticks_get() is rdtsc, so this only holds when the TSC is the wall clock.
+    if (wall_clock != CLOCK_TSC)
+        return false;
+    *ns_per_tick = ns_per_tsc;
+    return true;
+}
+
 // The PIT timer will keep track of wall time if we aren't using the TSC
 static enum handler_return pit_timer_tick(void *arg)
 {
@@ -253,6 +253,34 @@ extern mx_status_t _mx_channel_call(
     uint32_t actual_handles[1],
     mx_status_t read_status[1]) __attribute__((__leaf__));
 
+extern mx_status_t mx_channel_read_many(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_channel_msg_t msgs[],
+    uint32_t num_msgs,
+    uint32_t actual_msgs[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_channel_read_many(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_channel_msg_t msgs[],
+    uint32_t num_msgs,
+    uint32_t actual_msgs[1]) __attribute__((__leaf__));
+
+extern mx_status_t mx_channel_write_many(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_channel_msg_t msgs[],
+    uint32_t num_msgs,
+    uint32_t actual_msgs[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_channel_write_many(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_channel_msg_t msgs[],
+    uint32_t num_msgs,
+    uint32_t actual_msgs[1]) __attribute__((__leaf__));
+
 extern mx_status_t mx_socket_create(
     uint32_t options,
     mx_handle_t out0[1],
@@ -291,6 +319,62 @@ extern mx_status_t _mx_socket_read(
     size_t size,
     size_t actual[1]) __attribute__((__leaf__));
 
+extern mx_status_t mx_socket_create_etc(
+    uint32_t options,
+    size_t buffer_size,
+    mx_handle_t out0[1],
+    mx_handle_t out1[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_socket_create_etc(
+    uint32_t options,
+    size_t buffer_size,
+    mx_handle_t out0[1],
+    mx_handle_t out1[1]) __attribute__((__leaf__));
+
+extern mx_status_t mx_socket_writev(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_iovec_t iov[],
+    uint32_t num_iov,
+    size_t actual[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_socket_writev(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_iovec_t iov[],
+    uint32_t num_iov,
+    size_t actual[1]) __attribute__((__leaf__));
+
+extern mx_status_t mx_socket_readv(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_iovec_t iov[],
+    uint32_t num_iov,
+    size_t actual[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_socket_readv(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_iovec_t iov[],
+    uint32_t num_iov,
+    size_t actual[1]) __attribute__((__leaf__));
+
+extern mx_status_t mx_socket_splice(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_handle_t vmo,
+    uint64_t offset,
+    size_t size,
+    size_t actual[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_socket_splice(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_handle_t vmo,
+    uint64_t offset,
+    size_t size,
+    size_t actual[1]) __attribute__((__leaf__));
+
 extern void mx_thread_exit(void) __attribute__((__leaf__)) __attribute__((__noreturn__));
 
 extern void _mx_thread_exit(void) __attribute__((__leaf__)) __attribute__((__noreturn__));
@@ -489,6 +573,24 @@ extern mx_status_t _mx_futex_requeue(
     mx_futex_t requeue_ptr[1],
     uint32_t requeue_count) __attribute__((__leaf__));
 
+extern mx_status_t mx_futex_lock_pi(
+    mx_futex_t value_ptr[1],
+    int current_value,
+    mx_handle_t new_owner,
+    mx_time_t timeout) __attribute__((__leaf__));
+
+extern mx_status_t _mx_futex_lock_pi(
+    mx_futex_t value_ptr[1],
+    int current_value,
+    mx_handle_t new_owner,
+    mx_time_t timeout) __attribute__((__leaf__));
+
+extern mx_status_t mx_futex_unlock_pi(
+    mx_futex_t value_ptr[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_futex_unlock_pi(
+    mx_futex_t value_ptr[1]) __attribute__((__leaf__));
+
 extern mx_status_t mx_waitset_create(
     uint32_t options,
     mx_handle_t out[1]) __attribute__((__leaf__));
@@ -559,6 +661,20 @@ extern mx_status_t _mx_port_wait(
     void* packet,
     size_t size) __attribute__((__leaf__));
 
+extern mx_status_t mx_port_wait_many(
+    mx_handle_t handle,
+    mx_time_t timeout,
+    void* packets,
+    uint32_t count,
+    uint32_t actual[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_port_wait_many(
+    mx_handle_t handle,
+    mx_time_t timeout,
+    void* packets,
+    uint32_t count,
+    uint32_t actual[1]) __attribute__((__leaf__));
+
 extern mx_status_t mx_port_bind(
     mx_handle_t handle,
     uint64_t key,
@@ -641,6 +757,20 @@ extern mx_status_t _mx_vmo_op_range(
     void* buffer,
     size_t buffer_size) __attribute__((__leaf__));
 
+extern mx_status_t mx_vmo_clone(
+    mx_handle_t handle,
+    uint32_t options,
+    uint64_t offset,
+    uint64_t size,
+    mx_handle_t out[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_vmo_clone(
+    mx_handle_t handle,
+    uint32_t options,
+    uint64_t offset,
+    uint64_t size,
+    mx_handle_t out[1]) __attribute__((__leaf__));
+
 extern mx_status_t mx_cprng_draw(
     void* buffer,
     size_t len,
@@ -697,6 +827,22 @@ extern mx_status_t _mx_fifo_write(
     size_t len,
     uint32_t num_written[1]) __attribute__((__leaf__));
 
+extern mx_status_t mx_fifo_get_ring(
+    mx_handle_t handle,
+    mx_handle_t vmo[1],
+    uint32_t ring[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_fifo_get_ring(
+    mx_handle_t handle,
+    mx_handle_t vmo[1],
+    uint32_t ring[1]) __attribute__((__leaf__));
+
+extern mx_status_t mx_fifo_doorbell(
+    mx_handle_t handle) __attribute__((__leaf__));
+
+extern mx_status_t _mx_fifo_doorbell(
+    mx_handle_t handle) __attribute__((__leaf__));
+
 extern mx_status_t mx_log_create(
     uint32_t options,
     mx_handle_t out[1]) __attribute__((__leaf__));
@@ -10,3 +10,6 @@
 
 // Mask for all the valid MX_CHANNEL_READ_... flags:
 #define MX_CHANNEL_READ_MASK                1u
+
+// Most messages mx_channel_read_many() and mx_channel_write_many() take at once:
+#define MX_CHANNEL_MAX_MSGS_PER_CALL        64u
@@ -46,6 +46,16 @@ typedef struct mx_exception_packet {
 #define MX_PKT_TYPE_USER            0u
 #define MX_PKT_TYPE_SIGNAL          1u
 
+// mx_object_wait_async() options.  A one-shot wait queues a single packet.
+// A repeating wait queues a packet whenever one of its signals goes up (and
+// once more when the handle is closed), except that edges which arrive while
+// its last packet is still in the port are folded into that packet.
+#define MX_WAIT_ASYNC_ONCE          0u
+#define MX_WAIT_ASYNC_REPEATING     1u
+
+// Most packets mx_port_wait_many() returns at once:
+#define MX_PORT_MAX_PKTS_PER_WAIT   64u
+
 // port_packet_t::type MX_PKT_TYPE_USER
 typedef union mx_packet_user {
     uint64_t u64[4];
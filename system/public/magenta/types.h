@@ -149,6 +149,16 @@ typedef struct {
     uint32_t rd_num_handles;
 } mx_channel_call_args_t;
 
+// Structure for mx_channel_read_many() and mx_channel_write_many():
+typedef struct {
+    void* bytes;
+    mx_handle_t* handles;
+    uint32_t num_bytes;
+    uint32_t num_handles;
+    uint32_t actual_bytes;
+    uint32_t actual_handles;
+} mx_channel_msg_t;
+
 // Structure for mx_object_wait_many():
 typedef struct {
     mx_handle_t handle;
@@ -189,6 +199,9 @@ typedef uint32_t mx_rights_t;
 #define MX_VMO_OP_CACHE_CLEAN            8u
 #define MX_VMO_OP_CACHE_CLEAN_INVALIDATE 9u
 
+// VM Object clone flags
+#define MX_VMO_CLONE_COPY_ON_WRITE       1u
+
 // flags to vmar routines
 #define MX_VM_FLAG_PERM_READ          (1u << 0)
 #define MX_VM_FLAG_PERM_WRITE         (1u << 1)
@@ -233,6 +246,23 @@ typedef int64_t mx_rel_off_t;
 // Socket flags and limits.
 #define MX_SOCKET_HALF_CLOSE                1u
 
+// Options for mx_socket_splice(), exactly one of which must be given.
+#define MX_SOCKET_SPLICE_FROM_VMO           1u
+#define MX_SOCKET_SPLICE_TO_VMO             2u
+
+// Buffer sizes mx_socket_create_etc() accepts, before rounding up to a power
+// of two.  Zero picks the same default as mx_socket_create().
+#define MX_SOCKET_MIN_BUFFER_SIZE           ((size_t)4096u)
+#define MX_SOCKET_MAX_BUFFER_SIZE           ((size_t)16u * 1024u * 1024u)
+
+// Structure for mx_socket_readv() and mx_socket_writev():
+typedef struct {
+    void* buffer;
+    size_t size;
+} mx_iovec_t;
+
+#define MX_SOCKET_MAX_IOVECS                64u
+
 // Flags which can be used to to control cache policy for APIs which map memory.
 typedef enum {
     MX_CACHE_POLICY_CACHED          = 0,
@@ -256,6 +286,28 @@ typedef enum {
     MX_FIFO_OP_CONSUMER_EXCEPTION = 4,
 } mx_fifo_op_t;
 
+// Options for mx_fifo_create.
+#define MX_FIFO_SHARED_RING       ((uint32_t)1u << 0)
+
+// Indices of one direction of a fifo created with MX_FIFO_SHARED_RING.
+// The producer stores entries and then advances head; the consumer loads
+// them and then advances tail.  Both count up forever and wrap at 2^32;
+// entry i lives in slot (i & (elem_count - 1)).  They sit on separate
+// cache lines so the two sides do not contend.
+typedef struct {
+    uint32_t head;
+    uint8_t reserved0[60];
+    uint32_t tail;
+    uint8_t reserved1[60];
+} mx_fifo_ring_t;
+
+// Layout of the VMO returned by mx_fifo_get_ring: the first page holds an
+// mx_fifo_ring_t for each direction, and the entries of ring n start at
+// the beginning of page n + 1.
+#define MX_FIFO_RING_HEADER(n)    ((uint64_t)(n) * sizeof(mx_fifo_ring_t))
+#define MX_FIFO_RING_ENTRIES(n)   ((uint64_t)((n) + 1) * 4096u)
+#define MX_FIFO_RING_VMO_SIZE     ((uint64_t)3 * 4096u)
+
 #define MX_FIFO_PRODUCER_RIGHTS \
     (MX_RIGHT_READ | MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_FIFO_PRODUCER)
 #define MX_FIFO_CONSUMER_RIGHTS \
@@ -282,4 +334,8 @@ typedef atomic_int mx_futex_t;
 #endif
 #endif
 
+// A priority inheriting futex (see mx_futex_lock_pi) holds its owner's thread
+// handle, which is never negative, so the sign bit is free to mark waiters.
+#define MX_FUTEX_PI_WAITERS ((int)0x80000000)
+
 __END_CDECLS
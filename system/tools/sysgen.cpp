@@ -508,6 +508,11 @@ bool is_vdso(const Syscall& sc) {
         sc.attributes.begin(), sc.attributes.end(), "vdsocall") != sc.attributes.end();
 }
 
+bool is_internal(const Syscall& sc) {
+    return std::find(
+        sc.attributes.begin(), sc.attributes.end(), "internal") != sc.attributes.end();
+}
+
 bool is_noreturn(const Syscall& sc) {
     return std::find(
         sc.attributes.begin(), sc.attributes.end(), "noreturn") != sc.attributes.end();
@@ -517,6 +522,11 @@ bool generate_legacy_header(
     int index, const GenParams& gp, std::ofstream& os, const Syscall& sc) {
     constexpr uint32_t indent_spaces = 4u;
 
+    // Internal syscalls are only ever called from inside the vDSO, so
+    // they get no public declaration.
+    if (is_internal(sc) && gp.entry_prefix)
+        return true;
+
     auto syscall_name = gp.name_prefix + sc.name;
 
     // We write each entry one or two times. The second time the syscall name
@@ -607,14 +617,25 @@ bool generate_legacy_code(int index, const GenParams& gp, std::ofstream& os, con
     return os.good();
 }
 
+// Internal syscalls get a SYSCALL_ prefix on their stub's name, and the
+// stub is hidden so that only the vDSO's own code can call it.
+bool generate_internal_hidden(const GenParams& gp, std::ofstream& os, const Syscall& sc) {
+    if (is_internal(sc)) {
+        os << ".hidden _SYSCALL_" << gp.name_prefix << sc.name << "\n";
+        os << ".hidden SYSCALL_" << gp.name_prefix << sc.name << "\n";
+    }
+    return os.good();
+}
+
 bool generate_legacy_assembly_x64(
     int index, const GenParams& gp, std::ofstream& os, const Syscall& sc) {
     if (is_vdso(sc))
         return true;
     // SYSCALL_DEF(nargs64, nargs32, n, ret, name, args...) m_syscall nargs64, mx_##name, n
     os << gp.entry_prefix << " " << sc.arg_spec.size() << " "
+       << (is_internal(sc) ? "SYSCALL_" : "")
        << gp.name_prefix << sc.name << " " << index << "\n";
-    return os.good();
+    return generate_internal_hidden(gp, os, sc);
 }
 
 bool generate_legacy_assembly_arm64(
@@ -622,8 +643,9 @@ bool generate_legacy_assembly_arm64(
     if (is_vdso(sc))
         return true;
     // SYSCALL_DEF(nargs64, nargs32, n, ret, name, args...) m_syscall mx_##name, n
-    os << gp.entry_prefix << " " << gp.name_prefix << sc.name << " " << index << "\n";
-    return os.good();
+    os << gp.entry_prefix << " " << (is_internal(sc) ? "SYSCALL_" : "")
+       << gp.name_prefix << sc.name << " " << index << "\n";
+    return generate_internal_hidden(gp, os, sc);
 }
 
 bool generate_syscall_numbers_header(
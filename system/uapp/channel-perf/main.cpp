@@ -6,12 +6,16 @@
 #include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <threads.h>
 
 #include <magenta/compiler.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/channel.h>
+#include <magenta/syscalls/port.h>
 #include <mxtl/unique_ptr.h>
 
 namespace {
@@ -111,6 +115,314 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
            test_args.size, test_args.handles, test_args.queue, its_per_second);
 }
 
+struct HandleTransferArgs {
+    uint64_t duration_ns;
+    uint64_t transfers;
+    uint64_t elapsed_ns;
+};
+
+// Each iteration duplicates a handle, sends it through a channel, receives
+// it and closes it, so every transfer creates and destroys a kernel handle.
+int handle_transfer_thread(void* arg) {
+    __UNUSED mx_status_t status;
+    auto args = static_cast<HandleTransferArgs*>(arg);
+
+    mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
+    status = mx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == NO_ERROR);
+
+    mx_handle_t event;
+    status = mx_event_create(0u, &event);
+    assert(status == NO_ERROR);
+
+    static constexpr uint32_t big_it_size = 1000;
+    uint64_t big_its = 0;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t end_ns;
+    for (;;) {
+        big_its++;
+        for (uint32_t i = 0; i < big_it_size; i++) {
+            mx_handle_t h;
+            status = mx_handle_duplicate(event, MX_RIGHT_SAME_RIGHTS, &h);
+            assert(status == NO_ERROR);
+            status = mx_channel_write(mp[0], 0u, nullptr, 0u, &h, 1u);
+            assert(status == NO_ERROR);
+
+            uint32_t r_size = 0u;
+            uint32_t r_handles = 1u;
+            status = mx_channel_read(mp[1], 0u, nullptr, 0u, &r_size, &h, 1u, &r_handles);
+            assert(status == NO_ERROR);
+            assert(r_handles == 1u);
+            status = mx_handle_close(h);
+            assert(status == NO_ERROR);
+        }
+
+        end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((end_ns - start_ns) >= args->duration_ns)
+            break;
+    }
+
+    mx_handle_close(event);
+    mx_handle_close(mp[0]);
+    mx_handle_close(mp[1]);
+
+    args->transfers = big_its * big_it_size;
+    args->elapsed_ns = end_ns - start_ns;
+    return 0;
+}
+
+void do_handle_transfer_test(uint32_t duration, uint32_t num_threads) {
+    mxtl::unique_ptr<thrd_t[]> threads(new thrd_t[num_threads]);
+    mxtl::unique_ptr<HandleTransferArgs[]> args(new HandleTransferArgs[num_threads]);
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        args[i] = {duration * 1000000000ull, 0u, 0u};
+        int ret = thrd_create(&threads[i], handle_transfer_thread, &args[i]);
+        assert(ret == thrd_success);
+    }
+
+    double transfers_per_second = 0.0;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], nullptr);
+        double real_duration = static_cast<double>(args[i].elapsed_ns) / 1000000000.0;
+        transfers_per_second += static_cast<double>(args[i].transfers) / real_duration;
+    }
+
+    printf("handle transfer, %" PRIu32 " sender threads: %.0f transfers/second "
+               "(%.0f per thread)\n",
+           num_threads, transfers_per_second, transfers_per_second / num_threads);
+}
+
+// Moves |depth| messages through a channel per iteration, either with a
+// channel_write/channel_read for each one or with as few
+// channel_write_many/channel_read_many calls as it takes.
+double batch_test_msgs_per_second(uint64_t duration_ns, uint32_t size, uint32_t depth,
+                                  bool batched) {
+    __UNUSED mx_status_t status;
+
+    mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
+    status = mx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == NO_ERROR);
+
+    mxtl::unique_ptr<uint8_t[]> data(new uint8_t[size * depth]);
+    mxtl::unique_ptr<mx_channel_msg_t[]> msgs(new mx_channel_msg_t[depth]);
+    for (uint32_t i = 0; i < depth; i++) {
+        msgs[i] = {data.get() + i * size, nullptr, size, 0u, 0u, 0u};
+    }
+
+    uint64_t its = 0;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t end_ns;
+    for (;;) {
+        its++;
+        if (batched) {
+            for (uint32_t done = 0; done < depth;) {
+                uint32_t actual;
+                uint32_t n = depth - done;
+                if (n > MX_CHANNEL_MAX_MSGS_PER_CALL)
+                    n = MX_CHANNEL_MAX_MSGS_PER_CALL;
+                status = mx_channel_write_many(mp[0], 0u, &msgs[done], n, &actual);
+                assert(status == NO_ERROR);
+                done += actual;
+            }
+            for (uint32_t done = 0; done < depth;) {
+                uint32_t actual;
+                uint32_t n = depth - done;
+                if (n > MX_CHANNEL_MAX_MSGS_PER_CALL)
+                    n = MX_CHANNEL_MAX_MSGS_PER_CALL;
+                status = mx_channel_read_many(mp[1], 0u, &msgs[done], n, &actual);
+                assert(status == NO_ERROR);
+                done += actual;
+            }
+        } else {
+            for (uint32_t i = 0; i < depth; i++) {
+                status = mx_channel_write(mp[0], 0u, msgs[i].bytes, size, nullptr, 0u);
+                assert(status == NO_ERROR);
+            }
+            for (uint32_t i = 0; i < depth; i++) {
+                uint32_t r_size;
+                status = mx_channel_read(mp[1], 0u, msgs[i].bytes, size, &r_size,
+                                         nullptr, 0u, nullptr);
+                assert(status == NO_ERROR);
+                assert(r_size == size);
+            }
+        }
+
+        end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((end_ns - start_ns) >= duration_ns)
+            break;
+    }
+
+    mx_handle_close(mp[0]);
+    mx_handle_close(mp[1]);
+
+    double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    return static_cast<double>(its) * depth / real_duration;
+}
+
+void do_batch_test(uint32_t duration, uint32_t size) {
+    static constexpr uint32_t depths[] = {1, 16, 256};
+    for (size_t i = 0; i < countof(depths); i++) {
+        double single = batch_test_msgs_per_second(duration * 1000000000ull, size, depths[i],
+                                                   false);
+        double batched = batch_test_msgs_per_second(duration * 1000000000ull, size, depths[i],
+                                                    true);
+        printf("%" PRIu32 " bytes, queue depth %3" PRIu32 ": %.0f messages/second single, "
+                   "%.0f messages/second batched\n",
+               size, depths[i], single, batched);
+    }
+}
+
+// Moves |size| byte messages through a channel, reading each one into |buffer|.
+double large_message_bytes_per_second(uint64_t duration_ns, uint32_t size, uint8_t* buffer) {
+    __UNUSED mx_status_t status;
+
+    mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
+    status = mx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == NO_ERROR);
+
+    mxtl::unique_ptr<uint8_t[]> data(new uint8_t[size]);
+    for (uint32_t i = 0; i < size; i++)
+        data[i] = static_cast<uint8_t>(i);
+
+    static constexpr uint32_t big_it_size = 100;
+    uint64_t big_its = 0;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t end_ns;
+    for (;;) {
+        big_its++;
+        for (uint32_t i = 0; i < big_it_size; i++) {
+            status = mx_channel_write(mp[0], 0u, data.get(), size, nullptr, 0u);
+            assert(status == NO_ERROR);
+
+            uint32_t r_size;
+            status = mx_channel_read(mp[1], 0u, buffer, size, &r_size, nullptr, 0u, nullptr);
+            assert(status == NO_ERROR);
+            assert(r_size == size);
+        }
+
+        end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((end_ns - start_ns) >= duration_ns)
+            break;
+    }
+    assert(buffer[size - 1] == static_cast<uint8_t>(size - 1));
+
+    mx_handle_close(mp[0]);
+    mx_handle_close(mp[1]);
+
+    double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    return static_cast<double>(big_its) * big_it_size * size / real_duration;
+}
+
+// Sweeps the message size, reading into a page aligned buffer (which big
+// messages can hand their pages to) and into one that is a byte off (which
+// they have to be copied into).
+void do_large_message_test(uint32_t duration) {
+    __UNUSED mx_status_t status;
+
+    static constexpr uint32_t sizes[] = {64, 256, 1024, 4096, 16384, 32768, 65536};
+    static constexpr uint32_t buffer_size = 65536 + PAGE_SIZE;
+
+    mx_handle_t vmo;
+    status = mx_vmo_create(buffer_size, 0u, &vmo);
+    assert(status == NO_ERROR);
+    uintptr_t base;
+    status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, buffer_size,
+                         MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &base);
+    assert(status == NO_ERROR);
+
+    for (size_t i = 0; i < countof(sizes); i++) {
+        double aligned = large_message_bytes_per_second(duration * 1000000000ull, sizes[i],
+                                                        reinterpret_cast<uint8_t*>(base));
+        double unaligned = large_message_bytes_per_second(duration * 1000000000ull, sizes[i],
+                                                          reinterpret_cast<uint8_t*>(base + 1));
+        printf("%6" PRIu32 " byte messages: %.0f bytes/second page aligned, "
+                   "%.0f bytes/second unaligned\n",
+               sizes[i], aligned, unaligned);
+    }
+
+    mx_vmar_unmap(mx_vmar_root_self(), base, buffer_size);
+    mx_handle_close(vmo);
+}
+
+// Writes a message to each of |num_channels| channels watched by one port,
+// then services them as they show up on the port: read the message and wait
+// on the channel again.  Packets come off the port one per mx_port_wait(), or
+// as many as are ready per mx_port_wait_many().
+double port_test_packets_per_second(uint64_t duration_ns, uint32_t num_channels, bool batched) {
+    __UNUSED mx_status_t status;
+
+    mx_handle_t port;
+    status = mx_port_create(MX_PORT_OPT_V2, &port);
+    assert(status == NO_ERROR);
+
+    mxtl::unique_ptr<mx_handle_t[]> writers(new mx_handle_t[num_channels]);
+    mxtl::unique_ptr<mx_handle_t[]> readers(new mx_handle_t[num_channels]);
+    for (uint32_t i = 0; i < num_channels; i++) {
+        status = mx_channel_create(0u, &writers[i], &readers[i]);
+        assert(status == NO_ERROR);
+        status = mx_object_wait_async(readers[i], port, i, MX_CHANNEL_READABLE, 0u);
+        assert(status == NO_ERROR);
+    }
+
+    mx_port_packet_t packets[MX_PORT_MAX_PKTS_PER_WAIT];
+    uint64_t its = 0;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t end_ns;
+    for (;;) {
+        its++;
+        for (uint32_t i = 0; i < num_channels; i++) {
+            status = mx_channel_write(writers[i], 0u, &i, sizeof(i), nullptr, 0u);
+            assert(status == NO_ERROR);
+        }
+
+        for (uint32_t done = 0; done < num_channels;) {
+            uint32_t actual = 1u;
+            if (batched) {
+                status = mx_port_wait_many(port, MX_TIME_INFINITE, packets,
+                                           MX_PORT_MAX_PKTS_PER_WAIT, &actual);
+            } else {
+                status = mx_port_wait(port, MX_TIME_INFINITE, &packets[0], 0u);
+            }
+            assert(status == NO_ERROR);
+
+            for (uint32_t j = 0; j < actual; j++) {
+                uint64_t key = packets[j].key;
+                uint32_t msg;
+                uint32_t r_size;
+                status = mx_channel_read(readers[key], 0u, &msg, sizeof(msg), &r_size,
+                                         nullptr, 0u, nullptr);
+                assert(status == NO_ERROR);
+                assert(msg == key);
+                status = mx_object_wait_async(readers[key], port, key, MX_CHANNEL_READABLE, 0u);
+                assert(status == NO_ERROR);
+            }
+            done += actual;
+        }
+
+        end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((end_ns - start_ns) >= duration_ns)
+            break;
+    }
+
+    for (uint32_t i = 0; i < num_channels; i++) {
+        mx_handle_close(writers[i]);
+        mx_handle_close(readers[i]);
+    }
+    mx_handle_close(port);
+
+    double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    return static_cast<double>(its) * num_channels / real_duration;
+}
+
+void do_port_test(uint32_t duration, uint32_t num_channels) {
+    double single = port_test_packets_per_second(duration * 1000000000ull, num_channels, false);
+    double batched = port_test_packets_per_second(duration * 1000000000ull, num_channels, true);
+    printf("%" PRIu32 " channels on one port: %.0f packets/second single, "
+               "%.0f packets/second batched\n",
+           num_channels, single, batched);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -125,11 +437,19 @@ int main(int argc, char** argv) {
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
         "  -H N  set message handle count to N handles (default: 0)\n"
-        "  -Q N  set message pre-queue count to N messages (default: 0)\n";
+        "  -Q N  set message pre-queue count to N messages (default: 0)\n"
+        "  -T N  run handle transfer test with N sender threads instead\n"
+        "  -B    compare single and batched reads/writes of -S byte messages instead\n"
+        "  -L    sweep message sizes up to 64KiB, reading into aligned and unaligned buffers\n"
+        "  -P N  service N channels through one port, one packet or a batch per wait, instead\n";
 
     bool run_suite = false;  // -o/-s
     uint32_t duration = 5;   // -d
     uint32_t repeats = 1;    // -n
+    uint32_t transfer_threads = 0;  // -T
+    bool batch_test = false;  // -B
+    bool large_test = false;  // -L
+    uint32_t port_channels = 0;  // -P
     // Ignored when running a suite:
     TestArgs test_args = {
         10,                  // -S (size)
@@ -138,7 +458,7 @@ int main(int argc, char** argv) {
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hosBLn:d:S:H:Q:T:P:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -160,6 +480,12 @@ int main(int argc, char** argv) {
             case 's':
                 run_suite = true;
                 break;
+            case 'B':
+                batch_test = true;
+                break;
+            case 'L':
+                large_test = true;
+                break;
             case 'n':
                 assert(optarg);
                 repeats = value;
@@ -180,6 +506,18 @@ int main(int argc, char** argv) {
                 assert(optarg);
                 test_args.queue = value;
                 break;
+            case 'T':
+                assert(optarg);
+                if (value == 0u)
+                    argument_error(argv[0], "need at least one sender thread");
+                transfer_threads = value;
+                break;
+            case 'P':
+                assert(optarg);
+                if (value == 0u)
+                    argument_error(argv[0], "need at least one channel");
+                port_channels = value;
+                break;
             default:  // '?'
                 argument_error(argv[0], "invalid option");
                 break;
@@ -216,6 +554,22 @@ int main(int argc, char** argv) {
             };
             for (size_t i = 0; i < countof(suite); i++)
                 do_test(duration, suite[i]);
+
+            static constexpr uint32_t transfer_suite[] = {1, 2, 4, 8, 16};
+            for (size_t i = 0; i < countof(transfer_suite); i++)
+                do_handle_transfer_test(duration, transfer_suite[i]);
+
+            do_batch_test(duration, 10);
+            do_large_message_test(duration);
+            do_port_test(duration, 1000);
+        } else if (port_channels) {
+            do_port_test(duration, port_channels);
+        } else if (large_test) {
+            do_large_message_test(duration);
+        } else if (batch_test) {
+            do_batch_test(duration, test_args.size);
+        } else if (transfer_threads) {
+            do_handle_transfer_test(duration, transfer_threads);
         } else {
             do_test(duration, test_args);
         }
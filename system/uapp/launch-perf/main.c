@@ -0,0 +1,206 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <elfload/elfload.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <launchpad/launchpad.h>
+#include <launchpad/vmo.h>
+#include <limits.h>
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Process launch benchmark.
+//
+// Measures how long it takes to launch a program with launchpad and wait
+// for it to exit, and then compares the two ways of giving each process
+// its own writable copy of the program's data segments: copying them into
+// a fresh VMO, which is what the loader used to do, and taking a
+// copy-on-write clone of the file's VMO, which is what it does now.  For
+// each, it reports the time per launch and the pages committed up front.
+
+#define MAX_PHNUM 32
+
+static _Noreturn void fail(const char* call, mx_status_t status) {
+    fprintf(stderr, "%s failed: %d\n", call, status);
+    exit(1);
+}
+
+static void check(const char* call, mx_status_t status) {
+    if (status < 0)
+        fail(call, status);
+}
+
+static uint64_t now(void) {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+static void launch_bench(const char* program, int argc, const char* const* argv,
+                         uint32_t iterations) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t start = now();
+
+        launchpad_t* lp;
+        launchpad_create(0, program, &lp);
+        launchpad_load_from_file(lp, program);
+        launchpad_set_args(lp, argc, argv);
+        launchpad_clone(lp, LP_CLONE_MXIO_ROOT | LP_CLONE_ENVIRON);
+
+        mx_handle_t proc;
+        const char* errmsg;
+        mx_status_t status = launchpad_go(lp, &proc, &errmsg);
+        if (status != NO_ERROR) {
+            fprintf(stderr, "launching %s failed: %s: %d\n", program, errmsg, status);
+            exit(1);
+        }
+        check("mx_object_wait_one",
+              mx_object_wait_one(proc, MX_TASK_TERMINATED, MX_TIME_INFINITE, NULL));
+        mx_handle_close(proc);
+
+        total += now() - start;
+    }
+
+    printf("launch %s: %" PRIu64 " us per launch (%u launches)\n",
+           program, total / iterations / 1000, iterations);
+}
+
+// The old way: a new VMO with the data copied in through a mapping.
+static mx_handle_t copy_segment(mx_handle_t vmo, uintptr_t start, size_t size) {
+    mx_handle_t copy;
+    check("mx_vmo_create", mx_vmo_create(size, 0, &copy));
+    uintptr_t window;
+    check("mx_vmar_map", mx_vmar_map(mx_vmar_root_self(), 0, vmo, start, size,
+                                     MX_VM_FLAG_PERM_READ, &window));
+    size_t n;
+    check("mx_vmo_write", mx_vmo_write(copy, (void*)window, 0, size, &n));
+    mx_vmar_unmap(mx_vmar_root_self(), window, size);
+    return copy;
+}
+
+static mx_handle_t clone_segment(mx_handle_t vmo, uintptr_t start, size_t size) {
+    mx_handle_t clone;
+    check("mx_vmo_clone", mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, start, size, &clone));
+    return clone;
+}
+
+// Pages that belong to the VMO itself rather than being shared with a parent.
+static size_t committed_pages(mx_handle_t vmo, size_t size) {
+    size_t pages = 0;
+    for (size_t off = 0; off < size; off += PAGE_SIZE) {
+        mx_paddr_t pa;
+        if (mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, off, PAGE_SIZE, &pa, sizeof(pa)) == NO_ERROR)
+            pages++;
+    }
+    return pages;
+}
+
+typedef mx_handle_t (*segment_func_t)(mx_handle_t vmo, uintptr_t start, size_t size);
+
+static void segment_bench(const char* name, segment_func_t func, mx_handle_t vmo,
+                          const elf_phdr_t* phdrs, size_t phnum, uint32_t iterations) {
+    uint64_t total = 0;
+    size_t pages = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (size_t n = 0; n < phnum; n++) {
+            const elf_phdr_t* ph = &phdrs[n];
+            if (ph->p_type != PT_LOAD || !(ph->p_flags & PF_W) || ph->p_filesz == 0)
+                continue;
+
+            // Same rounding as the ELF loader.
+            uintptr_t start = ph->p_offset & -PAGE_SIZE;
+            uintptr_t end = (ph->p_offset + ph->p_filesz + PAGE_SIZE - 1) & -PAGE_SIZE;
+
+            uint64_t t = now();
+            mx_handle_t data = func(vmo, start, end - start);
+            total += now() - t;
+
+            if (i == 0)
+                pages += committed_pages(data, end - start);
+            mx_handle_close(data);
+        }
+    }
+
+    printf("  %-6s %8" PRIu64 " ns per launch, %4zu pages (%zu KB) committed per process\n",
+           name, total / iterations, pages, pages * PAGE_SIZE / 1024);
+}
+
+static void data_bench(const char* program, uint32_t iterations) {
+    mx_handle_t vmo = launchpad_vmo_from_file(program);
+    check("launchpad_vmo_from_file", vmo);
+
+    elf_load_header_t header;
+    uintptr_t phoff;
+    check("elf_load_prepare", elf_load_prepare(vmo, &header, &phoff));
+    if (header.e_phnum > MAX_PHNUM)
+        fail("elf_load_prepare", ERR_NOT_SUPPORTED);
+    elf_phdr_t phdrs[MAX_PHNUM];
+    check("elf_load_read_phdrs", elf_load_read_phdrs(vmo, phdrs, phoff, header.e_phnum));
+
+    printf("writable segments of %s:\n", program);
+    segment_bench("copy", copy_segment, vmo, phdrs, header.e_phnum, iterations);
+    segment_bench("clone", clone_segment, vmo, phdrs, header.e_phnum, iterations);
+
+    mx_handle_close(vmo);
+}
+
+int main(int argc, char** argv) {
+    static const char help[] =
+        "Usage: %s [options ...] [PROGRAM [ARGS...]]\n"
+        "\n"
+        "Launches PROGRAM (by default, this benchmark with -x) over and over\n"
+        "and compares copying its data segments with cloning them.\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -n N  set launch count to N (default: 100)\n"
+        "  -x    exit immediately (used as the default program)\n";
+
+    uint32_t iterations = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+hn:x")) != -1) {
+        switch (opt) {
+        case 'h':
+            printf(help, argv[0]);
+            return EXIT_SUCCESS;
+        case 'n': {
+            errno = 0;
+            char* endptr = NULL;
+            unsigned long v = strtoul(optarg, &endptr, 10);
+            if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT32_MAX) {
+                fprintf(stderr, "%s: invalid launch count\n", argv[0]);
+                return EXIT_FAILURE;
+            }
+            iterations = (uint32_t)v;
+            break;
+        }
+        case 'x':
+            return EXIT_SUCCESS;
+        default:
+            fprintf(stderr, "Run with -h for help.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    static const char* const self_argv[] = { "/boot/bin/launch-perf", "-x" };
+    const char* program = self_argv[0];
+    const char* const* child_argv = self_argv;
+    int child_argc = countof(self_argv);
+    if (optind < argc) {
+        program = argv[optind];
+        child_argv = (const char* const*)&argv[optind];
+        child_argc = argc - optind;
+    }
+
+    launch_bench(program, child_argc, child_argv, iterations);
+    data_bench(program, iterations);
+
+    return EXIT_SUCCESS;
+}
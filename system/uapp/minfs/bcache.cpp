@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <fs/trace.h>
@@ -15,8 +16,14 @@
 #include "minfs.h"
 #include "minfs-private.h"
 
-mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
-    off_t off = bno * kMinfsBlockSize;
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+mx_status_t Bcache::ReadblkRaw(uint32_t bno, void* data) {
+    off_t off = (off_t)bno * kMinfsBlockSize;
     trace(IO, "readblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
     if (lseek(fd_, off, SEEK_SET) < 0) {
         error("minfs: cannot seek to block %u\n", bno);
@@ -29,20 +36,55 @@ mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
     return NO_ERROR;
 }
 
-mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
-    off_t off = bno * kMinfsBlockSize;
-    trace(IO, "writeblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
+// Writes |count| contiguous blocks starting at |bno|.
+mx_status_t Bcache::WriteblkRaw(uint32_t bno, const void* data, uint32_t count) {
+    off_t off = (off_t)bno * kMinfsBlockSize;
+    ssize_t len = (ssize_t)count * kMinfsBlockSize;
+    trace(IO, "writeblk() bno=%u count=%u off=%#llx\n", bno, count, (unsigned long long)off);
     if (lseek(fd_, off, SEEK_SET) < 0) {
         error("minfs: cannot seek to block %u\n", bno);
         return ERR_IO;
     }
-    if (write(fd_, data, kMinfsBlockSize) != kMinfsBlockSize) {
+    if ((crash_after_ != 0) && (++writes_ >= crash_after_)) {
+        // only the first half of a multi-block write makes it
+        if (write(fd_, data, (count / 2) * kMinfsBlockSize) < 0) {
+            error("minfs: cannot write block %u\n", bno);
+        }
+        error("minfs: crashing at write %u (block %u, %u blocks)\n", writes_, bno, count);
+        _exit(1);
+    }
+    if (write(fd_, data, len) != len) {
         error("minfs: cannot write block %u\n", bno);
         return ERR_IO;
     }
     return NO_ERROR;
 }
 
+mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
+    // A cached copy may be newer than what is on disk.
+    auto iter = hash_.find(bno);
+    if (iter.IsValid()) {
+        memcpy(data, iter->data(), blocksize_);
+        return NO_ERROR;
+    }
+    return ReadblkRaw(JournalLocation(bno), data);
+}
+
+mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
+    mx_status_t status = WriteblkRaw(bno, data, 1);
+    // Keep any cached copy current, and make sure a pending write back of an
+    // older version cannot land on top of this one.
+    auto iter = hash_.find(bno);
+    if (iter.IsValid()) {
+        memcpy(iter->data(), data, blocksize_);
+        if (iter->dirty_list_state_.InContainer()) {
+            dirty_.erase(*iter);
+            dirty_count_--;
+        }
+    }
+    return status;
+}
+
 constexpr uint32_t kModeFind = 0;
 constexpr uint32_t kModeLoad = 1;
 constexpr uint32_t kModeZero = 2;
@@ -57,6 +99,7 @@ static const char* modestr(uint32_t mode) {
 }
 
 void Bcache::Invalidate() {
+    Flush();
     mxtl::RefPtr<BlockNode> blk;
     uint32_t n = 0;
     while ((blk = lists_.PopFront(kBlockLRU)) != nullptr) {
@@ -91,19 +134,27 @@ mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
     } else {
         if ((blk = lists_.PopFront(kBlockFree)) != nullptr) {
             // nothing extra to do
-        } else if ((blk = lists_.PopFront(kBlockLRU)) != nullptr) {
+        } else if ((blk = Evict()) != nullptr) {
             // remove from hash, bno to be reassigned
             hash_.erase(*blk);
+        } else if (jnl_count_ != 0) {
+            // Every block is held by the open transaction; grow for it,
+            // TxnEnd() shrinks the cache back.
+            lists_.Grow();
+            if (BlockNode::Create(this) != NO_ERROR) {
+                panic("bcache: out of memory\n");
+            }
+            blk = lists_.PopFront(kBlockFree);
         } else {
             panic("bcache: out of blocks\n");
         }
         blk->bno_ = bno;
         hash_.insert(blk);
-        assert(hash_.size() <= kMinfsBlockCacheSize);
+        assert(hash_.size() <= lists_.Capacity());
         if (mode == kModeZero) {
             blk->flags_ |= kBlockDirty;
             memset(blk->data(), 0, blocksize_);
-        } else if (Readblk(bno, blk->data()) < 0) {
+        } else if (ReadblkRaw(JournalLocation(bno), blk->data()) < 0) {
             panic("bcache: bno %u read error!\n", bno);
         }
     }
@@ -115,6 +166,42 @@ done:
     return blk;
 }
 
+mxtl::RefPtr<BlockNode> Bcache::Evict() {
+    if (jnl_count_ == 0) {
+        mxtl::RefPtr<BlockNode> blk = lists_.PopFront(kBlockLRU);
+        if ((blk != nullptr) && blk->dirty_list_state_.InContainer()) {
+            // evicting a block that was never written back; take the
+            // rest of the dirty blocks along while we're at it
+            if (Flush() != NO_ERROR) {
+                error("bcache: write back failed evicting bno %u\n", blk->bno_);
+            }
+        }
+        return blk;
+    }
+
+    // With a journal, a changed block must be committed before it can go.
+    // Commits wait for the end of the transaction.
+    auto committed = [](const BlockNode& blk) { return !blk.dirty_list_state_.InContainer(); };
+    BlockNode* victim = lists_.Find(kBlockLRU, committed);
+    if (victim == nullptr) {
+        if (txn_depth_ > 0) {
+            return nullptr;
+        }
+        if (Commit() != NO_ERROR) {
+            error("bcache: journal commit failed\n");
+        }
+        if ((victim = lists_.Find(kBlockLRU, committed)) == nullptr) {
+            return nullptr;
+        }
+    }
+    // The checkpoint writes it from the journal instead.
+    if (victim->ckpt_list_state_.InContainer()) {
+        ckpt_.erase(*victim);
+        ckpt_count_--;
+    }
+    return lists_.Erase(mxtl::RefPtr<BlockNode>(victim), kBlockLRU);
+}
+
 mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno) {
     return Get(bno, kModeLoad);
 }
@@ -129,12 +216,116 @@ void Bcache::Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags) {
     // remove from busy list
     lists_.Erase(blk, kBlockBusy);
     if ((flags | blk->flags_) & kBlockDirty) {
-        if (Writeblk(blk->bno_, blk->data()) < 0) {
+        blk->flags_ &= ~kBlockDirty;
+        if ((options_ & kBcacheWriteBack) || (jnl_count_ != 0)) {
+            MarkDirty(blk);
+        } else if (WriteblkRaw(blk->bno_, blk->data(), 1) < 0) {
             error("block write error!\n");
         }
-        blk->flags_ &= ~kBlockDirty;
     }
     lists_.PushBack(mxtl::move(blk), kBlockLRU);
+    MaybeFlush();
+}
+
+void Bcache::MarkDirty(const mxtl::RefPtr<BlockNode>& blk) {
+    if (blk->dirty_list_state_.InContainer()) {
+        return;
+    }
+    if (dirty_.is_empty()) {
+        dirty_since_ = now_ms();
+    }
+    dirty_.push_back(blk);
+    dirty_count_++;
+}
+
+void Bcache::MaybeFlush() {
+    if (jnl_count_ != 0) {
+        // Commit at the end of each operation, or with write back, once
+        // there has been time to gather a few, or enough to fill a good
+        // part of the journal.
+        if ((txn_depth_ > 0) || dirty_.is_empty() ||
+            ((options_ & kBcacheWriteBack) && (dirty_count_ < jnl_count_ / 8) &&
+             (now_ms() - dirty_since_ < kMinfsFlushDelayMs))) {
+            return;
+        }
+        if (Commit() != NO_ERROR) {
+            error("bcache: journal commit failed\n");
+        }
+        return;
+    }
+    if (dirty_.is_empty() || (now_ms() - dirty_since_ < kMinfsFlushDelayMs)) {
+        return;
+    }
+    if (Flush() != NO_ERROR) {
+        error("bcache: write back failed\n");
+    }
+}
+
+static int bno_cmp(const void* a, const void* b) {
+    uint32_t x = (*(BlockNode* const*)a)->GetKey();
+    uint32_t y = (*(BlockNode* const*)b)->GetKey();
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+mx_status_t Bcache::Flush() {
+    if (jnl_count_ != 0) {
+        mx_status_t status = Commit();
+        if (status != NO_ERROR) {
+            return status;
+        }
+        return Checkpoint();
+    }
+    if (dirty_.is_empty()) {
+        return NO_ERROR;
+    }
+    trace(BCACHE, "bcache_flush() %u blocks\n", dirty_count_);
+
+    // The dirty blocks stay referenced by the cache's lists and hash, so
+    // raw pointers are enough to put them in order.
+    mxtl::unique_free_ptr<BlockNode*> sorted(
+        static_cast<BlockNode**>(malloc(dirty_count_ * sizeof(BlockNode*))));
+    if (sorted == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+    uint32_t count = 0;
+    while (!dirty_.is_empty()) {
+        sorted.get()[count++] = dirty_.pop_front().get();
+    }
+    assert(count == dirty_count_);
+    dirty_count_ = 0;
+    return WriteRuns(sorted.get(), count);
+}
+
+mx_status_t Bcache::WriteRuns(BlockNode** blks, uint32_t count) {
+    mxtl::unique_free_ptr<char> run(static_cast<char*>(malloc(kMinfsMaxFlushRun * blocksize_)));
+    if (run == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+    qsort(blks, count, sizeof(BlockNode*), bno_cmp);
+
+    // Copy runs of contiguous blocks into one buffer and write each run in
+    // a single operation.
+    mx_status_t status = NO_ERROR;
+    uint32_t i = 0;
+    while (i < count) {
+        uint32_t n = 1;
+        while ((i + n < count) && (n < kMinfsMaxFlushRun) &&
+               (blks[i + n]->bno_ == blks[i]->bno_ + n)) {
+            n++;
+        }
+        const void* data = blks[i]->data();
+        if (n > 1) {
+            for (uint32_t j = 0; j < n; j++) {
+                memcpy(run.get() + j * blocksize_, blks[i + j]->data(), blocksize_);
+            }
+            data = run.get();
+        }
+        if (WriteblkRaw(blks[i]->bno_, data, n) < 0) {
+            status = ERR_IO;
+        }
+        i += n;
+    }
+    return status;
 }
 
 mx_status_t Bcache::Read(uint32_t bno, void* data, uint32_t off, uint32_t len) {
@@ -154,12 +345,15 @@ mx_status_t Bcache::Read(uint32_t bno, void* data, uint32_t off, uint32_t len) {
 }
 
 int Bcache::Sync() {
+    if (Flush() != NO_ERROR) {
+        return -1;
+    }
     return fsync(fd_);
 }
 
 mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blocksize,
-                           uint32_t num) {
-    mxtl::unique_ptr<Bcache> bc(new Bcache(fd, blockmax, blocksize));
+                           uint32_t num, uint32_t options) {
+    mxtl::unique_ptr<Bcache> bc(new Bcache(fd, blockmax, blocksize, num, options));
     if (bc == nullptr) {
         return ERR_NO_MEMORY;
     }
@@ -174,43 +368,69 @@ mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blo
     return NO_ERROR;
 }
 
+void Bcache::TxnEnd() {
+    assert(txn_depth_ > 0);
+    if (--txn_depth_ > 0) {
+        return;
+    }
+    MaybeFlush();
+
+    // Give back what the cache grew by during the transaction.
+    while (lists_.Capacity() > num_) {
+        mxtl::RefPtr<BlockNode> blk = lists_.PopFront(kBlockFree);
+        if ((blk == nullptr) && ((blk = Evict()) != nullptr)) {
+            hash_.erase(*blk);
+        }
+        if (blk == nullptr) {
+            break;
+        }
+        lists_.Shrink();
+    }
+}
+
 int Bcache::Close() {
+    if (Flush() != NO_ERROR) {
+        error("bcache: write back failed on close\n");
+    }
     return close(fd_);
 }
 
-Bcache::Bcache(int fd, uint32_t blockmax, uint32_t blocksize) :
-    fd_(fd), blockmax_(blockmax), blocksize_(blocksize) {}
+Bcache::Bcache(int fd, uint32_t blockmax, uint32_t blocksize, uint32_t num, uint32_t options) :
+    lists_(num), dirty_count_(0), dirty_since_(0), fd_(fd), blockmax_(blockmax),
+    blocksize_(blocksize), num_(num), options_(options), ckpt_count_(0), revoke_count_(0),
+    jnl_start_(0), jnl_count_(0), jnl_next_(0), jnl_seq_(0), jnl_unsynced_(false),
+    txn_depth_(0), writes_(0), crash_after_(0) {}
 Bcache::~Bcache() {}
 
-size_t BcacheLists::SizeAllSlow() const {
-    return list_busy_.size_slow() + list_lru_.size_slow() + list_free_.size_slow();
-}
-
 void BcacheLists::PushBack(mxtl::RefPtr<BlockNode> blk, uint32_t block_type) {
-    assert(SizeAllSlow() < kMinfsBlockCacheSize);
+    assert(size_ < capacity_);
     block_type &= kBlockLLFlags;
     auto ll = GetList(block_type);
     blk->flags_ |= block_type;
     ll->push_back(mxtl::move(blk));
+    size_++;
 }
 
 mxtl::RefPtr<BlockNode> BcacheLists::PopFront(uint32_t block_type) {
-    assert(SizeAllSlow() == kMinfsBlockCacheSize);
+    assert(size_ == capacity_);
     block_type &= kBlockLLFlags;
     auto ll = GetList(block_type);
     auto blk = ll->pop_front();
-    if (blk != nullptr)
+    if (blk != nullptr) {
         blk->flags_ &= ~block_type;
+        size_--;
+    }
     return blk;
 }
 
 mxtl::RefPtr<BlockNode> BcacheLists::Erase(mxtl::RefPtr<BlockNode> blk, uint32_t block_type) {
-    assert(SizeAllSlow() == kMinfsBlockCacheSize);
+    assert(size_ == capacity_);
     block_type &= kBlockLLFlags;
     auto ll = GetList(block_type);
     blk->flags_ &= ~block_type;
     auto ptr = ll->erase(*blk);
     assert(ptr != nullptr);
+    size_--;
     return ptr;
 }
 
@@ -0,0 +1,337 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <magenta/compiler.h>
+
+#include "host.h"
+#include "minfs.h"
+
+void drop_cache(void);
+
+// Large file benchmark: how long it takes to get the first bytes out of a
+// freshly opened large file, how fast the rest of it streams, and how much
+// memory that costs.
+//
+// Metadata benchmark: how many empty files per second can be created in, and
+// then unlinked from, a single directory.
+//
+// Directory benchmark: how long one create and one lookup take in a directory
+// which already holds a given number of entries.
+
+#define BENCH_PATH "::bench-large"
+#define BENCH_DIR "::bench-files"
+#define BENCH_BUFSIZE (64 * 1024)
+#define BENCH_FILES 10000
+#define BENCH_DIR_OPS 1000
+// Leaves room for BENCH_DIR_OPS more among the 32768 inodes mkfs makes.
+#define BENCH_DIR_MAX 30000
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Resident set size of this process, in KiB. Where the current size is not
+// available this is the peak, which still shows growth.
+static uint64_t rss_kb(void) {
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f != nullptr) {
+        unsigned long pages, resident;
+        int n = fscanf(f, "%lu %lu", &pages, &resident);
+        fclose(f);
+        if (n == 2) {
+            return (uint64_t)resident * (sysconf(_SC_PAGESIZE) / 1024);
+        }
+    }
+#endif
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static int bench_large_file(uint64_t size) {
+    static uint8_t buf[BENCH_BUFSIZE];
+
+    int fd = emu_open(BENCH_PATH, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "bench: cannot create '%s'\n", BENCH_PATH);
+        return -1;
+    }
+    for (uint64_t off = 0; off < size; off += sizeof(buf)) {
+        memset(buf, (int)(off / sizeof(buf)), sizeof(buf));
+        if (emu_write(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf)) {
+            fprintf(stderr, "bench: write failed @%" PRIu64 "\n", off);
+            emu_close(fd);
+            return -1;
+        }
+    }
+    emu_close(fd);
+    drop_cache();
+
+    uint64_t rss_before = rss_kb();
+
+    uint64_t t0 = now_ns();
+    if ((fd = emu_open(BENCH_PATH, O_RDONLY, 0)) < 0) {
+        fprintf(stderr, "bench: cannot open '%s'\n", BENCH_PATH);
+        return -1;
+    }
+    if (emu_read(fd, buf, 4096) != 4096) {
+        fprintf(stderr, "bench: first read failed\n");
+        emu_close(fd);
+        return -1;
+    }
+    uint64_t t1 = now_ns();
+    uint64_t rss_first = rss_kb();
+
+    uint64_t total = 4096;
+    for (;;) {
+        ssize_t r = emu_read(fd, buf, sizeof(buf));
+        if (r < 0) {
+            fprintf(stderr, "bench: read failed @%" PRIu64 "\n", total);
+            emu_close(fd);
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+        total += r;
+    }
+    uint64_t t2 = now_ns();
+    uint64_t rss_all = rss_kb();
+    emu_close(fd);
+
+    if (total != size) {
+        fprintf(stderr, "bench: read %" PRIu64 " of %" PRIu64 " bytes\n", total, size);
+        return -1;
+    }
+    if (emu_unlink(BENCH_PATH) < 0) {
+        fprintf(stderr, "bench: cannot unlink '%s'\n", BENCH_PATH);
+        return -1;
+    }
+
+    uint64_t mib = size / (1024 * 1024);
+    uint64_t seq_ns = (t2 - t1) ? (t2 - t1) : 1;
+    fprintf(stderr, "%5" PRIu64 " MiB file: first byte %8" PRIu64 " us, "
+            "sequential %6" PRIu64 " MiB/s, rss %+" PRId64 " KiB after first read, "
+            "%+" PRId64 " KiB after all\n",
+            mib, (t1 - t0) / 1000, size * 1000000000 / seq_ns / (1024 * 1024),
+            (int64_t)(rss_first - rss_before), (int64_t)(rss_all - rss_before));
+    return 0;
+}
+
+static int bench_files(uint32_t count) {
+    char path[64];
+
+    if (emu_mkdir(BENCH_DIR, 0755) < 0) {
+        fprintf(stderr, "bench: cannot create '%s'\n", BENCH_DIR);
+        return -1;
+    }
+
+    uint64_t t0 = now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), BENCH_DIR "/f%05u", i);
+        int fd = emu_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "bench: cannot create '%s'\n", path);
+            return -1;
+        }
+        emu_close(fd);
+    }
+    uint64_t t1 = now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), BENCH_DIR "/f%05u", i);
+        if (emu_unlink(path) < 0) {
+            fprintf(stderr, "bench: cannot unlink '%s'\n", path);
+            return -1;
+        }
+    }
+    uint64_t t2 = now_ns();
+
+    if (emu_unlink(BENCH_DIR) < 0) {
+        fprintf(stderr, "bench: cannot unlink '%s'\n", BENCH_DIR);
+        return -1;
+    }
+
+    uint64_t create_ns = (t1 - t0) ? (t1 - t0) : 1;
+    uint64_t unlink_ns = (t2 - t1) ? (t2 - t1) : 1;
+    fprintf(stderr, "%5u files: create %8" PRIu64 " ops/s, unlink %8" PRIu64 " ops/s\n",
+            count, (uint64_t)count * 1000000000 / create_ns,
+            (uint64_t)count * 1000000000 / unlink_ns);
+    return 0;
+}
+
+static int bench_dir(uint32_t count) {
+    char path[64];
+    struct stat s;
+
+    if (emu_mkdir(BENCH_DIR, 0755) < 0) {
+        fprintf(stderr, "bench: cannot create '%s'\n", BENCH_DIR);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), BENCH_DIR "/f%05u", i);
+        int fd = emu_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "bench: cannot create '%s'\n", path);
+            return -1;
+        }
+        emu_close(fd);
+    }
+
+    uint64_t t0 = now_ns();
+    for (uint32_t i = 0; i < BENCH_DIR_OPS; i++) {
+        snprintf(path, sizeof(path), BENCH_DIR "/g%05u", i);
+        int fd = emu_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "bench: cannot create '%s'\n", path);
+            return -1;
+        }
+        emu_close(fd);
+    }
+    uint64_t t1 = now_ns();
+    rand32_t r = RAND32SEED(count);
+    for (uint32_t i = 0; i < BENCH_DIR_OPS; i++) {
+        snprintf(path, sizeof(path), BENCH_DIR "/f%05u", rand32(&r) % count);
+        if (emu_stat(path, &s) < 0) {
+            fprintf(stderr, "bench: cannot find '%s'\n", path);
+            return -1;
+        }
+    }
+    uint64_t t2 = now_ns();
+
+    for (uint32_t i = 0; i < count + BENCH_DIR_OPS; i++) {
+        if (i < count) {
+            snprintf(path, sizeof(path), BENCH_DIR "/f%05u", i);
+        } else {
+            snprintf(path, sizeof(path), BENCH_DIR "/g%05u", i - count);
+        }
+        if (emu_unlink(path) < 0) {
+            fprintf(stderr, "bench: cannot unlink '%s'\n", path);
+            return -1;
+        }
+    }
+    if (emu_unlink(BENCH_DIR) < 0) {
+        fprintf(stderr, "bench: cannot unlink '%s'\n", BENCH_DIR);
+        return -1;
+    }
+
+    fprintf(stderr, "%5u entries: create %8" PRIu64 " us, lookup %8" PRIu64 " us\n",
+            count, (t1 - t0) / 1000 / BENCH_DIR_OPS, (t2 - t1) / 1000 / BENCH_DIR_OPS);
+    return 0;
+}
+
+static int bench_all_dir(int argc, char** argv) {
+    // Directory sizes, unless given on the command line.
+    static const uint32_t default_counts[] = { 100, 1000, 10000, BENCH_DIR_MAX };
+
+    if (argc > 0) {
+        for (int i = 0; i < argc; i++) {
+            char* end;
+            unsigned long n = strtoul(argv[i], &end, 10);
+            if ((end == argv[i]) || *end || (n == 0) || (n > BENCH_DIR_MAX)) {
+                fprintf(stderr, "bench: bad entry count '%s' (1 to %u)\n",
+                        argv[i], BENCH_DIR_MAX);
+                return -1;
+            }
+            if (bench_dir((uint32_t)n) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    for (unsigned i = 0; i < countof(default_counts); i++) {
+        if (bench_dir(default_counts[i]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int bench_all_files(int argc, char** argv) {
+    uint32_t count = BENCH_FILES;
+    if (argc > 1) {
+        fprintf(stderr, "bench: files takes at most one count\n");
+        return -1;
+    } else if (argc == 1) {
+        char* end;
+        unsigned long n = strtoul(argv[0], &end, 10);
+        if ((end == argv[0]) || *end || (n == 0) || (n > 99999)) {
+            fprintf(stderr, "bench: bad file count '%s' (1 to 99999)\n", argv[0]);
+            return -1;
+        }
+        count = (uint32_t)n;
+    }
+    return bench_files(count);
+}
+
+static int bench_all_large(int argc, char** argv) {
+    // File sizes in MiB, unless given on the command line.
+    static const uint64_t default_sizes[] = { 16, 64, 256 };
+    const uint64_t max_mib = kMinfsMaxFileSize / (1024 * 1024);
+
+    if (argc > 0) {
+        for (int i = 0; i < argc; i++) {
+            char* end;
+            uint64_t mib = strtoull(argv[i], &end, 10);
+            if ((end == argv[i]) || *end || (mib == 0) || (mib > max_mib)) {
+                fprintf(stderr, "bench: bad size '%s' (1 to %" PRIu64 " MiB)\n",
+                        argv[i], max_mib);
+                return -1;
+            }
+            if (bench_large_file(mib * 1024 * 1024) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    for (unsigned i = 0; i < countof(default_sizes); i++) {
+        if (bench_large_file(default_sizes[i] * 1024 * 1024) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// bench [ large [ <MiB>* ] | files [ <count> ] | dir [ <count>* ] ]
+int run_fs_bench(int argc, char** argv) {
+    fprintf(stderr, "--- fs bench ---\n");
+
+    if (argc == 0) {
+        if (bench_all_large(0, nullptr) < 0) {
+            return -1;
+        }
+        if (bench_all_files(0, nullptr) < 0) {
+            return -1;
+        }
+        return bench_all_dir(0, nullptr);
+    } else if (!strcmp(argv[0], "large")) {
+        return bench_all_large(argc - 1, argv + 1);
+    } else if (!strcmp(argv[0], "files")) {
+        return bench_all_files(argc - 1, argv + 1);
+    } else if (!strcmp(argv[0], "dir")) {
+        return bench_all_dir(argc - 1, argv + 1);
+    }
+    fprintf(stderr, "bench: unknown benchmark '%s' (large, files or dir)\n", argv[0]);
+    return -1;
+}
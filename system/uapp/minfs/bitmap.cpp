@@ -99,6 +99,32 @@ uint32_t Bitmap::Alloc(uint32_t minbit) {
     return BITMAP_FAIL;
 }
 
+uint32_t Bitmap::AllocRun(uint32_t minbit, uint32_t want, uint32_t* count_out) {
+    // find the first clear bit, skipping over full words
+    uint32_t n = minbit;
+    while (n < bitcount_) {
+        // treat the bits below n in its word as set
+        uint64_t v = map_.get()[n >> 6] | ((1ULL << (n & 63)) - 1);
+        if (v != ~0ULL) {
+            n = (n & ~63u) + __builtin_ctzll(~v);
+            break;
+        }
+        n = (n | 63) + 1;
+    }
+    if (n >= bitcount_) {
+        return BITMAP_FAIL;
+    }
+
+    // extend the run while the following bits are clear
+    uint32_t start = n;
+    while ((n < bitcount_) && ((n - start) < want) && !Get(n)) {
+        Set(n);
+        n++;
+    }
+    *count_out = n - start;
+    return start;
+}
+
 #define FAIL_IF(c) do { if (c) { error("fail: %s\n", #c); return -1; } } while (0)
 
 int do_bitmap_test(void) {
@@ -149,6 +175,22 @@ int do_bitmap_test(void) {
     memset(map, 0xFF, bm.Capacity() / 8);
     FAIL_IF(bm.Alloc(0) != BITMAP_FAIL);
 
+    uint32_t count;
+    bm.Reset();
+    bm.Set(3);
+    bm.Set(70);
+    FAIL_IF(bm.AllocRun(0, 8, &count) != 0);
+    FAIL_IF(count != 3);
+    FAIL_IF(bm.AllocRun(1, 8, &count) != 4);
+    FAIL_IF(count != 8);
+    FAIL_IF(bm.AllocRun(12, 100, &count) != 12);
+    FAIL_IF(count != 58);
+    FAIL_IF(bm.AllocRun(64, 4, &count) != 71);
+    FAIL_IF(count != 4);
+    FAIL_IF(bm.AllocRun(1020, 8, &count) != 1020);
+    FAIL_IF(count != 4);
+    FAIL_IF(bm.AllocRun(1020, 8, &count) != BITMAP_FAIL);
+
     warn("bitmap: ok\n");
     return 0;
 }
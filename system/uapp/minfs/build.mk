@@ -35,9 +35,9 @@ else
 FUSE_LDFLAGS += -lfuse
 endif
 
-SRCS += main.cpp test.cpp
-LIBMINFS_SRCS += host.cpp bitmap.cpp bcache.cpp
-LIBMINFS_SRCS += minfs.cpp minfs-ops.cpp minfs-check.cpp
+SRCS += main.cpp test.cpp bench.cpp
+LIBMINFS_SRCS += host.cpp bitmap.cpp bcache.cpp journal.cpp
+LIBMINFS_SRCS += minfs.cpp minfs-ops.cpp minfs-check.cpp minfs-extent.cpp
 LIBFS_SRCS += vfs.c
 LIBMXCPP_SRCS := new.cpp pure_virtual.cpp
 
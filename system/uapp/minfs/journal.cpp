@@ -0,0 +1,354 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fs/trace.h>
+
+#include <mxtl/unique_ptr.h>
+
+#include "minfs.h"
+#include "minfs-private.h"
+
+// The journal is written front to back, one record per commit, and emptied
+// by a checkpoint when the next record would not fit. Each commit is a
+// single sequential write. Committed blocks may leave the cache before the
+// checkpoint; it writes those from their copies in the journal. See minfs.h
+// for the on-disk format.
+
+mx_status_t Bcache::JournalStart(uint32_t start, uint32_t count) {
+    if ((count < 3) || (count > kMinfsJournalMaxBlocks) ||
+        (start > blockmax_) || (count > blockmax_ - start)) {
+        error("minfs: bad journal location\n");
+        return ERR_INVALID_ARGS;
+    }
+    mx_status_t status;
+    if ((status = journaled_.Init(blockmax_)) < 0) {
+        return status;
+    }
+    revoked_.reset(static_cast<uint32_t*>(malloc(count * sizeof(uint32_t))));
+    jnl_map_.reset(static_cast<uint32_t*>(calloc(count, sizeof(uint32_t))));
+    if ((revoked_ == nullptr) || (jnl_map_ == nullptr)) {
+        return ERR_NO_MEMORY;
+    }
+    jnl_start_ = start;
+    jnl_count_ = count;
+    if ((status = JournalReplay()) < 0) {
+        jnl_count_ = 0;
+        return status;
+    }
+    // Replay wrote behind the cache's back.
+    Invalidate();
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::JournalWriteInfo() {
+    char bdata[kMinfsBlockSize];
+    memset(bdata, 0, sizeof(bdata));
+    minfs_journal_info_t* info = reinterpret_cast<minfs_journal_info_t*>(bdata);
+    info->magic = kMinfsMagicJournal;
+    info->seq = jnl_seq_;
+    return WriteblkRaw(jnl_start_, bdata, 1);
+}
+
+uint32_t Bcache::JournalLocation(uint32_t bno) const {
+    if ((jnl_count_ == 0) || !journaled_.Get(bno)) {
+        return bno;
+    }
+    for (uint32_t n = jnl_next_; n-- > 0;) {
+        if (jnl_map_.get()[n] == bno) {
+            return jnl_start_ + 1 + n;
+        }
+    }
+    return bno;
+}
+
+mx_status_t Bcache::JournalBarrier() {
+    if (!jnl_unsynced_) {
+        return NO_ERROR;
+    }
+    if (fsync(fd_) < 0) {
+        return ERR_IO;
+    }
+    jnl_unsynced_ = false;
+    return NO_ERROR;
+}
+
+// Reads the record at 'off' into 'buf', which has room for the largest one,
+// and returns how many blocks it takes, or 0 if it is not a complete record
+// with sequence number 'seq'.
+static uint32_t read_record(Bcache* bc, uint32_t start, uint32_t space, uint32_t off,
+                            uint64_t seq, char* buf) {
+    minfs_journal_header_t* hdr = reinterpret_cast<minfs_journal_header_t*>(buf);
+    if (bc->Readblk(start + off, buf) != NO_ERROR) {
+        return 0;
+    }
+    if ((hdr->magic != kMinfsMagicJournalRecord) || (hdr->seq != seq) ||
+        (hdr->count > space - off - 2) ||
+        (hdr->revoke_count > kMinfsJournalEntries - hdr->count)) {
+        return 0;
+    }
+    for (uint32_t n = 1; n <= hdr->count + 1; n++) {
+        if (bc->Readblk(start + off + n, buf + n * kMinfsBlockSize) != NO_ERROR) {
+            return 0;
+        }
+    }
+    size_t len = (hdr->count + 1) * kMinfsBlockSize;
+    const minfs_journal_commit_t* commit = reinterpret_cast<minfs_journal_commit_t*>(buf + len);
+    if ((commit->magic != kMinfsMagicJournalCommit) || (commit->seq != seq) ||
+        (commit->checksum != MinfsJournalChecksum(buf, len))) {
+        return 0;
+    }
+    return hdr->count + 2;
+}
+
+mx_status_t Bcache::JournalReplay() {
+    char bdata[kMinfsBlockSize];
+    if (ReadblkRaw(jnl_start_, bdata) != NO_ERROR) {
+        return ERR_IO;
+    }
+    const minfs_journal_info_t* jinfo = reinterpret_cast<minfs_journal_info_t*>(bdata);
+    if (jinfo->magic != kMinfsMagicJournal) {
+        error("minfs: bad journal magic\n");
+        return ERR_INVALID_ARGS;
+    }
+
+    // Records start after the info block. A record takes at least two
+    // blocks, and revokes only blocks copied by earlier records.
+    const uint32_t start = jnl_start_ + 1;
+    const uint32_t space = jnl_count_ - 1;
+    mxtl::unique_free_ptr<char> buf(static_cast<char*>(malloc(space * blocksize_)));
+    mxtl::unique_free_ptr<uint32_t> offs(
+        static_cast<uint32_t*>(malloc((space / 2) * sizeof(uint32_t))));
+    mxtl::unique_free_ptr<uint32_t> revoke_bno(
+        static_cast<uint32_t*>(malloc(space * sizeof(uint32_t))));
+    mxtl::unique_free_ptr<uint64_t> revoke_seq(
+        static_cast<uint64_t*>(malloc(space * sizeof(uint64_t))));
+    if ((buf == nullptr) || (offs == nullptr) || (revoke_bno == nullptr) ||
+        (revoke_seq == nullptr)) {
+        return ERR_NO_MEMORY;
+    }
+    const minfs_journal_header_t* hdr = reinterpret_cast<minfs_journal_header_t*>(buf.get());
+
+    // Find the complete records, and gather what they revoke.
+    uint32_t records = 0;
+    uint32_t revokes = 0;
+    uint32_t off = 0;
+    uint32_t len;
+    while ((off + 2 <= space) &&
+           ((len = read_record(this, start, space, off, jinfo->seq + records, buf.get())) != 0)) {
+        if (hdr->revoke_count > space - revokes) {
+            break;
+        }
+        for (uint32_t n = 0; n < hdr->revoke_count; n++) {
+            revoke_bno.get()[revokes] = hdr->bno[hdr->count + n];
+            revoke_seq.get()[revokes] = hdr->seq;
+            revokes++;
+        }
+        offs.get()[records++] = off;
+        off += len;
+    }
+    jnl_seq_ = jinfo->seq + records;
+    jnl_next_ = 0;
+    if (records == 0) {
+        return NO_ERROR;
+    }
+
+    // Write each record's copies in place, oldest first, leaving out the
+    // ones a later record revoked.
+    info("minfs: replaying %u journal record%s\n", records, (records > 1) ? "s" : "");
+    for (uint32_t r = 0; r < records; r++) {
+        uint64_t seq = jnl_seq_ - records + r;
+        if (read_record(this, start, space, offs.get()[r], seq, buf.get()) == 0) {
+            return ERR_IO;
+        }
+        for (uint32_t n = 0; n < hdr->count; n++) {
+            uint32_t bno = hdr->bno[n];
+            bool revoked = false;
+            for (uint32_t i = 0; i < revokes; i++) {
+                if ((revoke_bno.get()[i] == bno) && (revoke_seq.get()[i] > seq)) {
+                    revoked = true;
+                    break;
+                }
+            }
+            if (revoked) {
+                continue;
+            }
+            if (bno >= blockmax_) {
+                error("minfs: journal record %" PRIu64 " copies bad block %u\n", seq, bno);
+                return ERR_IO;
+            }
+            if (WriteblkRaw(bno, buf.get() + (n + 1) * blocksize_, 1) != NO_ERROR) {
+                return ERR_IO;
+            }
+        }
+    }
+
+    // Only forget the records once their blocks are safely in place.
+    if (fsync(fd_) < 0) {
+        return ERR_IO;
+    }
+    return JournalWriteInfo();
+}
+
+mx_status_t Bcache::Commit() {
+    if (dirty_.is_empty() && (revoke_count_ == 0)) {
+        return NO_ERROR;
+    }
+    const uint32_t space = jnl_count_ - 1;
+    mx_status_t status;
+    if ((jnl_next_ + dirty_count_ + 2 > space) ||
+        (dirty_count_ + revoke_count_ > kMinfsJournalEntries)) {
+        if ((status = Checkpoint()) != NO_ERROR) {
+            return status;
+        }
+    }
+    uint32_t count = dirty_count_;
+    if (count + 2 > space) {
+        // Too large for the journal: give up on atomicity, and write it all
+        // in place.
+        error("bcache: %u blocks do not fit in the journal, writing them in place\n", count);
+        mxtl::unique_free_ptr<BlockNode*> blks(
+            static_cast<BlockNode**>(malloc(count * sizeof(BlockNode*))));
+        if (blks == nullptr) {
+            return ERR_NO_MEMORY;
+        }
+        for (uint32_t n = 0; n < count; n++) {
+            blks.get()[n] = dirty_.pop_front().get();
+        }
+        dirty_count_ = 0;
+        return WriteRuns(blks.get(), count);
+    }
+    trace(BCACHE, "bcache_commit() seq=%" PRIu64 " %u blocks, %u revoked\n",
+          jnl_seq_, count, revoke_count_);
+
+    // Header, copies, and commit, written with one write.
+    mxtl::unique_free_ptr<char> buf(static_cast<char*>(malloc((count + 2) * blocksize_)));
+    if (buf == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+    minfs_journal_header_t* hdr = reinterpret_cast<minfs_journal_header_t*>(buf.get());
+    memset(hdr, 0, blocksize_);
+    hdr->magic = kMinfsMagicJournalRecord;
+    hdr->count = count;
+    hdr->seq = jnl_seq_;
+    hdr->revoke_count = revoke_count_;
+    uint32_t* map = jnl_map_.get() + 1 + jnl_next_;
+    uint32_t n = 0;
+    for (auto& blk : dirty_) {
+        hdr->bno[n] = blk.bno_;
+        map[n] = blk.bno_;
+        memcpy(buf.get() + (n + 1) * blocksize_, blk.data(), blocksize_);
+        n++;
+    }
+    memcpy(hdr->bno + count, revoked_.get(), revoke_count_ * sizeof(uint32_t));
+    size_t len = (count + 1) * blocksize_;
+    minfs_journal_commit_t* commit = reinterpret_cast<minfs_journal_commit_t*>(buf.get() + len);
+    memset(commit, 0, blocksize_);
+    commit->magic = kMinfsMagicJournalCommit;
+    commit->seq = jnl_seq_;
+    commit->checksum = MinfsJournalChecksum(buf.get(), len);
+    if ((status = WriteblkRaw(jnl_start_ + 1 + jnl_next_, buf.get(), count + 2)) != NO_ERROR) {
+        return status;
+    }
+
+    // The blocks now wait for a checkpoint rather than a commit.
+    while (!dirty_.is_empty()) {
+        mxtl::RefPtr<BlockNode> blk = dirty_.pop_front();
+        journaled_.Set(blk->bno_);
+        if (!blk->ckpt_list_state_.InContainer()) {
+            ckpt_.push_back(mxtl::move(blk));
+            ckpt_count_++;
+        }
+    }
+    dirty_count_ = 0;
+    revoke_count_ = 0;
+    jnl_map_.get()[jnl_next_] = 0;
+    jnl_map_.get()[jnl_next_ + count + 1] = 0;
+    jnl_next_ += count + 2;
+    jnl_seq_++;
+    jnl_unsynced_ = true;
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::Checkpoint() {
+    if (jnl_next_ == 0) {
+        return NO_ERROR;
+    }
+    trace(BCACHE, "bcache_checkpoint() %u journal blocks, %u cached\n", jnl_next_, ckpt_count_);
+    mx_status_t status;
+    if ((status = JournalBarrier()) != NO_ERROR) {
+        return status;
+    }
+
+    // Cached blocks unchanged since they were committed can be written from
+    // the cache.
+    mxtl::unique_free_ptr<BlockNode*> blks(
+        static_cast<BlockNode**>(malloc(ckpt_count_ * sizeof(BlockNode*))));
+    if ((ckpt_count_ > 0) && (blks == nullptr)) {
+        return ERR_NO_MEMORY;
+    }
+    uint32_t count = 0;
+    while (!ckpt_.is_empty()) {
+        mxtl::RefPtr<BlockNode> blk = ckpt_.pop_front();
+        if (!blk->dirty_list_state_.InContainer() && !(blk->flags_ & kBlockBusy)) {
+            journaled_.Clr(blk->bno_);
+            blks.get()[count++] = blk.get();
+        }
+    }
+    ckpt_count_ = 0;
+    if ((status = WriteRuns(blks.get(), count)) != NO_ERROR) {
+        return status;
+    }
+
+    // Everything else, from its newest copy in the journal.
+    char bdata[kMinfsBlockSize];
+    for (uint32_t n = jnl_next_; n-- > 0;) {
+        uint32_t bno = jnl_map_.get()[n];
+        if ((bno == 0) || !journaled_.Get(bno)) {
+            continue;
+        }
+        journaled_.Clr(bno);
+        if ((ReadblkRaw(jnl_start_ + 1 + n, bdata) != NO_ERROR) ||
+            (WriteblkRaw(bno, bdata, 1) != NO_ERROR)) {
+            return ERR_IO;
+        }
+    }
+
+    // Once that is on disk, the journal can start over.
+    if (fsync(fd_) < 0) {
+        return ERR_IO;
+    }
+    if ((status = JournalWriteInfo()) != NO_ERROR) {
+        return status;
+    }
+    jnl_next_ = 0;
+    revoke_count_ = 0;
+    return NO_ERROR;
+}
+
+void Bcache::Revoke(uint32_t bno) {
+    if (jnl_count_ == 0) {
+        return;
+    }
+    auto iter = hash_.find(bno);
+    if (iter.IsValid()) {
+        if (iter->dirty_list_state_.InContainer()) {
+            dirty_.erase(*iter);
+            dirty_count_--;
+        }
+        if (iter->ckpt_list_state_.InContainer()) {
+            ckpt_.erase(*iter);
+            ckpt_count_--;
+        }
+    }
+    if (journaled_.Get(bno)) {
+        journaled_.Clr(bno);
+        revoked_.get()[revoke_count_++] = bno;
+    }
+}
@@ -7,6 +7,7 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,6 +36,7 @@ int do_minfs_mount(Bcache* bc, int argc, char** argv) {
 }
 #else
 int run_fs_tests(int argc, char** argv);
+int run_fs_bench(int argc, char** argv);
 
 static Bcache* the_block_cache;
 void drop_cache(void) {
@@ -60,6 +62,13 @@ int do_minfs_test(Bcache* bc, int argc, char** argv) {
     return run_fs_tests(argc, argv);
 }
 
+int do_minfs_bench(Bcache* bc, int argc, char** argv) {
+    if (io_setup(bc)) {
+        return -1;
+    }
+    return run_fs_bench(argc, argv);
+}
+
 int do_cp(Bcache* bc, int argc, char** argv) {
     if (argc != 2) {
         fprintf(stderr, "cp requires two arguments\n");
@@ -225,12 +234,13 @@ struct {
 } CMDS[] = {
     {"create", do_minfs_mkfs, O_RDWR | O_CREAT, "initialize filesystem"},
     {"mkfs", do_minfs_mkfs, O_RDWR | O_CREAT, "initialize filesystem"},
-    {"check", do_minfs_check, O_RDONLY, "check filesystem integrity"},
-    {"fsck", do_minfs_check, O_RDONLY, "check filesystem integrity"},
+    {"check", do_minfs_check, O_RDWR, "replay journal, check filesystem integrity"},
+    {"fsck", do_minfs_check, O_RDWR, "replay journal, check filesystem integrity"},
 #ifdef __Fuchsia__
     {"mount", do_minfs_mount, O_RDWR, "mount filesystem"},
 #else
     {"test", do_minfs_test, O_RDWR, "run tests against filesystem"},
+    {"bench", do_minfs_bench, O_RDWR, "benchmark large files, file creation and large directories"},
     {"cp", do_cp, O_RDWR, "copy to/from fs"},
     {"mkdir", do_mkdir, O_RDWR, "create directory"},
     {"rm", do_unlink, O_RDWR, "delete file or directory"},
@@ -247,13 +257,18 @@ int usage(void) {
             "\n"
             "options:  -v         some debug messages\n"
             "          -vv        all debug messages\n"
+            "          -c <n>     cache <n> blocks (default %u)\n"
+            "          -w         write back cached blocks lazily\n"
+#ifndef __Fuchsia__
+            "          -x <n>     crash instead of making the <n>th write\n"
+#endif
 #ifdef __Fuchsia__
             "\n"
             "On Fuchsia, MinFS takes the block device argument by handle.\n"
             "This can make 'minfs' commands hard to invoke from command line.\n"
             "Try using the [mkfs,fsck,mount,umount] commands instead\n"
 #endif
-            "\n");
+            "\n", kMinfsBlockCacheSize);
     for (unsigned n = 0; n < countof(CMDS); n++) {
         fprintf(stderr, "%9s %-10s %s\n", n ? "" : "commands:",
                 CMDS[n].name, CMDS[n].help);
@@ -275,6 +290,9 @@ int do_bitmap_test(void);
 
 int main(int argc, char** argv) {
     off_t size = 0;
+    uint32_t cache_size = kMinfsBlockCacheSize;
+    uint32_t cache_options = 0;
+    uint32_t crash_after = 0;
 
     // handle options
     while (argc > 1) {
@@ -282,6 +300,31 @@ int main(int argc, char** argv) {
             trace_on(TRACE_SOME);
         } else if (!strcmp(argv[1], "-vv")) {
             trace_on(TRACE_ALL);
+        } else if (!strcmp(argv[1], "-w")) {
+            cache_options |= kBcacheWriteBack;
+        } else if (!strcmp(argv[1], "-c") && (argc > 2)) {
+            char* end;
+            unsigned long n = strtoul(argv[2], &end, 10);
+            if ((end == argv[2]) || *end || (n < kMinfsBlockCacheMin) || (n > UINT32_MAX)) {
+                fprintf(stderr, "minfs: bad cache size: %s (at least %u blocks)\n",
+                        argv[2], kMinfsBlockCacheMin);
+                return usage();
+            }
+            cache_size = (uint32_t)n;
+            argc--;
+            argv++;
+#ifndef __Fuchsia__
+        } else if (!strcmp(argv[1], "-x") && (argc > 2)) {
+            char* end;
+            unsigned long n = strtoul(argv[2], &end, 10);
+            if ((end == argv[2]) || *end || (n == 0) || (n > UINT32_MAX)) {
+                fprintf(stderr, "minfs: bad write count: %s\n", argv[2]);
+                return usage();
+            }
+            crash_after = (uint32_t)n;
+            argc--;
+            argv++;
+#endif
         } else {
             break;
         }
@@ -364,14 +407,22 @@ found:
     size /= kMinfsBlockSize;
 
     Bcache* bc;
-    if (Bcache::Create(&bc, fd, (uint32_t) size, kMinfsBlockSize, kMinfsBlockCacheSize) < 0) {
+    if (Bcache::Create(&bc, fd, (uint32_t) size, kMinfsBlockSize, cache_size,
+                       cache_options) < 0) {
         fprintf(stderr, "error: cannot create block cache\n");
         return -1;
     }
+    bc->CrashAfter(crash_after);
 
     for (unsigned i = 0; i < countof(CMDS); i++) {
         if (!strcmp(cmd, CMDS[i].name)) {
-            return CMDS[i].func(bc, argc - 3, argv + 3);
+            int r = CMDS[i].func(bc, argc - 3, argv + 3);
+            // host commands return without unmounting
+            if (bc->Flush() != NO_ERROR) {
+                fprintf(stderr, "error: cannot write back block cache\n");
+                return -1;
+            }
+            return r;
         }
     }
     return -1;
@@ -34,35 +34,6 @@ static mx_status_t get_inode(const Minfs* fs, minfs_inode_t* inode, uint32_t ino
 #define CD_DUMP 1
 #define CD_RECURSE 2
 
-static mx_status_t get_inode_nth_bno(const Minfs* fs, minfs_inode_t* inode, uint32_t n,
-                                     uint32_t* bno_out) {
-    if (n < kMinfsDirect) {
-        *bno_out = inode->dnum[n];
-        return NO_ERROR;
-    }
-    n -= kMinfsDirect;
-    uint32_t i = static_cast<uint32_t>(n / (kMinfsBlockSize / sizeof(uint32_t)));
-    uint32_t j = n % (kMinfsBlockSize / sizeof(uint32_t));
-
-    if (i >= kMinfsIndirect) {
-        return ERR_OUT_OF_RANGE;
-    }
-
-    uint32_t ibno;
-    if ((ibno = inode->inum[i]) == 0) {
-        *bno_out = 0;
-        return NO_ERROR;
-    }
-    mxtl::RefPtr<BlockNode> iblk;
-    if ((iblk = fs->bc->Get(ibno)) == nullptr) {
-        return ERR_NOT_FOUND;
-    }
-    uint32_t* ientry = static_cast<uint32_t*>(iblk->data());
-    *bno_out = ientry[j];
-    fs->bc->Put(mxtl::move(iblk), 0);
-    return NO_ERROR;
-}
-
 // Convert 'single-block-reads' to generic reads, which may cross block
 // boundaries. This function works on directories too.
 static mx_status_t file_read(const Minfs* fs, minfs_inode_t* inode, void* data,
@@ -88,11 +59,13 @@ static mx_status_t file_read(const Minfs* fs, minfs_inode_t* inode, void* data,
 
         uint32_t bno;
         mx_status_t status;
-        if ((status = get_inode_nth_bno(fs, inode, n, &bno)) != NO_ERROR) {
+        if ((status = minfs_extent_lookup(fs->bc, inode, n, &bno, nullptr)) != NO_ERROR) {
             return status;
         }
 
-        if ((status = fs->bc->Read(bno, data, adjust, xfer)) != NO_ERROR) {
+        if (bno == 0) {
+            memset(data, 0, xfer);
+        } else if ((status = fs->bc->Read(bno, data, adjust, xfer)) != NO_ERROR) {
             return status;
         }
 
@@ -105,18 +78,67 @@ static mx_status_t file_read(const Minfs* fs, minfs_inode_t* inode, void* data,
     return static_cast<mx_status_t>((uintptr_t) data - (uintptr_t) start);
 }
 
+// Read the hash index of a directory into memory.
+static mx_status_t load_dir_hash(const Minfs* fs, minfs_inode_t* inode, uint32_t ino,
+                                 mxtl::unique_free_ptr<minfs_dirhash_t>* out) {
+    uint32_t slots = inode->dir_hash_slots;
+    if ((slots < kMinfsDirHashMinSlots) || (slots > kMinfsDirHashMaxSlots) ||
+        (slots & (slots - 1))) {
+        error("check: ino#%u: bad directory index size %u\n", ino, slots);
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    size_t len = slots * sizeof(minfs_dirhash_t);
+    mxtl::unique_free_ptr<minfs_dirhash_t> table(
+        static_cast<minfs_dirhash_t*>(malloc(len)));
+    if (table == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+    mx_status_t status = file_read(fs, inode, table.get(), len, kMinfsDirHashOffset);
+    if (status != static_cast<mx_status_t>(len)) {
+        error("check: ino#%u: could not read directory index\n", ino);
+        return status < 0 ? status : ERR_IO;
+    }
+    *out = mxtl::move(table);
+    return NO_ERROR;
+}
+
+// Check that the dirent at 'off' can be found through the directory index.
+static bool check_dir_hash_entry(const minfs_dirhash_t* table, uint32_t slots,
+                                 const minfs_dirent_t* de, size_t off) {
+    uint32_t hash = MinfsDirHash(de->name, de->namelen);
+    uint32_t mask = slots - 1;
+    uint32_t n = hash & mask;
+    for (uint32_t i = 0; i < slots; i++, n = (n + 1) & mask) {
+        if (table[n].hash == kMinfsDirHashFree) {
+            break;
+        } else if ((table[n].hash == hash) && (table[n].off == off)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static mx_status_t check_directory(CheckMaps* chk, const Minfs* fs, minfs_inode_t* inode,
                                    uint32_t ino, uint32_t parent, uint32_t flags) {
     unsigned eno = 0;
     bool dot = false;
     bool dotdot = false;
     uint32_t dirent_count = 0;
+    uint32_t indexed = 0;
+
+    mxtl::unique_free_ptr<minfs_dirhash_t> table;
+    if (inode->dir_hash_slots != 0) {
+        mx_status_t status = load_dir_hash(fs, inode, ino, &table);
+        if (status != NO_ERROR) {
+            return status;
+        }
+    }
 
     size_t off = 0;
     while (true) {
-        uint32_t data[MINFS_DIRENT_SIZE];
-        mx_status_t status = file_read(fs, inode, data, MINFS_DIRENT_SIZE, off);
-        if (status != MINFS_DIRENT_SIZE) {
+        uint32_t data[kMinfsMaxDirentSize / sizeof(uint32_t)];
+        mx_status_t status = file_read(fs, inode, data, kMinfsMaxDirentSize, off);
+        if ((status < 0) || (static_cast<uint32_t>(status) < MINFS_DIRENT_SIZE)) {
             error("check: ino#%u: Could not read direnty at %zd\n", ino, off);
             return status < 0 ? status : ERR_IO;
         }
@@ -133,7 +155,8 @@ static mx_status_t check_directory(CheckMaps* chk, const Minfs* fs, minfs_inode_
                 info("ino#%u: de[%u]: <empty> reclen=%u\n", ino, eno, rlen);
             }
         } else {
-            if ((de->namelen == 0) || (de->namelen > (rlen - MINFS_DIRENT_SIZE))) {
+            if ((de->namelen == 0) || (de->namelen > (rlen - MINFS_DIRENT_SIZE)) ||
+                (DirentSize(de->namelen) > static_cast<uint32_t>(status))) {
                 error("check: ino#%u: de[%u]: invalid namelen %u\n", ino, eno, de->namelen);
                 return ERR_IO_DATA_INTEGRITY;
             }
@@ -155,6 +178,14 @@ static mx_status_t check_directory(CheckMaps* chk, const Minfs* fs, minfs_inode_
                     error("check: ino#%u: de[%u]: '..' ino=%u (not parent!)\n", ino, eno, de->ino);
                 }
             }
+            if (table != nullptr) {
+                if (check_dir_hash_entry(table.get(), inode->dir_hash_slots, de, off)) {
+                    indexed++;
+                } else {
+                    error("check: ino#%u: de[%u]: '%.*s' missing from directory index\n",
+                          ino, eno, de->namelen, de->name);
+                }
+            }
             //TODO: check for cycles (non-dot/dotdot dir ref already in checked bitmap)
             if (flags & CD_DUMP) {
                 info("ino#%u: de[%u]: ino=%u type=%u '%.*s'\n",
@@ -168,12 +199,36 @@ static mx_status_t check_directory(CheckMaps* chk, const Minfs* fs, minfs_inode_
             dirent_count++;
         }
         if (is_last) {
+            if (off != inode->dir_tail) {
+                error("check: ino#%u: last dirent at %zd, not %u\n", ino, off, inode->dir_tail);
+            }
             break;
         } else {
             off += rlen;
         }
         eno++;
     }
+    if (table != nullptr) {
+        uint32_t used = 0;
+        uint32_t deleted = 0;
+        for (uint32_t n = 0; n < inode->dir_hash_slots; n++) {
+            if (table.get()[n].hash == kMinfsDirHashDeleted) {
+                deleted++;
+            } else if (table.get()[n].hash != kMinfsDirHashFree) {
+                used++;
+            }
+        }
+        if (used != indexed) {
+            error("check: ino#%u: directory index has %u stale entries\n", ino, used - indexed);
+        }
+        if (deleted != inode->dir_hash_deleted) {
+            error("check: ino#%u: directory index has %u deleted slots, not %u\n",
+                  ino, deleted, inode->dir_hash_deleted);
+        }
+        if (2 * (used + deleted) > inode->dir_hash_slots) {
+            warn("check: ino#%u: directory index more than half full\n", ino);
+        }
+    }
     if (dirent_count != inode->dirent_count) {
         error("check: ino#%u: dirent_count of %u != %u (actual)\n",
               ino, inode->dirent_count, dirent_count);
@@ -204,51 +259,89 @@ const char* check_data_block(CheckMaps* chk, const Minfs* fs, uint32_t bno) {
     return nullptr;
 }
 
-mx_status_t check_file(CheckMaps* chk, const Minfs* fs,
-                       minfs_inode_t* inode, uint32_t ino) {
+// Check that a sorted extent array maps file blocks within [lo, hi) only,
+// and that its blocks belong to nothing else. Counts the blocks, and records
+// the end of the last extent in 'max'.
+static void check_extents(CheckMaps* chk, const Minfs* fs, uint32_t ino,
+                          const minfs_extent_t* ext, uint32_t count, uint32_t lo, uint32_t hi,
+                          uint32_t* blocks, uint32_t* max) {
+    uint32_t next = lo;
+    for (uint32_t i = 0; i < count; i++) {
+        const minfs_extent_t* e = &ext[i];
 #if VERBOSE
-    for (unsigned n = 0; n < kMinfsDirect; n++) {
-        info("%d, ", inode->dnum[n]);
-    }
-    info("...\n");
+        info("%u+%u@%u, ", e->fbn, e->count, e->bno);
 #endif
-
-    uint32_t blocks = 0;
-
-    // count and sanity-check indirect blocks
-    for (unsigned n = 0; n < kMinfsIndirect; n++) {
-        if (inode->inum[n]) {
+        if ((e->count == 0) || (e->fbn < next) || (e->fbn >= hi) || (e->count > hi - e->fbn)) {
+            warn("check: ino#%u: extent %u+%u@%u: out of order or out of range\n",
+                 ino, e->fbn, e->count, e->bno);
+            continue;
+        }
+        for (uint32_t n = 0; n < e->count; n++) {
             const char* msg;
-            if ((msg = check_data_block(chk, fs, inode->inum[n])) != nullptr) {
-                warn("check: ino#%u: indirect block %u(@%u): %s\n",
-                     ino, n, inode->inum[n], msg);
+            if ((msg = check_data_block(chk, fs, e->bno + n)) != nullptr) {
+                warn("check: ino#%u: block %u(@%u): %s\n", ino, e->fbn + n, e->bno + n, msg);
             }
-            blocks++;
         }
+        next = e->fbn + e->count;
+        *blocks += e->count;
+        *max = next;
     }
+}
 
-    // count and sanity-check data blocks
+mx_status_t check_file(CheckMaps* chk, const Minfs* fs,
+                       minfs_inode_t* inode, uint32_t ino) {
+    uint32_t blocks = 0;
+    uint32_t max = 0;
 
-    unsigned max = 0;
-    for (unsigned n = 0;;n++) {
-        mx_status_t status;
-        uint32_t bno;
-        if ((status = get_inode_nth_bno(fs, inode, n, &bno)) < 0) {
-            if (status == ERR_OUT_OF_RANGE) {
-                break;
-            } else {
-                return status;
-            }
+    if (inode->extent_count > kMinfsInodeExtents) {
+        error("check: ino#%u: extent count %u too large\n", ino, inode->extent_count);
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    if (inode->extent_depth == 0) {
+        check_extents(chk, fs, ino, inode->extents, inode->extent_count, 0,
+                      kMinfsMaxFileBlock, &blocks, &max);
+    } else if (inode->extent_depth == 1) {
+        if ((inode->extent_count == 0) || (inode->extents[0].fbn != 0)) {
+            warn("check: ino#%u: extent index does not start at block 0\n", ino);
         }
-        if (bno) {
-            blocks++;
+        // count and sanity-check extent blocks, then the extents in them
+        for (uint32_t i = 0; i < inode->extent_count; i++) {
+            const minfs_extent_t* idx = &inode->extents[i];
+            uint32_t hi = (i + 1 < inode->extent_count) ? inode->extents[i + 1].fbn :
+                          kMinfsMaxFileBlock;
             const char* msg;
-            if ((msg = check_data_block(chk, fs, bno)) != nullptr) {
-                warn("check: ino#%u: block %u(@%u): %s\n", ino, n, bno, msg);
+            if ((msg = check_data_block(chk, fs, idx->bno)) != nullptr) {
+                warn("check: ino#%u: extent block %u(@%u): %s\n", ino, i, idx->bno, msg);
+                continue;
+            }
+            blocks++;
+            if ((hi <= idx->fbn) || (idx->count > kMinfsBlockExtents)) {
+                warn("check: ino#%u: extent block %u(@%u): bad index entry\n",
+                     ino, i, idx->bno);
+                continue;
+            }
+            mxtl::RefPtr<BlockNode> blk;
+            if ((blk = fs->bc->Get(idx->bno)) == nullptr) {
+                return ERR_IO;
+            }
+            const minfs_extent_block_t* eb = static_cast<minfs_extent_block_t*>(blk->data());
+            if (eb->magic != kMinfsMagicExtents) {
+                warn("check: ino#%u: extent block %u(@%u): bad magic %#x\n",
+                     ino, i, idx->bno, eb->magic);
+            } else {
+                check_extents(chk, fs, ino, eb->extents, idx->count, idx->fbn, hi,
+                              &blocks, &max);
             }
-            max = n + 1;
+            fs->bc->Put(mxtl::move(blk), 0);
         }
+    } else {
+        error("check: ino#%u: bad extent depth %u\n", ino, inode->extent_depth);
+        return ERR_IO_DATA_INTEGRITY;
     }
+#if VERBOSE
+    info("...\n");
+#endif
+
     if (max) {
         unsigned sizeblocks = inode->size / kMinfsBlockSize;
         if (sizeblocks > max) {
@@ -319,6 +412,10 @@ mx_status_t minfs_check(Bcache* bc) {
     if (minfs_check_info(&info, bc->Maxblk())) {
         return -1;
     }
+    // check what a mount would see
+    if ((status = bc->JournalStart(info.jnl_block, info.jnl_blocks)) < 0) {
+        return status;
+    }
 
     CheckMaps chk;
     if ((status = chk.checked_inodes.Init(info.inode_count)) < 0) {
@@ -0,0 +1,380 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "minfs.h"
+#include "minfs-private.h"
+
+// An inode maps its data with up to kMinfsInodeExtents extents of its own.
+// When a file needs more than that, they move out to an extent block, and
+// the inode's extents become an index of up to kMinfsInodeExtents extent
+// blocks instead. Extent blocks split when they fill up.
+
+// Index of the last extent starting at or before 'fbn', or -1 if none does.
+static int extent_find(const minfs_extent_t* ext, uint32_t count, uint32_t fbn) {
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ext[mid].fbn <= fbn) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return static_cast<int>(lo) - 1;
+}
+
+// Look 'fbn' up in a sorted extent array which maps nothing at or past
+// file block 'limit'.
+static void extent_map(const minfs_extent_t* ext, uint32_t count, uint32_t limit,
+                       uint32_t fbn, uint32_t* bno_out, uint32_t* count_out) {
+    int i = extent_find(ext, count, fbn);
+    if ((i >= 0) && ((fbn - ext[i].fbn) < ext[i].count)) {
+        *bno_out = ext[i].bno + (fbn - ext[i].fbn);
+        *count_out = ext[i].count - (fbn - ext[i].fbn);
+        return;
+    }
+    uint32_t next = (static_cast<uint32_t>(i + 1) < count) ? ext[i + 1].fbn : limit;
+    *bno_out = 0;
+    *count_out = next - fbn;
+}
+
+// Add a mapping to a sorted extent array with room for 'max' entries,
+// merging it with its neighbours where they are contiguous both in the file
+// and on disk.
+static mx_status_t extent_add(minfs_extent_t* ext, uint32_t* count, uint32_t max,
+                              uint32_t fbn, uint32_t bno, uint32_t len) {
+    uint32_t p = static_cast<uint32_t>(extent_find(ext, *count, fbn) + 1);
+    bool prev = (p > 0) && (ext[p - 1].fbn + ext[p - 1].count == fbn) &&
+                (ext[p - 1].bno + ext[p - 1].count == bno);
+    bool next = (p < *count) && (fbn + len == ext[p].fbn) && (bno + len == ext[p].bno);
+
+    if (prev && next) {
+        ext[p - 1].count += len + ext[p].count;
+        memmove(ext + p, ext + p + 1, (*count - p - 1) * sizeof(minfs_extent_t));
+        (*count)--;
+        memset(ext + *count, 0, sizeof(minfs_extent_t));
+    } else if (prev) {
+        ext[p - 1].count += len;
+    } else if (next) {
+        ext[p].fbn = fbn;
+        ext[p].bno = bno;
+        ext[p].count += len;
+    } else {
+        if (*count == max) {
+            return ERR_NO_SPACE;
+        }
+        memmove(ext + p + 1, ext + p, (*count - p) * sizeof(minfs_extent_t));
+        ext[p].fbn = fbn;
+        ext[p].bno = bno;
+        ext[p].count = len;
+        (*count)++;
+    }
+    return NO_ERROR;
+}
+
+static mx_status_t blocks_free(Minfs* fs, mxtl::RefPtr<BlockNode>* bitmap_blk,
+                               uint32_t bno, uint32_t count) {
+    for (uint32_t n = bno; n < bno + count; n++) {
+        if ((*bitmap_blk = fs->BitmapBlockGet(*bitmap_blk, n)) == nullptr) {
+            return ERR_IO;
+        }
+        fs->block_map.Clr(n);
+    }
+    return NO_ERROR;
+}
+
+// Drop everything at or past file block 'start' from a sorted extent array,
+// freeing the blocks and counting them in 'freed'.
+static mx_status_t extent_trim(Minfs* fs, mxtl::RefPtr<BlockNode>* bitmap_blk,
+                               minfs_extent_t* ext, uint32_t* count, uint32_t start,
+                               uint32_t* freed) {
+    mx_status_t status;
+    while (*count > 0) {
+        minfs_extent_t* e = &ext[*count - 1];
+        if (e->fbn >= start) {
+            if ((status = blocks_free(fs, bitmap_blk, e->bno, e->count)) != NO_ERROR) {
+                return status;
+            }
+            *freed += e->count;
+            memset(e, 0, sizeof(minfs_extent_t));
+            (*count)--;
+        } else {
+            if (e->fbn + e->count > start) {
+                uint32_t keep = start - e->fbn;
+                if ((status = blocks_free(fs, bitmap_blk, e->bno + keep,
+                                          e->count - keep)) != NO_ERROR) {
+                    return status;
+                }
+                *freed += e->count - keep;
+                e->count = keep;
+            }
+            break;
+        }
+    }
+    return NO_ERROR;
+}
+
+static mx_status_t extent_block_new(Minfs* fs, minfs_inode_t* inode, uint32_t* bno_out,
+                                    mxtl::RefPtr<BlockNode>* blk_out) {
+    mx_status_t status;
+    if ((status = fs->BlockNew(0, bno_out, blk_out)) != NO_ERROR) {
+        return status;
+    }
+    minfs_extent_block_t* eb = static_cast<minfs_extent_block_t*>((*blk_out)->data());
+    eb->magic = kMinfsMagicExtents;
+    inode->block_count++;
+    return NO_ERROR;
+}
+
+static mx_status_t extent_block_get(Bcache* bc, const minfs_extent_t* idx,
+                                    mxtl::RefPtr<BlockNode>* blk_out) {
+    if (idx->count > kMinfsBlockExtents) {
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    if ((*blk_out = bc->Get(idx->bno)) == nullptr) {
+        return ERR_IO;
+    }
+    if (static_cast<minfs_extent_block_t*>((*blk_out)->data())->magic != kMinfsMagicExtents) {
+        bc->Put(*blk_out, 0);
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t minfs_extent_lookup(Bcache* bc, const minfs_inode_t* inode, uint32_t fbn,
+                                uint32_t* bno_out, uint32_t* count_out) {
+    if (fbn >= kMinfsMaxFileBlock) {
+        return ERR_OUT_OF_RANGE;
+    }
+    if (inode->extent_count > kMinfsInodeExtents) {
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    uint32_t count;
+    if (count_out == nullptr) {
+        count_out = &count;
+    }
+    if (inode->extent_depth == 0) {
+        extent_map(inode->extents, inode->extent_count, kMinfsMaxFileBlock,
+                   fbn, bno_out, count_out);
+        return NO_ERROR;
+    }
+
+    int i = extent_find(inode->extents, inode->extent_count, fbn);
+    if (i < 0) {
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    const minfs_extent_t* idx = &inode->extents[i];
+    uint32_t limit = (static_cast<uint32_t>(i + 1) < inode->extent_count) ?
+                     inode->extents[i + 1].fbn : kMinfsMaxFileBlock;
+    mx_status_t status;
+    mxtl::RefPtr<BlockNode> blk;
+    if ((status = extent_block_get(bc, idx, &blk)) != NO_ERROR) {
+        return status;
+    }
+    const minfs_extent_block_t* eb = static_cast<minfs_extent_block_t*>(blk->data());
+    extent_map(eb->extents, idx->count, limit, fbn, bno_out, count_out);
+    bc->Put(blk, 0);
+    return NO_ERROR;
+}
+
+// Move the inode's own extents out into an extent block, and index it.
+static mx_status_t extent_grow(Minfs* fs, minfs_inode_t* inode) {
+    mx_status_t status;
+    uint32_t bno;
+    mxtl::RefPtr<BlockNode> blk;
+    if ((status = extent_block_new(fs, inode, &bno, &blk)) != NO_ERROR) {
+        return status;
+    }
+    minfs_extent_block_t* eb = static_cast<minfs_extent_block_t*>(blk->data());
+    memcpy(eb->extents, inode->extents, inode->extent_count * sizeof(minfs_extent_t));
+    fs->bc->Put(blk, kBlockDirty);
+
+    uint32_t count = inode->extent_count;
+    memset(inode->extents, 0, sizeof(inode->extents));
+    inode->extents[0].fbn = 0;
+    inode->extents[0].bno = bno;
+    inode->extents[0].count = count;
+    inode->extent_count = 1;
+    inode->extent_depth = 1;
+    return NO_ERROR;
+}
+
+static mx_status_t extent_insert_indexed(Minfs* fs, minfs_inode_t* inode, uint32_t fbn,
+                                         uint32_t bno, uint32_t count) {
+    int i = extent_find(inode->extents, inode->extent_count, fbn);
+    if (i < 0) {
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    minfs_extent_t* idx = &inode->extents[i];
+
+    mx_status_t status;
+    mxtl::RefPtr<BlockNode> blk;
+    if ((status = extent_block_get(fs->bc, idx, &blk)) != NO_ERROR) {
+        return status;
+    }
+    minfs_extent_block_t* eb = static_cast<minfs_extent_block_t*>(blk->data());
+    status = extent_add(eb->extents, &idx->count, kMinfsBlockExtents, fbn, bno, count);
+    if (status != ERR_NO_SPACE) {
+        fs->bc->Put(blk, (status == NO_ERROR) ? kBlockDirty : 0);
+        return status;
+    }
+
+    // The extent block is full, so split it. Appending to it starts a new
+    // one instead, so files written in order leave full blocks behind.
+    if (inode->extent_count == kMinfsInodeExtents) {
+        fs->bc->Put(blk, 0);
+        return ERR_NO_SPACE;
+    }
+    uint32_t new_bno;
+    mxtl::RefPtr<BlockNode> new_blk;
+    if ((status = extent_block_new(fs, inode, &new_bno, &new_blk)) != NO_ERROR) {
+        fs->bc->Put(blk, 0);
+        return status;
+    }
+    minfs_extent_block_t* new_eb = static_cast<minfs_extent_block_t*>(new_blk->data());
+    uint32_t p = static_cast<uint32_t>(extent_find(eb->extents, idx->count, fbn) + 1);
+    uint32_t keep = (p == idx->count) ? idx->count : idx->count / 2;
+    uint32_t moved = idx->count - keep;
+    memcpy(new_eb->extents, eb->extents + keep, moved * sizeof(minfs_extent_t));
+    memset(eb->extents + keep, 0, moved * sizeof(minfs_extent_t));
+    idx->count = keep;
+
+    memmove(idx + 2, idx + 1, (inode->extent_count - i - 1) * sizeof(minfs_extent_t));
+    inode->extent_count++;
+    minfs_extent_t* new_idx = idx + 1;
+    new_idx->fbn = moved ? new_eb->extents[0].fbn : fbn;
+    new_idx->bno = new_bno;
+    new_idx->count = moved;
+
+    if (fbn >= new_idx->fbn) {
+        status = extent_add(new_eb->extents, &new_idx->count, kMinfsBlockExtents,
+                            fbn, bno, count);
+    } else {
+        status = extent_add(eb->extents, &idx->count, kMinfsBlockExtents, fbn, bno, count);
+    }
+    assert(status == NO_ERROR);
+    fs->bc->Put(blk, kBlockDirty);
+    fs->bc->Put(new_blk, kBlockDirty);
+    return status;
+}
+
+mx_status_t minfs_extent_insert(Minfs* fs, minfs_inode_t* inode, uint32_t fbn,
+                                uint32_t bno, uint32_t count) {
+    mx_status_t status;
+    if (inode->extent_count > kMinfsInodeExtents) {
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    if (inode->extent_depth == 0) {
+        status = extent_add(inode->extents, &inode->extent_count, kMinfsInodeExtents,
+                            fbn, bno, count);
+        if (status != ERR_NO_SPACE) {
+            if (status == NO_ERROR) {
+                inode->block_count += count;
+            }
+            return status;
+        }
+        if ((status = extent_grow(fs, inode)) != NO_ERROR) {
+            return status;
+        }
+    }
+    if ((status = extent_insert_indexed(fs, inode, fbn, bno, count)) == NO_ERROR) {
+        inode->block_count += count;
+    }
+    return status;
+}
+
+// Bring the extents back into the inode once they fit there again.
+static mx_status_t extent_shrink(Minfs* fs, mxtl::RefPtr<BlockNode>* bitmap_blk,
+                                 minfs_inode_t* inode) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < inode->extent_count; i++) {
+        total += inode->extents[i].count;
+    }
+    if (total > kMinfsInodeExtents) {
+        return NO_ERROR;
+    }
+
+    mx_status_t status;
+    minfs_extent_t ext[kMinfsInodeExtents];
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < inode->extent_count; i++) {
+        mxtl::RefPtr<BlockNode> blk;
+        if ((status = extent_block_get(fs->bc, &inode->extents[i], &blk)) != NO_ERROR) {
+            return status;
+        }
+        const minfs_extent_block_t* eb = static_cast<minfs_extent_block_t*>(blk->data());
+        memcpy(ext + count, eb->extents, inode->extents[i].count * sizeof(minfs_extent_t));
+        count += inode->extents[i].count;
+        fs->bc->Put(blk, 0);
+    }
+    for (uint32_t i = 0; i < inode->extent_count; i++) {
+        if ((status = blocks_free(fs, bitmap_blk, inode->extents[i].bno, 1)) != NO_ERROR) {
+            return status;
+        }
+        inode->block_count--;
+    }
+
+    memset(inode->extents, 0, sizeof(inode->extents));
+    memcpy(inode->extents, ext, count * sizeof(minfs_extent_t));
+    inode->extent_count = count;
+    inode->extent_depth = 0;
+    return NO_ERROR;
+}
+
+static mx_status_t extent_truncate(Minfs* fs, mxtl::RefPtr<BlockNode>* bitmap_blk,
+                                   minfs_inode_t* inode, uint32_t start) {
+    mx_status_t status;
+    uint32_t freed = 0;
+    if (inode->extent_count > kMinfsInodeExtents) {
+        return ERR_IO_DATA_INTEGRITY;
+    }
+    if (inode->extent_depth == 0) {
+        status = extent_trim(fs, bitmap_blk, inode->extents, &inode->extent_count,
+                             start, &freed);
+        inode->block_count -= freed;
+        return status;
+    }
+
+    // Only the extent block covering 'start' and the ones after it change.
+    while (inode->extent_count > 0) {
+        minfs_extent_t* idx = &inode->extents[inode->extent_count - 1];
+        mxtl::RefPtr<BlockNode> blk;
+        if ((status = extent_block_get(fs->bc, idx, &blk)) != NO_ERROR) {
+            return status;
+        }
+        minfs_extent_block_t* eb = static_cast<minfs_extent_block_t*>(blk->data());
+        uint32_t before = idx->count;
+        status = extent_trim(fs, bitmap_blk, eb->extents, &idx->count, start, &freed);
+        inode->block_count -= freed;
+        freed = 0;
+        fs->bc->Put(blk, (idx->count != before) ? kBlockDirty : 0);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        bool last = (idx->fbn <= start);
+        if (idx->count == 0) {
+            if ((status = blocks_free(fs, bitmap_blk, idx->bno, 1)) != NO_ERROR) {
+                return status;
+            }
+            inode->block_count--;
+            memset(idx, 0, sizeof(minfs_extent_t));
+            inode->extent_count--;
+        }
+        if (last) {
+            break;
+        }
+    }
+    return extent_shrink(fs, bitmap_blk, inode);
+}
+
+mx_status_t minfs_extent_truncate(Minfs* fs, minfs_inode_t* inode, uint32_t start) {
+    mxtl::RefPtr<BlockNode> bitmap_blk;
+    mx_status_t status = extent_truncate(fs, &bitmap_blk, inode, start);
+    fs->BitmapBlockPut(bitmap_blk);
+    return status;
+}
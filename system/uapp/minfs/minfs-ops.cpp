@@ -64,8 +64,7 @@ mxtl::RefPtr<BlockNode> Minfs::BitmapBlockGet(const mxtl::RefPtr<BlockNode>& blk
             return blk;
         }
         // write previous block to disk
-        const void* src = block_map.GetBlock(bitblock_old);
-        memcpy(blk->data(), src, kMinfsBlockSize);
+        BitmapBlockCopy(blk->data(), bitblock_old);
         bc->Put(blk, kBlockDirty);
     }
     return mxtl::RefPtr<BlockNode>(bc->Get(info.abm_block + bitblock));
@@ -74,8 +73,7 @@ mxtl::RefPtr<BlockNode> Minfs::BitmapBlockGet(const mxtl::RefPtr<BlockNode>& blk
 void Minfs::BitmapBlockPut(const mxtl::RefPtr<BlockNode>& blk) {
     if (blk) {
         uint32_t bitblock = blk->GetKey() - info.abm_block;
-        const void* src = block_map.GetBlock(bitblock);
-        memcpy(blk->data(), src, kMinfsBlockSize);
+        BitmapBlockCopy(blk->data(), bitblock);
         bc->Put(blk, kBlockDirty);
     }
 }
@@ -95,238 +93,227 @@ static mx_status_t minfs_inode_destroy(vnode_t* vn) {
 // Delete all blocks (relative to a file) from "start" (inclusive) to the end of
 // the file. Does not update mtime/atime.
 static mx_status_t vn_blocks_shrink(vnode_t* vn, uint32_t start) {
-    mxtl::RefPtr<BlockNode> bitmap_blk = nullptr;
+    mx_status_t status = minfs_extent_truncate(vn->fs, &vn->inode, start);
+    minfs_sync_vnode(vn, kMxFsSyncDefault);
+    return status;
+}
 
-    // release direct blocks
-    for (unsigned bno = start; bno < kMinfsDirect; bno++) {
-        if (vn->inode.dnum[bno] == 0) {
-            continue;
-        }
-        if ((bitmap_blk = vn->fs->BitmapBlockGet(bitmap_blk, vn->inode.dnum[bno])) == nullptr) {
-            return ERR_IO;
-        }
+// Get the bno corresponding to the nth logical block within the file, or 0
+// if that block is a hole.
+static mx_status_t vn_get_bno(vnode_t* vn, uint32_t n, uint32_t* bno) {
+    return minfs_extent_lookup(vn->fs->bc, &vn->inode, n, bno, nullptr);
+}
 
-        vn->fs->block_map.Clr(vn->inode.dnum[bno]);
-        vn->inode.dnum[bno] = 0;
-        vn->inode.block_count--;
-        minfs_sync_vnode(vn, kMxFsSyncDefault);
+// Get the bno backing the nth logical block within the file, allocating it
+// if necessary. A new allocation takes a contiguous run of up to 'want'
+// blocks, which back the file blocks from n on.
+static mx_status_t vn_alloc_bno(vnode_t* vn, uint32_t n, uint32_t want, uint32_t* bno) {
+    mx_status_t status;
+    uint32_t hole;
+    if ((status = minfs_extent_lookup(vn->fs->bc, &vn->inode, n, bno, &hole)) != NO_ERROR) {
+        return status;
+    } else if (*bno != 0) {
+        return NO_ERROR;
+    }
+    if (want > hole) {
+        want = hole;
     }
 
-    const unsigned direct_per_indirect = kMinfsBlockSize / sizeof(uint32_t);
+    // try to carry on from the block before this one
+    uint32_t hint = 0;
+    if ((n > 0) && (vn_get_bno(vn, n - 1, &hint) == NO_ERROR) && (hint != 0)) {
+        hint++;
+    }
+    uint32_t count;
+    if ((status = vn->fs->BlocksNew(hint, want, bno, &count)) != NO_ERROR) {
+        return status;
+    }
+    if ((status = minfs_extent_insert(vn->fs, &vn->inode, n, *bno, count)) != NO_ERROR) {
+        // the extent map has no room for the run; give it back
+        vn->fs->BlocksFree(*bno, count);
+        minfs_sync_vnode(vn, kMxFsSyncDefault);
+        return status;
+    }
+    minfs_sync_vnode(vn, kMxFsSyncDefault);
+    return NO_ERROR;
+}
 
-    // release indirect blocks
-    for (unsigned indirect = 0; indirect < kMinfsIndirect; indirect++) {
-        if (vn->inode.inum[indirect] == 0) {
-            continue;
-        }
-        unsigned bno = kMinfsDirect + (indirect + 1) * direct_per_indirect;
-        if (start > bno) {
-            continue;
-        }
-        mxtl::RefPtr<BlockNode> blk = nullptr;
-        if ((blk = vn->fs->bc->Get(vn->inode.inum[indirect])) == nullptr) {
-            vn->fs->BitmapBlockPut(bitmap_blk);
-            return ERR_IO;
-        }
-        uint32_t* entry = static_cast<uint32_t*>(blk->data());
-        uint32_t iflags = 0;
-        bool delete_indirect = true; // can we delete the indirect block?
-        // release the blocks pointed at by the entries in the indirect block
-        for (unsigned direct = 0; direct < direct_per_indirect; direct++) {
-            if (entry[direct] == 0) {
-                continue;
-            }
-            unsigned bno = kMinfsDirect + indirect * direct_per_indirect + direct;
-            if (start > bno) {
-                // This is a valid entry which exists in the indirect block
-                // BEFORE our truncation point. Don't delete it, and don't
-                // delete the indirect block.
-                delete_indirect = false;
-                continue;
-            }
+#ifdef __Fuchsia__
+static bool vn_block_loaded(const vnode_t* vn, uint32_t n) {
+    return (vn->vmo_loaded[n / 64] & (1ULL << (n % 64))) != 0;
+}
 
-            if ((bitmap_blk = vn->fs->BitmapBlockGet(bitmap_blk, entry[direct])) == nullptr) {
-                vn->fs->bc->Put(blk, iflags);
-                return ERR_IO;
-            }
-            vn->fs->block_map.Clr(entry[direct]);
-            entry[direct] = 0;
-            iflags = kBlockDirty;
-            vn->inode.block_count--;
-        }
-        // only update the indirect block if an entry was deleted
-        if (iflags & kBlockDirty) {
-            minfs_sync_vnode(vn, kMxFsSyncDefault);
-        }
-        vn->fs->bc->Put(blk, iflags);
+static void vn_set_loaded(vnode_t* vn, uint32_t n) {
+    vn->vmo_loaded[n / 64] |= (1ULL << (n % 64));
+}
 
-        if (delete_indirect)  {
-            // release the direct block itself
-            bitmap_blk = vn->fs->BitmapBlockGet(bitmap_blk, vn->inode.inum[indirect]);
-            if (bitmap_blk == nullptr) {
-                return ERR_IO;
-            }
-            vn->fs->block_map.Clr(vn->inode.inum[indirect]);
-            vn->inode.inum[indirect] = 0;
-            vn->inode.block_count--;
-            minfs_sync_vnode(vn, kMxFsSyncDefault);
+// Make room to track 'count' blocks of the VMO. Newly covered bits are clear.
+static mx_status_t vn_loaded_reserve(vnode_t* vn, uint32_t count) {
+    size_t words = (count + 63) / 64;
+    size_t old_words = (vn->vmo_loaded_count + 63) / 64;
+    if (words > old_words) {
+        uint64_t* loaded = static_cast<uint64_t*>(realloc(vn->vmo_loaded,
+                                                          words * sizeof(uint64_t)));
+        if (loaded == nullptr) {
+            return ERR_NO_MEMORY;
         }
+        memset(loaded + old_words, 0, (words - old_words) * sizeof(uint64_t));
+        vn->vmo_loaded = loaded;
     }
-
-    vn->fs->BitmapBlockPut(bitmap_blk);
     return NO_ERROR;
 }
 
-#ifdef __Fuchsia__
-// Read data from disk at block 'bno', into the 'nth' logical block of the file.
-static mx_status_t vn_fill_block(vnode_t* vn, uint32_t n, uint32_t bno) {
-    // TODO(smklein): read directly from block device into vmo; no need to copy
-    // into an intermediate buffer.
-    char bdata[kMinfsBlockSize];
-    if (vn->fs->bc->Readblk(bno, bdata)) {
-        return ERR_IO;
+// Resize the VMO, along with the record of which of its blocks are loaded.
+// Blocks past the old end count as loaded, since they are zero in the VMO
+// and not allocated on disk.
+static mx_status_t vn_set_vmo_size(vnode_t* vn, size_t size) {
+    uint32_t count = static_cast<uint32_t>(ROUNDUP(size, kMinfsBlockSize) / kMinfsBlockSize);
+    mx_status_t status;
+    if ((status = vn_loaded_reserve(vn, count)) != NO_ERROR) {
+        return status;
     }
-    mx_status_t status = vmo_write_exact(vn->vmo, bdata, n * kMinfsBlockSize, kMinfsBlockSize);
-    if (status != NO_ERROR) {
+    if ((status = mx_vmo_set_size(vn->vmo, count * kMinfsBlockSize)) != NO_ERROR) {
         return status;
     }
+    for (uint32_t n = vn->vmo_loaded_count; n < count; n++) {
+        vn_set_loaded(vn, n);
+    }
+    vn->vmo_loaded_count = count;
     return NO_ERROR;
 }
 
-// Since we cannot yet register the filesystem as a paging service (and cleanly
-// fault on pages when they are actually needed), we currently read an entire
-// file to a VMO when a file's data block are accessed.
-//
-// TODO(smklein): Even this hack can be optimized; a bitmap could be used to
-// track all 'empty/read/dirty' blocks for each vnode, rather than reading
-// the entire file.
+// Create the VMO backing a file's data. Nothing is read from disk here;
+// vn_fill_blocks() brings blocks in as they are touched.
 static mx_status_t vn_init_vmo(vnode_t* vn) {
     if (vn->vmo != MX_HANDLE_INVALID) {
         return NO_ERROR;
     }
 
     mx_status_t status;
-    if ((status = mx_vmo_create(ROUNDUP(vn->inode.size, kMinfsBlockSize), 0, &vn->vmo)) != NO_ERROR) {
-        error("Failed to initialize vmo; error: %d\n", status);
+    uint32_t count = static_cast<uint32_t>(ROUNDUP(vn->inode.size, kMinfsBlockSize) /
+                                           kMinfsBlockSize);
+    if ((status = vn_loaded_reserve(vn, count)) != NO_ERROR) {
         return status;
     }
-
-    // Initialize all direct blocks
-    uint32_t bno;
-    for (uint32_t d = 0; d < kMinfsDirect; d++) {
-        if ((bno = vn->inode.dnum[d]) != 0) {
-            if ((status = vn_fill_block(vn, d, bno)) != NO_ERROR) {
-                error("Failed to fill bno %u; error: %d\n", bno, status);
-                return status;
-            }
-        }
-    }
-
-    // Initialize all indirect blocks
-    for (uint32_t i = 0; i < kMinfsIndirect; i++) {
-        uint32_t ibno;
-        mxtl::RefPtr<BlockNode> iblk;
-        if ((ibno = vn->inode.inum[i]) != 0) {
-            // TODO(smklein): Should there be a separate vmo for indirect blocks?
-            if ((iblk = vn->fs->bc->Get(ibno)) == nullptr) {
-                return ERR_IO;
-            }
-            uint32_t* ientry = static_cast<uint32_t*>(iblk->data());
-
-            const uint32_t direct_per_indirect = kMinfsBlockSize / sizeof(uint32_t);
-            for (uint32_t j = 0; j < direct_per_indirect; j++) {
-                if ((bno = ientry[j]) != 0) {
-                    uint32_t n = kMinfsDirect + i * direct_per_indirect + j;
-                    if ((status = vn_fill_block(vn, n, bno)) != NO_ERROR) {
-                        vn->fs->bc->Put(iblk, 0);
-                        return status;
-                    }
-                }
-            }
-            vn->fs->bc->Put(iblk, 0);
-        }
+    if ((status = mx_vmo_create(count * kMinfsBlockSize, 0, &vn->vmo)) != NO_ERROR) {
+        error("Failed to initialize vmo; error: %d\n", status);
+        return status;
     }
-
+    vn->vmo_loaded_count = count;
     return NO_ERROR;
 }
-#endif
 
-// Get the bno corresponding to the nth logical block within the file.
-static mx_status_t vn_get_bno(vnode_t* vn, uint32_t n, uint32_t* bno, bool alloc) {
-    uint32_t hint = 0;
-    // direct blocks are simple... is there an entry in dnum[]?
-    if (n < kMinfsDirect) {
-        if (((*bno = vn->inode.dnum[n]) == 0) && alloc) {
-            mx_status_t status = vn->fs->BlockNew(hint, bno, nullptr);
-            if (status != NO_ERROR) {
-                return status;
-            }
-            vn->inode.dnum[n] = *bno;
-            vn->inode.block_count++;
-            minfs_sync_vnode(vn, kMxFsSyncDefault);
-        }
-        return NO_ERROR;
+// Read the blocks in [start, end) that are not in the VMO yet from disk.
+// Runs of allocated blocks go into the VMO with a single write; holes are
+// already zero there, and are left uncommitted.
+static mx_status_t vn_fill_blocks(vnode_t* vn, uint32_t start, uint32_t end) {
+    if (end > vn->vmo_loaded_count) {
+        end = vn->vmo_loaded_count;
     }
-
-    // for indirect blocks, adjust past the direct blocks
-    n -= kMinfsDirect;
-
-    // determine indices into the indirect block list and into
-    // the block list in the indirect block
-    uint32_t i = static_cast<uint32_t>(n / (kMinfsBlockSize / sizeof(uint32_t)));
-    uint32_t j = n % (kMinfsBlockSize / sizeof(uint32_t));
-
-    if (i >= kMinfsIndirect) {
-        return ERR_OUT_OF_RANGE;
+    if (start >= end) {
+        return NO_ERROR;
     }
 
-    uint32_t ibno;
-    mxtl::RefPtr<BlockNode> iblk;
-    uint32_t iflags = 0;
+    // TODO(smklein): read directly from block device into vmo; no need to copy
+    // into an intermediate buffer.
+    const uint32_t max_run = (end - start) < kMinfsReadAheadMax ? (end - start) : kMinfsReadAheadMax;
+    mxtl::unique_free_ptr<char> buf;
+    uint32_t run_start = start;
+    uint32_t run = 0;
 
-    // look up the indirect bno
-    if ((ibno = vn->inode.inum[i]) == 0) {
-        if (!alloc) {
-            *bno = 0;
+    auto flush = [vn, &buf, &run_start, &run]() -> mx_status_t {
+        if (run == 0) {
             return NO_ERROR;
         }
-        // allocate a new indirect block
-        mx_status_t status = vn->fs->BlockNew(0, &ibno, &iblk);
+        mx_status_t status = vmo_write_exact(vn->vmo, buf.get(), run_start * kMinfsBlockSize,
+                                             run * kMinfsBlockSize);
         if (status != NO_ERROR) {
             return status;
         }
-        // record new indirect block in inode, note that we need to update
-        vn->inode.block_count++;
-        vn->inode.inum[i] = ibno;
-        iflags = kBlockDirty;
-    } else {
-        if ((iblk = vn->fs->bc->Get(ibno)) == nullptr) {
+        for (uint32_t n = run_start; n < run_start + run; n++) {
+            vn_set_loaded(vn, n);
+        }
+        run = 0;
+        return NO_ERROR;
+    };
+
+    // the extent last looked up: 'map_count' blocks from 'map_n' on
+    uint32_t map_n = 0;
+    uint32_t map_bno = 0;
+    uint32_t map_count = 0;
+
+    mx_status_t status;
+    for (uint32_t n = start; n < end; n++) {
+        if (vn_block_loaded(vn, n)) {
+            if ((status = flush()) != NO_ERROR) {
+                return status;
+            }
+            continue;
+        }
+        if ((n < map_n) || (n - map_n >= map_count)) {
+            map_n = n;
+            if ((status = minfs_extent_lookup(vn->fs->bc, &vn->inode, n, &map_bno,
+                                              &map_count)) != NO_ERROR) {
+                return status;
+            }
+        }
+        uint32_t bno = map_bno ? map_bno + (n - map_n) : 0;
+        if (bno == 0) {
+            if ((status = flush()) != NO_ERROR) {
+                return status;
+            }
+            vn_set_loaded(vn, n);
+            continue;
+        }
+        if (buf == nullptr) {
+            buf.reset(static_cast<char*>(malloc(max_run * kMinfsBlockSize)));
+            if (buf == nullptr) {
+                return ERR_NO_MEMORY;
+            }
+        }
+        if (run == 0) {
+            run_start = n;
+        }
+        if (vn->fs->bc->Readblk(bno, buf.get() + run * kMinfsBlockSize)) {
+            error("Failed to fill bno %u\n", bno);
             return ERR_IO;
         }
+        if (++run == max_run) {
+            if ((status = flush()) != NO_ERROR) {
+                return status;
+            }
+        }
     }
-    uint32_t* ientry = static_cast<uint32_t*>(iblk->data());
+    return flush();
+}
 
-    if (((*bno = ientry[j]) == 0) && alloc) {
-        // allocate a new block
-        mx_status_t status = vn->fs->BlockNew(hint, bno, nullptr);
-        if (status != NO_ERROR) {
-            vn->fs->bc->Put(iblk, iflags);
-            return status;
+// Make sure the blocks backing [off, off + len) are in the VMO. A read which
+// starts where the previous one stopped also pulls in a read-ahead window,
+// which grows while the file is read sequentially.
+static mx_status_t vn_fill_range(vnode_t* vn, size_t off, size_t len) {
+    uint32_t start = static_cast<uint32_t>(off / kMinfsBlockSize);
+    uint32_t end = static_cast<uint32_t>(ROUNDUP(off + len, kMinfsBlockSize) / kMinfsBlockSize);
+
+    if (start == vn->readahead_next) {
+        if (vn->readahead_window < kMinfsReadAheadMin) {
+            vn->readahead_window = kMinfsReadAheadMin;
+        } else if (vn->readahead_window < kMinfsReadAheadMax) {
+            vn->readahead_window *= 2;
         }
-        vn->inode.block_count++;
-        ientry[j] = *bno;
-        iflags = kBlockDirty;
+    } else {
+        vn->readahead_window = 0;
     }
+    vn->readahead_next = static_cast<uint32_t>((off + len) / kMinfsBlockSize);
 
-    // release indirect block, updating if necessary
-    // and update the inode as well if we changed it
-    vn->fs->bc->Put(iblk, iflags);
-    if (iflags & kBlockDirty) {
-        minfs_sync_vnode(vn, kMxFsSyncDefault);
+    // Only read ahead once the window has been used up.
+    uint32_t fill_end = end;
+    if (vn->readahead_window && (end <= vn->vmo_loaded_count) &&
+        !vn_block_loaded(vn, end - 1)) {
+        fill_end = end + vn->readahead_window;
     }
-
-    return NO_ERROR;
+    return vn_fill_blocks(vn, start, fill_end);
 }
+#endif
 
 // Immediately stop iterating over the directory.
 #define DIR_CB_DONE 0
@@ -335,6 +322,21 @@ static mx_status_t vn_get_bno(vnode_t* vn, uint32_t n, uint32_t* bno, bool alloc
 // Identify that the direntry record was modified. Stop iterating.
 #define DIR_CB_SAVE_SYNC 2
 
+// Directory contents are metadata, so they go through the block cache and
+// its journal. File data is written straight to disk.
+static mx_status_t vn_write_block(vnode_t* vn, uint32_t bno, const void* data) {
+    if (!VNODE_IS_DIR(vn)) {
+        return vn->fs->bc->Writeblk(bno, data);
+    }
+    mxtl::RefPtr<BlockNode> blk = vn->fs->bc->GetZero(bno);
+    if (blk == nullptr) {
+        return ERR_IO;
+    }
+    memcpy(blk->data(), data, kMinfsBlockSize);
+    vn->fs->bc->Put(mxtl::move(blk), kBlockDirty);
+    return NO_ERROR;
+}
+
 static mx_status_t _fs_read(vnode_t* vn, void* data, size_t len, size_t off, size_t* actual);
 static mx_status_t _fs_write(vnode_t* vn, const void* data, size_t len, size_t off, size_t* actual);
 static mx_status_t _fs_truncate(vnode_t* vn, size_t len);
@@ -367,6 +369,7 @@ typedef struct dir_args {
     uint32_t ino;
     uint32_t type;
     uint32_t reclen;
+    size_t off;      // Set by cb_dir_append to where it put the new dirent
 } dir_args_t;
 
 typedef struct de_off {
@@ -478,14 +481,18 @@ static mx_status_t do_unlink(vnode_t* vndir, vnode_t* vn, minfs_dirent_t* de,
     de->ino = 0;
     de->reclen = static_cast<uint32_t>(coalesced_size & kMinfsReclenMask) |
         (de->reclen & kMinfsReclenLast);
+    if (de->reclen & kMinfsReclenLast) {
+        vndir->inode.dir_tail = static_cast<uint32_t>(off);
+    }
     mx_status_t status = _fs_write_exact(vndir, de, MINFS_DIRENT_SIZE, off);
     if (status != NO_ERROR) {
         return status;
     }
 
-    if (de->reclen & kMinfsReclenLast) {
+    if ((de->reclen & kMinfsReclenLast) && (vndir->inode.dir_hash_slots == 0)) {
         // Truncating the directory merely removed unused space; if it fails,
-        // the directory contents are still valid.
+        // the directory contents are still valid. Indexed directories keep
+        // their index past the dirents, so they are not truncated.
         _fs_truncate(vndir, off + MINFS_DIRENT_SIZE);
     }
 
@@ -608,6 +615,10 @@ static mx_status_t fill_dirent(vnode_t* vndir, minfs_dirent_t* de,
     de->namelen = static_cast<uint8_t>(args->len);
     memcpy(de->name, args->name, args->len);
     vndir->inode.dirent_count++;
+    if (de->reclen & kMinfsReclenLast) {
+        vndir->inode.dir_tail = static_cast<uint32_t>(off);
+    }
+    args->off = off;
     mx_status_t status = _fs_write_exact(vndir, de, DirentSize(de->namelen), off);
     if (status != NO_ERROR) {
         return status;
@@ -698,15 +709,264 @@ static mx_status_t vn_dir_for_each(vnode_t* vn, dir_args_t* args,
     return ERR_NOT_FOUND;
 }
 
+// Read the dirent at 'off' of 'vndir' into 'de', which must have room for
+// kMinfsMaxDirentSize bytes.
+static mx_status_t dir_read_dirent(vnode_t* vndir, minfs_dirent_t* de, size_t off) {
+    size_t r;
+    mx_status_t status = _fs_read(vndir, de, kMinfsMaxDirentSize, off, &r);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    return validate_dirent(de, r, off);
+}
+
+static size_t dir_hash_slot_off(uint32_t slot) {
+    return kMinfsDirHashOffset + slot * sizeof(minfs_dirhash_t);
+}
+
+// (Re)build the hash index of 'vndir' from its dirents, with room for the
+// directory to double before it needs doing again.
+static mx_status_t dir_hash_rebuild(vnode_t* vndir) {
+    uint32_t slots = kMinfsDirHashMinSlots;
+    while ((slots < kMinfsDirHashMaxSlots) && (slots < 4 * (vndir->inode.dirent_count + 1))) {
+        slots *= 2;
+    }
+    minfs_dirhash_t* table = (minfs_dirhash_t*)calloc(slots, sizeof(minfs_dirhash_t));
+    if (table == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    uint32_t mask = slots - 1;
+    uint32_t used = 0;
+    size_t off = 0;
+    mx_status_t status;
+    while (true) {
+        if ((status = dir_read_dirent(vndir, de, off)) != NO_ERROR) {
+            goto done;
+        }
+        if (de->ino != 0) {
+            if (++used > slots / 2) {
+                error("minfs: ino#%u: too many dirents to index\n", vndir->ino);
+                status = ERR_IO;
+                goto done;
+            }
+            uint32_t hash = MinfsDirHash(de->name, de->namelen);
+            uint32_t slot = hash & mask;
+            while (table[slot].hash != kMinfsDirHashFree) {
+                slot = (slot + 1) & mask;
+            }
+            table[slot].hash = hash;
+            table[slot].off = static_cast<uint32_t>(off);
+        }
+        if (de->reclen & kMinfsReclenLast) {
+            break;
+        }
+        off += MinfsReclen(de, off);
+    }
+
+    if ((status = _fs_write_exact(vndir, table, slots * sizeof(minfs_dirhash_t),
+                                  kMinfsDirHashOffset)) != NO_ERROR) {
+        goto done;
+    }
+    if (vndir->inode.size > dir_hash_slot_off(slots)) {
+        // drop what is left of a larger index
+        _fs_truncate(vndir, dir_hash_slot_off(slots));
+    }
+    trace(MINFS, "dir_hash_rebuild() vn=%p(#%u) %u dirents, %u slots\n",
+          vndir, vndir->ino, used, slots);
+    vndir->inode.dir_hash_slots = slots;
+    vndir->inode.dir_hash_deleted = 0;
+    vndir->inode.dir_tail = static_cast<uint32_t>(off);
+    minfs_sync_vnode(vndir, kMxFsSyncDefault);
+done:
+    free(table);
+    return status;
+}
+
+// Give up on the hash index of 'vndir', which goes back to being searched
+// linearly. Used when the index can no longer be kept up to date.
+static void dir_hash_drop(vnode_t* vndir) {
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    size_t off = vndir->inode.dir_tail;
+
+    warn("minfs: ino#%u: dropping directory index\n", vndir->ino);
+    vndir->inode.dir_hash_slots = 0;
+    vndir->inode.dir_hash_deleted = 0;
+    if (dir_read_dirent(vndir, de, off) == NO_ERROR) {
+        _fs_truncate(vndir, off + (de->ino ? DirentSize(de->namelen) : MINFS_DIRENT_SIZE));
+    }
+    minfs_sync_vnode(vndir, kMxFsSyncDefault);
+}
+
+// Find 'name' through the hash index of 'vndir'. On success its dirent is
+// read into 'de', and 'off' and 'slot' say where the dirent and its index
+// slot are.
+static mx_status_t dir_hash_find(vnode_t* vndir, const char* name, size_t len,
+                                 minfs_dirent_t* de, size_t* off, uint32_t* slot) {
+    uint32_t hash = MinfsDirHash(name, len);
+    uint32_t mask = vndir->inode.dir_hash_slots - 1;
+    uint32_t n = hash & mask;
+    for (uint32_t i = 0; i <= mask; i++, n = (n + 1) & mask) {
+        minfs_dirhash_t dh;
+        mx_status_t status;
+        if ((status = _fs_read_exact(vndir, &dh, sizeof(dh), dir_hash_slot_off(n))) != NO_ERROR) {
+            return status;
+        }
+        if (dh.hash == kMinfsDirHashFree) {
+            break;
+        } else if (dh.hash != hash) {
+            continue;
+        }
+        if ((status = dir_read_dirent(vndir, de, dh.off)) != NO_ERROR) {
+            return status;
+        }
+        if ((de->ino != 0) && (de->namelen == len) && !memcmp(de->name, name, len)) {
+            *off = dh.off;
+            *slot = n;
+            return NO_ERROR;
+        }
+    }
+    return ERR_NOT_FOUND;
+}
+
+// Add the dirent for 'name' at 'off', which is already in place, to the
+// hash index of 'vndir'.
+static mx_status_t dir_hash_insert(vnode_t* vndir, const char* name, size_t len, size_t off) {
+    if (2 * (vndir->inode.dirent_count + vndir->inode.dir_hash_deleted) >
+        vndir->inode.dir_hash_slots) {
+        return dir_hash_rebuild(vndir);
+    }
+
+    uint32_t hash = MinfsDirHash(name, len);
+    uint32_t mask = vndir->inode.dir_hash_slots - 1;
+    uint32_t n = hash & mask;
+    minfs_dirhash_t dh;
+    mx_status_t status;
+    while (true) {
+        if ((status = _fs_read_exact(vndir, &dh, sizeof(dh), dir_hash_slot_off(n))) != NO_ERROR) {
+            return status;
+        }
+        if (dh.hash == kMinfsDirHashDeleted) {
+            vndir->inode.dir_hash_deleted--;
+            break;
+        } else if (dh.hash == kMinfsDirHashFree) {
+            break;
+        }
+        n = (n + 1) & mask;
+    }
+    dh.hash = hash;
+    dh.off = static_cast<uint32_t>(off);
+    return _fs_write_exact(vndir, &dh, sizeof(dh), dir_hash_slot_off(n));
+}
+
+static mx_status_t dir_hash_remove(vnode_t* vndir, uint32_t slot) {
+    minfs_dirhash_t dh;
+    dh.hash = kMinfsDirHashDeleted;
+    dh.off = 0;
+    vndir->inode.dir_hash_deleted++;
+    return _fs_write_exact(vndir, &dh, sizeof(dh), dir_hash_slot_off(slot));
+}
+
+// Calls 'func' on the dirent named by 'args', as vn_dir_for_each would.
+// Directories with a hash index find it through that; if 'func' frees the
+// dirent, it is removed from the index as well.
+static mx_status_t vn_dir_lookup(vnode_t* vn, dir_args_t* args,
+                                 mx_status_t (*func)(vnode_t*, minfs_dirent_t*,
+                                                     dir_args_t*, de_off_t* offs)) {
+    if (vn->inode.dir_hash_slots == 0) {
+        return vn_dir_for_each(vn, args, func);
+    }
+
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    size_t off;
+    uint32_t slot;
+    mx_status_t status;
+    if ((status = dir_hash_find(vn, args->name, args->len, de, &off, &slot)) != NO_ERROR) {
+        return status;
+    }
+    // Without the previous dirent at hand, an unlink only coalesces the
+    // freed record with the next one.
+    de_off_t offs = {
+        .off = off,
+        .off_prev = off,
+    };
+    switch ((status = func(vn, de, args, &offs))) {
+    case DIR_CB_NEXT:
+        // 'func' disagrees that the names match
+        return ERR_IO;
+    case DIR_CB_SAVE_SYNC:
+        if ((de->ino == 0) && (dir_hash_remove(vn, slot) != NO_ERROR)) {
+            dir_hash_drop(vn);
+        }
+        vn->inode.seq_num++;
+        minfs_sync_vnode(vn, kMxFsSyncMtime);
+        return NO_ERROR;
+    case DIR_CB_DONE:
+    default:
+        return status;
+    }
+}
+
+// Add a dirent for 'args' to the directory 'vn', indexing the directory once
+// it has grown large enough. Indexed directories add it at the end if there
+// is room, and only search the rest for space otherwise.
+static mx_status_t vn_dir_append(vnode_t* vn, dir_args_t* args) {
+    mx_status_t status;
+    if (vn->inode.dir_hash_slots == 0) {
+        if ((status = vn_dir_for_each(vn, args, cb_dir_append)) < 0) {
+            return status;
+        }
+        if ((vn->inode.dirent_count >= kMinfsDirHashMinEntries) &&
+            (dir_hash_rebuild(vn) != NO_ERROR)) {
+            // The directory is still usable, just not indexed.
+            dir_hash_drop(vn);
+        }
+        return NO_ERROR;
+    }
+
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    de_off_t offs = {
+        .off = vn->inode.dir_tail,
+        .off_prev = vn->inode.dir_tail,
+    };
+    if ((status = dir_read_dirent(vn, de, offs.off)) != NO_ERROR) {
+        return status;
+    }
+    switch ((status = cb_dir_append(vn, de, args, &offs))) {
+    case DIR_CB_SAVE_SYNC:
+        vn->inode.seq_num++;
+        minfs_sync_vnode(vn, kMxFsSyncMtime);
+        break;
+    case DIR_CB_NEXT:
+        if ((status = vn_dir_for_each(vn, args, cb_dir_append)) < 0) {
+            return status;
+        }
+        break;
+    default:
+        return status;
+    }
+    if (dir_hash_insert(vn, args->name, args->len, args->off) != NO_ERROR) {
+        dir_hash_drop(vn);
+    }
+    return NO_ERROR;
+}
+
 static void fs_release(vnode_t* vn) {
     trace(MINFS, "minfs_release() vn=%p(#%u)%s\n", vn, vn->ino,
           vn->inode.link_count ? "" : " link-count is zero");
     if (vn->inode.link_count == 0) {
+        MinfsTxn txn(vn->fs->bc);
         minfs_inode_destroy(vn);
     }
     list_delete(&vn->hashnode);
 #ifdef __Fuchsia__
     mx_handle_close(vn->vmo);
+    free(vn->vmo_loaded);
 #endif
     free(vn);
 }
@@ -755,6 +1015,8 @@ static mx_status_t _fs_read(vnode_t* vn, void* data, size_t len, size_t off, siz
 #ifdef __Fuchsia__
     if ((status = vn_init_vmo(vn)) != NO_ERROR) {
         return status;
+    } else if ((status = vn_fill_range(vn, off, len)) != NO_ERROR) {
+        return status;
     } else if ((status = mx_vmo_read(vn->vmo, data, off, len, actual)) != NO_ERROR) {
         return status;
     }
@@ -763,6 +1025,11 @@ static mx_status_t _fs_read(vnode_t* vn, void* data, size_t len, size_t off, siz
     uint32_t n = off / kMinfsBlockSize;
     size_t adjust = off % kMinfsBlockSize;
 
+    // the extent last looked up: 'map_count' blocks from 'map_n' on
+    uint32_t map_n = 0;
+    uint32_t map_bno = 0;
+    uint32_t map_count = 0;
+
     while ((len > 0) && (n < kMinfsMaxFileBlock)) {
         size_t xfer;
         if (len > (kMinfsBlockSize - adjust)) {
@@ -771,10 +1038,14 @@ static mx_status_t _fs_read(vnode_t* vn, void* data, size_t len, size_t off, siz
             xfer = len;
         }
 
-        uint32_t bno;
-        if ((status = vn_get_bno(vn, n, &bno, false)) != NO_ERROR) {
-            return status;
+        if ((n < map_n) || (n - map_n >= map_count)) {
+            map_n = n;
+            if ((status = minfs_extent_lookup(vn->fs->bc, &vn->inode, n, &map_bno,
+                                              &map_count)) != NO_ERROR) {
+                return status;
+            }
         }
+        uint32_t bno = map_bno ? map_bno + (n - map_n) : 0;
         if (bno != 0) {
             char bdata[kMinfsBlockSize];
             if (vn->fs->bc->Readblk(bno, bdata)) {
@@ -801,6 +1072,7 @@ static ssize_t fs_write(vnode_t* vn, const void* data, size_t len, size_t off) {
     if (VNODE_IS_DIR(vn)) {
         return ERR_NOT_FILE;
     }
+    MinfsTxn txn(vn->fs->bc);
     size_t actual;
     mx_status_t status = _fs_write(vn, data, len, off, &actual);
     if (status != NO_ERROR) {
@@ -816,7 +1088,7 @@ static mx_status_t _fs_write(vnode_t* vn, const void* data, size_t len, size_t o
         return NO_ERROR;
     }
 
-    mx_status_t status;
+    mx_status_t status = NO_ERROR;
 #ifdef __Fuchsia__
     if ((status = vn_init_vmo(vn)) != NO_ERROR) {
         return status;
@@ -833,12 +1105,23 @@ static mx_status_t _fs_write(vnode_t* vn, const void* data, size_t len, size_t o
         } else {
             xfer = len;
         }
+        // blocks left to write, for allocating them together
+        uint32_t want = static_cast<uint32_t>((adjust + len + kMinfsBlockSize - 1) /
+                                              kMinfsBlockSize);
 
 #ifdef __Fuchsia__
+        // The rest of a partially written block has to come from disk first.
+        if (xfer != kMinfsBlockSize) {
+            if ((status = vn_fill_blocks(vn, n, n + 1)) != NO_ERROR) {
+                status = ERR_IO;
+                goto done;
+            }
+        }
+
         size_t xfer_off = n * kMinfsBlockSize + adjust;
         if ((xfer_off + xfer) > vn->inode.size) {
             size_t new_size = xfer_off + xfer;
-            if ((status = mx_vmo_set_size(vn->vmo, ROUNDUP(new_size, kMinfsBlockSize))) != NO_ERROR) {
+            if ((status = vn_set_vmo_size(vn, new_size)) != NO_ERROR) {
                 goto done;
             }
             vn->inode.size = static_cast<uint32_t>(new_size);
@@ -854,6 +1137,7 @@ static mx_status_t _fs_write(vnode_t* vn, const void* data, size_t len, size_t o
         if ((status = vmo_write_exact(vn->vmo, data, xfer_off, xfer)) != NO_ERROR) {
             return ERR_IO;
         }
+        vn_set_loaded(vn, n);
 
         // Update this block on-disk
         char bdata[kMinfsBlockSize];
@@ -866,16 +1150,16 @@ static mx_status_t _fs_write(vnode_t* vn, const void* data, size_t len, size_t o
         }
         const void* wdata = (xfer != kMinfsBlockSize) ? bdata : data;
         uint32_t bno;
-        if ((status = vn_get_bno(vn, n, &bno, true)) != NO_ERROR) {
+        if ((status = vn_alloc_bno(vn, n, want, &bno)) != NO_ERROR) {
             return status;
         }
         assert(bno != 0);
-        if (vn->fs->bc->Writeblk(bno, wdata)) {
+        if (vn_write_block(vn, bno, wdata)) {
             return ERR_IO;
         }
 #else
         uint32_t bno;
-        if ((status = vn_get_bno(vn, n, &bno, true)) != NO_ERROR) {
+        if ((status = vn_alloc_bno(vn, n, want, &bno)) != NO_ERROR) {
             goto done;
         }
         assert(bno != 0);
@@ -884,7 +1168,7 @@ static mx_status_t _fs_write(vnode_t* vn, const void* data, size_t len, size_t o
             return ERR_IO;
         }
         memcpy(wdata + adjust, data, xfer);
-        if (vn->fs->bc->Writeblk(bno, wdata)) {
+        if (vn_write_block(vn, bno, wdata)) {
             return ERR_IO;
         }
 #endif
@@ -902,6 +1186,8 @@ done:
         // return an error explicitly (rather than zero).
         if (off >= kMinfsMaxFileSize) {
             return ERR_FILE_BIG;
+        } else if (status == ERR_IO) {
+            return ERR_IO;
         }
 
         return ERR_NO_RESOURCES;
@@ -928,7 +1214,7 @@ static mx_status_t fs_lookup(vnode_t* vn, vnode_t** out, const char* name, size_
     args.name = name;
     args.len = len;
     mx_status_t status;
-    if ((status = vn_dir_for_each(vn, &args, cb_dir_find)) < 0) {
+    if ((status = vn_dir_lookup(vn, &args, cb_dir_find)) < 0) {
         return status;
     }
     if ((status = vn->fs->VnodeGet(&vn, args.ino)) < 0) {
@@ -964,6 +1250,7 @@ static mx_status_t fs_setattr(vnode_t* vn, vnattr_t* a) {
     }
     if (dirty) {
         // write to disk, but don't overwrite the time
+        MinfsTxn txn(vn->fs->bc);
         minfs_sync_vnode(vn, kMxFsSyncDefault);
     }
     return NO_ERROR;
@@ -973,11 +1260,14 @@ static mx_status_t fs_setattr(vnode_t* vn, vnattr_t* a) {
 #define DIRCOOKIE_FLAG_ERROR 2
 
 typedef struct dircookie {
-    uint32_t flags;  // Identifies the state of the dircookie
     size_t off;      // Offset into directory
+    uint32_t flags;  // Identifies the state of the dircookie
     uint32_t seqno;  // inode seq no
 } dircookie_t;
 
+static_assert(sizeof(dircookie_t) <= sizeof(vdircookie_t),
+              "MinFS dircookie too large to fit in IO state");
+
 static mx_status_t fs_readdir(vnode_t* vn, void* cookie, void* dirents, size_t len) {
     trace(MINFS, "minfs_readdir() vn=%p(#%u) cookie=%p len=%zd\n", vn, vn->ino, cookie, len);
     dircookie_t* dc = reinterpret_cast<dircookie_t*>(cookie);
@@ -1052,13 +1342,14 @@ static mx_status_t fs_create(vnode_t* vndir, vnode_t** out,
     if (!VNODE_IS_DIR(vndir)) {
         return ERR_NOT_SUPPORTED;
     }
+    MinfsTxn txn(vndir->fs->bc);
 
     dir_args_t args = dir_args_t();
     args.name = name;
     args.len = len;
     // ensure file does not exist
     mx_status_t status;
-    if ((status = vn_dir_for_each(vndir, &args, cb_dir_find)) != ERR_NOT_FOUND) {
+    if ((status = vn_dir_lookup(vndir, &args, cb_dir_find)) != ERR_NOT_FOUND) {
         return ERR_ALREADY_EXISTS;
     }
 
@@ -1075,7 +1366,7 @@ static mx_status_t fs_create(vnode_t* vndir, vnode_t** out,
     args.ino = vn->ino;
     args.type = type;
     args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(len)));
-    if ((status = vn_dir_for_each(vndir, &args, cb_dir_append)) < 0) {
+    if ((status = vn_dir_append(vndir, &args)) < 0) {
         fs_release(vndir);
         return status;
     }
@@ -1089,6 +1380,7 @@ static mx_status_t fs_create(vnode_t* vndir, vnode_t** out,
             return ERR_IO;
         }
         vn->inode.dirent_count = 2;
+        vn->inode.dir_tail = DirentSize(1);
         minfs_sync_vnode(vn, kMxFsSyncDefault);
     }
     *out = vn;
@@ -1124,11 +1416,12 @@ static mx_status_t fs_unlink(vnode_t* vn, const char* name, size_t len, bool mus
     if ((len == 2) && (name[0] == '.') && (name[1] == '.')) {
         return ERR_BAD_STATE;
     }
+    MinfsTxn txn(vn->fs->bc);
     dir_args_t args = dir_args_t();
     args.name = name;
     args.len = len;
     args.type = must_be_dir ? kMinfsTypeDir : 0;
-    return vn_dir_for_each(vn, &args, cb_dir_unlink);
+    return vn_dir_lookup(vn, &args, cb_dir_unlink);
 }
 
 static mx_status_t fs_truncate(vnode_t* vn, size_t len) {
@@ -1136,6 +1429,7 @@ static mx_status_t fs_truncate(vnode_t* vn, size_t len) {
         return ERR_NOT_FILE;
     }
 
+    MinfsTxn txn(vn->fs->bc);
     return _fs_truncate(vn, len);
 }
 
@@ -1170,12 +1464,16 @@ static mx_status_t _fs_truncate(vnode_t* vn, size_t len) {
             char bdata[kMinfsBlockSize];
             uint32_t bno;
             if (vn_get_bno(vn, static_cast<uint32_t>(len / kMinfsBlockSize),
-                           &bno, false) != NO_ERROR) {
+                           &bno) != NO_ERROR) {
                 return ERR_IO;
             }
             if (bno != 0) {
                 size_t adjust = len % kMinfsBlockSize;
 #ifdef __Fuchsia__
+                uint32_t n = static_cast<uint32_t>(len / kMinfsBlockSize);
+                if ((r = vn_fill_blocks(vn, n, n + 1)) != NO_ERROR) {
+                    return ERR_IO;
+                }
                 if ((r = vmo_read_exact(vn->vmo, bdata, len - adjust, adjust)) != NO_ERROR) {
                     return ERR_IO;
                 }
@@ -1193,7 +1491,7 @@ static mx_status_t _fs_truncate(vnode_t* vn, size_t len) {
                 memset(bdata + adjust, 0, kMinfsBlockSize - adjust);
 #endif
 
-                if (vn->fs->bc->Writeblk(bno, bdata)) {
+                if (vn_write_block(vn, bno, bdata)) {
                     return ERR_IO;
                 }
             }
@@ -1212,7 +1510,7 @@ static mx_status_t _fs_truncate(vnode_t* vn, size_t len) {
     }
 
 #ifdef __Fuchsia__
-    if ((r = mx_vmo_set_size(vn->vmo, ROUNDUP(len, kMinfsBlockSize))) != NO_ERROR) {
+    if ((r = vn_set_vmo_size(vn, len)) != NO_ERROR) {
         return r;
     }
 #endif
@@ -1269,13 +1567,14 @@ static mx_status_t fs_rename(vnode_t* olddir, vnode_t* newdir,
     if ((newlen == 2) && (newname[0] == '.') && (newname[1] == '.'))
         return ERR_BAD_STATE;
 
+    MinfsTxn txn(olddir->fs->bc);
     mx_status_t status;
     vnode_t* oldvn = nullptr;
     // acquire the 'oldname' node (it must exist)
     dir_args_t args = dir_args_t();
     args.name = oldname;
     args.len = oldlen;
-    if ((status = vn_dir_for_each(olddir, &args, cb_dir_find)) < 0) {
+    if ((status = vn_dir_lookup(olddir, &args, cb_dir_find)) < 0) {
         return status;
     } else if ((status = olddir->fs->VnodeGet(&oldvn, args.ino)) < 0) {
         return status;
@@ -1295,11 +1594,11 @@ static mx_status_t fs_rename(vnode_t* olddir, vnode_t* newdir,
     args.len = newlen;
     args.ino = oldvn->ino;
     args.type = VNODE_IS_DIR(oldvn) ? kMinfsTypeDir : kMinfsTypeFile;
-    status = vn_dir_for_each(newdir, &args, cb_dir_attempt_rename);
+    status = vn_dir_lookup(newdir, &args, cb_dir_attempt_rename);
     if (status == ERR_NOT_FOUND) {
         // if 'newname' does not exist, create it
         args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(newlen)));
-        if ((status = vn_dir_for_each(newdir, &args, cb_dir_append)) < 0) {
+        if ((status = vn_dir_append(newdir, &args)) < 0) {
             goto done;
         }
         status = NO_ERROR;
@@ -1317,7 +1616,7 @@ static mx_status_t fs_rename(vnode_t* olddir, vnode_t* newdir,
         args.name = "..";
         args.len = 2;
         args.ino = newdir->ino;
-        if ((status = vn_dir_for_each(vn, &args, cb_dir_update_inode)) < 0) {
+        if ((status = vn_dir_lookup(vn, &args, cb_dir_update_inode)) < 0) {
             vn_release(vn);
             goto done;
         }
@@ -1331,7 +1630,7 @@ static mx_status_t fs_rename(vnode_t* olddir, vnode_t* newdir,
     // finally, remove oldname from its original position
     args.name = oldname;
     args.len = oldlen;
-    status = vn_dir_for_each(olddir, &args, cb_dir_force_unlink);
+    status = vn_dir_lookup(olddir, &args, cb_dir_force_unlink);
 done:
     vn_release(oldvn);
     return status;
@@ -20,7 +20,15 @@ constexpr uint32_t kMxFsSyncDefault = 0;     // default: no implicit time update
 constexpr uint32_t kMxFsSyncMtime   = (1<<0);
 constexpr uint32_t kMxFsSyncCtime   = (1<<1);
 
+// Default and smallest block cache sizes, in blocks. A single operation may
+// hold several blocks busy at once.
 constexpr uint32_t kMinfsBlockCacheSize = 64;
+constexpr uint32_t kMinfsBlockCacheMin = 16;
+
+// Read-ahead for sequential file reads, in blocks. The window starts at the
+// minimum and doubles with each further sequential read.
+constexpr uint32_t kMinfsReadAheadMin = 4;
+constexpr uint32_t kMinfsReadAheadMax = 32;
 
 // Used by fsck
 struct CheckMaps {
@@ -47,6 +55,15 @@ public:
     // Acquires the block if out_block is not null.
     mx_status_t BlockNew(uint32_t hint, uint32_t* out_bno, mxtl::RefPtr<BlockNode>* out_block);
 
+    // Allocate a contiguous run of up to 'want' data blocks, starting at
+    // 'hint' if that block is free. The blocks are not read or zeroed.
+    mx_status_t BlocksNew(uint32_t hint, uint32_t want, uint32_t* out_bno, uint32_t* out_count);
+
+    // Free a run of data blocks. They are free on disk right away, but are
+    // not allocated again until the journal has committed that, so that
+    // nothing can be written over them before a crash would bring them back.
+    mx_status_t BlocksFree(uint32_t bno, uint32_t count);
+
     // free ino in inode bitmap, release all blocks held by inode
     mx_status_t InoFree(const minfs_inode_t& inode, uint32_t ino);
 
@@ -70,9 +87,20 @@ private:
     mx_status_t InoNew(minfs_inode_t* inode, uint32_t* ino_out);
     mx_status_t LoadBitmaps();
 
+    // Copy block 'bitblock' of the allocation bitmap, as it should be on
+    // disk, to 'data'.
+    void BitmapBlockCopy(void* data, uint32_t bitblock) const;
+    // Make the blocks freed so far available, if that has been committed.
+    void ReleaseFreed();
+
     uint32_t abmblks_;
     uint32_t ibmblks_;
     Bitmap inode_map_;
+    // Blocks freed, but still set in 'block_map' until the commit of
+    // transaction 'freed_seq_'.
+    Bitmap freed_map_;
+    bool freed_;
+    uint64_t freed_seq_;
     list_node_t vnode_hash_[kMinfsBuckets];
 
     // Fsck can introspect Minfs
@@ -80,6 +108,18 @@ private:
     friend mx_status_t minfs_check(Bcache*);
 };
 
+// Makes the block cache changes during its lifetime part of one journal
+// transaction. Every operation which changes the filesystem holds one.
+class MinfsTxn {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(MinfsTxn);
+    explicit MinfsTxn(Bcache* bc) : bc_(bc) { bc_->TxnBegin(); }
+    ~MinfsTxn() { bc_->TxnEnd(); }
+
+private:
+    Bcache* bc_;
+};
+
 struct vnode {
     // ops, flags, refcount
     VNODE_BASE_FIELDS
@@ -94,9 +134,18 @@ struct vnode {
 #ifdef __Fuchsia__
     // TODO(smklein): When we have can register MinFS as a pager service, and
     // it can properly handle pages faults on a vnode's contents, then we can
-    // avoid reading the entire file up-front. Until then, read the contents of
-    // a VMO into memory when it is read/written.
+    // let the kernel ask for blocks. Until then, blocks are read into the VMO
+    // the first time a read or write touches them.
     mx_handle_t vmo;
+
+    // One bit per block of the VMO, set once the block holds the file's data.
+    uint64_t* vmo_loaded;
+    uint32_t vmo_loaded_count;
+
+    // Reads starting at block |readahead_next| are sequential, and fill
+    // |readahead_window| blocks past what they asked for.
+    uint32_t readahead_next;
+    uint32_t readahead_window;
 #endif
 
     minfs_inode_t inode;
@@ -111,6 +160,25 @@ extern vnode_ops_t minfs_ops;
 // write the inode data of this vnode to disk (default does not update time values)
 void minfs_sync_vnode(vnode_t* vn, uint32_t flags);
 
+// Extent maps (minfs-extent.cpp). These update the inode in memory, including
+// its block_count; the caller writes it back.
+
+// Find the disk block backing file block 'fbn', or 0 if it is a hole.
+// 'count_out', if not null, receives how many blocks from 'fbn' on map the
+// same way: contiguous on disk, or all holes.
+mx_status_t minfs_extent_lookup(Bcache* bc, const minfs_inode_t* inode, uint32_t fbn,
+                                uint32_t* bno_out, uint32_t* count_out);
+
+// Map the unmapped file blocks [fbn, fbn + count) to the newly allocated
+// disk blocks [bno, bno + count). Fails with ERR_NO_SPACE once the map has no
+// room for another extent.
+mx_status_t minfs_extent_insert(Minfs* fs, minfs_inode_t* inode, uint32_t fbn,
+                                uint32_t bno, uint32_t count);
+
+// Unmap and free every data block at or past file block 'start', along
+// with the extent blocks that are no longer needed.
+mx_status_t minfs_extent_truncate(Minfs* fs, minfs_inode_t* inode, uint32_t start);
+
 mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max);
 void minfs_dump_info(minfs_info_t* info);
 
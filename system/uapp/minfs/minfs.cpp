@@ -19,6 +19,7 @@ void minfs_dump_info(minfs_info_t* info) {
     printf("minfs: inode bitmap @ %10u\n", info->ibm_block);
     printf("minfs: alloc bitmap @ %10u\n", info->abm_block);
     printf("minfs: inode table  @ %10u\n", info->ino_block);
+    printf("minfs: journal      @ %10u (%u blocks)\n", info->jnl_block, info->jnl_blocks);
     printf("minfs: data blocks  @ %10u\n", info->dat_block);
 }
 
@@ -42,6 +43,12 @@ mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
         error("minfs: too large for device\n");
         return ERR_INVALID_ARGS;
     }
+    if ((info->jnl_block < info->ino_block) || (info->jnl_blocks < 3) ||
+        (info->jnl_blocks > kMinfsJournalMaxBlocks) ||
+        (info->jnl_block + info->jnl_blocks > info->dat_block)) {
+        error("minfs: bad journal location %u (%u blocks)\n", info->jnl_block, info->jnl_blocks);
+        return ERR_INVALID_ARGS;
+    }
     //TODO: validate layout
     return 0;
 }
@@ -82,7 +89,7 @@ void minfs_sync_vnode(vnode_t* vn, uint32_t flags) {
     vn->fs->bc->Put(blk, kBlockDirty);
 }
 
-Minfs::Minfs(Bcache* bc_, minfs_info_t* info_) : bc(bc_) {
+Minfs::Minfs(Bcache* bc_, minfs_info_t* info_) : bc(bc_), freed_(false), freed_seq_(0) {
     memcpy(&info, info_, sizeof(minfs_info_t));
     for (size_t n = 0; n < kMinfsBuckets; n++) {
         list_initialize(vnode_hash_ + n);
@@ -108,51 +115,9 @@ mx_status_t Minfs::InoFree(const minfs_inode_t& inode, uint32_t ino) {
     memcpy(block_ibm->data(), bmdata, kMinfsBlockSize);
     bc->Put(block_ibm, kBlockDirty);
 
-    mxtl::RefPtr<BlockNode> bitmap_blk;
-
-    // release all direct blocks
-    for (unsigned n = 0; n < kMinfsDirect; n++) {
-        if (inode.dnum[n] == 0) {
-            continue;
-        }
-        if ((bitmap_blk = BitmapBlockGet(bitmap_blk, inode.dnum[n])) == nullptr) {
-            return ERR_IO;
-        }
-        block_map.Clr(inode.dnum[n]);
-    }
-
-    // release all indirect blocks
-    for (unsigned n = 0; n < kMinfsIndirect; n++) {
-        if (inode.inum[n] == 0) {
-            continue;
-        }
-        mxtl::RefPtr<BlockNode> blk;
-        if ((blk = bc->Get(inode.inum[n])) == nullptr) {
-            BitmapBlockPut(bitmap_blk);
-            return ERR_IO;
-        }
-        uint32_t* entry = static_cast<uint32_t*>(blk->data());
-        // release the blocks pointed at by the entries in the indirect block
-        for (unsigned m = 0; m < (kMinfsBlockSize / sizeof(uint32_t)); m++) {
-            if (entry[m] == 0) {
-                continue;
-            }
-            if ((bitmap_blk = BitmapBlockGet(bitmap_blk, entry[m])) == nullptr) {
-                bc->Put(blk, 0);
-                return ERR_IO;
-            }
-            block_map.Clr(entry[m]);
-        }
-        bc->Put(blk, 0);
-        // release the direct block itself
-        if ((bitmap_blk = BitmapBlockGet(bitmap_blk, inode.inum[n])) == nullptr) {
-            return ERR_IO;
-        }
-        block_map.Clr(inode.inum[n]);
-    }
-    BitmapBlockPut(bitmap_blk);
-
-    return NO_ERROR;
+    // release all data and extent blocks
+    minfs_inode_t copy = inode;
+    return minfs_extent_truncate(this, &copy, 0);
 }
 
 mx_status_t Minfs::InoNew(minfs_inode_t* inode, uint32_t* ino_out) {
@@ -251,10 +216,9 @@ mx_status_t Minfs::VnodeGet(vnode_t** out, uint32_t ino) {
                            kMinfsInodeSize * (ino % ino_per_blk), kMinfsInodeSize)) < 0) {
         return status;
     }
-    trace(MINFS, "get_vnode() %p(#%u) { magic=%#08x size=%u blks=%u dn=%u,%u,%u,%u... }\n",
+    trace(MINFS, "get_vnode() %p(#%u) { magic=%#08x size=%u blks=%u extents=%u depth=%u }\n",
           vn, ino, vn->inode.magic, vn->inode.size, vn->inode.block_count,
-          vn->inode.dnum[0], vn->inode.dnum[1], vn->inode.dnum[2],
-          vn->inode.dnum[3]);
+          vn->inode.extent_count, vn->inode.extent_depth);
     vn->fs = this;
     vn->ino = ino;
     vn->refcount = 1;
@@ -271,6 +235,7 @@ mx_status_t Minfs::VnodeGet(vnode_t** out, uint32_t ino) {
 // If hint is nonzero it indicates which block number to start the search for
 // free blocks from.
 mx_status_t Minfs::BlockNew(uint32_t hint, uint32_t* out_bno, mxtl::RefPtr<BlockNode> *out_block) {
+    ReleaseFreed();
     uint32_t bno = block_map.Alloc(hint);
     if ((bno == BITMAP_FAIL) && (hint != 0)) {
         bno = block_map.Alloc(0);
@@ -280,14 +245,10 @@ mx_status_t Minfs::BlockNew(uint32_t hint, uint32_t* out_bno, mxtl::RefPtr<Block
     }
     assert(bno != 0); // Cannot allocate root block
 
-    // obtain the in-memory bitmap block
-    uint32_t bmbno;
-    void *bmdata = block_map.GetBitBlock(&bmbno, bno); // bmbno relative to bitmap
-    bmbno += info.abm_block;                          // bmbno relative to block device
-
     // obtain the block of the alloc bitmap we need
+    uint32_t bitblock = bno / kMinfsBlockBits;
     mxtl::RefPtr<BlockNode> block_abm;
-    if ((block_abm = bc->Get(bmbno)) == nullptr) {
+    if ((block_abm = bc->Get(info.abm_block + bitblock)) == nullptr) {
         block_map.Clr(bno);
         return ERR_IO;
     }
@@ -302,12 +263,78 @@ mx_status_t Minfs::BlockNew(uint32_t hint, uint32_t* out_bno, mxtl::RefPtr<Block
     }
 
     // commit the bitmap
-    memcpy(block_abm->data(), bmdata, kMinfsBlockSize);
+    BitmapBlockCopy(block_abm->data(), bitblock);
     bc->Put(block_abm, kBlockDirty);
     *out_bno = bno;
     return NO_ERROR;
 }
 
+mx_status_t Minfs::BlocksNew(uint32_t hint, uint32_t want, uint32_t* out_bno,
+                             uint32_t* out_count) {
+    ReleaseFreed();
+    uint32_t count;
+    uint32_t bno = block_map.AllocRun(hint, want, &count);
+    if ((bno == BITMAP_FAIL) && (hint != 0)) {
+        bno = block_map.AllocRun(0, want, &count);
+    }
+    if (bno == BITMAP_FAIL) {
+        return ERR_NO_SPACE;
+    }
+    assert(bno != 0); // Cannot allocate root block
+
+    // commit the bitmap blocks covering the run
+    mxtl::RefPtr<BlockNode> bitmap_blk;
+    for (uint32_t n = bno; n < bno + count; n++) {
+        if ((bitmap_blk = BitmapBlockGet(bitmap_blk, n)) == nullptr) {
+            for (n = bno; n < bno + count; n++) {
+                block_map.Clr(n);
+            }
+            return ERR_IO;
+        }
+    }
+    BitmapBlockPut(bitmap_blk);
+    *out_bno = bno;
+    *out_count = count;
+    return NO_ERROR;
+}
+
+mx_status_t Minfs::BlocksFree(uint32_t bno, uint32_t count) {
+    mxtl::RefPtr<BlockNode> bitmap_blk;
+    for (uint32_t n = bno; n < bno + count; n++) {
+        if ((bitmap_blk = BitmapBlockGet(bitmap_blk, n)) == nullptr) {
+            return ERR_IO;
+        }
+        freed_map_.Set(n);
+        bc->Revoke(n);
+    }
+    freed_ = true;
+    freed_seq_ = bc->TxnSeq();
+    BitmapBlockPut(bitmap_blk);
+    return NO_ERROR;
+}
+
+void Minfs::ReleaseFreed() {
+    if (!freed_ || !bc->Committed(freed_seq_)) {
+        return;
+    }
+    uint64_t* map = static_cast<uint64_t*>(block_map.data());
+    const uint64_t* freed = static_cast<const uint64_t*>(freed_map_.data());
+    for (size_t n = 0; n < abmblks_ * kMinfsBlockBits / 64; n++) {
+        map[n] &= ~freed[n];
+    }
+    freed_map_.Reset();
+    freed_ = false;
+}
+
+void Minfs::BitmapBlockCopy(void* data, uint32_t bitblock) const {
+    const uint64_t* map = static_cast<const uint64_t*>(block_map.GetBlock(bitblock));
+    const uint64_t* freed = static_cast<const uint64_t*>(freed_map_.GetBlock(bitblock));
+    uint64_t* out = static_cast<uint64_t*>(data);
+    for (size_t n = 0; n < kMinfsBlockSize / sizeof(uint64_t); n++) {
+        out[n] = map[n] & ~freed[n];
+    }
+}
+
 void minfs_dir_init(void* bdata, uint32_t ino_self, uint32_t ino_parent) {
 #define DE0_SIZE DirentSize(1)
 
@@ -355,6 +382,9 @@ mx_status_t Minfs::Create(Minfs** out, Bcache* bc, minfs_info_t* info) {
     if ((status = fs->inode_map_.Init(fs->ibmblks_ * kMinfsBlockBits)) < 0) {
         return status;
     }
+    if ((status = fs->freed_map_.Init(fs->abmblks_ * kMinfsBlockBits)) < 0) {
+        return status;
+    }
     // this keeps the underlying storage a block multiple but ensures we
     // can't allocate beyond the last real block or inode
     fs->block_map.Resize(fs->info.block_count);
@@ -393,6 +423,10 @@ mx_status_t minfs_mount(vnode_t** out, Bcache* bc) {
     if (minfs_check_info(&info, bc->Maxblk())) {
         return -1;
     }
+    if (bc->JournalStart(info.jnl_block, info.jnl_blocks) != NO_ERROR) {
+        error("minfs: cannot replay journal\n");
+        return -1;
+    }
 
     Minfs* fs;
     if (Minfs::Create(&fs, bc, &info)) {
@@ -424,6 +458,12 @@ int minfs_mkfs(Bcache* bc) {
     uint32_t inoblks = (inodes + kMinfsInodesPerBlock - 1) / kMinfsInodesPerBlock;
     uint32_t abmblks = (blocks + kMinfsBlockBits - 1) / kMinfsBlockBits;
     uint32_t ibmblks = (inodes + kMinfsBlockBits - 1) / kMinfsBlockBits;
+    uint32_t jnlblks = blocks / 64;
+    if (jnlblks < kMinfsJournalMinBlocks) {
+        jnlblks = kMinfsJournalMinBlocks;
+    } else if (jnlblks > kMinfsJournalMaxBlocks) {
+        jnlblks = kMinfsJournalMaxBlocks;
+    }
 
     minfs_info_t info;
     memset(&info, 0x00, sizeof(info));
@@ -438,7 +478,9 @@ int minfs_mkfs(Bcache* bc) {
     info.ibm_block = 8;
     info.abm_block = 16;
     info.ino_block = info.abm_block + ((abmblks + 8) & (~7));
-    info.dat_block = info.ino_block + inoblks;
+    info.jnl_block = info.ino_block + inoblks;
+    info.jnl_blocks = jnlblks;
+    info.dat_block = info.jnl_block + jnlblks;
     minfs_dump_info(&info);
 
     Bitmap abm;
@@ -492,6 +534,16 @@ int minfs_mkfs(Bcache* bc) {
         bc->Put(blk, kBlockDirty);
     }
 
+    // write an empty journal: its info block, and a first record which
+    // cannot be mistaken for one left on the device from before
+    blk = bc->GetZero(info.jnl_block);
+    minfs_journal_info_t* jnl = (minfs_journal_info_t*) blk->data();
+    jnl->magic = kMinfsMagicJournal;
+    jnl->seq = 1;
+    bc->Put(blk, kBlockDirty);
+    blk = bc->GetZero(info.jnl_block + 1);
+    bc->Put(blk, kBlockDirty);
+
 
     // setup root inode
     blk = bc->Get(info.ino_block);
@@ -501,7 +553,11 @@ int minfs_mkfs(Bcache* bc) {
     ino[kMinfsRootIno].block_count = 1;
     ino[kMinfsRootIno].link_count = 1;
     ino[kMinfsRootIno].dirent_count = 2;
-    ino[kMinfsRootIno].dnum[0] = info.dat_block;
+    ino[kMinfsRootIno].dir_tail = DirentSize(1);
+    ino[kMinfsRootIno].extent_count = 1;
+    ino[kMinfsRootIno].extents[0].fbn = 0;
+    ino[kMinfsRootIno].extents[0].bno = info.dat_block;
+    ino[kMinfsRootIno].extents[0].count = 1;
     bc->Put(blk, kBlockDirty);
 
     blk = bc->GetZero(0);
@@ -24,7 +24,7 @@
 
 constexpr uint64_t kMinfsMagic0 = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1 = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion = 0x00000002;
+constexpr uint32_t kMinfsVersion = 0x00000004;
 
 constexpr uint32_t kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 1;
@@ -33,12 +33,9 @@ constexpr uint32_t kMinfsBlockBits      = (kMinfsBlockSize * 8);
 constexpr uint32_t kMinfsInodeSize      = 256;
 constexpr uint32_t kMinfsInodesPerBlock = (kMinfsBlockSize / kMinfsInodeSize);
 
-constexpr uint32_t kMinfsDirect   = 16;
-constexpr uint32_t kMinfsIndirect = 32;
-
 // not possible to have a block at or past this one
-// due to the limitations of the inode and indirect blocks
-constexpr uint64_t kMinfsMaxFileBlock = (kMinfsDirect + kMinfsIndirect * (kMinfsBlockSize / sizeof(uint32_t)));
+// due to the 32 bit file size in the inode
+constexpr uint64_t kMinfsMaxFileBlock = (UINT32_MAX / kMinfsBlockSize);
 constexpr uint64_t kMinfsMaxFileSize  = kMinfsMaxFileBlock * kMinfsBlockSize;
 
 constexpr uint32_t kMinfsTypeFile = 8;
@@ -49,6 +46,8 @@ constexpr uint32_t kMinfsMagicDir  = MinfsMagic(kMinfsTypeDir);
 constexpr uint32_t kMinfsMagicFile = MinfsMagic(kMinfsTypeFile);
 constexpr uint32_t MinfsMagicType(uint32_t n) { return n & 0xFF; }
 
+constexpr uint32_t kMinfsMagicExtents = 0xAA6f6e45;
+
 typedef struct {
     uint64_t magic0;
     uint64_t magic1;
@@ -62,14 +61,16 @@ typedef struct {
     uint32_t abm_block;     // first blockno of block allocation bitmap
     uint32_t ino_block;     // first blockno of inode table
     uint32_t dat_block;     // first blockno available for file data
+    uint32_t jnl_block;     // first blockno of the metadata journal
+    uint32_t jnl_blocks;    // number of blocks in the metadata journal
 } minfs_info_t;
 
 // Notes:
-// - the ibm, abm, ino, and dat regions must be in that order
+// - the ibm, abm, ino, jnl, and dat regions must be in that order
 //   and may not overlap
 // - the abm has an entry for every block on the volume, including
 //   the info block (0), the bitmaps, etc
-// - data blocks referenced from direct and indirect block tables
+// - data blocks referenced from extents and extent blocks
 //   in inodes are also relative to (0), but it is not legal for
 //   a block number of less than dat_block (start of data blocks)
 //   to be used
@@ -78,24 +79,58 @@ typedef struct {
 //   at offset: ino % kMinfsInodesPerBlock
 // - inode 0 is never used, should be marked allocated but ignored
 
+// Maps 'count' file blocks starting at 'fbn' to as many contiguous
+// disk blocks starting at 'bno'.
+typedef struct {
+    uint32_t fbn;
+    uint32_t bno;
+    uint32_t count;
+} minfs_extent_t;
+
+constexpr uint32_t kMinfsInodeExtents = 16;
+
 typedef struct {
     uint32_t magic;
     uint32_t size;
-    uint32_t block_count;
+    uint32_t block_count;           // data blocks plus extent blocks
     uint32_t link_count;
     uint64_t create_time;
     uint64_t modify_time;
     uint32_t seq_num;               // bumped when modified
     uint32_t gen_num;               // bumped when deleted
     uint32_t dirent_count;          // for directories
-    uint32_t rsvd[5];
-    uint32_t dnum[kMinfsDirect];    // direct blocks
-    uint32_t inum[kMinfsIndirect];  // indirect blocks
+    uint32_t extent_count;          // entries used in extents[]
+    uint32_t extent_depth;          // 0: extents[] map data, 1: extents[] index extent blocks
+    uint32_t dir_hash_slots;        // for directories: size of the hash index, 0 if none
+    uint32_t dir_hash_deleted;      // for directories: deleted slots in the hash index
+    uint32_t dir_tail;              // for directories: offset of the last dirent
+    minfs_extent_t extents[kMinfsInodeExtents];
 } minfs_inode_t;
 
 static_assert(sizeof(minfs_inode_t) == kMinfsInodeSize,
               "minfs inode size is wrong");
 
+constexpr uint32_t kMinfsBlockExtents = (kMinfsBlockSize - 4 * sizeof(uint32_t)) /
+                                        sizeof(minfs_extent_t);
+
+typedef struct {
+    uint32_t magic;                 // kMinfsMagicExtents
+    uint32_t rsvd[3];
+    minfs_extent_t extents[kMinfsBlockExtents];
+} minfs_extent_block_t;
+
+static_assert(sizeof(minfs_extent_block_t) <= kMinfsBlockSize,
+              "minfs extent block is too large");
+
+// Notes:
+// - extents are sorted by fbn and do not overlap; file blocks that
+//   no extent covers are holes, and read as zeros
+// - with an extent_depth of 1, each of the inode's extents is an index
+//   entry instead: 'bno' is an extent block, 'count' is how many of the
+//   extents in that block are used, and the entry covers the file blocks
+//   from its 'fbn' up to the 'fbn' of the next entry. The first entry
+//   always has an 'fbn' of 0.
+
 typedef struct {
     uint32_t ino;                   // inode number
     uint32_t reclen;                // Low 28 bits: Length of record
@@ -138,10 +173,118 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 //   record starts. If the MAX_DIR_SIZE is increased, this 'last' record will
 //   also increase in size.
 
+// Directories with kMinfsDirHashMinEntries or more entries also keep a hash
+// index of them, so that lookup and create need not read every dirent. It is
+// an open addressed table of 'dir_hash_slots' slots, stored in the directory
+// from kMinfsDirHashOffset on, past anything the dirents can use.
+typedef struct {
+    uint32_t hash;                  // MinfsDirHash() of the name, or kMinfsDirHash{Free,Deleted}
+    uint32_t off;                   // offset of the dirent in the directory
+} minfs_dirhash_t;
+
+constexpr uint32_t kMinfsDirHashFree       = 0;
+constexpr uint32_t kMinfsDirHashDeleted    = 1;
+constexpr uint32_t kMinfsDirHashOffset     = (1 << 20);
+constexpr uint32_t kMinfsDirHashMinEntries = 256;
+constexpr uint32_t kMinfsDirHashMinSlots   = kMinfsBlockSize / sizeof(minfs_dirhash_t);
+constexpr uint32_t kMinfsDirHashMaxSlots   = (1 << 18);
+
+static_assert((kMinfsDirHashOffset >= kMinfsMaxDirectorySize) &&
+              (kMinfsDirHashOffset % kMinfsBlockSize == 0),
+              "MinFS directory index must start on a block past the dirents");
+static_assert(kMinfsDirHashMaxSlots >= 2 * (kMinfsMaxDirectorySize / DirentSize(1)),
+              "MinFS directory index must have room for every possible dirent");
+
+static inline uint32_t MinfsDirHash(const char* name, size_t len) {
+    uint32_t hash = fnv1a32(name, len);
+    return (hash > kMinfsDirHashDeleted) ? hash : hash + 2;
+}
 
-// blocksize   8K    16K    32K
-// 16 dir =  128K   256K   512K
-// 32 ind =  512M  1024M  2048M
+// Notes:
+// - the index has a slot for every dirent in use, '.' and '..' included,
+//   and is probed linearly from slot (hash % dir_hash_slots)
+// - slots in use plus deleted slots never exceed half the table; past that
+//   the index is rebuilt from the dirents, larger if need be
+// - dir_tail is the offset of the record with kMinfsReclenLast. Indexed
+//   directories add entries there, and only look for free space among the
+//   earlier dirents once it has run out.
+// - readdir walks the dirents only, so its cookies work the same with or
+//   without an index
+
+
+// Metadata journal. Changes to metadata blocks (bitmaps, inodes, extent
+// blocks and directory contents) are written to the journal first, as one
+// record per group of operations, and only later to their home locations.
+// After a crash, replaying the complete records leaves every operation
+// either done or not started. File data is not journaled; it is written
+// before the record that refers to it.
+typedef struct {
+    uint32_t magic;                 // kMinfsMagicJournal
+    uint32_t rsvd;
+    uint64_t seq;                   // sequence number of the first record
+} minfs_journal_info_t;
+
+constexpr uint32_t kMinfsJournalEntries = (kMinfsBlockSize - 6 * sizeof(uint32_t)) /
+                                          sizeof(uint32_t);
+
+typedef struct {
+    uint32_t magic;                 // kMinfsMagicJournalRecord
+    uint32_t count;                 // blocks copied into this record
+    uint64_t seq;
+    uint32_t revoke_count;          // blocks whose older copies must not be replayed
+    uint32_t rsvd;
+    uint32_t bno[kMinfsJournalEntries]; // 'count' copied blocks, then the revoked ones
+} minfs_journal_header_t;
+
+typedef struct {
+    uint32_t magic;                 // kMinfsMagicJournalCommit
+    uint32_t checksum;              // MinfsJournalChecksum() of the header and the copies
+    uint64_t seq;
+} minfs_journal_commit_t;
+
+constexpr uint32_t kMinfsMagicJournal       = 0xAA6f6e4C;
+constexpr uint32_t kMinfsMagicJournalRecord = 0xAA6f6e52;
+constexpr uint32_t kMinfsMagicJournalCommit = 0xAA6f6e43;
+
+// Journal size chosen by mkfs: 1/64th of the volume, within these bounds.
+constexpr uint32_t kMinfsJournalMinBlocks = 64;
+constexpr uint32_t kMinfsJournalMaxBlocks = 1024;
+
+// FNV-1a, taken a 64 bit word at a time: records are whole blocks, and this
+// is quick enough to run over every one written.
+static inline uint32_t MinfsJournalChecksum(const void* data, size_t len) {
+    const uint64_t* word = static_cast<const uint64_t*>(data);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t n = 0; n < len / sizeof(uint64_t); n++) {
+        hash = (hash ^ word[n]) * 1099511628211ULL;
+    }
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+static_assert(sizeof(minfs_journal_header_t) <= kMinfsBlockSize,
+              "minfs journal header is too large");
+static_assert(kMinfsJournalMaxBlocks <= kMinfsJournalEntries,
+              "minfs journal header must be able to list every block in the journal");
+
+// Notes:
+// - the first journal block holds minfs_journal_info_t. Records follow it
+//   back to back: a header, a copy of each block it lists, and a commit.
+//   A record is complete if its commit carries its 'seq' and the checksum
+//   of what came before.
+// - records have consecutive sequence numbers, starting from the info
+//   block's 'seq'. Replay stops at the first record that is missing, torn,
+//   or left over from before the last checkpoint.
+// - a checkpoint writes the latest copy of every journaled block in place,
+//   then advances the info block's 'seq' past the last record, emptying
+//   the journal
+// - a block is revoked when it is freed after a record copied it: it may
+//   hold file data by now, so replay skips the copies of it in records
+//   older than the one which revoked it
+
+
+// A file can have up to kMinfsInodeExtents extents in its inode, or
+// kMinfsInodeExtents * kMinfsBlockExtents (10896) in extent blocks. How much
+// data that maps depends on how contiguous its blocks are.
 
 //  1GB ->  128K blocks ->  16K bitmap (2K qword)
 //  4GB ->  512K blocks ->  64K bitmap (8K qword)
@@ -149,6 +292,66 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 
 
 
+// Allocation Bitmap (bitmap.c)
+constexpr uint32_t BITMAP_FAIL = (0xFFFFFFFF);
+
+class Bitmap {
+public:
+    Bitmap();
+    ~Bitmap();
+
+    mx_status_t Init(uint32_t maxbits);
+    void Reset();
+
+    // find an available bit, set it, return that bitnumber
+    // returns BITMAP_FAIL if no bit is found
+    uint32_t Alloc(uint32_t minbit);
+
+    // find the first available bit at or after minbit (exactly, not rounded
+    // like Alloc()), and set it along with the available bits right after
+    // it, up to 'want' bits in all. Returns the first bit of the run and its
+    // length in 'count_out', or BITMAP_FAIL if no bit is found.
+    uint32_t AllocRun(uint32_t minbit, uint32_t want, uint32_t* count_out);
+
+    // This will never fail if the new maxbits is no larger
+    // that the original maxbits.  The underlying storage will
+    // not be reduced (so this is useful for creating a bitmap
+    // to match a particular storage size and then adjust it
+    // to a maximum allowed bit smaller than the storage)
+    mx_status_t Resize(uint32_t maxbits);
+
+    void Set(uint32_t n);
+    void Clr(uint32_t n);
+    bool Get(uint32_t n) const;
+
+    // Get a pointer to block 'blkno' in bitmap.
+    void* GetBlock(uint32_t blkno) const {
+        assert(blkno * kMinfsBlockSize <= bitcount_);
+        return (void*)((uintptr_t)(map_.get()) + (uintptr_t)(kMinfsBlockSize * blkno));
+    }
+
+    // Get a pointer to block 'blkno_out' in bitmap, which contains bit 'bitno'.
+    void* GetBitBlock(uint32_t* blkno_out, uint32_t bitno) const {
+        assert(bitno <= bitcount_);
+        *blkno_out = (bitno / kMinfsBlockBits);
+        return GetBlock(*blkno_out);
+    }
+
+    void* data() const { return map_.get(); }
+
+    uint32_t Capacity() const {
+        return bitcount_;
+    }
+
+private:
+    uint32_t Mapcount() const;
+    uint64_t* End() const;
+    size_t BytesRequired() const;
+
+    uint32_t bitcount_; // Number of addressable bits
+    mxtl::unique_free_ptr<uint64_t> map_; // Underlying map of bits
+};
+
 // Block Cache (bcache.c)
 class Bcache;
 
@@ -174,6 +377,12 @@ public:
     struct TypeHashTraits {
         static NodeState& node_state(BlockNode& bn) { return bn.type_hash_state_; }
     };
+    struct DirtyListTraits {
+        static NodeState& node_state(BlockNode& bn) { return bn.dirty_list_state_; }
+    };
+    struct CheckpointListTraits {
+        static NodeState& node_state(BlockNode& bn) { return bn.ckpt_list_state_; }
+    };
 
     // Create a single Block within a Block Cache
     static mx_status_t Create(Bcache* bc);
@@ -190,12 +399,16 @@ private:
     friend class BcacheLists;
     friend struct TypeListTraits;
     friend struct TypeHashTraits;
+    friend struct DirtyListTraits;
+    friend struct CheckpointListTraits;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(BlockNode);
     BlockNode();
 
     NodeState type_list_state_;
     NodeState type_hash_state_;
+    NodeState dirty_list_state_;
+    NodeState ckpt_list_state_;
     uint32_t flags_;
     uint32_t bno_;
     mxtl::unique_free_ptr<char> data_;
@@ -205,30 +418,60 @@ private:
 // one list to another.
 class BcacheLists {
 public:
+    explicit BcacheLists(uint32_t capacity) : size_(0), capacity_(capacity) {}
+
     void PushBack(mxtl::RefPtr<BlockNode> blk, uint32_t block_type);
     mxtl::RefPtr<BlockNode> PopFront(uint32_t block_type);
     mxtl::RefPtr<BlockNode> Erase(mxtl::RefPtr<BlockNode> blk, uint32_t block_type);
+    // Find the first block on a list that 'fn' accepts, without removing it.
+    template <typename UnaryFn>
+    BlockNode* Find(uint32_t block_type, UnaryFn fn) {
+        auto iter = GetList(block_type & kBlockLLFlags)->find_if(fn);
+        return iter.IsValid() ? &*iter : nullptr;
+    }
+
+    // Make room for one more block, or one less once a block has been taken
+    // off the lists for good.
+    void Grow() { capacity_++; }
+    void Shrink() { capacity_--; }
+    uint32_t Capacity() const { return capacity_; }
 
 private:
     using LinkedList = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>, BlockNode::TypeListTraits>;
     LinkedList* GetList(uint32_t block_type);
-    size_t SizeAllSlow() const; // Used for debugging
 
     LinkedList list_busy_;  // Between Get() and Put(). In hash.
     LinkedList list_lru_;   // Available for re-use. In hash.
     LinkedList list_free_;  // Never been used. Not in hash.
+    // Blocks on the lists, and blocks owned by the cache. These only differ
+    // while a block moves between lists (or during creation). Counted rather
+    // than walked, so checking them stays cheap for large caches.
+    uint32_t size_;
+    uint32_t capacity_;
 };
 
+// Bcache::Create() options
+// Defer writes of dirty blocks until Sync(), Close(), eviction, or until the
+// oldest dirty block has waited kMinfsFlushDelayMs. With a journal, this
+// groups the operations of that time into a single commit.
+constexpr uint32_t kBcacheWriteBack = 0x01;
+
+constexpr uint32_t kMinfsFlushDelayMs = 1000;
+// Most blocks written to disk by a single write when flushing.
+constexpr uint32_t kMinfsMaxFlushRun = 32;
+
 class Bcache {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Bcache);
     friend class BlockNode;
 
     static mx_status_t Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blocksize,
-                              uint32_t num);
+                              uint32_t num, uint32_t options = 0);
 
-    // Raw block read functions.
-    // These do not track blocks (or attempt to access the block cache)
+    // Uncached block read functions.
+    // These do not track blocks, but they do see (and update) a cached copy of
+    // the block, so they never read stale data or get overwritten by a later
+    // flush.
     mx_status_t Readblk(uint32_t bno, void* data);
     mx_status_t Writeblk(uint32_t bno, const void* data);
 
@@ -248,78 +491,108 @@ public:
     // Helper function which combines 'Get' and 'Put'.
     mx_status_t Read(uint32_t bno, void* data, uint32_t off, uint32_t len);
 
-    // drop all non-busy, non-dirty blocks
+    // write back dirty blocks, then drop all non-busy blocks
     void Invalidate();
 
+    // Write all dirty blocks to disk, in block order, coalescing runs of
+    // contiguous blocks into single writes. With a journal, they are
+    // committed to it and then checkpointed.
+    mx_status_t Flush();
+
     int Sync();
     int Close();
 
+    // Replay the journal in blocks [start, start + count), then journal all
+    // further changes to cached blocks there. Changes are committed at the
+    // end of the outermost transaction, or with -w once they have waited
+    // kMinfsFlushDelayMs, and written in place at the next checkpoint.
+    mx_status_t JournalStart(uint32_t start, uint32_t count);
+
+    // Bracket each filesystem operation, so that a commit never contains
+    // only part of one. Transactions nest.
+    void TxnBegin() { txn_depth_++; }
+    void TxnEnd();
+
+    // Sequence number the changes made now will be committed with, and
+    // whether changes made with sequence number 'seq' have been committed.
+    uint64_t TxnSeq() const { return jnl_seq_; }
+    bool Committed(uint64_t seq) const { return (jnl_count_ == 0) || (seq < jnl_seq_); }
+
+    // A block has been freed: forget changes to it that are not yet written,
+    // and keep the journal from replaying its old contents.
+    void Revoke(uint32_t bno);
+
+    // Testing aid: give up, like a sudden power loss, instead of performing
+    // the 'writes'th write to disk. The last write may be torn.
+    void CrashAfter(uint32_t writes) { crash_after_ = writes; }
+
     ~Bcache();
 
 private:
-    Bcache(int fd, uint32_t blockmax, uint32_t blocksize);
+    Bcache(int fd, uint32_t blockmax, uint32_t blocksize, uint32_t num, uint32_t options);
 
     mxtl::RefPtr<BlockNode> Get(uint32_t bno, uint32_t mode);
 
+    mx_status_t ReadblkRaw(uint32_t bno, void* data);
+    mx_status_t WriteblkRaw(uint32_t bno, const void* data, uint32_t count);
+
+    // Queue a block whose contents have changed to be written back.
+    void MarkDirty(const mxtl::RefPtr<BlockNode>& blk);
+    // Flush (or commit) if the oldest dirty block has waited long enough.
+    void MaybeFlush();
+    // Take a cached block to hold another, or return nullptr if the cache
+    // has to grow instead.
+    mxtl::RefPtr<BlockNode> Evict();
+    // Write 'count' blocks to their home locations, in block order.
+    mx_status_t WriteRuns(BlockNode** blks, uint32_t count);
+
+    // Journal (journal.cpp)
+    // Write the dirty blocks and pending revokes to the journal as a record.
+    mx_status_t Commit();
+    // Write every block in the journal in place, as last committed, from the
+    // cache where it still has that, and empty the journal.
+    mx_status_t Checkpoint();
+    mx_status_t JournalReplay();
+    mx_status_t JournalWriteInfo();
+    // Where the current contents of a block which is not cached are: its
+    // newest copy in the journal, if any, or its home location.
+    uint32_t JournalLocation(uint32_t bno) const;
+    // Wait for the journal to reach the disk before writing over anything
+    // it holds a copy of.
+    mx_status_t JournalBarrier();
+
     using HashTableBucket = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>, BlockNode::TypeHashTraits>;
-    using HashTable = mxtl::HashTable<uint32_t, mxtl::RefPtr<BlockNode>, HashTableBucket>;
+    // Sized for caches much larger than the default.
+    using HashTable = mxtl::HashTable<uint32_t, mxtl::RefPtr<BlockNode>, HashTableBucket,
+                                      size_t, kMinfsBuckets>;
+    using DirtyList = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>, BlockNode::DirtyListTraits>;
+    using CheckpointList = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>,
+                                                  BlockNode::CheckpointListTraits>;
     HashTable hash_; // Map of all 'in use' blocks, accessible by bno
     BcacheLists lists_;
+    DirtyList dirty_; // Blocks waiting to be written back, in no particular order.
+    uint32_t dirty_count_;
+    uint64_t dirty_since_; // When the oldest block on |dirty_| was dirtied, in ms.
     int fd_;
     uint32_t blockmax_;
     uint32_t blocksize_;
-};
-
-// Allocation Bitmap (bitmap.c)
-constexpr uint32_t BITMAP_FAIL = (0xFFFFFFFF);
-
-class Bitmap {
-public:
-    Bitmap();
-    ~Bitmap();
-
-    mx_status_t Init(uint32_t maxbits);
-    void Reset();
-
-    // find an available bit, set it, return that bitnumber
-    // returns BITMAP_FAIL if no bit is found
-    uint32_t Alloc(uint32_t minbit);
-
-    // This will never fail if the new maxbits is no larger
-    // that the original maxbits.  The underlying storage will
-    // not be reduced (so this is useful for creating a bitmap
-    // to match a particular storage size and then adjust it
-    // to a maximum allowed bit smaller than the storage)
-    mx_status_t Resize(uint32_t maxbits);
-
-    void Set(uint32_t n);
-    void Clr(uint32_t n);
-    bool Get(uint32_t n) const;
-
-    // Get a pointer to block 'blkno' in bitmap.
-    void* GetBlock(uint32_t blkno) const {
-        assert(blkno * kMinfsBlockSize <= bitcount_);
-        return (void*)((uintptr_t)(map_.get()) + (uintptr_t)(kMinfsBlockSize * blkno));
-    }
-
-    // Get a pointer to block 'blkno_out' in bitmap, which contains bit 'bitno'.
-    void* GetBitBlock(uint32_t* blkno_out, uint32_t bitno) const {
-        assert(bitno <= bitcount_);
-        *blkno_out = (bitno / kMinfsBlockBits);
-        return GetBlock(*blkno_out);
-    }
-
-    void* data() const { return map_.get(); }
-
-    uint32_t Capacity() const {
-        return bitcount_;
-    }
-
-private:
-    uint32_t Mapcount() const;
-    uint64_t* End() const;
-    size_t BytesRequired() const;
-
-    uint32_t bitcount_; // Number of addressable bits
-    mxtl::unique_free_ptr<uint64_t> map_; // Underlying map of bits
+    uint32_t num_;
+    uint32_t options_;
+
+    // Journal state. Without a journal, |jnl_count_| is 0.
+    CheckpointList ckpt_; // Cached blocks as last committed, not yet written in place.
+    uint32_t ckpt_count_;
+    Bitmap journaled_; // Blocks with a copy in the journal since the last checkpoint.
+    mxtl::unique_free_ptr<uint32_t> jnl_map_; // Block copied to each journal block, or 0.
+    mxtl::unique_free_ptr<uint32_t> revoked_; // Revokes for the next commit.
+    uint32_t revoke_count_;
+    uint32_t jnl_start_;
+    uint32_t jnl_count_;
+    uint32_t jnl_next_; // Where the next record goes, relative to the first record.
+    uint64_t jnl_seq_; // Sequence number of the next record.
+    bool jnl_unsynced_; // Records written since the last barrier.
+    uint32_t txn_depth_;
+
+    uint32_t writes_;
+    uint32_t crash_after_;
 };
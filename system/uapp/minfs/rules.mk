@@ -16,6 +16,7 @@ MODULE_SRCS := \
 MODULE_SRCS += \
     $(LOCAL_DIR)/bitmap.cpp \
     $(LOCAL_DIR)/bcache.cpp \
+    $(LOCAL_DIR)/journal.cpp \
     $(LOCAL_DIR)/rpc.cpp \
 
 # minfs implementation
@@ -23,6 +24,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/minfs.cpp \
     $(LOCAL_DIR)/minfs-ops.cpp \
     $(LOCAL_DIR)/minfs-check.cpp \
+    $(LOCAL_DIR)/minfs-extent.cpp \
 
 MODULE_STATIC_LIBS := \
     ulib/fs \
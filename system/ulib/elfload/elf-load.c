@@ -128,35 +128,49 @@ static mx_status_t choose_load_bias(mx_handle_t root_vmar,
     return status;
 }
 
-// TODO(mcgrathr): Temporary hack to avoid modifying the file VMO.
-// This will go away when we have copy-on-write.
+// Writable segments get a copy-on-write clone of the file VMO when the
+// handle lets the clone be written, so the file's pages are shared until
+// the process writes to them.  Otherwise the data is copied.
 static mx_status_t get_writable_vmo(mx_handle_t vmar_self,
                                     mx_handle_t vmo, size_t data_size,
                                     uintptr_t* file_start,
                                     uintptr_t* file_end,
                                     mx_handle_t* copy_vmo) {
-    mx_status_t status = mx_vmo_create(data_size, 0, copy_vmo);
+    mx_info_handle_basic_t info;
+    mx_status_t status = mx_object_get_info(vmo, MX_INFO_HANDLE_BASIC,
+                                            &info, sizeof(info), NULL, NULL);
     if (status != NO_ERROR)
         return status;
-    uintptr_t window = 0;
-    status = mx_vmar_map(vmar_self, 0, vmo,
-                         *file_start, data_size, MX_VM_FLAG_PERM_READ,
-                         &window);
-    if (status != NO_ERROR) {
-        mx_handle_close(*copy_vmo);
-        return status;
+    status = ERR_NOT_SUPPORTED;
+    if (info.rights & MX_RIGHT_WRITE)
+        status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE,
+                              *file_start, data_size, copy_vmo);
+    if (status == ERR_NOT_SUPPORTED) {
+        status = mx_vmo_create(data_size, 0, copy_vmo);
+        if (status != NO_ERROR)
+            return status;
+        uintptr_t window = 0;
+        status = mx_vmar_map(vmar_self, 0, vmo,
+                             *file_start, data_size, MX_VM_FLAG_PERM_READ,
+                             &window);
+        if (status != NO_ERROR) {
+            mx_handle_close(*copy_vmo);
+            return status;
+        }
+        size_t n;
+        status = mx_vmo_write(*copy_vmo, (void*)window, 0, data_size, &n);
+        mx_vmar_unmap(vmar_self, window, data_size);
+        if (status != NO_ERROR) {
+            mx_handle_close(*copy_vmo);
+            return status;
+        }
+        if (n != data_size) {
+            mx_handle_close(*copy_vmo);
+            return ERR_IO;
+        }
     }
-    size_t n;
-    status = mx_vmo_write(*copy_vmo, (void*)window, 0, data_size, &n);
-    mx_vmar_unmap(vmar_self, window, data_size);
-    if (status != NO_ERROR) {
-        mx_handle_close(*copy_vmo);
+    if (status != NO_ERROR)
         return status;
-    }
-    if (n != data_size) {
-        mx_handle_close(*copy_vmo);
-        return ERR_IO;
-    }
     *file_end -= *file_start;
     *file_start = 0;
     return NO_ERROR;
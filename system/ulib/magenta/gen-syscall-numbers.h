@@ -2,124 +2,137 @@
 // This is a GENERATED file. The license governing this file can be found in the LICENSE file.
 
 #define MX_SYS_time_get 0
-#define MX_SYS_nanosleep 1
-#define MX_SYS_ticks_get 2
-#define MX_SYS_ticks_per_second 3
-#define MX_SYS_num_cpus 4
-#define MX_SYS_version_get 5
-#define MX_SYS_cache_flush 6
-#define MX_SYS_handle_close 7
-#define MX_SYS_handle_duplicate 8
-#define MX_SYS_handle_replace 9
-#define MX_SYS_object_wait_one 10
-#define MX_SYS_object_wait_many 11
-#define MX_SYS_object_wait_async 12
-#define MX_SYS_object_signal 13
-#define MX_SYS_object_signal_peer 14
-#define MX_SYS_object_get_property 15
-#define MX_SYS_object_set_property 16
-#define MX_SYS_object_get_info 17
-#define MX_SYS_object_get_child 18
-#define MX_SYS_object_bind_exception_port 19
-#define MX_SYS_channel_create 20
-#define MX_SYS_channel_read 21
-#define MX_SYS_channel_write 22
-#define MX_SYS_channel_call 23
-#define MX_SYS_socket_create 24
-#define MX_SYS_socket_write 25
-#define MX_SYS_socket_read 26
-#define MX_SYS_thread_exit 27
-#define MX_SYS_thread_create 28
-#define MX_SYS_thread_start 29
-#define MX_SYS_thread_read_state 30
-#define MX_SYS_thread_write_state 31
-#define MX_SYS_process_exit 32
-#define MX_SYS_process_create 33
-#define MX_SYS_process_start 34
-#define MX_SYS_process_read_memory 35
-#define MX_SYS_process_write_memory 36
-#define MX_SYS_job_create 37
-#define MX_SYS_task_resume 38
-#define MX_SYS_task_kill 39
-#define MX_SYS_event_create 40
-#define MX_SYS_eventpair_create 41
-#define MX_SYS_futex_wait 42
-#define MX_SYS_futex_wake 43
-#define MX_SYS_futex_requeue 44
-#define MX_SYS_waitset_create 45
-#define MX_SYS_waitset_add 46
-#define MX_SYS_waitset_remove 47
-#define MX_SYS_waitset_wait 48
-#define MX_SYS_port_create 49
-#define MX_SYS_port_queue 50
-#define MX_SYS_port_wait 51
-#define MX_SYS_port_bind 52
-#define MX_SYS_vmo_create 53
-#define MX_SYS_vmo_read 54
-#define MX_SYS_vmo_write 55
-#define MX_SYS_vmo_get_size 56
-#define MX_SYS_vmo_set_size 57
-#define MX_SYS_vmo_op_range 58
-#define MX_SYS_cprng_draw 59
-#define MX_SYS_cprng_add_entropy 60
-#define MX_SYS_fifo_create 61
-#define MX_SYS_fifo_read 62
-#define MX_SYS_fifo_write 63
-#define MX_SYS_log_create 64
-#define MX_SYS_log_write 65
-#define MX_SYS_log_read 66
-#define MX_SYS_ktrace_read 67
-#define MX_SYS_ktrace_control 68
-#define MX_SYS_ktrace_write 69
-#define MX_SYS_mtrace_control 70
-#define MX_SYS_debug_transfer_handle 71
-#define MX_SYS_debug_read 72
-#define MX_SYS_debug_write 73
-#define MX_SYS_debug_send_command 74
-#define MX_SYS_interrupt_create 75
-#define MX_SYS_interrupt_complete 76
-#define MX_SYS_interrupt_wait 77
-#define MX_SYS_interrupt_signal 78
-#define MX_SYS_mmap_device_io 79
-#define MX_SYS_mmap_device_memory 80
-#define MX_SYS_io_mapping_get_info 81
-#define MX_SYS_vmo_create_contiguous 82
-#define MX_SYS_vmar_allocate 83
-#define MX_SYS_vmar_destroy 84
-#define MX_SYS_vmar_map 85
-#define MX_SYS_vmar_unmap 86
-#define MX_SYS_vmar_protect 87
-#define MX_SYS_bootloader_fb_get_info 88
-#define MX_SYS_set_framebuffer 89
-#define MX_SYS_clock_adjust 90
-#define MX_SYS_pci_get_nth_device 91
-#define MX_SYS_pci_claim_device 92
-#define MX_SYS_pci_enable_bus_master 93
-#define MX_SYS_pci_enable_pio 94
-#define MX_SYS_pci_reset_device 95
-#define MX_SYS_pci_map_mmio 96
-#define MX_SYS_pci_io_write 97
-#define MX_SYS_pci_io_read 98
-#define MX_SYS_pci_map_interrupt 99
-#define MX_SYS_pci_map_config 100
-#define MX_SYS_pci_query_irq_mode_caps 101
-#define MX_SYS_pci_set_irq_mode 102
-#define MX_SYS_pci_init 103
-#define MX_SYS_pci_add_subtract_io_range 104
-#define MX_SYS_acpi_uefi_rsdp 105
-#define MX_SYS_acpi_cache_flush 106
-#define MX_SYS_resource_create 107
-#define MX_SYS_resource_get_handle 108
-#define MX_SYS_resource_do_action 109
-#define MX_SYS_resource_connect 110
-#define MX_SYS_resource_accept 111
-#define MX_SYS_syscall_test_0 112
-#define MX_SYS_syscall_test_1 113
-#define MX_SYS_syscall_test_2 114
-#define MX_SYS_syscall_test_3 115
-#define MX_SYS_syscall_test_4 116
-#define MX_SYS_syscall_test_5 117
-#define MX_SYS_syscall_test_6 118
-#define MX_SYS_syscall_test_7 119
-#define MX_SYS_syscall_test_8 120
+#define MX_SYS_time_get_kernel 1
+#define MX_SYS_nanosleep 2
+#define MX_SYS_ticks_get 3
+#define MX_SYS_ticks_per_second 4
+#define MX_SYS_num_cpus 5
+#define MX_SYS_version_get 6
+#define MX_SYS_cache_flush 7
+#define MX_SYS_handle_close 8
+#define MX_SYS_handle_duplicate 9
+#define MX_SYS_handle_replace 10
+#define MX_SYS_object_wait_one 11
+#define MX_SYS_object_wait_many 12
+#define MX_SYS_object_wait_async 13
+#define MX_SYS_object_signal 14
+#define MX_SYS_object_signal_peer 15
+#define MX_SYS_object_get_property 16
+#define MX_SYS_object_set_property 17
+#define MX_SYS_object_get_info 18
+#define MX_SYS_object_get_child 19
+#define MX_SYS_object_bind_exception_port 20
+#define MX_SYS_channel_create 21
+#define MX_SYS_channel_read 22
+#define MX_SYS_channel_write 23
+#define MX_SYS_channel_call 24
+#define MX_SYS_channel_read_many 25
+#define MX_SYS_channel_write_many 26
+#define MX_SYS_socket_create 27
+#define MX_SYS_socket_write 28
+#define MX_SYS_socket_read 29
+#define MX_SYS_socket_create_etc 30
+#define MX_SYS_socket_writev 31
+#define MX_SYS_socket_readv 32
+#define MX_SYS_socket_splice 33
+#define MX_SYS_thread_exit 34
+#define MX_SYS_thread_create 35
+#define MX_SYS_thread_start 36
+#define MX_SYS_thread_read_state 37
+#define MX_SYS_thread_write_state 38
+#define MX_SYS_process_exit 39
+#define MX_SYS_process_create 40
+#define MX_SYS_process_start 41
+#define MX_SYS_process_read_memory 42
+#define MX_SYS_process_write_memory 43
+#define MX_SYS_job_create 44
+#define MX_SYS_task_resume 45
+#define MX_SYS_task_kill 46
+#define MX_SYS_event_create 47
+#define MX_SYS_eventpair_create 48
+#define MX_SYS_futex_wait 49
+#define MX_SYS_futex_wake 50
+#define MX_SYS_futex_requeue 51
+#define MX_SYS_futex_lock_pi 52
+#define MX_SYS_futex_unlock_pi 53
+#define MX_SYS_waitset_create 54
+#define MX_SYS_waitset_add 55
+#define MX_SYS_waitset_remove 56
+#define MX_SYS_waitset_wait 57
+#define MX_SYS_port_create 58
+#define MX_SYS_port_queue 59
+#define MX_SYS_port_wait 60
+#define MX_SYS_port_wait_many 61
+#define MX_SYS_port_bind 62
+#define MX_SYS_vmo_create 63
+#define MX_SYS_vmo_read 64
+#define MX_SYS_vmo_write 65
+#define MX_SYS_vmo_get_size 66
+#define MX_SYS_vmo_set_size 67
+#define MX_SYS_vmo_op_range 68
+#define MX_SYS_vmo_clone 69
+#define MX_SYS_cprng_draw 70
+#define MX_SYS_cprng_add_entropy 71
+#define MX_SYS_fifo_create 72
+#define MX_SYS_fifo_read 73
+#define MX_SYS_fifo_write 74
+#define MX_SYS_fifo_get_ring 75
+#define MX_SYS_fifo_doorbell 76
+#define MX_SYS_log_create 77
+#define MX_SYS_log_write 78
+#define MX_SYS_log_read 79
+#define MX_SYS_ktrace_read 80
+#define MX_SYS_ktrace_control 81
+#define MX_SYS_ktrace_write 82
+#define MX_SYS_mtrace_control 83
+#define MX_SYS_debug_transfer_handle 84
+#define MX_SYS_debug_read 85
+#define MX_SYS_debug_write 86
+#define MX_SYS_debug_send_command 87
+#define MX_SYS_interrupt_create 88
+#define MX_SYS_interrupt_complete 89
+#define MX_SYS_interrupt_wait 90
+#define MX_SYS_interrupt_signal 91
+#define MX_SYS_mmap_device_io 92
+#define MX_SYS_mmap_device_memory 93
+#define MX_SYS_io_mapping_get_info 94
+#define MX_SYS_vmo_create_contiguous 95
+#define MX_SYS_vmar_allocate 96
+#define MX_SYS_vmar_destroy 97
+#define MX_SYS_vmar_map 98
+#define MX_SYS_vmar_unmap 99
+#define MX_SYS_vmar_protect 100
+#define MX_SYS_bootloader_fb_get_info 101
+#define MX_SYS_set_framebuffer 102
+#define MX_SYS_clock_adjust 103
+#define MX_SYS_pci_get_nth_device 104
+#define MX_SYS_pci_claim_device 105
+#define MX_SYS_pci_enable_bus_master 106
+#define MX_SYS_pci_enable_pio 107
+#define MX_SYS_pci_reset_device 108
+#define MX_SYS_pci_map_mmio 109
+#define MX_SYS_pci_io_write 110
+#define MX_SYS_pci_io_read 111
+#define MX_SYS_pci_map_interrupt 112
+#define MX_SYS_pci_map_config 113
+#define MX_SYS_pci_query_irq_mode_caps 114
+#define MX_SYS_pci_set_irq_mode 115
+#define MX_SYS_pci_init 116
+#define MX_SYS_pci_add_subtract_io_range 117
+#define MX_SYS_acpi_uefi_rsdp 118
+#define MX_SYS_acpi_cache_flush 119
+#define MX_SYS_resource_create 120
+#define MX_SYS_resource_get_handle 121
+#define MX_SYS_resource_do_action 122
+#define MX_SYS_resource_connect 123
+#define MX_SYS_resource_accept 124
+#define MX_SYS_syscall_test_0 125
+#define MX_SYS_syscall_test_1 126
+#define MX_SYS_syscall_test_2 127
+#define MX_SYS_syscall_test_3 128
+#define MX_SYS_syscall_test_4 129
+#define MX_SYS_syscall_test_5 130
+#define MX_SYS_syscall_test_6 131
+#define MX_SYS_syscall_test_7 132
+#define MX_SYS_syscall_test_8 133
 
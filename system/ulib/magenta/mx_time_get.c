@@ -0,0 +1,72 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+
+#include <magenta/compiler.h>
+#include "private.h"
+
+// This is u64_mul_u64_fp32_64 from the kernel's lib/fixed_point.h, so
+// that the time computed here matches current_time_hires() exactly.
+static uint64_t ticks_to_ns(uint64_t ticks, uint32_t l0, uint32_t l32, uint32_t l64) {
+    uint32_t a_r32 = ticks >> 32;
+    uint32_t a_0 = ticks;
+    uint64_t res_0;
+    uint64_t res_l32;
+    uint32_t res_l32_32;
+    uint64_t tmp;
+
+    tmp = (uint64_t)a_r32 * l0;
+    res_0 = tmp << 32;
+    tmp = (uint64_t)a_0 * l0;
+    res_0 += tmp;
+    tmp = (uint64_t)a_r32 * l32;
+    res_0 += tmp;
+    tmp = (uint64_t)a_0 * l32;
+    res_0 += tmp >> 32;
+    res_l32 = (uint32_t)tmp;
+    tmp = (uint64_t)a_r32 * l64;
+    res_0 += tmp >> 32;
+    res_l32 += (uint32_t)tmp;
+    tmp = (uint64_t)a_0 * l64;
+    res_l32 += tmp >> 32;
+    res_0 += res_l32 >> 32;
+    res_l32_32 = res_l32;
+    return res_0 + (res_l32_32 >> 31);
+}
+
+#define CLOCK_LOAD(member) __atomic_load_n(&DATA_CLOCK.member, __ATOMIC_RELAXED)
+
+mx_time_t _mx_time_get(uint32_t clock_id) {
+    if (clock_id != MX_CLOCK_MONOTONIC && clock_id != MX_CLOCK_UTC)
+        return _SYSCALL_mx_time_get_kernel(clock_id);
+
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&DATA_CLOCK.seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+
+        if (!CLOCK_LOAD(ticks_valid))
+            return _SYSCALL_mx_time_get_kernel(clock_id);
+
+        uint64_t ticks = read_ticks();
+        uint32_t l0 = CLOCK_LOAD(ns_per_tick_l0);
+        uint32_t l32 = CLOCK_LOAD(ns_per_tick_l32);
+        uint32_t l64 = CLOCK_LOAD(ns_per_tick_l64);
+        int64_t utc_offset = CLOCK_LOAD(utc_offset);
+
+        // Order the loads above before the check of seq below.
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&DATA_CLOCK.seq, __ATOMIC_RELAXED) != seq)
+            continue;
+
+        mx_time_t time = ticks_to_ns(ticks, l0, l32, l64);
+        if (clock_id == MX_CLOCK_UTC)
+            time += utc_offset;
+        return time;
+    }
+}
+
+__typeof(mx_time_get) mx_time_get
+    __attribute__((weak, alias("_mx_time_get")));
@@ -7,5 +7,35 @@
 // This defines the struct shared with the kernel.
 #include <lib/vdso-constants.h>
 
+#include <magenta/types.h>
+
 extern const struct vdso_constants DATA_CONSTANTS
     __attribute__((visibility("hidden")));
+
+extern const struct vdso_clock DATA_CLOCK
+    __attribute__((visibility("hidden")));
+
+// Stubs for internal syscalls, defined in the generated assembly.
+extern mx_time_t _SYSCALL_mx_time_get_kernel(uint32_t clock_id)
+    __attribute__((visibility("hidden")));
+
+// Read the counter behind mx_ticks_get.  This is inline so that other vDSO
+// code can use it without a call through the PLT.
+static inline uint64_t read_ticks(void) {
+#if __aarch64__
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, pmccntr_el0" : "=r" (ticks));
+    return ticks;
+#elif __x86_64__
+    uint32_t ticks_low;
+    uint32_t ticks_high;
+    __asm__ volatile("rdtsc" : "=a" (ticks_low), "=d" (ticks_high));
+    return ((uint64_t)ticks_high << 32) | ticks_low;
+#elif __i386__
+    uint64_t ticks;
+    __asm__ volatile("rdtsc" : "=A" (ticks));
+    return ticks;
+#else
+#error Unsupported architecture
+#endif
+}
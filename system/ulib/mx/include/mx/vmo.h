@@ -48,6 +48,9 @@ public:
                          void* buffer, size_t buffer_size) const {
         return mx_vmo_op_range(get(), op, offset, size, buffer, buffer_size);
     }
+
+    mx_status_t clone(uint32_t options, uint64_t offset, uint64_t size,
+                      vmo* result) const;
 };
 
 } // namespace mx
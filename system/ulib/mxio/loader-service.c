@@ -46,6 +46,75 @@ static const char* libpaths[] = {
     "/boot/lib",
 };
 
+// Library files are read in once and cached here.  Every load hands out a
+// copy-on-write clone of the cached VMO, so all the processes using a
+// library share its pages until they write to them.
+#define VMO_CACHE_SIZE 32
+
+typedef struct {
+    char* path;
+    off_t size;
+    time_t mtime;
+    mx_handle_t vmo;
+} vmo_cache_entry_t;
+
+static mtx_t vmo_cache_lock = MTX_INIT;
+static vmo_cache_entry_t vmo_cache[VMO_CACHE_SIZE];
+static unsigned vmo_cache_next;
+
+// Returns a clone of the cached VMO for |path| if the file hasn't changed
+// since it was cached, or MX_HANDLE_INVALID.
+static mx_handle_t vmo_cache_lookup(const char* path, const struct stat* s) {
+    mx_handle_t clone = MX_HANDLE_INVALID;
+    mtx_lock(&vmo_cache_lock);
+    for (unsigned n = 0; n < countof(vmo_cache); n++) {
+        vmo_cache_entry_t* e = &vmo_cache[n];
+        if (e->path == NULL || strcmp(e->path, path))
+            continue;
+        if (e->size == s->st_size && e->mtime == s->st_mtime) {
+            if (mx_vmo_clone(e->vmo, MX_VMO_CLONE_COPY_ON_WRITE,
+                             0, e->size, &clone) < 0)
+                clone = MX_HANDLE_INVALID;
+        }
+        break;
+    }
+    mtx_unlock(&vmo_cache_lock);
+    return clone;
+}
+
+// Takes ownership of |vmo| and caches it as the contents of |path|,
+// replacing any stale copy of the file or else the oldest entry.
+static void vmo_cache_insert(const char* path, const struct stat* s,
+                             mx_handle_t vmo) {
+    char* p = strdup(path);
+    if (p == NULL) {
+        mx_handle_close(vmo);
+        return;
+    }
+
+    mtx_lock(&vmo_cache_lock);
+    unsigned slot = vmo_cache_next;
+    for (unsigned n = 0; n < countof(vmo_cache); n++) {
+        if (vmo_cache[n].path && !strcmp(vmo_cache[n].path, path)) {
+            slot = n;
+            break;
+        }
+    }
+    if (slot == vmo_cache_next)
+        vmo_cache_next = (vmo_cache_next + 1) % countof(vmo_cache);
+
+    vmo_cache_entry_t* e = &vmo_cache[slot];
+    if (e->path) {
+        free(e->path);
+        mx_handle_close(e->vmo);
+    }
+    e->path = p;
+    e->size = s->st_size;
+    e->mtime = s->st_mtime;
+    e->vmo = vmo;
+    mtx_unlock(&vmo_cache_lock);
+}
+
 static mx_handle_t default_load_object(void* ignored, const char* fn) {
     char buffer[8192];  // 8K is the max io size of the mxio layer right now
     char path[PATH_MAX];
@@ -71,6 +140,11 @@ found:
         goto fail;
     }
 
+    if ((vmo = vmo_cache_lookup(path, &s)) != MX_HANDLE_INVALID) {
+        close(fd);
+        return vmo;
+    }
+
     if ((err = mx_vmo_create(s.st_size, 0, &vmo)) < 0) {
         goto fail;
     }
@@ -96,7 +170,13 @@ found:
         size -= xfer;
     }
     close(fd);
-    return vmo;
+
+    // Keep the file's contents for next time and give out a clone of them.
+    mx_handle_t clone;
+    if (mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, s.st_size, &clone) < 0)
+        return vmo;
+    vmo_cache_insert(path, &s, vmo);
+    return clone;
 
 fail:
     close(fd);
@@ -770,6 +770,78 @@ static bool channel_nest(void) {
     END_TEST;
 }
 
+static bool channel_read_write_many(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    // three messages, the middle one carrying a handle
+    uint32_t data[3] = {1u, 2u, 3u};
+    mx_handle_t sent;
+    ASSERT_EQ(mx_handle_duplicate(event, MX_RIGHT_SAME_RIGHTS, &sent), NO_ERROR, "");
+    mx_channel_msg_t out[3] = {
+        {&data[0], NULL, sizeof(uint32_t), 0u, 0u, 0u},
+        {&data[1], &sent, sizeof(uint32_t), 1u, 0u, 0u},
+        {&data[2], NULL, sizeof(uint32_t), 0u, 0u, 0u},
+    };
+    uint32_t actual = 0u;
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, out, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 3u, "wrong number of messages written");
+
+    // a buffer too small for the first message reads nothing
+    uint32_t in_data[4] = {};
+    mx_handle_t received = MX_HANDLE_INVALID;
+    mx_channel_msg_t in[4] = {
+        {&in_data[0], NULL, 0u, 0u, 0u, 0u},
+    };
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, in, 1u, &actual), ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(in[0].actual_bytes, sizeof(uint32_t), "wrong size");
+
+    // reading stops at the message that doesn't fit: the second one's handle
+    in[0].num_bytes = sizeof(uint32_t);
+    in[1] = (mx_channel_msg_t){&in_data[1], NULL, sizeof(uint32_t), 0u, 0u, 0u};
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, in, 2u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "wrong number of messages read");
+    EXPECT_EQ(in_data[0], 1u, "wrong message");
+
+    // the rest come out in order, with the handle
+    in[0] = (mx_channel_msg_t){&in_data[1], &received, sizeof(uint32_t), 1u, 0u, 0u};
+    in[1] = (mx_channel_msg_t){&in_data[2], NULL, sizeof(uint32_t), 0u, 0u, 0u};
+    in[2] = (mx_channel_msg_t){&in_data[3], NULL, sizeof(uint32_t), 0u, 0u, 0u};
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, in, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 2u, "wrong number of messages read");
+    EXPECT_EQ(in_data[1], 2u, "wrong message");
+    EXPECT_EQ(in[0].actual_handles, 1u, "wrong number of handles");
+    EXPECT_EQ(in_data[2], 3u, "wrong message");
+    EXPECT_NEQ(received, MX_HANDLE_INVALID, "no handle received");
+    EXPECT_EQ(mx_object_wait_one(channel[1], MX_CHANNEL_READABLE, 0u, NULL), ERR_TIMED_OUT, "");
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, in, 3u, &actual), ERR_SHOULD_WAIT, "");
+
+    // a bad message in the middle still lets the ones before it through
+    out[1].handles = &channel[0];
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, out, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "wrong number of messages written");
+
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, out, 0u, &actual), ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, out, MX_CHANNEL_MAX_MSGS_PER_CALL + 1, &actual),
+              ERR_OUT_OF_RANGE, "");
+
+    // with the peer gone, the handles of the batch stay with the writer
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+    out[1].handles = &received;
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, out, 3u, &actual), ERR_REMOTE_CLOSED, "");
+    EXPECT_EQ(mx_handle_close(received), NO_ERROR, "handle was lost");
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(event), NO_ERROR, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
@@ -781,6 +853,7 @@ RUN_TEST(channel_may_discard)
 RUN_TEST(channel_call)
 RUN_TEST(channel_call2)
 RUN_TEST(channel_nest)
+RUN_TEST(channel_read_write_many)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
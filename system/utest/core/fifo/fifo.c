@@ -3,9 +3,11 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 #include <unistd.h>
 
@@ -108,8 +110,246 @@ static bool basic_test(void) {
     END_TEST;
 }
 
+// One endpoint of a MX_FIFO_SHARED_RING fifo, with the rings mapped.
+typedef struct {
+    mx_handle_t fifo;
+    uintptr_t base;
+    uint32_t ring; // the ring we produce into
+    uint32_t elem_count;
+} ring_end_t;
+
+static bool ring_end_init(ring_end_t* end, mx_handle_t fifo, uint32_t elem_count) {
+    mx_handle_t vmo;
+    end->fifo = fifo;
+    end->elem_count = elem_count;
+    if (mx_fifo_get_ring(fifo, &vmo, &end->ring) != NO_ERROR)
+        return false;
+    mx_status_t status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, MX_FIFO_RING_VMO_SIZE,
+                                     MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &end->base);
+    mx_handle_close(vmo);
+    return status == NO_ERROR;
+}
+
+static void ring_end_destroy(ring_end_t* end) {
+    mx_vmar_unmap(mx_vmar_root_self(), end->base, MX_FIFO_RING_VMO_SIZE);
+    mx_handle_close(end->fifo);
+}
+
+static mx_fifo_ring_t* ring_header(ring_end_t* end, uint32_t ring) {
+    return (mx_fifo_ring_t*)(end->base + MX_FIFO_RING_HEADER(ring));
+}
+
+static uint64_t* ring_entries(ring_end_t* end, uint32_t ring) {
+    return (uint64_t*)(end->base + MX_FIFO_RING_ENTRIES(ring));
+}
+
+static bool ring_can_send(ring_end_t* end) {
+    mx_fifo_ring_t* r = ring_header(end, end->ring);
+    return r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) < end->elem_count;
+}
+
+static bool ring_can_receive(ring_end_t* end) {
+    mx_fifo_ring_t* r = ring_header(end, end->ring ^ 1);
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != r->tail;
+}
+
+// Waits until |ready| holds, spinning briefly before falling back to a
+// doorbell and a wait on |signal|.  Returns false if the peer went away.
+static bool ring_wait(ring_end_t* end, bool (*ready)(ring_end_t*), mx_signals_t signal) {
+    for (int spins = 0; !ready(end); spins++) {
+        if (spins < 100)
+            continue;
+        // The signals are only as fresh as the last doorbell, so ring it
+        // before trusting them.
+        if (mx_fifo_doorbell(end->fifo) != NO_ERROR)
+            return false;
+        if (ready(end))
+            break;
+        mx_signals_t pending;
+        mx_object_wait_one(end->fifo, signal | MX_FIFO_PEER_CLOSED, MX_TIME_INFINITE, &pending);
+        if (pending & MX_FIFO_PEER_CLOSED)
+            return false;
+    }
+    return true;
+}
+
+static bool ring_send(ring_end_t* end, uint64_t value) {
+    if (!ring_wait(end, ring_can_send, MX_FIFO_WRITABLE))
+        return false;
+    mx_fifo_ring_t* r = ring_header(end, end->ring);
+    uint32_t head = r->head;
+    ring_entries(end, end->ring)[head & (end->elem_count - 1)] = value;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+    // If the consumer had drained everything before this entry, it may be
+    // about to wait for it.
+    if (__atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) == head)
+        mx_fifo_doorbell(end->fifo);
+    return true;
+}
+
+static bool ring_receive(ring_end_t* end, uint64_t* value) {
+    if (!ring_wait(end, ring_can_receive, MX_FIFO_READABLE))
+        return false;
+    mx_fifo_ring_t* r = ring_header(end, end->ring ^ 1);
+    uint32_t tail = r->tail;
+    *value = ring_entries(end, end->ring ^ 1)[tail & (end->elem_count - 1)];
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+    // If the ring was full, the producer may be waiting for room.
+    if (__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) - tail == end->elem_count)
+        mx_fifo_doorbell(end->fifo);
+    return true;
+}
+
+static bool shared_ring_test(void) {
+    BEGIN_TEST;
+    mx_handle_t a, b;
+    uint64_t n[8] = { 1, 2, 3, 4, 5, 6, 7, 8};
+    uint32_t actual;
+
+    EXPECT_EQ(mx_fifo_create(8, 8, ~MX_FIFO_SHARED_RING, &a, &b), ERR_INVALID_ARGS, "");
+    ASSERT_EQ(mx_fifo_create(8, 8, MX_FIFO_SHARED_RING, &a, &b), NO_ERROR, "");
+    EXPECT_SIGNALS(a, MX_FIFO_WRITABLE);
+    EXPECT_SIGNALS(b, MX_FIFO_WRITABLE);
+
+    // entries only move through the shared rings
+    EXPECT_EQ(mx_fifo_write(a, n, sizeof(n), &actual), ERR_BAD_STATE, "");
+    EXPECT_EQ(mx_fifo_read(b, n, sizeof(n), &actual), ERR_BAD_STATE, "");
+
+    ring_end_t ea, eb;
+    ASSERT_TRUE(ring_end_init(&ea, a, 8), "");
+    ASSERT_TRUE(ring_end_init(&eb, b, 8), "");
+    ASSERT_EQ(ea.ring ^ eb.ring, 1u, "endpoints should produce into different rings");
+
+    // the kernel reads the indices through its own mapping, so the ring's
+    // pages must stay put
+    mx_handle_t vmo;
+    uint32_t ring;
+    ASSERT_EQ(mx_fifo_get_ring(a, &vmo, &ring), NO_ERROR, "");
+    EXPECT_EQ(mx_vmo_set_size(vmo, 0), ERR_NOT_SUPPORTED, "");
+    EXPECT_EQ(mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, MX_FIFO_RING_VMO_SIZE, NULL, 0),
+              ERR_NOT_SUPPORTED, "");
+    mx_handle_close(vmo);
+    EXPECT_EQ(mx_fifo_doorbell(a), NO_ERROR, "");
+
+    // fill a's ring; the signals follow the doorbells
+    for (uint64_t i = 0; i < 8; i++)
+        ASSERT_TRUE(ring_send(&ea, i), "");
+    EXPECT_FALSE(ring_can_send(&ea), "");
+    ASSERT_EQ(mx_fifo_doorbell(a), NO_ERROR, "");
+    EXPECT_SIGNALS(a, 0u);
+    EXPECT_SIGNALS(b, MX_FIFO_READABLE | MX_FIFO_WRITABLE);
+
+    for (uint64_t i = 0; i < 8; i++) {
+        uint64_t value;
+        ASSERT_TRUE(ring_receive(&eb, &value), "");
+        ASSERT_EQ(value, i, "");
+    }
+    ASSERT_EQ(mx_fifo_doorbell(b), NO_ERROR, "");
+    EXPECT_SIGNALS(a, MX_FIFO_WRITABLE);
+    EXPECT_SIGNALS(b, MX_FIFO_WRITABLE);
+
+    ring_end_destroy(&eb);
+    EXPECT_SIGNALS(a, MX_FIFO_PEER_CLOSED);
+    EXPECT_EQ(mx_fifo_doorbell(a), ERR_REMOTE_CLOSED, "");
+    ring_end_destroy(&ea);
+
+    // rings are only available in shared ring mode
+    ASSERT_EQ(mx_fifo_create(8, 8, 0, &a, &b), NO_ERROR, "");
+    EXPECT_EQ(mx_fifo_get_ring(a, &vmo, &ring), ERR_BAD_STATE, "");
+    EXPECT_EQ(mx_fifo_doorbell(a), ERR_BAD_STATE, "");
+    mx_handle_close(a);
+    mx_handle_close(b);
+
+    END_TEST;
+}
+
+#define PING_PONG_ROUNDS 100000
+#define PING_PONG_DEPTH 16
+
+static int copy_pong_thread(void* arg) {
+    mx_handle_t fifo = *(mx_handle_t*)arg;
+    for (;;) {
+        uint64_t value;
+        uint32_t actual;
+        mx_status_t status;
+        while ((status = mx_fifo_read(fifo, &value, sizeof(value), &actual)) == ERR_SHOULD_WAIT) {
+            mx_signals_t pending;
+            mx_object_wait_one(fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
+                               MX_TIME_INFINITE, &pending);
+            if (pending & MX_FIFO_PEER_CLOSED)
+                return 0;
+        }
+        if (status != NO_ERROR || mx_fifo_write(fifo, &value, sizeof(value), &actual) != NO_ERROR)
+            return 0;
+    }
+}
+
+static int ring_pong_thread(void* arg) {
+    ring_end_t* end = arg;
+    uint64_t value;
+    while (ring_receive(end, &value)) {
+        if (!ring_send(end, value))
+            break;
+    }
+    return 0;
+}
+
+// Bounces one entry back and forth between two threads, first through the
+// copying fifo calls and then through a shared ring, and reports how many
+// entries per second each moves.
+static bool ping_pong_benchmark(void) {
+    BEGIN_TEST;
+    mx_handle_t a, b;
+    thrd_t thread;
+
+    ASSERT_EQ(mx_fifo_create(PING_PONG_DEPTH, sizeof(uint64_t), 0, &a, &b), NO_ERROR, "");
+    ASSERT_EQ(thrd_create(&thread, copy_pong_thread, &b), thrd_success, "");
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (uint64_t i = 0; i < PING_PONG_ROUNDS; i++) {
+        uint64_t value = i;
+        uint32_t actual;
+        ASSERT_EQ(mx_fifo_write(a, &value, sizeof(value), &actual), NO_ERROR, "");
+        mx_status_t status;
+        while ((status = mx_fifo_read(a, &value, sizeof(value), &actual)) == ERR_SHOULD_WAIT)
+            mx_object_wait_one(a, MX_FIFO_READABLE, MX_TIME_INFINITE, NULL);
+        ASSERT_EQ(status, NO_ERROR, "");
+        ASSERT_EQ(value, i, "");
+    }
+    mx_time_t copy_elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    mx_handle_close(a);
+    thrd_join(thread, NULL);
+    mx_handle_close(b);
+
+    ASSERT_EQ(mx_fifo_create(PING_PONG_DEPTH, sizeof(uint64_t), MX_FIFO_SHARED_RING, &a, &b),
+              NO_ERROR, "");
+    ring_end_t ea, eb;
+    ASSERT_TRUE(ring_end_init(&ea, a, PING_PONG_DEPTH), "");
+    ASSERT_TRUE(ring_end_init(&eb, b, PING_PONG_DEPTH), "");
+    ASSERT_EQ(thrd_create(&thread, ring_pong_thread, &eb), thrd_success, "");
+    start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (uint64_t i = 0; i < PING_PONG_ROUNDS; i++) {
+        uint64_t value;
+        ASSERT_TRUE(ring_send(&ea, i), "");
+        ASSERT_TRUE(ring_receive(&ea, &value), "");
+        ASSERT_EQ(value, i, "");
+    }
+    mx_time_t ring_elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    ring_end_destroy(&ea);
+    thrd_join(thread, NULL);
+    ring_end_destroy(&eb);
+
+    // each round moves two entries
+    unittest_printf("\ncopy: %" PRIu64 " entries/sec, shared ring: %" PRIu64 " entries/sec\n",
+                    2ull * PING_PONG_ROUNDS * 1000000000 / copy_elapsed,
+                    2ull * PING_PONG_ROUNDS * 1000000000 / ring_elapsed);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(fifo_tests)
 RUN_TEST(basic_test)
+RUN_TEST(shared_ring_test)
+RUN_TEST(ping_pong_benchmark)
 END_TEST_CASE(fifo_tests)
 
 #ifndef BUILD_COMBINED_TESTS
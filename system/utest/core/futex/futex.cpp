@@ -390,10 +390,162 @@ static bool test_futex_misaligned() {
 
   mx_futex_t* futex_2 = (mx_futex_t*)&buffer[2];
   ASSERT_EQ(mx_futex_requeue(futex, 1, 0, futex_2, 1), ERR_INVALID_ARGS, "");
+  ASSERT_EQ(mx_futex_unlock_pi(futex), ERR_INVALID_ARGS, "");
 
   END_TEST;
 }
 
+struct PiWaiterArgs {
+    volatile int* futex;
+    int owner;
+    bool hand_on;
+    volatile bool done;
+    volatile int value;
+};
+
+// Blocks on the futex, records what it holds once we are woken and, if
+// asked to, hands it on to the next waiter.
+static int pi_waiter_thread(void* arg) {
+    PiWaiterArgs* args = static_cast<PiWaiterArgs*>(arg);
+    int self = (int)thrd_get_mx_handle(thrd_current());
+    mx_status_t status = mx_futex_lock_pi((mx_futex_t*)args->futex,
+                                          args->owner | MX_FUTEX_PI_WAITERS,
+                                          self, MX_TIME_INFINITE);
+    args->value = *args->futex;
+    args->done = true;
+    if (status == NO_ERROR && args->hand_on)
+        status = mx_futex_unlock_pi((mx_futex_t*)args->futex);
+    return status;
+}
+
+static int pi_unlocker_thread(void* arg) {
+    return mx_futex_unlock_pi((mx_futex_t*)arg);
+}
+
+// Test that a thread blocked in futex_lock_pi() is handed the futex by
+// futex_unlock_pi(), that only the owner may unlock, and that the kernel
+// rejects values that do not name a thread.
+static bool test_futex_pi() {
+    BEGIN_TEST;
+
+    int self = (int)thrd_get_mx_handle(thrd_current());
+    volatile int futex_value = self | MX_FUTEX_PI_WAITERS;
+
+    ASSERT_EQ(mx_futex_lock_pi((mx_futex_t*)&futex_value, self | MX_FUTEX_PI_WAITERS,
+                               self, MX_TIME_INFINITE),
+              ERR_INVALID_ARGS, "Blocking on our own futex should fail");
+    ASSERT_EQ(mx_futex_lock_pi((mx_futex_t*)&futex_value, 0, self, MX_TIME_INFINITE),
+              ERR_BAD_HANDLE, "An unlocked futex has no owner to block on");
+    ASSERT_EQ(mx_futex_lock_pi((mx_futex_t*)&futex_value, self, self, 0),
+              ERR_BAD_STATE, "Mismatched value should fail");
+
+    PiWaiterArgs args = { &futex_value, self, false, false, 0 };
+    thrd_t thread;
+    ASSERT_EQ(thrd_create_with_name(&thread, pi_waiter_thread, &args, "pi waiter"),
+              thrd_success, "Error during thread creation");
+
+    mx_nanosleep(MX_MSEC(100));
+    EXPECT_FALSE(args.done, "Waiter should still be blocked");
+
+    thrd_t unlocker;
+    ASSERT_EQ(thrd_create_with_name(&unlocker, pi_unlocker_thread, (void*)&futex_value,
+                                    "pi unlocker"),
+              thrd_success, "Error during thread creation");
+    int unlock_result;
+    ASSERT_EQ(thrd_join(unlocker, &unlock_result), thrd_success, "Error during join");
+    EXPECT_EQ(unlock_result, ERR_ACCESS_DENIED, "Only the owner may unlock");
+    EXPECT_FALSE(args.done, "Waiter should still be blocked");
+
+    int waiter = (int)thrd_get_mx_handle(thread);
+    ASSERT_EQ(mx_futex_unlock_pi((mx_futex_t*)&futex_value), NO_ERROR, "");
+    EXPECT_EQ(futex_value, waiter, "The futex should have been handed to the waiter");
+
+    int result;
+    ASSERT_EQ(thrd_join(thread, &result), thrd_success, "Error during join");
+    EXPECT_EQ(result, NO_ERROR, "Waiter should have been woken");
+    EXPECT_EQ(args.value, waiter, "The waiter should own the futex when it wakes");
+
+    // Unlocking with nobody waiting just releases the futex.
+    futex_value = self;
+    EXPECT_EQ(mx_futex_unlock_pi((mx_futex_t*)&futex_value), NO_ERROR, "");
+    EXPECT_EQ(futex_value, 0, "");
+
+    END_TEST;
+}
+
+struct PiBargerArgs {
+    volatile int* futex;
+    volatile bool stop;
+    volatile bool barged;
+};
+
+// Keeps trying to take the futex the way an uncontended lock would.
+static int pi_barger_thread(void* arg) {
+    PiBargerArgs* args = static_cast<PiBargerArgs*>(arg);
+    int self = (int)thrd_get_mx_handle(thrd_current());
+    while (!args->stop) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n((int*)args->futex, &expected, self, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            args->barged = true;
+            break;
+        }
+    }
+    return 0;
+}
+
+// Test that the futex passes from owner to waiter to waiter without ever
+// being free for a third thread to barge in and take.
+static bool test_futex_pi_handoff() {
+    BEGIN_TEST;
+
+    int self = (int)thrd_get_mx_handle(thrd_current());
+    volatile int futex_value = self | MX_FUTEX_PI_WAITERS;
+
+    // The first waiter hands the futex on to the second when it gets it.
+    PiWaiterArgs first_args = { &futex_value, self, true, false, 0 };
+    thrd_t first;
+    ASSERT_EQ(thrd_create_with_name(&first, pi_waiter_thread, &first_args, "pi waiter 1"),
+              thrd_success, "Error during thread creation");
+    mx_nanosleep(MX_MSEC(100));
+    PiWaiterArgs second_args = { &futex_value, self, false, false, 0 };
+    thrd_t second;
+    ASSERT_EQ(thrd_create_with_name(&second, pi_waiter_thread, &second_args, "pi waiter 2"),
+              thrd_success, "Error during thread creation");
+    mx_nanosleep(MX_MSEC(100));
+    EXPECT_FALSE(first_args.done, "Waiter should still be blocked");
+    EXPECT_FALSE(second_args.done, "Waiter should still be blocked");
+
+    PiBargerArgs barger_args = { &futex_value, false, false };
+    thrd_t barger;
+    ASSERT_EQ(thrd_create_with_name(&barger, pi_barger_thread, &barger_args, "pi barger"),
+              thrd_success, "Error during thread creation");
+
+    ASSERT_EQ(mx_futex_unlock_pi((mx_futex_t*)&futex_value), NO_ERROR, "");
+
+    int result;
+    ASSERT_EQ(thrd_join(first, &result), thrd_success, "Error during join");
+    EXPECT_EQ(result, NO_ERROR, "First waiter should have got and handed on the futex");
+    ASSERT_EQ(thrd_join(second, &result), thrd_success, "Error during join");
+    EXPECT_EQ(result, NO_ERROR, "Second waiter should have got the futex");
+
+    barger_args.stop = true;
+    ASSERT_EQ(thrd_join(barger, NULL), thrd_success, "Error during join");
+    EXPECT_FALSE(barger_args.barged, "The futex should never have been free");
+
+    // The second waiter still owns the futex, though it has exited since.
+    int second_handle = second_args.value & ~MX_FUTEX_PI_WAITERS;
+    EXPECT_NEQ(second_handle, 0, "");
+    EXPECT_EQ(first_args.value & MX_FUTEX_PI_WAITERS, MX_FUTEX_PI_WAITERS,
+              "The first waiter should have been handed the futex with a waiter behind it");
+    EXPECT_NEQ(first_args.value & ~MX_FUTEX_PI_WAITERS, 0, "");
+    EXPECT_EQ(second_args.value, second_handle,
+              "The second waiter should have been handed the futex with nobody behind it");
+    EXPECT_EQ(futex_value, second_handle, "");
+
+    END_TEST;
+}
+
 static void log(const char* str) {
     uint64_t now = mx_time_get(MX_CLOCK_MONOTONIC);
     unittest_printf("[%08" PRIu64 ".%08" PRIu64 "]: %s",
@@ -485,6 +637,8 @@ RUN_TEST(test_futex_requeue);
 RUN_TEST(test_futex_requeue_unqueued_on_timeout);
 RUN_TEST(test_futex_thread_killed);
 RUN_TEST(test_futex_misaligned);
+RUN_TEST(test_futex_pi);
+RUN_TEST(test_futex_pi_handoff);
 RUN_TEST(test_event_signaling);
 END_TEST_CASE(futex_tests)
 
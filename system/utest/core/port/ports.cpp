@@ -183,12 +183,258 @@ static bool async_wait_event_test(void) {
     END_TEST;
 }
 
+static bool wait_many_test(void) {
+    BEGIN_TEST;
+    mx_status_t status;
+
+    mx_handle_t port;
+    status = mx_port_create(MX_PORT_OPT_V2, &port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    const uint32_t kNumPackets = 10;
+
+    for (uint32_t ix = 0; ix != kNumPackets; ++ix) {
+        const mx_port_packet_t in = { ix, MX_PKT_TYPE_USER, 0, { {} } };
+        status = mx_port_queue(port, &in, 0u);
+        EXPECT_EQ(status, NO_ERROR, "");
+    }
+
+    mx_port_packet_t out[MX_PORT_MAX_PKTS_PER_WAIT] = {};
+    uint32_t actual = 0u;
+
+    status = mx_port_wait_many(port, MX_TIME_INFINITE, out, 0u, &actual);
+    EXPECT_EQ(status, ERR_OUT_OF_RANGE, "");
+
+    status = mx_port_wait_many(port, MX_TIME_INFINITE, out, MX_PORT_MAX_PKTS_PER_WAIT + 1,
+                               &actual);
+    EXPECT_EQ(status, ERR_OUT_OF_RANGE, "");
+
+    // Packets come out in order, no more than asked for at a time.
+    status = mx_port_wait_many(port, MX_TIME_INFINITE, out, 4u, &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, 4u, "");
+    for (uint32_t ix = 0; ix != 4u; ++ix)
+        EXPECT_EQ(out[ix].key, ix, "");
+
+    status = mx_port_wait_many(port, MX_TIME_INFINITE, out, MX_PORT_MAX_PKTS_PER_WAIT,
+                               &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, kNumPackets - 4u, "");
+    for (uint32_t ix = 0; ix != kNumPackets - 4u; ++ix) {
+        EXPECT_EQ(out[ix].key, ix + 4u, "");
+        EXPECT_EQ(out[ix].type, MX_PKT_TYPE_USER, "");
+    }
+
+    status = mx_port_wait_many(port, 0u, out, MX_PORT_MAX_PKTS_PER_WAIT, &actual);
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+static bool async_wait_repeating_test(void) {
+    BEGIN_TEST;
+    mx_status_t status;
+
+    const uint64_t key0 = 1122ull;
+
+    mx_handle_t port;
+    status = mx_port_create(MX_PORT_OPT_V2, &port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_handle_t ch[2];
+    status = mx_channel_create(0u, &ch[0], &ch[1]);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    // One registration serves every message.
+    status = mx_object_wait_async(ch[1], port, key0, MX_CHANNEL_READABLE,
+                                  MX_WAIT_ASYNC_REPEATING);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_port_packet_t out = {};
+
+    for (int ix = 0; ix != 5; ++ix) {
+        status = mx_port_wait(port, 0u, &out, 0u);
+        EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+        status = mx_channel_write(ch[0], 0u, "here", 4, nullptr, 0u);
+        EXPECT_EQ(status, NO_ERROR, "");
+
+        status = mx_port_wait(port, MX_TIME_INFINITE, &out, 0u);
+        EXPECT_EQ(status, NO_ERROR, "");
+        EXPECT_EQ(out.key, key0, "");
+        EXPECT_EQ(out.type, MX_PKT_TYPE_SIGNAL, "");
+        EXPECT_EQ(out.signal.count, 1u, "");
+        EXPECT_EQ(out.signal.effective, MX_CHANNEL_WRITABLE | MX_CHANNEL_READABLE, "");
+
+        status = mx_channel_read(ch[1], MX_CHANNEL_READ_MAY_DISCARD,
+                                 nullptr, 0u, nullptr, nullptr, 0, nullptr);
+        EXPECT_EQ(status, ERR_BUFFER_TOO_SMALL, "");
+    }
+
+    // Edges that arrive while the packet is queued share it.
+    for (int ix = 0; ix != 3; ++ix) {
+        status = mx_channel_write(ch[0], 0u, "here", 4, nullptr, 0u);
+        EXPECT_EQ(status, NO_ERROR, "");
+        status = mx_channel_read(ch[1], MX_CHANNEL_READ_MAY_DISCARD,
+                                 nullptr, 0u, nullptr, nullptr, 0, nullptr);
+        EXPECT_EQ(status, ERR_BUFFER_TOO_SMALL, "");
+    }
+
+    status = mx_port_wait(port, MX_TIME_INFINITE, &out, 0u);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(out.key, key0, "");
+    EXPECT_EQ(out.signal.count, 3u, "");
+
+    status = mx_port_wait(port, 0u, &out, 0u);
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    // Closing the handle sends one last packet.
+    status = mx_handle_close(ch[1]);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_port_wait(port, MX_TIME_INFINITE, &out, 0u);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(out.key, key0, "");
+    EXPECT_EQ(out.signal.effective, MX_SIGNAL_HANDLE_CLOSED, "");
+
+    status = mx_port_wait(port, 0u, &out, 0u);
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    status = mx_handle_close(ch[0]);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool close_port_with_repeating_wait_test(void) {
+    BEGIN_TEST;
+    mx_status_t status;
+
+    mx_handle_t port;
+    status = mx_port_create(MX_PORT_OPT_V2, &port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_handle_t ev;
+    status = mx_event_create(0u, &ev);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_object_wait_async(ev, port, 1u, MX_EVENT_SIGNALED, MX_WAIT_ASYNC_REPEATING);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    // Leave a packet queued, then close the port before the event.
+    status = mx_object_signal(ev, 0u, MX_EVENT_SIGNALED);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_object_signal(ev, MX_EVENT_SIGNALED, 0u);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_object_signal(ev, 0u, MX_EVENT_SIGNALED);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_handle_close(ev);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
+// Runs messages through |kNumChannels| channels watched by one port for
+// |kNumRounds| rounds, and reports how many packets per second came through.
+static bool wait_async_throughput(uint32_t options, double* packets_per_second) {
+    BEGIN_HELPER;
+    mx_status_t status;
+
+    const uint32_t kNumChannels = 64u;
+    const uint32_t kNumRounds = 200u;
+
+    mx_handle_t port;
+    status = mx_port_create(MX_PORT_OPT_V2, &port);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    mx_handle_t ch[kNumChannels][2];
+    for (uint32_t ix = 0; ix != kNumChannels; ++ix) {
+        status = mx_channel_create(0u, &ch[ix][0], &ch[ix][1]);
+        ASSERT_EQ(status, NO_ERROR, "");
+        status = mx_object_wait_async(ch[ix][1], port, ix, MX_CHANNEL_READABLE, options);
+        ASSERT_EQ(status, NO_ERROR, "");
+    }
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (uint32_t round = 0; round != kNumRounds; ++round) {
+        for (uint32_t ix = 0; ix != kNumChannels; ++ix) {
+            status = mx_channel_write(ch[ix][0], 0u, &round, sizeof(round), nullptr, 0u);
+            ASSERT_EQ(status, NO_ERROR, "");
+        }
+
+        for (uint32_t done = 0; done != kNumChannels;) {
+            mx_port_packet_t out[MX_PORT_MAX_PKTS_PER_WAIT];
+            uint32_t actual = 0u;
+            status = mx_port_wait_many(port, MX_TIME_INFINITE, out, MX_PORT_MAX_PKTS_PER_WAIT,
+                                       &actual);
+            ASSERT_EQ(status, NO_ERROR, "");
+
+            for (uint32_t jx = 0; jx != actual; ++jx) {
+                uint64_t key = out[jx].key;
+                ASSERT_LT(key, kNumChannels, "");
+
+                uint32_t msg = 0u;
+                uint32_t size = 0u;
+                status = mx_channel_read(ch[key][1], 0u, &msg, sizeof(msg), &size,
+                                         nullptr, 0u, nullptr);
+                ASSERT_EQ(status, NO_ERROR, "");
+                ASSERT_EQ(msg, round, "");
+
+                if (options == MX_WAIT_ASYNC_ONCE) {
+                    status = mx_object_wait_async(ch[key][1], port, key, MX_CHANNEL_READABLE,
+                                                  options);
+                    ASSERT_EQ(status, NO_ERROR, "");
+                }
+            }
+            done += actual;
+        }
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    for (uint32_t ix = 0; ix != kNumChannels; ++ix) {
+        EXPECT_EQ(mx_handle_close(ch[ix][0]), NO_ERROR, "");
+        EXPECT_EQ(mx_handle_close(ch[ix][1]), NO_ERROR, "");
+    }
+    EXPECT_EQ(mx_handle_close(port), NO_ERROR, "");
+
+    *packets_per_second = (double)kNumChannels * kNumRounds * 1000000000.0 / (double)elapsed;
+
+    END_HELPER;
+}
+
+static bool wait_async_throughput_test(void) {
+    BEGIN_TEST;
+
+    double once = 0.0;
+    double repeating = 0.0;
+    ASSERT_TRUE(wait_async_throughput(MX_WAIT_ASYNC_ONCE, &once), "");
+    ASSERT_TRUE(wait_async_throughput(MX_WAIT_ASYNC_REPEATING, &repeating), "");
+
+    unittest_printf("\n    one-shot waits: %.0f packets/second\n", once);
+    unittest_printf("    repeating waits: %.0f packets/second\n", repeating);
+
+    END_TEST;
+}
 
 BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
 RUN_TEST(async_wait_channel_test)
 RUN_TEST(async_wait_event_test)
+RUN_TEST(wait_many_test)
+RUN_TEST(async_wait_repeating_test)
+RUN_TEST(close_port_with_repeating_wait_test)
+RUN_TEST(wait_async_throughput_test)
 END_TEST_CASE(port_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -318,12 +318,89 @@ static bool pthread_getstack_other_thread_explicit_size() {
     END_TEST;
 }
 
+static const int kContentionThreads = 64;
+static const int kContentionMutexes = 8;
+static const int kContentionIterations = 2000;
+
+struct ContentionArgs {
+    pthread_mutex_t* mutexes;
+    int* counters;
+    int index;
+};
+
+static void* contention_thread(void* arg) {
+    ContentionArgs* args = static_cast<ContentionArgs*>(arg);
+    for (int i = 0; i < kContentionIterations; i++) {
+        int m = (args->index + i) % kContentionMutexes;
+        pthread_mutex_lock(&args->mutexes[m]);
+        args->counters[m]++;
+        pthread_mutex_unlock(&args->mutexes[m]);
+    }
+    return NULL;
+}
+
+// Runs kContentionThreads threads over kContentionMutexes mutexes of the
+// given protocol, checks nothing was lost and reports the time per lock.
+static bool run_contention(int protocol) {
+    pthread_mutexattr_t attr;
+    ASSERT_EQ(pthread_mutexattr_init(&attr), 0, "");
+    ASSERT_EQ(pthread_mutexattr_setprotocol(&attr, protocol), 0, "");
+
+    pthread_mutex_t mutexes[kContentionMutexes];
+    int counters[kContentionMutexes] = {};
+    for (int i = 0; i < kContentionMutexes; i++)
+        ASSERT_EQ(pthread_mutex_init(&mutexes[i], &attr), 0, "");
+
+    pthread_t threads[kContentionThreads];
+    ContentionArgs args[kContentionThreads];
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (int i = 0; i < kContentionThreads; i++) {
+        args[i] = {mutexes, counters, i};
+        ASSERT_EQ(pthread_create(&threads[i], NULL, contention_thread, &args[i]), 0, "");
+    }
+    for (int i = 0; i < kContentionThreads; i++)
+        ASSERT_EQ(pthread_join(threads[i], NULL), 0, "");
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    for (int i = 0; i < kContentionMutexes; i++) {
+        EXPECT_EQ(counters[i], kContentionThreads * kContentionIterations / kContentionMutexes,
+                  "mutex failed to protect its counter");
+        pthread_mutex_destroy(&mutexes[i]);
+    }
+    pthread_mutexattr_destroy(&attr);
+
+    uint64_t locks = (uint64_t)kContentionThreads * kContentionIterations;
+    unittest_printf("%s: %" PRIu64 " ns per lock/unlock\n",
+                    protocol == PTHREAD_PRIO_INHERIT ? "inherit" : "none",
+                    elapsed / locks);
+    return true;
+}
+
+static bool pthread_mutex_contention() {
+    BEGIN_TEST;
+
+    pthread_mutexattr_t attr;
+    int protocol = -1;
+    ASSERT_EQ(pthread_mutexattr_init(&attr), 0, "");
+    ASSERT_EQ(pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT), 0, "");
+    ASSERT_EQ(pthread_mutexattr_getprotocol(&attr, &protocol), 0, "");
+    EXPECT_EQ(protocol, PTHREAD_PRIO_INHERIT, "");
+    EXPECT_EQ(pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_PROTECT), ENOTSUP, "");
+    pthread_mutexattr_destroy(&attr);
+
+    ASSERT_TRUE(run_contention(PTHREAD_PRIO_NONE), "");
+    ASSERT_TRUE(run_contention(PTHREAD_PRIO_INHERIT), "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(pthread_tests)
 RUN_TEST(pthread_test)
 RUN_TEST(pthread_self_main_thread_test)
 RUN_TEST(pthread_big_stack_size)
 RUN_TEST(pthread_getstack_main_thread)
 RUN_TEST(pthread_getstack_other_thread)
+RUN_TEST(pthread_mutex_contention)
 END_TEST_CASE(pthread_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -3,11 +3,15 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <magenta/syscalls.h>
 #include <unittest/unittest.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <threads.h>
 #include <unistd.h>
 
 static mx_signals_t get_satisfied_signals(mx_handle_t handle) {
@@ -328,6 +332,244 @@ static bool socket_short_write(void) {
     END_TEST;
 }
 
+static bool socket_buffer_size(void) {
+    BEGIN_TEST;
+
+    mx_handle_t h0, h1;
+    EXPECT_EQ(mx_socket_create_etc(0u, MX_SOCKET_MIN_BUFFER_SIZE - 1, &h0, &h1),
+              ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(mx_socket_create_etc(0u, MX_SOCKET_MAX_BUFFER_SIZE + 1, &h0, &h1),
+              ERR_OUT_OF_RANGE, "");
+
+    // 5000 rounds up to 8192, one byte of which always stays free
+    ASSERT_EQ(mx_socket_create_etc(0u, 5000u, &h0, &h1), NO_ERROR, "");
+    char* buffer = calloc(1, 16384);
+    size_t written = 0;
+    ASSERT_EQ(mx_socket_write(h0, 0u, buffer, 16384, &written), NO_ERROR, "");
+    EXPECT_EQ(written, 8191u, "");
+    EXPECT_EQ(mx_socket_write(h0, 0u, buffer, 1, &written), ERR_SHOULD_WAIT, "");
+
+    free(buffer);
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    END_TEST;
+}
+
+static bool socket_writev_readv(void) {
+    BEGIN_TEST;
+
+    mx_handle_t h0, h1;
+    ASSERT_EQ(mx_socket_create(0u, &h0, &h1), NO_ERROR, "");
+
+    char a[] = "abc", b[] = "defgh", c[] = "ij";
+    mx_iovec_t wiov[] = {
+        { a, 3 }, { NULL, 0 }, { b, 5 }, { c, 2 },
+    };
+    size_t count;
+    EXPECT_EQ(mx_socket_writev(h0, 0u, wiov, 0u, &count), ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(mx_socket_writev(h0, 0u, wiov, MX_SOCKET_MAX_IOVECS + 1, &count),
+              ERR_OUT_OF_RANGE, "");
+    ASSERT_EQ(mx_socket_writev(h0, 0u, wiov, 4u, &count), NO_ERROR, "");
+    EXPECT_EQ(count, 10u, "");
+
+    // scatter the stream differently than it was gathered
+    char r0[4] = {}, r1[8] = {};
+    mx_iovec_t riov[] = { { r0, 4 }, { r1, 8 } };
+    ASSERT_EQ(mx_socket_readv(h1, 0u, riov, 2u, &count), NO_ERROR, "");
+    EXPECT_EQ(count, 10u, "");
+    EXPECT_EQ(memcmp(r0, "abcd", 4), 0, "");
+    EXPECT_EQ(memcmp(r1, "efghij", 6), 0, "");
+
+    EXPECT_EQ(mx_socket_readv(h1, 0u, riov, 2u, &count), ERR_SHOULD_WAIT, "");
+
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    END_TEST;
+}
+
+static bool socket_splice(void) {
+    BEGIN_TEST;
+
+    const size_t len = 3 * PAGE_SIZE + 100;
+    char* data = malloc(len);
+    char* check = malloc(len);
+    for (size_t i = 0; i < len; i++)
+        data[i] = (char)(i * 7);
+
+    mx_handle_t h0, h1, vmo;
+    ASSERT_EQ(mx_socket_create(0u, &h0, &h1), NO_ERROR, "");
+    ASSERT_EQ(mx_vmo_create(4 * PAGE_SIZE, 0u, &vmo), NO_ERROR, "");
+    size_t count;
+    ASSERT_EQ(mx_vmo_write(vmo, data, 0, len, &count), NO_ERROR, "");
+
+    EXPECT_EQ(mx_socket_splice(h0, 0u, vmo, 0, len, &count), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_socket_splice(h0, MX_SOCKET_SPLICE_FROM_VMO | MX_SOCKET_SPLICE_TO_VMO,
+                               vmo, 0, len, &count), ERR_INVALID_ARGS, "");
+
+    // VMO to socket, read back out with a plain read
+    ASSERT_EQ(mx_socket_splice(h0, MX_SOCKET_SPLICE_FROM_VMO, vmo, 0, len, &count), NO_ERROR, "");
+    EXPECT_EQ(count, len, "");
+    memset(check, 0, len);
+    ASSERT_EQ(mx_socket_read(h1, 0u, check, len, &count), NO_ERROR, "");
+    EXPECT_EQ(count, len, "");
+    EXPECT_EQ(memcmp(check, data, len), 0, "");
+
+    // plain write, socket to VMO at an offset that can't move pages
+    ASSERT_EQ(mx_socket_write(h1, 0u, data, len, &count), NO_ERROR, "");
+    ASSERT_EQ(mx_socket_splice(h0, MX_SOCKET_SPLICE_TO_VMO, vmo, 1, len, &count), NO_ERROR, "");
+    EXPECT_EQ(count, len, "");
+    memset(check, 0, len);
+    ASSERT_EQ(mx_vmo_read(vmo, check, 1, len, &count), NO_ERROR, "");
+    EXPECT_EQ(memcmp(check, data, len), 0, "");
+
+    EXPECT_EQ(mx_socket_splice(h0, MX_SOCKET_SPLICE_TO_VMO, vmo, 0, len, &count),
+              ERR_SHOULD_WAIT, "");
+
+    free(data);
+    free(check);
+    mx_handle_close(vmo);
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    END_TEST;
+}
+
+#define THROUGHPUT_TRANSFER (1024u * 1024u)
+#define THROUGHPUT_TRANSFERS 64u
+
+enum throughput_mode {
+    THROUGHPUT_COPY,
+    THROUGHPUT_IOVEC,
+    THROUGHPUT_SPLICE,
+};
+
+struct throughput_args {
+    mx_handle_t socket;
+    enum throughput_mode mode;
+};
+
+static bool wait_for(mx_handle_t socket, mx_signals_t signal) {
+    mx_signals_t pending = 0;
+    mx_object_wait_one(socket, signal | MX_SOCKET_PEER_CLOSED, MX_TIME_INFINITE, &pending);
+    return (pending & signal) != 0;
+}
+
+// Moves one transfer starting at |offset| in |vmo| or |buffer|, whichever
+// the mode uses.
+static mx_status_t throughput_io(struct throughput_args* args, bool write, char* buffer,
+                                 mx_handle_t vmo, size_t offset, size_t* actual) {
+    size_t len = THROUGHPUT_TRANSFER - offset;
+    switch (args->mode) {
+    case THROUGHPUT_COPY:
+        return write ? mx_socket_write(args->socket, 0u, buffer + offset, len, actual)
+                     : mx_socket_read(args->socket, 0u, buffer + offset, len, actual);
+    case THROUGHPUT_IOVEC: {
+        // two halves, as a protocol header and payload might be
+        size_t half = len / 2;
+        mx_iovec_t iov[] = {
+            { buffer + offset, half }, { buffer + offset + half, len - half },
+        };
+        return write ? mx_socket_writev(args->socket, 0u, iov, 2u, actual)
+                     : mx_socket_readv(args->socket, 0u, iov, 2u, actual);
+    }
+    case THROUGHPUT_SPLICE:
+        return mx_socket_splice(args->socket,
+                                write ? MX_SOCKET_SPLICE_FROM_VMO : MX_SOCKET_SPLICE_TO_VMO,
+                                vmo, offset, len, actual);
+    }
+    return ERR_INVALID_ARGS;
+}
+
+static int throughput_reader(void* arg) {
+    struct throughput_args* args = arg;
+    char* buffer = malloc(THROUGHPUT_TRANSFER);
+    mx_handle_t vmo;
+    if (mx_vmo_create(THROUGHPUT_TRANSFER, 0u, &vmo) != NO_ERROR)
+        return -1;
+
+    for (size_t done = 0; done < THROUGHPUT_TRANSFER * THROUGHPUT_TRANSFERS;) {
+        size_t offset = done % THROUGHPUT_TRANSFER;
+        size_t actual;
+        mx_status_t status = throughput_io(args, false, buffer, vmo, offset, &actual);
+        if (status == ERR_SHOULD_WAIT) {
+            if (!wait_for(args->socket, MX_SOCKET_READABLE))
+                break;
+            continue;
+        }
+        if (status != NO_ERROR)
+            break;
+        done += actual;
+    }
+
+    mx_handle_close(vmo);
+    free(buffer);
+    return 0;
+}
+
+// Streams THROUGHPUT_TRANSFERS transfers of 1MiB between two threads and
+// returns the rate in MiB/s.
+static uint64_t throughput_run(enum throughput_mode mode) {
+    mx_handle_t h0, h1;
+    if (mx_socket_create(0u, &h0, &h1) != NO_ERROR)
+        return 0;
+
+    struct throughput_args reader_args = { h1, mode };
+    struct throughput_args writer = { h0, mode };
+    thrd_t reader;
+    if (thrd_create(&reader, throughput_reader, &reader_args) != thrd_success)
+        return 0;
+
+    char* buffer = malloc(THROUGHPUT_TRANSFER);
+    memset(buffer, 0x5a, THROUGHPUT_TRANSFER);
+    mx_handle_t vmo;
+    mx_vmo_create(THROUGHPUT_TRANSFER, 0u, &vmo);
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t done = 0; done < THROUGHPUT_TRANSFER * THROUGHPUT_TRANSFERS;) {
+        size_t offset = done % THROUGHPUT_TRANSFER;
+        // splicing moves the pages out, so give it something to move
+        if (mode == THROUGHPUT_SPLICE && offset == 0)
+            mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, THROUGHPUT_TRANSFER, NULL, 0);
+        size_t actual;
+        mx_status_t status = throughput_io(&writer, true, buffer, vmo, offset, &actual);
+        if (status == ERR_SHOULD_WAIT) {
+            if (!wait_for(h0, MX_SOCKET_WRITABLE))
+                break;
+            continue;
+        }
+        if (status != NO_ERROR)
+            break;
+        done += actual;
+    }
+    thrd_join(reader, NULL);
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    mx_handle_close(vmo);
+    free(buffer);
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    return (uint64_t)THROUGHPUT_TRANSFERS * 1000000000u / elapsed;
+}
+
+static bool socket_throughput(void) {
+    BEGIN_TEST;
+
+    uint64_t copy = throughput_run(THROUGHPUT_COPY);
+    uint64_t iovec = throughput_run(THROUGHPUT_IOVEC);
+    uint64_t splice = throughput_run(THROUGHPUT_SPLICE);
+    EXPECT_NEQ(copy, 0u, "");
+    EXPECT_NEQ(iovec, 0u, "");
+    EXPECT_NEQ(splice, 0u, "");
+
+    unittest_printf("\n1MiB transfers: read/write %" PRIu64 " MiB/s, readv/writev %" PRIu64
+                    " MiB/s, splice %" PRIu64 " MiB/s\n", copy, iovec, splice);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(socket_tests)
 RUN_TEST(socket_basic)
 RUN_TEST(socket_signals)
@@ -335,6 +577,10 @@ RUN_TEST(socket_half_close)
 RUN_TEST(socket_bytes_outstanding)
 RUN_TEST(socket_bytes_outstanding_half_close)
 RUN_TEST(socket_short_write)
+RUN_TEST(socket_buffer_size)
+RUN_TEST(socket_writev_readv)
+RUN_TEST(socket_splice)
+RUN_TEST(socket_throughput)
 END_TEST_CASE(socket_tests)
 
 #ifndef BUILD_COMBINED_TESTS
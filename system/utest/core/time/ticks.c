@@ -23,8 +23,34 @@ static bool elapsed_time_using_ticks(void) {
     END_TEST;
 }
 
+// mx_time_get(MX_CLOCK_MONOTONIC) is computed in the vDSO; check that it
+// never goes backwards and keeps pace with the kernel's own timers.
+static bool monotonic_time_get(void) {
+    BEGIN_TEST;
+
+    const int kCalls = 1000000;
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_time_t last = start;
+    for (int i = 0; i < kCalls; i++) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        ASSERT_GE(now, last, "Monotonic time went backwards");
+        last = now;
+    }
+    unittest_printf("mx_time_get: %llu ns per call\n",
+                    (unsigned long long)((last - start) / kCalls));
+
+    const mx_time_t kSleep = MX_MSEC(10);
+    mx_time_t before = mx_time_get(MX_CLOCK_MONOTONIC);
+    ASSERT_EQ(mx_nanosleep(kSleep), NO_ERROR, "");
+    mx_time_t after = mx_time_get(MX_CLOCK_MONOTONIC);
+    ASSERT_GE(after - before, kSleep, "Slept less than asked");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(ticks_tests)
 RUN_TEST(elapsed_time_using_ticks)
+RUN_TEST(monotonic_time_get)
 END_TEST_CASE(ticks_tests)
 
 #ifndef BUILD_COMBINED_TESTS
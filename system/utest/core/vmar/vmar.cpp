@@ -5,7 +5,9 @@
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <inttypes.h>
 #include <stdalign.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <magenta/syscalls.h>
@@ -1537,6 +1539,102 @@ bool protect_over_demand_paged_test() {
     END_TEST;
 }
 
+struct FaultThreadArgs {
+    volatile uint8_t* base;
+    size_t pages;
+};
+
+// Write to every page in a slice back to front, so that fault-around can't
+// pick up the next page and every touch is a fault of its own.
+int fault_thread(void* arg) {
+    auto args = static_cast<FaultThreadArgs*>(arg);
+    for (size_t i = args->pages; i > 0; i--) {
+        args->base[(i - 1) * PAGE_SIZE] = static_cast<uint8_t>(i);
+    }
+    return 0;
+}
+
+int map_churn_thread(void* arg) {
+    auto done = static_cast<volatile bool*>(arg);
+
+    mx_handle_t vmo;
+    if (mx_vmo_create(PAGE_SIZE, 0, &vmo) != NO_ERROR)
+        return -1;
+    while (!*done) {
+        uintptr_t addr;
+        if (mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, PAGE_SIZE,
+                        MX_VM_FLAG_PERM_READ, &addr) == NO_ERROR) {
+            mx_vmar_unmap(mx_vmar_root_self(), addr, PAGE_SIZE);
+        }
+    }
+    mx_handle_close(vmo);
+    return 0;
+}
+
+// First-touch a large mapping from a growing number of threads while another
+// thread keeps mapping and unmapping elsewhere in the same address space.
+// Page faults only hold the aspace lock to look up the mapping and to map the
+// page, so the time taken should drop as threads are added.
+bool concurrent_fault_test() {
+    BEGIN_TEST;
+
+    const size_t size = 64 * 1024 * 1024;
+    const size_t kMaxThreads = 8;
+
+    for (size_t num_threads = 1; num_threads <= kMaxThreads; num_threads *= 2) {
+        mx_handle_t vmo;
+        ASSERT_EQ(mx_vmo_create(size, 0, &vmo), NO_ERROR, "");
+        uintptr_t mapping_addr;
+        ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                              &mapping_addr),
+                  NO_ERROR, "");
+        EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+
+        volatile bool done = false;
+        thrd_t churn;
+        ASSERT_EQ(thrd_create(&churn, map_churn_thread, (void*)&done), thrd_success, "");
+
+        const size_t pages_per_thread = size / PAGE_SIZE / num_threads;
+        FaultThreadArgs args[kMaxThreads];
+        thrd_t threads[kMaxThreads];
+
+        mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+        for (size_t i = 0; i < num_threads; i++) {
+            args[i].base = reinterpret_cast<volatile uint8_t*>(
+                    mapping_addr + i * pages_per_thread * PAGE_SIZE);
+            args[i].pages = pages_per_thread;
+            ASSERT_EQ(thrd_create(&threads[i], fault_thread, &args[i]), thrd_success, "");
+        }
+        for (size_t i = 0; i < num_threads; i++) {
+            EXPECT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+        }
+        mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+        done = true;
+        int churn_ret;
+        EXPECT_EQ(thrd_join(churn, &churn_ret), thrd_success, "");
+        EXPECT_EQ(churn_ret, 0, "");
+
+        unittest_printf("%zu threads: %" PRIu64 " ns to fault %zu pages, %" PRIu64 " ns per page\n",
+                        num_threads, elapsed, size / PAGE_SIZE, elapsed / (size / PAGE_SIZE));
+
+        // every page should hold what its thread wrote to it
+        for (size_t i = 0; i < num_threads; i++) {
+            for (size_t p = 0; p < pages_per_thread; p++) {
+                if (args[i].base[p * PAGE_SIZE] != static_cast<uint8_t>(p + 1)) {
+                    EXPECT_TRUE(false, "page lost its contents");
+                    break;
+                }
+            }
+        }
+
+        EXPECT_EQ(mx_vmar_unmap(mx_vmar_root_self(), mapping_addr, size), NO_ERROR, "");
+    }
+
+    END_TEST;
+}
+
 }
 
 BEGIN_TEST_CASE(vmar_tests)
@@ -1559,6 +1657,7 @@ RUN_TEST(map_specific_overwrite_test);
 RUN_TEST(protect_split_test);
 RUN_TEST(protect_multiple_test);
 RUN_TEST(protect_over_demand_paged_test);
+RUN_TEST(concurrent_fault_test);
 END_TEST_CASE(vmar_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -0,0 +1,166 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <fs-management/mount.h>
+#include <magenta/device/block.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+// These tests run against a minfs server, so file data goes through the
+// VMO each file keeps, which is filled from disk a block at a time.
+
+#define RAMCTL_PATH "/dev/misc/ramctl"
+#define RAMDISK_NAME "minfs-test-vmo"
+#define MOUNT_PATH "/tmp/minfs-test-vmo"
+#define FILE_PATH MOUNT_PATH "/file"
+
+#define MINFS_BLOCK_SIZE 8192
+#define FILE_SIZE (MINFS_BLOCK_SIZE * 4 + MINFS_BLOCK_SIZE / 2)
+
+static uint8_t expected[FILE_SIZE];
+static uint8_t actual[FILE_SIZE];
+
+static bool create_ramdisk(char* path, size_t len) {
+    int fd = open(RAMCTL_PATH, O_RDWR);
+    ASSERT_GE(fd, 0, "Could not open ramctl device");
+    ramdisk_ioctl_config_t config;
+    config.blk_size = 512;
+    config.blk_count = (64 << 20) / 512;
+    strcpy(config.name, RAMDISK_NAME);
+    ASSERT_EQ(ioctl_block_ramdisk_config(fd, &config), NO_ERROR, "Failed to create ramdisk");
+    ASSERT_EQ(close(fd), 0, "Failed to close ramctl");
+
+    // TODO(smklein): As in the ramdisk tests, the device may not be visible
+    // in the filesystem hierarchy right away (MG-468).
+    usleep(1000);
+
+    snprintf(path, len, "%s/%s", RAMCTL_PATH, RAMDISK_NAME);
+    return true;
+}
+
+static bool destroy_ramdisk(const char* path) {
+    int fd = open(path, O_RDWR);
+    ASSERT_GE(fd, 0, "Could not open ramdisk device");
+    ASSERT_GE(ioctl_block_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0, "");
+    return true;
+}
+
+static bool mount_minfs(const char* path) {
+    int fd = open(path, O_RDWR);
+    ASSERT_GE(fd, 0, "Could not open ramdisk device");
+    ASSERT_EQ(mount(fd, MOUNT_PATH, DISK_FORMAT_MINFS, &default_mount_options,
+                    launch_logs_async),
+              NO_ERROR, "Could not mount minfs");
+    return true;
+}
+
+// Unmounting and mounting again drops every cached vnode, so the file's next
+// VMO starts out empty.
+static bool remount_minfs(const char* path) {
+    ASSERT_EQ(umount(MOUNT_PATH), NO_ERROR, "Could not unmount minfs");
+    return mount_minfs(path);
+}
+
+static bool write_at(int fd, const void* data, size_t len, off_t off) {
+    ASSERT_EQ(lseek(fd, off, SEEK_SET), off, "");
+    ASSERT_EQ(write(fd, data, len), (ssize_t) len, "");
+    return true;
+}
+
+// Reads the file back |chunk| bytes at a time and compares it against
+// |expected|.
+static bool verify_file(size_t size, size_t chunk) {
+    int fd = open(FILE_PATH, O_RDONLY);
+    ASSERT_GE(fd, 0, "");
+    memset(actual, 0, sizeof(actual));
+    for (size_t off = 0; off < size; off += chunk) {
+        size_t len = (size - off < chunk) ? size - off : chunk;
+        ASSERT_EQ(read(fd, actual + off, len), (ssize_t) len, "");
+    }
+    ASSERT_EQ(read(fd, actual, 1), 0, "Expected end of file");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(memcmp(actual, expected, size), 0, "File contents differ");
+    return true;
+}
+
+bool minfs_test_vmo_path(void) {
+    BEGIN_TEST;
+
+    char ramdisk_path[PATH_MAX];
+    ASSERT_TRUE(create_ramdisk(ramdisk_path, sizeof(ramdisk_path)), "");
+    ASSERT_EQ(mkfs(ramdisk_path, DISK_FORMAT_MINFS, launch_stdio_sync), NO_ERROR,
+              "Could not format ramdisk");
+    ASSERT_EQ(mkdir(MOUNT_PATH, 0755), 0, "");
+    ASSERT_TRUE(mount_minfs(ramdisk_path), "");
+
+    for (size_t i = 0; i < sizeof(expected); i++)
+        expected[i] = (uint8_t) (i * 7 + i / MINFS_BLOCK_SIZE);
+
+    // Whole blocks and a partial tail, written in one go
+    int fd = open(FILE_PATH, O_RDWR | O_CREAT, 0644);
+    ASSERT_GE(fd, 0, "");
+    ASSERT_TRUE(write_at(fd, expected, FILE_SIZE, 0), "");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_TRUE(verify_file(FILE_SIZE, FILE_SIZE), "");
+
+    // A partial write to a block that is not in the VMO yet has to bring in
+    // the rest of the block from disk before writing it back.
+    ASSERT_TRUE(remount_minfs(ramdisk_path), "");
+    fd = open(FILE_PATH, O_RDWR);
+    ASSERT_GE(fd, 0, "");
+    memset(expected + MINFS_BLOCK_SIZE + 1000, 'x', 100);
+    ASSERT_TRUE(write_at(fd, expected + MINFS_BLOCK_SIZE + 1000, 100, MINFS_BLOCK_SIZE + 1000),
+                "");
+    // Likewise for a write straddling two cold blocks
+    memset(expected + 3 * MINFS_BLOCK_SIZE - 10, 'y', 20);
+    ASSERT_TRUE(write_at(fd, expected + 3 * MINFS_BLOCK_SIZE - 10, 20,
+                         3 * MINFS_BLOCK_SIZE - 10),
+                "");
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_TRUE(verify_file(FILE_SIZE, FILE_SIZE), "");
+
+    // Small sequential reads of a cold file go through read-ahead.
+    ASSERT_TRUE(remount_minfs(ramdisk_path), "");
+    ASSERT_TRUE(verify_file(FILE_SIZE, 1000), "");
+
+    // Truncating into a cold block keeps its head, and growing the file
+    // again reads back zeroes past the cut.
+    ASSERT_TRUE(remount_minfs(ramdisk_path), "");
+    fd = open(FILE_PATH, O_RDWR);
+    ASSERT_GE(fd, 0, "");
+    size_t cut = 2 * MINFS_BLOCK_SIZE + 50;
+    ASSERT_EQ(ftruncate(fd, cut), 0, "");
+    ASSERT_EQ(ftruncate(fd, 3 * MINFS_BLOCK_SIZE), 0, "");
+    ASSERT_EQ(close(fd), 0, "");
+    memset(expected + cut, 0, 3 * MINFS_BLOCK_SIZE - cut);
+    ASSERT_TRUE(verify_file(3 * MINFS_BLOCK_SIZE, MINFS_BLOCK_SIZE), "");
+    ASSERT_TRUE(remount_minfs(ramdisk_path), "");
+    ASSERT_TRUE(verify_file(3 * MINFS_BLOCK_SIZE, MINFS_BLOCK_SIZE), "");
+
+    ASSERT_EQ(unlink(FILE_PATH), 0, "");
+    ASSERT_EQ(umount(MOUNT_PATH), NO_ERROR, "");
+    ASSERT_EQ(rmdir(MOUNT_PATH), 0, "");
+    ASSERT_TRUE(destroy_ramdisk(ramdisk_path), "");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(minfs_tests)
+RUN_TEST(minfs_test_vmo_path)
+END_TEST_CASE(minfs_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
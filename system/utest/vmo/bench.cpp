@@ -7,6 +7,7 @@
 #include <inttypes.h>
 #include <sys/types.h>
 #include <stdlib.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <magenta/compiler.h>
@@ -21,6 +22,54 @@ inline mx_time_t time_it(T func) {
     return mx_time_get(MX_CLOCK_MONOTONIC) - t;
 }
 
+// each thread of the shootdown benchmark maps, touches, protects and unmaps
+// its own slice, so the aspace is live on as many cpus as there are threads
+// while every one of them is tearing down mappings
+struct shootdown_args {
+    size_t size;
+    int* ready;
+    int num_threads;
+    mx_time_t protect_time;
+    mx_time_t unmap_time;
+};
+
+static int shootdown_thread(void* arg) {
+    auto args = static_cast<shootdown_args*>(arg);
+
+    mx_handle_t vmo;
+    if (mx_vmo_create(args->size, 0, &vmo) != NO_ERROR) {
+        __atomic_fetch_add(args->ready, 1, __ATOMIC_SEQ_CST);
+        return -1;
+    }
+    mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, args->size, nullptr, 0);
+
+    uintptr_t ptr;
+    if (mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, args->size,
+                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &ptr) != NO_ERROR) {
+        __atomic_fetch_add(args->ready, 1, __ATOMIC_SEQ_CST);
+        mx_handle_close(vmo);
+        return -1;
+    }
+    for (size_t i = 0; i < args->size; i += PAGE_SIZE) {
+        __UNUSED char a = ((volatile char *)ptr)[i];
+    }
+
+    // wait for everyone else to have their slice mapped in
+    __atomic_fetch_add(args->ready, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(args->ready, __ATOMIC_SEQ_CST) < args->num_threads)
+        ;
+
+    args->protect_time = time_it([&](){
+        mx_vmar_protect(mx_vmar_root_self(), ptr, args->size, MX_VM_FLAG_PERM_READ);
+    });
+    args->unmap_time = time_it([&](){
+        mx_vmar_unmap(mx_vmar_root_self(), ptr, args->size);
+    });
+
+    mx_handle_close(vmo);
+    return 0;
+}
+
 int vmo_run_benchmark() {
     mx_time_t t;
     //mx_handle_t vmo;
@@ -66,6 +115,70 @@ int vmo_run_benchmark() {
     });
     printf("\ttook %" PRIu64 " nsecs to delete populated vmo of size %zu\n", t, size);
 
+    // touch a fresh mapping a page at a time, front to back and back to front.
+    // sequential touches should mostly be served by fault-around, while the
+    // backwards walk takes a fault for every page
+    const size_t touch_size = 64*1024*1024;
+    for (bool write : {false, true}) {
+        for (bool backwards : {false, true}) {
+            mx_vmo_create(touch_size, 0, &vmo);
+            mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, touch_size,
+                        MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &ptr);
+
+            t = time_it([&](){
+                for (size_t i = 0; i < touch_size; i += PAGE_SIZE) {
+                    size_t off = backwards ? touch_size - PAGE_SIZE - i : i;
+                    if (write) {
+                        ((volatile char *)ptr)[off] = 1;
+                    } else {
+                        __UNUSED char a = ((volatile char *)ptr)[off];
+                    }
+                }
+            });
+            printf("	took %" PRIu64 " nsecs to %s %zu pages %s (%" PRIu64 " nsecs per page)\n",
+                   t, write ? "write" : "read", touch_size / PAGE_SIZE,
+                   backwards ? "backwards" : "forwards", t / (touch_size / PAGE_SIZE));
+
+            mx_vmar_unmap(mx_vmar_root_self(), ptr, touch_size);
+            mx_handle_close(vmo);
+        }
+    }
+
+    // protect and then unmap 1GB worth of mappings, split up between 8 threads
+    const size_t shootdown_size = 1024*1024*1024;
+    const int shootdown_threads = 8;
+    int ready = 0;
+    shootdown_args args[shootdown_threads];
+    thrd_t threads[shootdown_threads];
+    int started = 0;
+    for (; started < shootdown_threads; started++) {
+        args[started] = { shootdown_size / shootdown_threads, &ready, shootdown_threads, 0, 0 };
+        if (thrd_create(&threads[started], shootdown_thread, &args[started]) != thrd_success)
+            break;
+    }
+    // don't leave the ones that did start waiting on the ones that didn't
+    __atomic_fetch_add(&ready, shootdown_threads - started, __ATOMIC_SEQ_CST);
+    mx_time_t protect_time = 0;
+    mx_time_t unmap_time = 0;
+    bool shootdown_failed = started != shootdown_threads;
+    for (int i = 0; i < started; i++) {
+        int ret;
+        thrd_join(threads[i], &ret);
+        shootdown_failed |= ret != 0;
+        if (args[i].protect_time > protect_time)
+            protect_time = args[i].protect_time;
+        if (args[i].unmap_time > unmap_time)
+            unmap_time = args[i].unmap_time;
+    }
+    if (shootdown_failed) {
+        printf("\tfailed to set up shootdown benchmark\n");
+    } else {
+        printf("\ttook %" PRIu64 " nsecs to protect %zu bytes from %d threads\n",
+               protect_time, shootdown_size, shootdown_threads);
+        printf("\ttook %" PRIu64 " nsecs to unmap %zu bytes from %d threads\n",
+               unmap_time, shootdown_size, shootdown_threads);
+    }
+
     printf("done with benchmark\n");
 
     return 0;
@@ -489,6 +489,162 @@ bool vmo_commit_test() {
     END_TEST;
 }
 
+bool vmo_clone_test() {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t size;
+    mx_handle_t vmo;
+    mx_handle_t clone;
+
+    // fill a parent with a pattern
+    const size_t len = PAGE_SIZE * 4;
+    status = mx_vmo_create(len, 0, &vmo);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_create");
+
+    char buf[PAGE_SIZE];
+    for (size_t i = 0; i < len / PAGE_SIZE; i++) {
+        memset(buf, 'a' + (int)i, sizeof(buf));
+        status = mx_vmo_write(vmo, buf, i * PAGE_SIZE, sizeof(buf), &size);
+        EXPECT_EQ(NO_ERROR, status, "vm_object_write");
+    }
+
+    // the offset has to be page aligned
+    status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 1, len, &clone);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_clone unaligned");
+    status = mx_vmo_clone(vmo, 0, 0, len, &clone);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_clone bad options");
+
+    // clone all but the first page
+    status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, PAGE_SIZE, len, &clone);
+    EXPECT_EQ(NO_ERROR, status, "vm_clone");
+
+    // the clone starts out with the parent's contents, and zeros past its end
+    char expected[PAGE_SIZE];
+    for (size_t i = 0; i < len / PAGE_SIZE; i++) {
+        memset(expected, (i < 3) ? 'b' + (int)i : 0, sizeof(expected));
+        status = mx_vmo_read(clone, buf, i * PAGE_SIZE, sizeof(buf), &size);
+        EXPECT_EQ(NO_ERROR, status, "vm_object_read clone");
+        EXPECT_BYTES_EQ((uint8_t*)expected, (uint8_t*)buf, sizeof(buf), "clone contents");
+    }
+
+    // nothing has been copied yet
+    mx_paddr_t pa;
+    status = mx_vmo_op_range(clone, MX_VMO_OP_LOOKUP, 0, PAGE_SIZE, &pa, sizeof(pa));
+    EXPECT_EQ(ERR_NO_MEMORY, status, "clone page uncommitted");
+
+    // write through a mapping of the clone, the parent must not see it
+    uintptr_t ptr;
+    status = mx_vmar_map(mx_vmar_root_self(), 0, clone, 0, len,
+                         MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &ptr);
+    EXPECT_EQ(NO_ERROR, status, "vm_map");
+    EXPECT_EQ('b', ((volatile char*)ptr)[0], "mapped clone read");
+    ((volatile char*)ptr)[0] = 'z';
+    EXPECT_EQ('z', ((volatile char*)ptr)[0], "mapped clone write");
+
+    status = mx_vmo_op_range(clone, MX_VMO_OP_LOOKUP, 0, PAGE_SIZE, &pa, sizeof(pa));
+    EXPECT_EQ(NO_ERROR, status, "clone page committed");
+
+    status = mx_vmo_read(vmo, buf, PAGE_SIZE, 1, &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_read parent");
+    EXPECT_EQ('b', buf[0], "parent unchanged");
+
+    // the clone is a snapshot, so later writes to the parent and decommits
+    // of it don't show through pages the clone hasn't copied
+    EXPECT_EQ('c', ((volatile char*)ptr)[PAGE_SIZE], "mapped clone read");
+    memset(buf, 'y', sizeof(buf));
+    status = mx_vmo_write(vmo, buf, 2 * PAGE_SIZE, sizeof(buf), &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_write parent");
+    EXPECT_EQ('c', ((volatile char*)ptr)[PAGE_SIZE], "parent write not visible");
+    EXPECT_EQ('z', ((volatile char*)ptr)[0], "clone copy kept");
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 3 * PAGE_SIZE, PAGE_SIZE, NULL, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_op_range decommit parent");
+    EXPECT_EQ('d', ((volatile char*)ptr)[2 * PAGE_SIZE], "parent decommit not visible");
+
+    status = mx_vmar_unmap(mx_vmar_root_self(), ptr, len);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap");
+
+    // a clone has no more rights than the handle it was made from
+    mx_handle_t ro_vmo;
+    status = mx_handle_duplicate(vmo, MX_RIGHT_READ, &ro_vmo);
+    EXPECT_EQ(NO_ERROR, status, "handle_duplicate");
+    mx_handle_t ro_clone;
+    status = mx_vmo_clone(ro_vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, len, &ro_clone);
+    EXPECT_EQ(NO_ERROR, status, "vm_clone read-only");
+    memset(buf, 'x', sizeof(buf));
+    status = mx_vmo_write(ro_clone, buf, 0, sizeof(buf), &size);
+    EXPECT_EQ(ERR_ACCESS_DENIED, status, "vm_object_write read-only clone");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(ro_clone), "handle_close");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(ro_vmo), "handle_close");
+
+    // the clone outlives the parent handle
+    status = mx_handle_close(vmo);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+    status = mx_vmo_read(clone, buf, PAGE_SIZE, 1, &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_read clone");
+    EXPECT_EQ('c', buf[0], "clone after parent close");
+
+    status = mx_handle_close(clone);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    END_TEST;
+}
+
+bool vmo_clone_chain_test() {
+    BEGIN_TEST;
+
+    mx_handle_t vmo;
+    mx_status_t status = mx_vmo_create(PAGE_SIZE, 0, &vmo);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_create");
+    char c = 'a';
+    size_t size;
+    status = mx_vmo_write(vmo, &c, 0, 1, &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_write");
+
+    // keep cloning the newest clone, holding a handle to only the root and
+    // the end of the chain, until the kernel refuses to go any deeper
+    mx_handle_t leaf = MX_HANDLE_INVALID;
+    mx_handle_t tip = vmo;
+    int depth = 0;
+    for (;;) {
+        mx_handle_t clone;
+        status = mx_vmo_clone(tip, MX_VMO_CLONE_COPY_ON_WRITE, 0, PAGE_SIZE, &clone);
+        if (status != NO_ERROR)
+            break;
+        if (tip != vmo)
+            EXPECT_EQ(NO_ERROR, mx_handle_close(tip), "handle_close");
+        tip = clone;
+        leaf = clone;
+        if (++depth == 4096)
+            break;
+    }
+    EXPECT_EQ(ERR_OUT_OF_RANGE, status, "vm_clone depth limit");
+    EXPECT_GT(depth, 1, "vm_clone chain");
+    ASSERT_NEQ(MX_HANDLE_INVALID, leaf, "vm_clone chain");
+
+    // the bottom of the chain sees the root's contents, and writes through a
+    // mapping of the root have to be looked for all the way down it
+    uintptr_t ptr;
+    status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, PAGE_SIZE,
+                         MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &ptr);
+    EXPECT_EQ(NO_ERROR, status, "vm_map");
+    uintptr_t leaf_ptr;
+    status = mx_vmar_map(mx_vmar_root_self(), 0, leaf, 0, PAGE_SIZE,
+                         MX_VM_FLAG_PERM_READ, &leaf_ptr);
+    EXPECT_EQ(NO_ERROR, status, "vm_map clone");
+    EXPECT_EQ('a', ((volatile char*)leaf_ptr)[0], "mapped clone read");
+    ((volatile char*)ptr)[0] = 'b';
+    EXPECT_EQ('a', ((volatile char*)leaf_ptr)[0], "clone unchanged by parent write");
+    EXPECT_EQ(NO_ERROR, mx_vmar_unmap(mx_vmar_root_self(), leaf_ptr, PAGE_SIZE), "vm_unmap");
+    EXPECT_EQ(NO_ERROR, mx_vmar_unmap(mx_vmar_root_self(), ptr, PAGE_SIZE), "vm_unmap");
+
+    // closing the last handle tears the whole chain down
+    EXPECT_EQ(NO_ERROR, mx_handle_close(leaf), "handle_close");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(vmo_tests)
 RUN_TEST(vmo_create_test);
 RUN_TEST(vmo_read_write_test);
@@ -498,6 +654,8 @@ RUN_TEST(vmo_resize_test);
 RUN_TEST(vmo_rights_test);
 RUN_TEST(vmo_lookup_test);
 RUN_TEST(vmo_commit_test);
+RUN_TEST(vmo_clone_test);
+RUN_TEST(vmo_clone_chain_test);
 END_TEST_CASE(vmo_tests)
 
 int main(int argc, char** argv) {
@@ -50,7 +50,7 @@ int pthread_condattr_getclock(const pthread_condattr_t* restrict a, clockid_t* r
 }
 
 int pthread_mutexattr_getprotocol(const pthread_mutexattr_t* restrict a, int* restrict protocol) {
-    *protocol = PTHREAD_PRIO_NONE;
+    *protocol = (a->__attr & __MUTEX_PI) ? PTHREAD_PRIO_INHERIT : PTHREAD_PRIO_NONE;
     return 0;
 }
 int pthread_mutexattr_getrobust(const pthread_mutexattr_t* restrict a, int* restrict robust) {
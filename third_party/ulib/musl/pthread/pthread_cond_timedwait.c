@@ -66,8 +66,12 @@ int pthread_cond_timedwait(pthread_cond_t* restrict c, pthread_mutex_t* restrict
     int e, seq, clock = c->_c_clock, cs, oldstate, tmp;
     volatile int* fut;
 
-    if ((m->_m_type & 15) && (m->_m_lock & INT_MAX) != __thread_get_tid())
+    if (m->_m_type & __MUTEX_PI) {
+        if (!__pthread_mutex_owned_pi(m))
+            return EPERM;
+    } else if ((m->_m_type & 15) && (m->_m_lock & INT_MAX) != __thread_get_tid()) {
         return EPERM;
+    }
 
     if (ts && ts->tv_nsec >= 1000000000UL)
         return EINVAL;
@@ -187,11 +191,19 @@ int pthread_cond_timedwait(pthread_cond_t* restrict c, pthread_mutex_t* restrict
         a_inc(&m->_m_waiters);
 
     /* Unlock the barrier that's holding back the next waiter, and
-     * either wake it or requeue it to the mutex. */
-    if (node.prev)
-        unlock_requeue(&node.prev->barrier, &m->_m_lock);
-    else
+     * either wake it or requeue it to the mutex.  Only threads blocked
+     * through mx_futex_lock_pi() may wait on a priority inheriting mutex,
+     * so the next waiter is woken to lock it itself. */
+    if (node.prev) {
+        if (m->_m_type & __MUTEX_PI) {
+            a_store(&node.prev->barrier, 0);
+            __wake(&node.prev->barrier, 1);
+        } else {
+            unlock_requeue(&node.prev->barrier, &m->_m_lock);
+        }
+    } else {
         a_dec(&m->_m_waiters);
+    }
 
     /* Since a signal was consumed, cancellation is not permitted. */
     if (e == ECANCELED)
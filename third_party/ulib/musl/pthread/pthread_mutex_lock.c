@@ -1,6 +1,8 @@
 #include "pthread_impl.h"
 
 int pthread_mutex_lock(pthread_mutex_t* m) {
+    if (m->_m_type & __MUTEX_PI)
+        return __pthread_mutex_timedlock_pi(m, 0);
     if ((m->_m_type & 15) == PTHREAD_MUTEX_NORMAL && !a_cas(&m->_m_lock, 0, EBUSY))
         return 0;
 
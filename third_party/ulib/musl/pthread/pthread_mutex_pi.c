@@ -0,0 +1,135 @@
+#include "pthread_impl.h"
+
+#include <magenta/syscalls.h>
+
+// Priority inheriting mutexes keep the owning thread's handle in _m_lock,
+// so the kernel can find and boost the owner while anyone waits on it.
+// MX_FUTEX_PI_WAITERS is set whenever the unlocker has to go through
+// mx_futex_unlock_pi, which hands the mutex straight to the next waiter by
+// storing its handle in _m_lock, so it is never free for a third thread to
+// take in between.
+
+#define NS_PER_S (1000000000ull)
+
+int __clock_gettime(clockid_t, struct timespec*);
+
+static int self_handle(void) {
+    return (int)mxr_thread_get_handle(&__pthread_self()->mxr_thread);
+}
+
+int __pthread_mutex_owned_pi(pthread_mutex_t* m) {
+    return (m->_m_lock & ~MX_FUTEX_PI_WAITERS) == self_handle();
+}
+
+int __pthread_mutex_trylock_pi(pthread_mutex_t* m) {
+    int self = self_handle();
+    int old = m->_m_lock;
+
+    if ((old & ~MX_FUTEX_PI_WAITERS) == self) {
+        if ((m->_m_type & 3) == PTHREAD_MUTEX_RECURSIVE) {
+            if ((unsigned)m->_m_count >= INT_MAX)
+                return EAGAIN;
+            m->_m_count++;
+            return 0;
+        }
+        return EBUSY;
+    }
+    if (old || a_cas(&m->_m_lock, 0, self))
+        return EBUSY;
+    return 0;
+}
+
+static mx_time_t timeout_for(const struct timespec* at) {
+    if (!at)
+        return MX_TIME_INFINITE;
+
+    struct timespec to;
+    if (__clock_gettime(CLOCK_REALTIME, &to))
+        return 0;
+    to.tv_sec = at->tv_sec - to.tv_sec;
+    if ((to.tv_nsec = at->tv_nsec - to.tv_nsec) < 0) {
+        to.tv_sec--;
+        to.tv_nsec += NS_PER_S;
+    }
+    if (to.tv_sec < 0)
+        return 0;
+    return to.tv_sec * NS_PER_S + to.tv_nsec;
+}
+
+int __pthread_mutex_timedlock_pi(pthread_mutex_t* restrict m, const struct timespec* restrict at) {
+    int self = self_handle();
+    int r;
+
+    r = __pthread_mutex_trylock_pi(m);
+    if (r != EBUSY)
+        return r;
+    if ((m->_m_lock & ~MX_FUTEX_PI_WAITERS) == self)
+        return (m->_m_type & 3) == PTHREAD_MUTEX_ERRORCHECK ? EDEADLK : EBUSY;
+    if (at && at->tv_nsec >= NS_PER_S)
+        return EINVAL;
+
+    a_inc(&m->_m_waiters);
+    for (;;) {
+        // Whoever takes the mutex while others are queued must leave the
+        // waiters bit set, so the next unlock hands it on.
+        int old = m->_m_lock;
+        if (!old) {
+            if (!a_cas(&m->_m_lock, 0, self | MX_FUTEX_PI_WAITERS)) {
+                r = 0;
+                break;
+            }
+            continue;
+        }
+        int t = old | MX_FUTEX_PI_WAITERS;
+        if (old != t && a_cas(&m->_m_lock, old, t) != old)
+            continue;
+
+        mx_time_t timeout = timeout_for(at);
+        if (timeout == 0) {
+            r = ETIMEDOUT;
+            break;
+        }
+
+        // The owner may unlock, or exit and lose its handle, between our
+        // read of _m_lock and the kernel's; both just mean trying again.
+        // Otherwise we only wake once the mutex is ours, unless whoever
+        // woke us was not going through mx_futex_unlock_pi.
+        mx_status_t status = _mx_futex_lock_pi((void*)&m->_m_lock, t, self, timeout);
+        if (status == ERR_TIMED_OUT) {
+            r = ETIMEDOUT;
+            break;
+        }
+        if (status == NO_ERROR && (m->_m_lock & ~MX_FUTEX_PI_WAITERS) == self) {
+            r = 0;
+            break;
+        }
+        if (status != NO_ERROR && status != ERR_BAD_STATE && status != ERR_BAD_HANDLE)
+            __builtin_trap();
+    }
+    a_dec(&m->_m_waiters);
+    return r;
+}
+
+int __pthread_mutex_unlock_pi(pthread_mutex_t* m) {
+    if (!__pthread_mutex_owned_pi(m))
+        return EPERM;
+    if ((m->_m_type & 3) == PTHREAD_MUTEX_RECURSIVE && m->_m_count)
+        return m->_m_count--, 0;
+
+    for (;;) {
+        int old = m->_m_lock;
+        if (!(old & MX_FUTEX_PI_WAITERS)) {
+            // A waiter setting the bit makes this fail, and we go round
+            // again to hand the mutex on.
+            if (a_cas(&m->_m_lock, old, 0) == old)
+                return 0;
+            continue;
+        }
+        // Nobody else may change _m_lock while we hold it with the bit set.
+        mx_status_t status = _mx_futex_unlock_pi((void*)&m->_m_lock);
+        if (status == NO_ERROR)
+            return 0;
+        if (status != ERR_BAD_STATE)
+            __builtin_trap();
+    }
+}
@@ -1,6 +1,8 @@
 #include "pthread_impl.h"
 
 int pthread_mutex_timedlock(pthread_mutex_t* restrict m, const struct timespec* restrict at) {
+    if (m->_m_type & __MUTEX_PI)
+        return __pthread_mutex_timedlock_pi(m, at);
     if ((m->_m_type & 15) == PTHREAD_MUTEX_NORMAL && !a_cas(&m->_m_lock, 0, EBUSY))
         return 0;
 
@@ -30,6 +30,8 @@ int __pthread_mutex_trylock_owner(pthread_mutex_t* m) {
 }
 
 int pthread_mutex_trylock(pthread_mutex_t* m) {
+    if (m->_m_type & __MUTEX_PI)
+        return __pthread_mutex_trylock_pi(m);
     if ((m->_m_type & 15) == PTHREAD_MUTEX_NORMAL)
         return a_cas(&m->_m_lock, 0, EBUSY) & EBUSY;
     return __pthread_mutex_trylock_owner(m);
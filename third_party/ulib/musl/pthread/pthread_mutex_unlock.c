@@ -3,6 +3,9 @@
 #include "futex_impl.h"
 
 int pthread_mutex_unlock(pthread_mutex_t* m) {
+    if (m->_m_type & __MUTEX_PI)
+        return __pthread_mutex_unlock_pi(m);
+
     int waiters = m->_m_waiters;
     int cont;
     int type = m->_m_type & 15;
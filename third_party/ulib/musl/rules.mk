@@ -101,6 +101,7 @@ LOCAL_SRCS := \
     $(LOCAL_DIR)/pthread/pthread_mutex_getprioceiling.c \
     $(LOCAL_DIR)/pthread/pthread_mutex_init.c \
     $(LOCAL_DIR)/pthread/pthread_mutex_lock.c \
+    $(LOCAL_DIR)/pthread/pthread_mutex_pi.c \
     $(LOCAL_DIR)/pthread/pthread_mutex_setprioceiling.c \
     $(LOCAL_DIR)/pthread/pthread_mutex_timedlock.c \
     $(LOCAL_DIR)/pthread/pthread_mutex_trylock.c \
@@ -103,6 +103,14 @@ void __vm_unlock(void);
 int __timedwait(volatile int*, int, clockid_t, const struct timespec*);
 int __timedwait_cp(volatile int*, int, clockid_t, const struct timespec*);
 
+// Set in _m_type (and the mutexattr's __attr) for PTHREAD_PRIO_INHERIT.
+#define __MUTEX_PI 16
+
+int __pthread_mutex_trylock_pi(pthread_mutex_t*);
+int __pthread_mutex_timedlock_pi(pthread_mutex_t* __restrict, const struct timespec* __restrict);
+int __pthread_mutex_unlock_pi(pthread_mutex_t*);
+int __pthread_mutex_owned_pi(pthread_mutex_t*);
+
 void __acquire_ptc(void);
 void __release_ptc(void);
 void __inhibit_ptc(void);